@@ -0,0 +1,222 @@
+/*
+
+	ds_lib - Despiking of raw sonic records, coded in plain C.
+
+	A value x is a spike if |x - M| exceeds both a minimum deviation and
+	'rThreshold' robust standard deviations, MAD/0.6745, where M and MAD
+	are the (lower) median and median absolute deviation of the valid
+	values in the window centred on x. As raw values are short integers,
+	the window is kept as counts by value in a Fenwick tree: the median is
+	found by descending the tree, and the MAD test needs no MAD at all, as
+	MAD < q if and only if at least half the window lies within q-1 of M
+	(integer values), which is one range count. Each record then costs
+	O(log DS_NUM_LEVELS) per channel, whatever the window length.
+
+	Spikes are replaced by the window median; invalid values (-9999 and
+	the like) are neither tested nor counted.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ds_lib.h"
+
+#define DS_OFFSET 32768		// Raw value to tree position
+
+
+/**********************
+* Fenwick trees       *
+**********************/
+
+static void treeAdd(int* ivTree, const int iValue, const int iDelta) {
+
+	int i;
+
+	for(i=iValue+DS_OFFSET+1; i<=DS_NUM_LEVELS; i+=i&(-i)) ivTree[i] += iDelta;
+
+}
+
+
+// Number of values not above 'iValue'
+static int treeCount(const int* ivTree, const int iValue) {
+
+	int i;
+	int iCount = 0;
+
+	if(iValue < -DS_OFFSET) return(0);
+	i = (iValue >= DS_NUM_LEVELS - DS_OFFSET ? DS_NUM_LEVELS - DS_OFFSET - 1 : iValue) + DS_OFFSET + 1;
+	for(; i>0; i-=i&(-i)) iCount += ivTree[i];
+	return(iCount);
+
+}
+
+
+// The k-th smallest value (k from 1)
+static int treeSelect(const int* ivTree, int k) {
+
+	int iPos = 0;
+	int iStep;
+
+	for(iStep=DS_NUM_LEVELS; iStep>0; iStep>>=1) {
+		if(iPos + iStep <= DS_NUM_LEVELS && ivTree[iPos + iStep] < k) {
+			iPos += iStep;
+			k    -= ivTree[iPos];
+		}
+	}
+	return(iPos - DS_OFFSET);
+
+}
+
+
+/**********************
+* Window              *
+**********************/
+
+static int isValid(const short iValue) {
+	return(iValue > -9990);
+}
+
+
+static void windowAdd(DsFilter* ptFilter, const short ivRecord[5], const int iDelta) {
+
+	int j;
+
+	for(j=0; j<DS_NUM_CHANNELS; j++) {
+		if(isValid(ivRecord[j+1])) {
+			treeAdd(ptFilter->ivTree[j], ivRecord[j+1], iDelta);
+			ptFilter->ivCount[j] += iDelta;
+		}
+	}
+
+}
+
+
+// Test the record at position 'iPos', on the window currently counted
+static void release(DsFilter* ptFilter, const int iPos, short ivOut[5], int* piFlags) {
+
+	const short* ivRecord = ptFilter->ivRing[iPos % ptFilter->iWindow];
+	int          iCount;
+	int          iHalfCount;
+	int          iMedian;
+	int          iDeviation;
+	int          iTolerance;
+	int          j;
+
+	memcpy(ivOut, ivRecord, 5*sizeof(short));
+	*piFlags = 0;
+	for(j=0; j<DS_NUM_CHANNELS; j++) {
+		iCount = ptFilter->ivCount[j];
+		if(!isValid(ivRecord[j+1]) || iCount < 3) continue;
+		iHalfCount = (iCount + 1) / 2;
+		iMedian    = treeSelect(ptFilter->ivTree[j], iHalfCount);
+		iDeviation = abs(ivRecord[j+1] - iMedian);
+		if(iDeviation <= ptFilter->iMinDeviation) continue;
+		iTolerance = (int)ceil(0.6745 * iDeviation / ptFilter->rThreshold) - 1;
+		if(iTolerance < 0) continue;
+		if(treeCount(ptFilter->ivTree[j], iMedian + iTolerance) - treeCount(ptFilter->ivTree[j], iMedian - iTolerance - 1) >= iHalfCount) {
+			ivOut[j+1] = (short)iMedian;
+			*piFlags  |= 1 << j;
+			ptFilter->ivSpikes[j]++;
+		}
+	}
+
+}
+
+
+/**********************
+* Filter              *
+**********************/
+
+DsFilter* dsFilterNew(const int iWindow, const double rThreshold, const int iMinDeviation) {
+
+	DsFilter* ptFilter;
+	int       j;
+
+	ptFilter = calloc(1, sizeof(DsFilter));
+	if(ptFilter == NULL) return(NULL);
+	ptFilter->iWindow       = iWindow < 3 ? 3 : (iWindow | 1);
+	ptFilter->iHalf         = ptFilter->iWindow / 2;
+	ptFilter->rThreshold    = rThreshold > 0. ? rThreshold : DS_DEFAULT_THRESHOLD;
+	ptFilter->iMinDeviation = iMinDeviation >= 0 ? iMinDeviation : 0;
+	ptFilter->ivRing        = malloc(ptFilter->iWindow * sizeof(ptFilter->ivRing[0]));
+	for(j=0; j<DS_NUM_CHANNELS; j++) ptFilter->ivTree[j] = calloc(DS_NUM_LEVELS + 1, sizeof(int));
+	for(j=0; j<DS_NUM_CHANNELS; j++) {
+		if(ptFilter->ivTree[j] == NULL) break;
+	}
+	if(ptFilter->ivRing == NULL || j < DS_NUM_CHANNELS) {
+		dsFilterFree(ptFilter);
+		return(NULL);
+	}
+	return(ptFilter);
+
+}
+
+
+void dsFilterFree(DsFilter* ptFilter) {
+
+	int j;
+
+	if(ptFilter == NULL) return;
+	free(ptFilter->ivRing);
+	for(j=0; j<DS_NUM_CHANNELS; j++) free(ptFilter->ivTree[j]);
+	free(ptFilter);
+
+}
+
+
+// Forget all records, uncounting those still in trees (cheaper than
+// clearing trees, as these are at most one window)
+void dsFilterReset(DsFilter* ptFilter) {
+
+	int j;
+
+	for(; ptFilter->iOldest < ptFilter->iNumIn; ptFilter->iOldest++) {
+		windowAdd(ptFilter, ptFilter->ivRing[ptFilter->iOldest % ptFilter->iWindow], -1);
+	}
+	ptFilter->iNumIn  = 0;
+	ptFilter->iNumOut = 0;
+	ptFilter->iOldest = 0;
+	for(j=0; j<DS_NUM_CHANNELS; j++) ptFilter->ivSpikes[j] = 0;
+
+}
+
+
+int dsFilterPush(DsFilter* ptFilter, const short ivIn[5], short ivOut[5], int* piFlags) {
+
+	// Slide window
+	if(ptFilter->iNumIn - ptFilter->iOldest >= ptFilter->iWindow) {
+		windowAdd(ptFilter, ptFilter->ivRing[ptFilter->iOldest % ptFilter->iWindow], -1);
+		ptFilter->iOldest++;
+	}
+	memcpy(ptFilter->ivRing[ptFilter->iNumIn % ptFilter->iWindow], ivIn, 5*sizeof(short));
+	windowAdd(ptFilter, ivIn, 1);
+	ptFilter->iNumIn++;
+
+	// Release the record now at window centre, if any
+	if(ptFilter->iNumIn <= ptFilter->iHalf) return(0);
+	release(ptFilter, ptFilter->iNumOut++, ivOut, piFlags);
+	return(1);
+
+}
+
+
+int dsFilterFlush(DsFilter* ptFilter, short ivOut[5], int* piFlags) {
+
+	const int iPos = ptFilter->iNumOut;
+
+	if(iPos >= ptFilter->iNumIn) {
+		dsFilterReset(ptFilter);
+		return(0);
+	}
+	for(; ptFilter->iOldest < iPos - ptFilter->iHalf; ptFilter->iOldest++) {
+		windowAdd(ptFilter, ptFilter->ivRing[ptFilter->iOldest % ptFilter->iWindow], -1);
+	}
+	release(ptFilter, ptFilter->iNumOut++, ivOut, piFlags);
+	return(1);
+
+}
@@ -0,0 +1,55 @@
+/*
+
+	ds_lib - Despiking of raw sonic records: each value is tested against
+	         the median and median absolute deviation (MAD) of a sliding
+	         window centred on it, and if too far replaced by the median.
+	         Records may be fed one at a time (online use, with a delay
+	         of half window) or by blocks.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#define DS_NUM_CHANNELS          4		// u, v, w, t
+#define DS_NUM_LEVELS        65536		// Distinct raw values (short int)
+#define DS_DEFAULT_WINDOW      101		// Samples (odd)
+#define DS_DEFAULT_THRESHOLD   6.0		// Robust standard deviations (MAD/0.6745)
+#define DS_MIN_DEVIATION        50		// Raw units (cm/s, 1/100 °C): smaller deviations are never spikes
+
+// Flags of records released, one bit per channel replaced
+#define DS_SPIKE_U  1
+#define DS_SPIKE_V  2
+#define DS_SPIKE_W  4
+#define DS_SPIKE_T  8
+
+// Filter state: raw records {time stamp, u, v, w, t} go through a ring of
+// one window; valid values in window are counted by value in Fenwick
+// trees, so that medians and MAD tests cost O(log DS_NUM_LEVELS)
+typedef struct DsFilter {
+	int       iWindow;
+	int       iHalf;
+	double    rThreshold;
+	int       iMinDeviation;
+	short     (*ivRing)[5];				// Last 'iWindow' records, as received
+	int       iNumIn;					// Records received since reset
+	int       iNumOut;					// Records released since reset
+	int       iOldest;					// Oldest record counted in trees
+	int*      ivTree[DS_NUM_CHANNELS];	// Counts of values in window
+	int       ivCount[DS_NUM_CHANNELS];	// Valid values in window
+	unsigned  ivSpikes[DS_NUM_CHANNELS];	// Values replaced since reset
+} DsFilter;
+
+// Filter management; window is rounded up to odd, and at least 3
+DsFilter* dsFilterNew(const int iWindow, const double rThreshold, const int iMinDeviation);
+void      dsFilterFree(DsFilter* ptFilter);
+void      dsFilterReset(DsFilter* ptFilter);
+
+// Feed a record; return 1 if a record (that of half window before) is
+// released into 'ivOut', with its flags, and 0 otherwise
+int dsFilterPush(DsFilter* ptFilter, const short ivIn[5], short ivOut[5], int* piFlags);
+
+// Release records still held, one per call, testing them on the shorter
+// windows available; return 0 when none is left, and the filter is reset
+int dsFilterFlush(DsFilter* ptFilter, short ivOut[5], int* piFlags);
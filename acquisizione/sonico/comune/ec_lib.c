@@ -0,0 +1,1791 @@
+/*
+
+	ec_lib - Eddy covariance engine, coded in plain C.
+
+	This is the processing chain of "eddy_cov" (GetTimeSubset, CheckTimeRegularity,
+	GetRange, RemoveLinearTrend, Average, Covariance, RotationMatrix,
+	WindStatistics, WindDirClassify and BasicTurbulence from SonicLib),
+	working on one averaging block at a time. No state is kept between
+	calls other than in the caller-owned workspace, so the engine may be
+	used within the acquisition task or from many threads at once.
+
+	Differences with eddy_cov: sums are accumulated in double precision,
+	and results of blocks which could not be processed are set to invalid
+	instead of being left undefined. Despiking, quality control, random
+	errors, spectra and the dissipation rate are optional stages, off unless
+	requested in the namelist.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#define _GNU_SOURCE		// For 'timegm'
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "ec_lib.h"
+#include "col_lib.h"
+#include "sk_lib.h"
+#include "sp_lib.h"
+#include "ds_lib.h"
+#include "qc_lib.h"
+
+#define EC_INVALID     -9999.9f
+#define EC_INVALID_INT -9999
+#define EC_PI          3.1415927
+
+/**************************
+* Configuration support   *
+**************************/
+
+// Locate "key = value" in a namelist text (already lowercase), and return
+// a pointer to the value, or NULL if not found
+static const char* namelistValue(const char* sText, const char* sKey) {
+
+	const char* p = sText;
+	size_t      iLen = strlen(sKey);
+
+	while((p = strstr(p, sKey)) != NULL) {
+		if((p == sText || !isalnum((unsigned char)p[-1])) && !isalnum((unsigned char)p[iLen])) {
+			p += iLen;
+			while(isspace((unsigned char)*p)) p++;
+			if(*p == '=') {
+				p++;
+				while(isspace((unsigned char)*p)) p++;
+				return(p);
+			}
+		}
+		else {
+			p += iLen;
+		}
+	}
+	return(NULL);
+
+}
+
+
+// Read configuration from an eddy_cov namelist file; return 0 on success,
+// 4 if it asks for a rotation this engine does not make (planar fit)
+int ecReadConfig(const char* sNamelistFile, EddyConfig* ptConfig) {
+
+	FILE*       f;
+	char        sText[4096];
+	size_t      iLen;
+	size_t      i;
+	const char* p;
+
+	// Get the whole file, in lowercase
+	f = fopen(sNamelistFile, "r");
+	if(f == NULL) return(1);
+	iLen = fread(sText, 1, sizeof(sText)-1, f);
+	fclose(f);
+	sText[iLen] = '\0';
+	for(i=0; i<iLen; i++) sText[i] = tolower((unsigned char)sText[i]);
+	if(strstr(sText, "&eddyconfig") == NULL) return(2);
+
+	// Get values
+	p = namelistValue(sText, "ldetrending");
+	if(p == NULL) return(3);
+	if(*p == '.') p++;
+	ptConfig->iDetrending = (*p == 't');
+	p = namelistValue(sText, "irotations");
+	if(p == NULL || sscanf(p, "%d", &ptConfig->iRotations) != 1) return(3);
+	if(ptConfig->iRotations < 0 || ptConfig->iRotations > 3) return(4);
+	p = namelistValue(sText, "raltitude");
+	if(p == NULL || sscanf(p, "%lf", &ptConfig->rAltitude) != 1) return(3);
+	p = namelistValue(sText, "ranemometerheight");
+	if(p == NULL || sscanf(p, "%lf", &ptConfig->rAnemometerHeight) != 1) return(3);
+
+	// Optional values, unknown to eddy_cov
+	ptConfig->iSpectra = 0;
+	p = namelistValue(sText, "lspectra");
+	if(p != NULL) {
+		if(*p == '.') p++;
+		ptConfig->iSpectra = (*p == 't');
+	}
+	ptConfig->iFluxErrors = 0;
+	p = namelistValue(sText, "lfluxerrors");
+	if(p != NULL) {
+		if(*p == '.') p++;
+		ptConfig->iFluxErrors = (*p == 't');
+	}
+	ptConfig->iDespiking = 0;
+	p = namelistValue(sText, "ldespiking");
+	if(p != NULL) {
+		if(*p == '.') p++;
+		ptConfig->iDespiking = (*p == 't');
+	}
+	ptConfig->iQualityControl = 0;
+	p = namelistValue(sText, "lqualitycontrol");
+	if(p != NULL) {
+		if(*p == '.') p++;
+		ptConfig->iQualityControl = (*p == 't');
+	}
+	ptConfig->iStationarity = 0;
+	p = namelistValue(sText, "lstationarity");
+	if(p != NULL) {
+		if(*p == '.') p++;
+		ptConfig->iStationarity = (*p == 't');
+	}
+	ptConfig->iDissipation = 0;
+	p = namelistValue(sText, "ldissipation");
+	if(p != NULL) {
+		if(*p == '.') p++;
+		ptConfig->iDissipation = (*p == 't');
+	}
+	ptConfig->iDespikingWindow = DS_DEFAULT_WINDOW;
+	p = namelistValue(sText, "idespikingwindow");
+	if(p != NULL && sscanf(p, "%d", &ptConfig->iDespikingWindow) != 1) return(3);
+	ptConfig->rDespikingThreshold = DS_DEFAULT_THRESHOLD;
+	p = namelistValue(sText, "rdespikingthreshold");
+	if(p != NULL && sscanf(p, "%lf", &ptConfig->rDespikingThreshold) != 1) return(3);
+
+	// Leave
+	return(0);
+
+}
+
+
+void ecWorkspaceInit(EddyWorkspace* ptWork) {
+	memset(ptWork, 0, sizeof(EddyWorkspace));
+}
+
+
+void ecWorkspaceFree(EddyWorkspace* ptWork) {
+	free(ptWork->ivTime);
+	free(ptWork->ivIndex);
+	free(ptWork->rvU);
+	free(ptWork->rvV);
+	free(ptWork->rvW);
+	free(ptWork->rvT);
+	free(ptWork->ivOrdered);
+	free(ptWork->ivFlags);
+	free(ptWork->ptQuality);
+	spWorkspaceFree(ptWork->ptSpectral);
+	dsFilterFree(ptWork->ptDespiker);
+	memset(ptWork, 0, sizeof(EddyWorkspace));
+}
+
+
+static int workspaceReserve(EddyWorkspace* ptWork, const int iNumData) {
+
+	if(iNumData <= ptWork->iCapacity) return(0);
+	ptWork->ivTime  = realloc(ptWork->ivTime,  iNumData * sizeof(int));
+	ptWork->ivIndex = realloc(ptWork->ivIndex, iNumData * sizeof(int));
+	ptWork->rvU     = realloc(ptWork->rvU, iNumData * sizeof(double));
+	ptWork->rvV     = realloc(ptWork->rvV, iNumData * sizeof(double));
+	ptWork->rvW     = realloc(ptWork->rvW, iNumData * sizeof(double));
+	ptWork->rvT     = realloc(ptWork->rvT, iNumData * sizeof(double));
+	ptWork->ivFlags = realloc(ptWork->ivFlags, iNumData * sizeof(unsigned char));
+	if(!ptWork->ivTime || !ptWork->ivIndex || !ptWork->rvU || !ptWork->rvV || !ptWork->rvW || !ptWork->rvT || !ptWork->ivFlags) {
+		ptWork->iCapacity = 0;
+		return(1);
+	}
+	ptWork->iCapacity = iNumData;
+	return(0);
+
+}
+
+
+/**********************
+* Processing steps    *
+**********************/
+
+static void invalidateBlock(EddyBlock* ptBlock) {
+
+	int    i;
+	float* p;
+
+	// All float fields follow the integer header, up to direction classes
+	for(p = &ptBlock->rvMin[0]; p <= &ptBlock->rDirCircStd; p++) *p = EC_INVALID;
+	for(i=0; i<16; i++) ptBlock->ivDirClass[i] = EC_INVALID_INT;
+	for(p = &ptBlock->rDominantDir; p <= &ptBlock->rLagrangianTimeW; p++) *p = EC_INVALID;
+	for(p = &ptBlock->rvSpecFreq[0]; p <= &ptBlock->rmOgive[1][EC_SPECTRAL_BINS-1]; p++) *p = EC_INVALID;
+	for(i=0; i<6; i++) ptBlock->ivQuality[i] = EC_INVALID_INT;
+	ptBlock->iFrequency      = EC_INVALID_INT;
+	ptBlock->iRegularityCode = 0;
+
+}
+
+
+// As SonicLib's CheckTimeRegularity; return 0 on success
+static int checkTimeRegularity(const int* ivTime, const int n, int* piFrequency, int* piRegularityCode) {
+
+	int ivNumTimeStamps[3600];
+	int ivFrequency[3601];
+	int iMaxNumStamps = 0;
+	int iMaxFrequency = 0;
+	int iMinTime = 3600;
+	int iMaxTime = -1;
+	int iActualData = 0;
+	int iExpectedData;
+	int i;
+
+	*piRegularityCode = 0;
+	memset(ivNumTimeStamps, 0, sizeof(ivNumTimeStamps));
+	for(i=0; i<n; i++) {
+		if(ivTime[i] >= 0 && ivTime[i] <= 3599) {
+			ivNumTimeStamps[ivTime[i]]++;
+			iActualData++;
+			if(ivTime[i] < iMinTime) iMinTime = ivTime[i];
+			if(ivTime[i] > iMaxTime) iMaxTime = ivTime[i];
+		}
+	}
+	for(i=0; i<3600; i++) {
+		if(ivNumTimeStamps[i] > iMaxNumStamps) iMaxNumStamps = ivNumTimeStamps[i];
+	}
+	if(iMaxNumStamps <= 0) return(1);
+
+	// Most frequent number of data per second estimates sampling frequency
+	memset(ivFrequency, 0, (iMaxNumStamps+1) * sizeof(int));
+	for(i=0; i<3600; i++) {
+		if(ivNumTimeStamps[i] > 0) ivFrequency[ivNumTimeStamps[i]]++;
+	}
+	*piFrequency = 1;
+	for(i=1; i<=iMaxNumStamps; i++) {
+		if(ivFrequency[i] > iMaxFrequency) {
+			iMaxFrequency = ivFrequency[i];
+			*piFrequency  = i;
+		}
+	}
+	*piRegularityCode = 1;
+
+	// Check no gaps are present
+	iExpectedData = *piFrequency * (iMaxTime - iMinTime + 1);
+	if(fabs((double)(iActualData - iExpectedData)) / iExpectedData <= 0.01) *piRegularityCode += 2;
+
+	// Leave
+	return(0);
+
+}
+
+
+// As SonicLib's RemoveLinearTrend, in place and average preserving. Fictive
+// time stamps count from block begin instead of file begin: the regression
+// slope, and then the residuals, do not depend on time origin.
+static void removeLinearTrend(const int* ivIndex, double* rvX, const int n, const int iFrequency) {
+
+	double rSumX  = 0.;
+	double rSumX2 = 0.;
+	double rSumY  = 0.;
+	double rSumXY = 0.;
+	double rSumR  = 0.;
+	double rX;
+	double rAlpha;
+	double rBeta;
+	int    i;
+
+	for(i=0; i<n; i++) {
+		rX      = (double)(ivIndex[i]+1) / iFrequency / 3600.;
+		rSumX  += rX;
+		rSumX2 += rX*rX;
+		rSumY  += rvX[i];
+		rSumXY += rX*rvX[i];
+	}
+	rBeta  = (rSumXY - rSumX*rSumY/n) / (rSumX2 - rSumX*rSumX/n);
+	rAlpha = rSumY/n - rBeta*rSumX/n;
+	if(!isfinite(rBeta)) return;	// Degenerate time axis: leave data as they are
+	for(i=0; i<n; i++) {
+		rX      = (double)(ivIndex[i]+1) / iFrequency / 3600.;
+		rvX[i] -= rAlpha + rBeta*rX;
+		rSumR  += rvX[i];
+	}
+	for(i=0; i<n; i++) rvX[i] += (rSumY - rSumR) / n;
+
+}
+
+
+// Means and co-moments (sums of products of deviations from means) of u,
+// v, w and t, mergeable (Chan et al., 1979)
+typedef struct EcMoments {
+	double rN;
+	double rvMean[4];
+	double rmM2[4][4];		// Upper triangle only
+} EcMoments;
+
+
+// Moments from sums of values and of their products (upper triangle), all
+// less a shift close to the mean, so that cancellation stays harmless
+static void momentsFromSums(EcMoments* ptMoments, const int n, const double rvShift[4], const double rvSum[4], const double rmProd[4][4]) {
+
+	int j, k;
+
+	memset(ptMoments, 0, sizeof(EcMoments));
+	if(n <= 0) return;
+	ptMoments->rN = n;
+	for(j=0; j<4; j++) ptMoments->rvMean[j] = rvShift[j] + rvSum[j] / n;
+	for(j=0; j<4; j++) {
+		for(k=j; k<4; k++) ptMoments->rmM2[j][k] = rmProd[j][k] - rvSum[j]*rvSum[k] / n;
+	}
+
+}
+
+
+static void momentsMerge(EcMoments* ptInto, const EcMoments* ptFrom) {
+
+	const double na = ptInto->rN;
+	const double nb = ptFrom->rN;
+	const double n  = na + nb;
+	double       rvDelta[4];
+	int          j, k;
+
+	if(nb <= 0.) return;
+	if(na <= 0.) {
+		*ptInto = *ptFrom;
+		return;
+	}
+	for(j=0; j<4; j++) {
+		rvDelta[j] = ptFrom->rvMean[j] - ptInto->rvMean[j];
+		ptInto->rvMean[j] += rvDelta[j] * nb / n;
+	}
+	for(j=0; j<4; j++) {
+		for(k=j; k<4; k++) ptInto->rmM2[j][k] += ptFrom->rmM2[j][k] + rvDelta[j]*rvDelta[k]*na*nb/n;
+	}
+	ptInto->rN = n;
+
+}
+
+
+// Rotated w't' and u'w' covariances from moments
+static void rotatedFluxes(const EcMoments* ptMoments, const double rmRot[3][3], double* prWT, double* prUW) {
+
+	double rmCov[4][4];
+	int    j, k;
+
+	for(j=0; j<4; j++) {
+		for(k=j; k<4; k++) rmCov[j][k] = rmCov[k][j] = ptMoments->rmM2[j][k] / ptMoments->rN;
+	}
+	*prWT = 0.;
+	*prUW = 0.;
+	for(j=0; j<3; j++) {
+		*prWT += rmRot[2][j]*rmCov[j][3];
+		for(k=0; k<3; k++) *prUW += rmRot[0][j]*rmCov[j][k]*rmRot[2][k];
+	}
+
+}
+
+
+// Foken and Wichura (1996) stationarity test: relative difference (%) of
+// the mean of sub-block covariances from the block one, for rotated w't'
+// and u'w' (rotated as the whole block); sub-blocks with less than two
+// data are left out
+static void stationarity(const EcMoments* tvSub, const EcMoments* ptBlock, const double rmRot[3][3], EddyBlock* ptResult) {
+
+	double rBlockWT, rBlockUW;
+	double rWT, rUW;
+	double rSumWT = 0.;
+	double rSumUW = 0.;
+	int    nSub = 0;
+	int    i;
+
+	for(i=0; i<EC_SUBBLOCKS; i++) {
+		if(tvSub[i].rN < 2.) continue;
+		rotatedFluxes(&tvSub[i], rmRot, &rWT, &rUW);
+		rSumWT += rWT;
+		rSumUW += rUW;
+		nSub++;
+	}
+	if(nSub <= 0) return;
+	rotatedFluxes(ptBlock, rmRot, &rBlockWT, &rBlockUW);
+	if(rBlockWT != 0.) ptResult->rStatWT = 100. * fabs((rSumWT/nSub - rBlockWT) / rBlockWT);
+	if(rBlockUW != 0.) ptResult->rStatUW = 100. * fabs((rSumUW/nSub - rBlockUW) / rBlockUW);
+
+}
+
+
+// TKE dissipation rate, from second-order structure functions in the
+// inertial subrange, D(r) = C (epsilon r)^(2/3), fitted through origin
+// against r^(2/3) for each component: C = 2.0 for the longitudinal one,
+// 4/3 of that for the transverse ones (which, with unrotated axes, is w
+// only). The estimate is the mean of those of components. Return 0 on
+// success.
+static int dissipation(const EddyConfig* ptConfig, EddyWorkspace* ptWork, const int n, const double rmRot[3][3], EddyBlock* ptBlock) {
+
+	static const double rvConst[3] = {2.0, 2.0*4./3., 2.0*4./3.};
+	const double rVel = sqrt(ptBlock->rvRotAvg[0]*ptBlock->rvRotAvg[0] + ptBlock->rvRotAvg[1]*ptBlock->rvRotAvg[1]);
+	double*      rvD;
+	double       rX;
+	double       rSumDX;
+	double       rSumXX;
+	double       rEpsilon = 0.;
+	int          iMinLag;
+	int          iMaxLag;
+	int          iNumLags;
+	int          iFirst;
+	int          j;
+	int          p;
+
+	// Lags spanning the inertial subrange, if any
+	if(rVel < EC_DISSIPATION_MIN_VEL) return(1);
+	iMinLag = (int)ceil(EC_DISSIPATION_MIN_DIST * ptBlock->iFrequency / rVel);
+	if(iMinLag < 1) iMinLag = 1;
+	iMaxLag = (int)floor(ptConfig->rAnemometerHeight * ptBlock->iFrequency / rVel);
+	if(iMaxLag > n/4) iMaxLag = n/4;
+	iNumLags = iMaxLag - iMinLag + 1;
+	if(iNumLags < EC_DISSIPATION_MIN_LAGS) return(1);
+
+	// Structure functions, and fit
+	rvD = malloc(3 * iNumLags * sizeof(double));
+	if(rvD == NULL) return(2);
+	if(spStructureFunctions(
+		ptWork->ptSpectral,
+		ptWork->ivIndex,
+		ptWork->rvU, ptWork->rvV, ptWork->rvW, ptWork->rvT,
+		n,
+		rmRot,
+		iMinLag, iMaxLag,
+		SP_SF_BEST,
+		rvD
+	) != 0) {
+		free(rvD);
+		return(3);
+	}
+	iFirst = ptConfig->iRotations > 0 ? 0 : 2;
+	for(j=iFirst; j<3; j++) {
+		rSumDX = 0.;
+		rSumXX = 0.;
+		for(p=iMinLag; p<=iMaxLag; p++) {
+			rX      = pow(p * rVel / ptBlock->iFrequency, 2./3.);
+			rSumDX += rvD[j*iNumLags + p - iMinLag] * rX;
+			rSumXX += rX * rX;
+		}
+		rEpsilon += pow(rSumDX / (rSumXX * rvConst[j]), 1.5);
+	}
+	free(rvD);
+	ptBlock->rEpsilon = rEpsilon / (3 - iFirst);
+
+	// Leave
+	return(0);
+
+}
+
+
+static void matMul(const double a[3][3], const double b[3][3], double c[3][3]) {
+
+	double r[3][3];
+	int    i, j, k;
+
+	for(i=0; i<3; i++) {
+		for(j=0; j<3; j++) {
+			r[i][j] = 0.;
+			for(k=0; k<3; k++) r[i][j] += a[i][k]*b[k][j];
+		}
+	}
+	memcpy(c, r, sizeof(r));
+
+}
+
+
+// As SonicLib's RotationMatrix
+static void rotationMatrix(const int iNumRot, const double rvAvg[3], const double rmCov[3][3], double rmRot[3][3], double* prTheta, double* prPhi, double* prPsi) {
+
+	double rmR[3][3];
+	double rmS[3][3];
+	double rmT[3][3];
+	double rmRotT[3][3];
+	double rmCovRot2[3][3];
+	int    i, j;
+
+	memset(rmRot, 0, 9*sizeof(double));
+	rmRot[0][0] = rmRot[1][1] = rmRot[2][2] = 1.;
+	*prTheta = 0.;
+	*prPhi   = 0.;
+	*prPsi   = 0.;
+	if(iNumRot <= 0) return;
+
+	// First rotation
+	*prTheta = atan2(rvAvg[1], rvAvg[0]);
+	memset(rmR, 0, sizeof(rmR));
+	rmR[0][0] = cos(*prTheta);
+	rmR[1][1] = rmR[0][0];
+	rmR[2][2] = 1.;
+	rmR[0][1] = sin(*prTheta);
+	rmR[1][0] = -rmR[0][1];
+	memcpy(rmRot, rmR, sizeof(rmR));
+
+	// Second rotation
+	if(iNumRot >= 2) {
+		*prPhi = atan2(rvAvg[2], sqrt(rvAvg[0]*rvAvg[0] + rvAvg[1]*rvAvg[1]));
+		memset(rmS, 0, sizeof(rmS));
+		rmS[0][0] = cos(*prPhi);
+		rmS[2][2] = rmS[0][0];
+		rmS[1][1] = 1.;
+		rmS[0][2] = sin(*prPhi);
+		rmS[2][0] = -rmS[0][2];
+		matMul(rmS, rmR, rmRot);
+	}
+
+	// Third rotation
+	if(iNumRot >= 3) {
+		for(i=0; i<3; i++) for(j=0; j<3; j++) rmRotT[i][j] = rmRot[j][i];
+		matMul(rmRot, rmCov, rmCovRot2);
+		matMul(rmCovRot2, rmRotT, rmCovRot2);
+		if(fabs(rmCovRot2[1][2]) >= 1.e-6 || fabs(rmCovRot2[1][1] - rmCovRot2[2][2]) >= 1.e-6) {
+			*prPsi = 0.5*atan2(2.*rmCovRot2[1][2], rmCovRot2[1][1] - rmCovRot2[2][2]);
+			memset(rmT, 0, sizeof(rmT));
+			rmT[1][1] = cos(*prPsi);
+			rmT[2][2] = rmT[1][1];
+			rmT[0][0] = 1.;
+			rmT[1][2] = sin(*prPsi);
+			rmT[2][1] = -rmT[1][2];
+			matMul(rmT, rmRot, rmRot);
+		}
+	}
+
+}
+
+
+// As SonicLib's WindStatistics and WindDirClassify; per-sample loops are in 'sk_lib'
+static void windStatistics(const double* rvU, const double* rvV, const double* rvW, const int n, EddyBlock* ptBlock) {
+
+	const double TO_DEGREES  = 180./EC_PI;
+	const float  CLASS_WIDTH = 360.f/16.f;
+	SkWindSums tSums;
+	double rMeanU, rMeanV, rMeanW;
+	double rUnitU;
+	double rUnitV;
+	double rEpsilon;
+	double rDir;
+	int    iMax;
+	int    i;
+
+	skWindSums(rvU, rvV, rvW, n, &tSums);
+	rMeanU = tSums.rSumU / n;
+	rMeanV = tSums.rSumV / n;
+	rMeanW = tSums.rSumW / n;
+
+	// Vector and scalar velocities
+	ptBlock->rVectorVel = sqrt(rMeanU*rMeanU + rMeanV*rMeanV);
+	ptBlock->r3DVel     = sqrt(rMeanU*rMeanU + rMeanV*rMeanV + rMeanW*rMeanW);
+	rDir = TO_DEGREES*atan2(-rMeanU, -rMeanV);
+	if(rDir < 0.) rDir += 360.;
+	ptBlock->rVectorDir    = rDir;
+	ptBlock->rScalarVel    = tSums.rSumVel / n;
+	ptBlock->rScalarVelStd = sqrt(fmax(tSums.rSumVel2/n - (tSums.rSumVel/n)*(tSums.rSumVel/n), 0.));
+
+	// Unit vectors related statistics
+	rUnitU   = tSums.rSumUnitU / n;
+	rUnitV   = tSums.rSumUnitV / n;
+	rEpsilon = sqrt(fmax(1. - rUnitU*rUnitU - rUnitV*rUnitV, 0.));
+	ptBlock->rEstSigmaDir = TO_DEGREES * asin(rEpsilon) * (1.0 + 0.1547*rEpsilon*rEpsilon*rEpsilon);
+	rDir = TO_DEGREES*atan2(-rUnitU, -rUnitV);
+	if(rDir <    0.) rDir += 360.;
+	if(rDir >= 360.) rDir -= 360.;
+	ptBlock->rUnitVectorDir = rDir;
+	ptBlock->rUnitVel       = sqrt(rUnitU*rUnitU + rUnitV*rUnitV);
+	if(fabs(ptBlock->rUnitVel) > 0.0001) {
+		ptBlock->rDirCircVar = 1. - ptBlock->rUnitVel;
+		ptBlock->rDirCircStd = sqrt(-log(ptBlock->rUnitVel));
+	}
+	else {
+		ptBlock->rDirCircVar = EC_INVALID;
+		ptBlock->rDirCircStd = EC_INVALID;
+	}
+
+	// Angle to horizontal plane
+	ptBlock->rPhiAngle      = tSums.rSumPhi / n;
+	ptBlock->rSigmaPhiAngle = sqrt(fmax(tSums.rSumPhi2/n - (tSums.rSumPhi/n)*(tSums.rSumPhi/n), 0.));
+
+	// Direction classes, the same sectors as WindDirClassify
+	memset(ptBlock->ivDirClass, 0, sizeof(ptBlock->ivDirClass));
+	skDirClassify(rvU, rvV, n, ptBlock->ivDirClass);
+	iMax = 0;
+	for(i=1; i<16; i++) {
+		if(ptBlock->ivDirClass[i] > ptBlock->ivDirClass[iMax]) iMax = i;
+	}
+	ptBlock->rDominantDir = CLASS_WIDTH*iMax;
+
+}
+
+
+// As SonicLib's BasicTurbulence; return 0 on success
+static int basicTurbulence(const EddyConfig* ptConfig, EddyBlock* ptBlock) {
+
+	const double K = 0.4;
+	const double g = 9.81;
+	const double C0 = 4.0;		// Lagrangian structure function constant (Du, 1997)
+	double rUU = ptBlock->rmRotCov[0][0];
+	double rVV = ptBlock->rmRotCov[1][1];
+	double rWW = ptBlock->rmRotCov[2][2];
+	double rUW = ptBlock->rmRotCov[0][2];
+	double rVW = ptBlock->rmRotCov[1][2];
+	double rWT = ptBlock->rvRotCovT[2];
+	double rErrWT = ptBlock->rErrCovWT;
+	double rErrUW = ptBlock->rErrCovUW;
+	double rErrVW = ptBlock->rErrCovVW;
+	double rErrUstar;
+	double rTemp;
+	double rPressure;
+	double rRhoCp;
+	double rUstar;
+
+	if(rUU < 0. || rVV < 0. || rWW < 0.) return(1);
+
+	// Rho*Cp, by hydrostatic approximation
+	rTemp     = ptBlock->rvAvg[3] + 273.15;
+	rPressure = 1013.0 * exp(-0.0342/rTemp*fmax(0., ptConfig->rAltitude));
+	rRhoCp    = 350.125*rPressure/rTemp;
+
+	// Turbulence indicators
+	rUstar = fmax(pow(rUW*rUW + rVW*rVW, 0.25), 0.001);
+	ptBlock->rTKE    = 0.5*(rUU + rVV + rWW);
+	ptBlock->rSigmaU = sqrt(rUU);
+	ptBlock->rSigmaV = sqrt(rVV);
+	ptBlock->rSigmaW = sqrt(rWW);
+	ptBlock->rSigmaT = sqrt(ptBlock->rVarT);
+	ptBlock->rUstar  = rUstar;
+	ptBlock->rTstar  = -rWT / rUstar;
+	ptBlock->rH0     = rRhoCp * rWT;
+	ptBlock->rZl     = -K*ptConfig->rAnemometerHeight*g/rTemp * rWT / (rUstar*rUstar*rUstar);
+	ptBlock->rUstarBase     = copysign(sqrt(fabs(rUW)), rUW >= 0. ? 1. : -1.);
+	ptBlock->rUstarExtended = copysign(pow(rUW*rUW + rVW*rVW, 0.25), rUW >= 0. ? 1. : -1.);
+
+	// Scales derived from the dissipation rate
+	if(ptBlock->rEpsilon != EC_INVALID && ptBlock->rEpsilon > 0.) {
+		ptBlock->rDissipationLength = pow(ptBlock->rTKE, 1.5) / ptBlock->rEpsilon;
+		ptBlock->rLagrangianTimeW   = 2.*rWW / (C0 * ptBlock->rEpsilon);
+	}
+
+	// Random errors, propagated from those of covariances (assumed independent)
+	if(ptBlock->rErrCovWT != EC_INVALID) {
+		rErrUstar = sqrt(rUW*rUW*rErrUW*rErrUW + rVW*rVW*rErrVW*rErrVW) / (2.*rUstar*rUstar*rUstar);
+		ptBlock->rErrH0    = rRhoCp * rErrWT;
+		ptBlock->rErrUstar = rErrUstar;
+		ptBlock->rErrZl    = sqrt(
+			pow(K*ptConfig->rAnemometerHeight*g/rTemp * rErrWT / (rUstar*rUstar*rUstar), 2.) +
+			pow(3.*ptBlock->rZl * rErrUstar/rUstar, 2.)
+		);
+	}
+
+	// Leave
+	return(0);
+
+}
+
+
+// Append a record to valid data, if all its values are valid, and account
+// it for quality control if requested
+static void selectRecord(const short ivRecord[5], const int iPos, const int iFlags, EddyWorkspace* ptWork, EddyBlock* ptBlock, QcState* ptQuality, int* pn) {
+
+	const int n = *pn;
+	int       j;
+
+	if(ivRecord[1] > -9990 && ivRecord[2] > -9990 && ivRecord[3] > -9990 && ivRecord[4] > -9990) {
+		ptWork->ivTime[n]  = ivRecord[0];
+		ptWork->ivIndex[n] = iPos;
+		ptWork->ivFlags[n] = (unsigned char)iFlags;
+		ptWork->rvU[n]     = ivRecord[1] / 100.;
+		ptWork->rvV[n]     = ivRecord[2] / 100.;
+		ptWork->rvW[n]     = ivRecord[3] / 100.;
+		ptWork->rvT[n]     = ivRecord[4] / 100.;
+		for(j=0; j<4; j++) {
+			if(iFlags & (1 << j)) ptBlock->ivSpikes[j]++;
+		}
+		if(ptQuality != NULL) qcAdd(ptQuality, iPos, ivRecord);
+		*pn = n + 1;
+	}
+
+}
+
+
+/*******************
+* Block interface  *
+*******************/
+
+// Process one averaging block, whose raw records (all having second of
+// hour within the block) are given contiguously. Return 0 on success,
+// non-zero if workspace could not be reserved; block validity is reported
+// in ptBlock->iStatus.
+int ecProcessBlock(const EddyConfig* ptConfig, const short ivData[][5], const int iNumData, const int iTimeStamp, EddyBlock* ptBlock, EddyWorkspace* ptWork) {
+
+	double* rvX[4];
+	double  rvAvg[4];
+	double  rmCov[3][3];
+	double  rvCovT[3];
+	double  rmRot[3][3];
+	double  rmRotT[3][3];
+	double  rmAux[3][3];
+	double  rTheta, rPhi, rPsi;
+	double  rvError[3];
+	double  rvShift[4];
+	double  rvValue[4];
+	double  rmSubSum[EC_SUBBLOCKS][4];
+	double  rmSubProd[EC_SUBBLOCKS][4][4];
+	int     ivSubN[EC_SUBBLOCKS];
+	EcMoments tvSub[EC_SUBBLOCKS];
+	EcMoments tBlockMoments;
+	int     iSubEnd;
+	short   ivRecord[5];
+	int     iFlags;
+	QcState* ptQuality;
+	int     n = 0;
+	int     i, j, k, l;
+
+	// Start from an invalid block
+	memset(ptBlock, 0, sizeof(EddyBlock));
+	invalidateBlock(ptBlock);
+	ptBlock->iFluxErrors = ptConfig->iFluxErrors != 0;
+	ptBlock->iDespiking  = ptConfig->iDespiking != 0;
+	ptBlock->iQualityControl = ptConfig->iQualityControl != 0;
+	ptBlock->iStationarity   = ptConfig->iStationarity != 0;
+	ptBlock->iDissipation    = ptConfig->iDissipation != 0;
+	ptBlock->iTimeStamp = iTimeStamp;
+	ptBlock->iTotData   = iNumData;
+	if(workspaceReserve(ptWork, iNumData) != 0) return(1);
+
+	// Select valid data, converting them to m/s and °C; if requested, data
+	// go through the despiking filter first, which releases them in order,
+	// and are accounted for quality control tests in the same pass
+	ptQuality = NULL;
+	if(ptConfig->iQualityControl) {
+		if(ptWork->ptQuality == NULL) ptWork->ptQuality = malloc(sizeof(QcState));
+		if(ptWork->ptQuality == NULL) return(1);
+		ptQuality = ptWork->ptQuality;
+		qcBegin(ptQuality, iNumData);
+	}
+	if(ptConfig->iDespiking) {
+		if(ptWork->ptDespiker == NULL) ptWork->ptDespiker = dsFilterNew(ptConfig->iDespikingWindow, ptConfig->rDespikingThreshold, DS_MIN_DEVIATION);
+		if(ptWork->ptDespiker == NULL) return(1);
+		dsFilterReset(ptWork->ptDespiker);
+		for(i=0, k=0; i<iNumData; i++) {
+			if(dsFilterPush(ptWork->ptDespiker, ivData[i], ivRecord, &iFlags)) selectRecord(ivRecord, k++, iFlags, ptWork, ptBlock, ptQuality, &n);
+		}
+		while(dsFilterFlush(ptWork->ptDespiker, ivRecord, &iFlags)) selectRecord(ivRecord, k++, iFlags, ptWork, ptBlock, ptQuality, &n);
+	}
+	else {
+		for(i=0; i<iNumData; i++) selectRecord(ivData[i], i, 0, ptWork, ptBlock, ptQuality, &n);
+	}
+	ptBlock->iUsedData = n;
+	if(ptQuality != NULL && n > 0) {
+		qcFinish(ptQuality, ptBlock->ivQuality);
+		ptBlock->ivQuality[QC_NUM_TESTS] = QC_PASSED;
+		for(j=0; j<QC_NUM_TESTS; j++) {
+			if(ptBlock->ivQuality[j] > ptBlock->ivQuality[QC_NUM_TESTS]) ptBlock->ivQuality[QC_NUM_TESTS] = ptBlock->ivQuality[j];
+		}
+	}
+	if(n <= 0) {
+		ptBlock->iStatus = EC_BLOCK_NO_DATA;
+		return(0);
+	}
+
+	// Time stamp regularity
+	if(checkTimeRegularity(ptWork->ivTime, n, &ptBlock->iFrequency, &ptBlock->iRegularityCode) != 0) {
+		ptBlock->iStatus = EC_BLOCK_IRREGULAR;
+		return(0);
+	}
+
+	// Ranges
+	rvX[0] = ptWork->rvU;
+	rvX[1] = ptWork->rvV;
+	rvX[2] = ptWork->rvW;
+	rvX[3] = ptWork->rvT;
+	for(j=0; j<4; j++) {
+		ptBlock->rvMin[j] = ptBlock->rvMax[j] = rvX[j][0];
+		for(i=1; i<n; i++) {
+			if(rvX[j][i] < ptBlock->rvMin[j]) ptBlock->rvMin[j] = rvX[j][i];
+			if(rvX[j][i] > ptBlock->rvMax[j]) ptBlock->rvMax[j] = rvX[j][i];
+		}
+		ptBlock->rvRange[j] = ptBlock->rvMax[j] - ptBlock->rvMin[j];
+	}
+
+	// Trend removal, if requested and possible
+	if(ptConfig->iDetrending && ptBlock->iRegularityCode >= 3) {
+		for(j=0; j<4; j++) removeLinearTrend(ptWork->ivIndex, rvX[j], n, ptBlock->iFrequency);
+	}
+
+	// Non-rotated averages and (co)variances, merged from those of sub-blocks
+	// (single pass, by position in block)
+	memset(ivSubN, 0, sizeof(ivSubN));
+	memset(rmSubSum, 0, sizeof(rmSubSum));
+	memset(rmSubProd, 0, sizeof(rmSubProd));
+	for(j=0; j<4; j++) rvShift[j] = rvX[j][0];
+	for(i=0, k=0, iSubEnd=iNumData/EC_SUBBLOCKS; i<n; i++) {
+		while(ptWork->ivIndex[i] >= iSubEnd && k < EC_SUBBLOCKS-1) {
+			k++;
+			iSubEnd = (int)((long long)(k+1) * iNumData / EC_SUBBLOCKS);
+		}
+		for(j=0; j<4; j++) {
+			rvValue[j]       = rvX[j][i] - rvShift[j];
+			rmSubSum[k][j]  += rvValue[j];
+		}
+		for(j=0; j<4; j++) {
+			for(l=j; l<4; l++) rmSubProd[k][j][l] += rvValue[j]*rvValue[l];
+		}
+		ivSubN[k]++;
+	}
+	for(k=0; k<EC_SUBBLOCKS; k++) momentsFromSums(&tvSub[k], ivSubN[k], rvShift, rmSubSum[k], (const double (*)[4])rmSubProd[k]);
+	tBlockMoments = tvSub[0];
+	for(k=1; k<EC_SUBBLOCKS; k++) momentsMerge(&tBlockMoments, &tvSub[k]);
+	for(j=0; j<4; j++) {
+		rvAvg[j] = tBlockMoments.rvMean[j];
+		ptBlock->rvAvg[j] = rvAvg[j];
+	}
+	for(j=0; j<3; j++) {
+		for(k=j; k<3; k++) {
+			rmCov[j][k] = rmCov[k][j] = tBlockMoments.rmM2[j][k] / n;
+			ptBlock->rmCov[j][k] = ptBlock->rmCov[k][j] = rmCov[j][k];
+		}
+		rvCovT[j] = tBlockMoments.rmM2[j][3] / n;
+		ptBlock->rvCovT[j] = rvCovT[j];
+	}
+	ptBlock->rVarT = tBlockMoments.rmM2[3][3] / n;
+	ptBlock->rTKE  = 0.5*(rmCov[0][0] + rmCov[1][1] + rmCov[2][2]);
+
+	// Axis rotation
+	rotationMatrix(ptConfig->iRotations, rvAvg, rmCov, rmRot, &rTheta, &rPhi, &rPsi);
+	ptBlock->rTheta = rTheta;
+	ptBlock->rPhi   = rPhi;
+	ptBlock->rPsi   = rPsi;
+	for(j=0; j<3; j++) for(k=0; k<3; k++) rmRotT[j][k] = rmRot[k][j];
+	matMul(rmRot, rmCov, rmAux);
+	matMul(rmAux, rmRotT, rmAux);
+	for(j=0; j<3; j++) {
+		ptBlock->rvRotAvg[j]  = 0.;
+		ptBlock->rvRotCovT[j] = 0.;
+		for(k=0; k<3; k++) {
+			ptBlock->rvRotAvg[j]  += rmRot[j][k]*rvAvg[k];
+			ptBlock->rvRotCovT[j] += rmRot[j][k]*rvCovT[k];
+			ptBlock->rmRotCov[j][k] = rmAux[j][k];
+		}
+	}
+
+	// Stationarity test, if requested
+	if(ptConfig->iStationarity) stationarity(tvSub, &tBlockMoments, (const double (*)[3])rmRot, ptBlock);
+
+	// Spectra, cospectra and ogives, on equally spaced data only
+	if(ptConfig->iSpectra && ptBlock->iRegularityCode >= 3) {
+		if(ptWork->ptSpectral == NULL) ptWork->ptSpectral = spWorkspaceNew();
+		if(ptWork->ptSpectral == NULL) return(1);
+		spBlockSpectra(
+			ptWork->ptSpectral,
+			ptWork->ivIndex,
+			ptWork->rvU, ptWork->rvV, ptWork->rvW, ptWork->rvT,
+			n,
+			(const double (*)[3])rmRot,
+			ptBlock->iFrequency,
+			EC_SPECTRAL_BINS,
+			EC_INVALID,
+			ptBlock->rvSpecFreq,
+			&ptBlock->rmSpectrum[0][0],
+			&ptBlock->rmOgive[0][0]
+		);
+	}
+
+	// Random errors of rotated covariances, on equally spaced data only
+	if(ptConfig->iFluxErrors && ptBlock->iRegularityCode >= 3) {
+		if(ptWork->ptSpectral == NULL) ptWork->ptSpectral = spWorkspaceNew();
+		if(ptWork->ptSpectral == NULL) return(1);
+		if(spCovarianceErrors(
+			ptWork->ptSpectral,
+			ptWork->ivIndex,
+			ptWork->rvU, ptWork->rvV, ptWork->rvW, ptWork->rvT,
+			n,
+			(const double (*)[3])rmRot,
+			EC_ERROR_MAX_LAG * ptBlock->iFrequency,
+			rvError
+		) == 0) {
+			ptBlock->rErrCovWT = rvError[0];
+			ptBlock->rErrCovUW = rvError[1];
+			ptBlock->rErrCovVW = rvError[2];
+		}
+	}
+
+	// Dissipation rate, on equally spaced data only
+	if(ptConfig->iDissipation && ptBlock->iRegularityCode >= 3) {
+		if(ptWork->ptSpectral == NULL) ptWork->ptSpectral = spWorkspaceNew();
+		if(ptWork->ptSpectral == NULL) return(1);
+		if(dissipation(ptConfig, ptWork, n, (const double (*)[3])rmRot, ptBlock) == 2) return(1);
+	}
+
+	// Non-turbulent wind statistics
+	windStatistics(ptWork->rvU, ptWork->rvV, ptWork->rvW, n, ptBlock);
+
+	// Turbulence indicators
+	if(basicTurbulence(ptConfig, ptBlock) != 0) {
+		ptBlock->rvAvg[3] = EC_INVALID;
+		for(j=0; j<3; j++) for(k=0; k<3; k++) ptBlock->rmRotCov[j][k] = EC_INVALID;
+		ptBlock->rUstar = ptBlock->rUstarBase = ptBlock->rUstarExtended = EC_INVALID;
+		ptBlock->rTstar = ptBlock->rH0 = ptBlock->rZl = ptBlock->rTKE = EC_INVALID;
+		ptBlock->rSigmaU = ptBlock->rSigmaV = ptBlock->rSigmaW = ptBlock->rSigmaT = EC_INVALID;
+		ptBlock->rErrH0 = ptBlock->rErrUstar = ptBlock->rErrZl = EC_INVALID;
+		ptBlock->rEpsilon = ptBlock->rDissipationLength = ptBlock->rLagrangianTimeW = EC_INVALID;
+	}
+
+	// Leave
+	ptBlock->iStatus = EC_BLOCK_OK;
+	return(0);
+
+}
+
+
+// Process the first iNumBlocks averaging blocks of an hour, whose raw records
+// are given in any order (as they are in raw files). Return 0 on success.
+int ecProcessHour(const EddyConfig* ptConfig, const short ivData[][5], const int iNumData, const int iHourBegin, const int iAveragingTime, const int iNumBlocks, EddyBlock* tvBlock, EddyWorkspace* ptWork) {
+
+	return(ecProcessBlocks(ptConfig, ivData, iNumData, iHourBegin, iAveragingTime, 0, iNumBlocks, tvBlock, ptWork));
+
+}
+
+
+// Process averaging blocks iFirstBlock to iNumBlocks-1 of an hour, whose raw
+// records are given in any order, placing results at the same positions of
+// tvBlock (the ones before are not touched). Return 0 on success.
+int ecProcessBlocks(const EddyConfig* ptConfig, const short ivData[][5], const int iNumData, const int iHourBegin, const int iAveragingTime, const int iFirstBlock, const int iNumBlocks, EddyBlock* tvBlock, EddyWorkspace* ptWork) {
+
+	int* ivFirst;
+	int* ivNext;
+	int  iBlock;
+	int  i;
+
+	if(iAveragingTime <= 0 || iNumBlocks <= 0 || iNumBlocks > 3600/iAveragingTime) return(1);
+	if(iFirstBlock < 0 || iFirstBlock >= iNumBlocks) return(1);
+
+	// Group records by block, preserving their order
+	if(iNumData > ptWork->iOrderedCapacity) {
+		ptWork->ivOrdered = realloc(ptWork->ivOrdered, iNumData * sizeof(ptWork->ivOrdered[0]));
+		if(ptWork->ivOrdered == NULL) {
+			ptWork->iOrderedCapacity = 0;
+			return(2);
+		}
+		ptWork->iOrderedCapacity = iNumData;
+	}
+	ivFirst = calloc(iNumBlocks + 1, sizeof(int));
+	ivNext  = calloc(iNumBlocks + 1, sizeof(int));
+	if(ivFirst == NULL || ivNext == NULL) {
+		free(ivFirst);
+		free(ivNext);
+		return(2);
+	}
+	for(i=0; i<iNumData; i++) {
+		if(ivData[i][0] < 0 || ivData[i][0] >= 3600) continue;
+		iBlock = ivData[i][0] / iAveragingTime;
+		if(iBlock >= iFirstBlock && iBlock < iNumBlocks) ivFirst[iBlock+1]++;
+	}
+	for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+		ivFirst[iBlock+1] += ivFirst[iBlock];
+		ivNext[iBlock]     = ivFirst[iBlock];
+	}
+	for(i=0; i<iNumData; i++) {
+		if(ivData[i][0] < 0 || ivData[i][0] >= 3600) continue;
+		iBlock = ivData[i][0] / iAveragingTime;
+		if(iBlock >= iFirstBlock && iBlock < iNumBlocks) memcpy(ptWork->ivOrdered[ivNext[iBlock]++], ivData[i], sizeof(ivData[i]));
+	}
+
+	// Process blocks, each being now a contiguous slice
+	for(iBlock=iFirstBlock; iBlock<iNumBlocks; iBlock++) {
+		if(ecProcessBlock(
+			ptConfig,
+			(const short (*)[5])&ptWork->ivOrdered[ivFirst[iBlock]],
+			ivFirst[iBlock+1] - ivFirst[iBlock],
+			iHourBegin + iBlock*iAveragingTime,
+			&tvBlock[iBlock],
+			ptWork
+		) != 0) {
+			free(ivFirst);
+			free(ivNext);
+			return(3);
+		}
+	}
+
+	// Leave
+	free(ivFirst);
+	free(ivNext);
+	return(0);
+
+}
+
+
+// Retain sonic records only (second of hour between 0 and 3600), moving
+// them to the beginning of the array in their order; return their number
+int ecCompactRawData(short ivData[][5], const int iNumRecords) {
+
+	int i;
+	int n = 0;
+
+	for(i=0; i<iNumRecords; i++) {
+		if(ivData[i][0] < 0 || ivData[i][0] > 3600) continue;
+		if(n != i) memcpy(ivData[n], ivData[i], sizeof(ivData[0]));
+		n++;
+	}
+	return(n);
+
+}
+
+
+// Read a raw data file, retaining sonic records only (second of hour
+// between 0 and 3600). Data are returned in a newly allocated array.
+int ecReadRawFile(const char* sFileName, short (**pivData)[5], int* piNumData) {
+
+	FILE*  f;
+	long   lSize;
+	int    iNumRecords;
+	int    n;
+	short  (*ivData)[5];
+
+	*pivData   = NULL;
+	*piNumData = 0;
+	f = fopen(sFileName, "rb");
+	if(f == NULL) return(1);
+	fseek(f, 0L, SEEK_END);
+	lSize = ftell(f);
+	fseek(f, 0L, SEEK_SET);
+	iNumRecords = lSize / sizeof(ivData[0]);
+	ivData = malloc(iNumRecords * sizeof(ivData[0]) + 1);
+	if(ivData == NULL) {
+		fclose(f);
+		return(2);
+	}
+	iNumRecords = fread(ivData, sizeof(ivData[0]), iNumRecords, f);
+	fclose(f);
+	n = ecCompactRawData(ivData, iNumRecords);
+	if(n <= 0) {
+		free(ivData);
+		return(3);
+	}
+	*pivData   = ivData;
+	*piNumData = n;
+	return(0);
+
+}
+
+
+/**********************
+* In-process support  *
+**********************/
+
+void ecBufferInit(EddyHourBuffer* ptBuffer) {
+	memset(ptBuffer, 0, sizeof(EddyHourBuffer));
+	ptBuffer->iHourBegin = -1;
+}
+
+
+void ecBufferFree(EddyHourBuffer* ptBuffer) {
+	free(ptBuffer->ivData);
+	ecBufferInit(ptBuffer);
+}
+
+
+void ecBufferReset(EddyHourBuffer* ptBuffer, const int iHourBegin) {
+	ptBuffer->iHourBegin = iHourBegin;
+	ptBuffer->iNumData   = 0;
+}
+
+
+// Append a raw record, growing buffer as needed (by ten minutes at 10Hz);
+// return 0 on success
+int ecBufferAppend(EddyHourBuffer* ptBuffer, const short ivData[5]) {
+
+	short (*ivNew)[5];
+
+	if(ptBuffer->iNumData >= ptBuffer->iCapacity) {
+		ivNew = realloc(ptBuffer->ivData, (ptBuffer->iCapacity + 6000) * sizeof(ptBuffer->ivData[0]));
+		if(ivNew == NULL) return(1);
+		ptBuffer->ivData     = ivNew;
+		ptBuffer->iCapacity += 6000;
+	}
+	memcpy(ptBuffer->ivData[ptBuffer->iNumData++], ivData, sizeof(ptBuffer->ivData[0]));
+	return(0);
+
+}
+
+
+// Make ptTo a copy of ptFrom, growing it as needed; return 0 on success
+int ecBufferCopy(EddyHourBuffer* ptTo, const EddyHourBuffer* ptFrom) {
+
+	short (*ivNew)[5];
+
+	if(ptFrom->iNumData > ptTo->iCapacity) {
+		ivNew = realloc(ptTo->ivData, ptFrom->iCapacity * sizeof(ptTo->ivData[0]));
+		if(ivNew == NULL) return(1);
+		ptTo->ivData    = ivNew;
+		ptTo->iCapacity = ptFrom->iCapacity;
+	}
+	if(ptFrom->iNumData > 0) memcpy(ptTo->ivData, ptFrom->ivData, ptFrom->iNumData * sizeof(ptTo->ivData[0]));
+	ptTo->iHourBegin = ptFrom->iHourBegin;
+	ptTo->iNumData   = ptFrom->iNumData;
+	return(0);
+
+}
+
+
+// Process the hour containing ptTime up to ptTime itself, as eddy_cov would do
+// when invoked with the same parameters. Data are taken from the buffer holding
+// that hour, if any, or from its raw file otherwise. Return 0 on success.
+int ecProcessAndWrite(const EddyConfig* ptConfig, const EddyHourBuffer* tvBuffer, const int iNumBuffers, const char* sDataPath, const struct tm* ptTime, const int iAveragingTime, EddyWorkspace* ptWork) {
+
+	struct tm   tTime = *ptTime;
+	int         iCurTime;
+	int         iHourBegin;
+	int         iNumBlocks;
+	const short (*ivData)[5] = NULL;
+	short       (*ivFileData)[5] = NULL;
+	int         iNumData = 0;
+	char        sFileName[256];
+	EddyBlock*  tvBlock;
+	int         iRetCode;
+	int         i;
+
+	if(iAveragingTime <= 0) return(1);
+	iCurTime   = (int)timegm(&tTime);
+	iHourBegin = iCurTime - iCurTime % 3600;
+	iNumBlocks = (iCurTime - iHourBegin) / iAveragingTime + 1;
+
+	// Locate data
+	for(i=0; i<iNumBuffers; i++) {
+		if(tvBuffer[i].iHourBegin == iHourBegin) {
+			ivData   = (const short (*)[5])tvBuffer[i].ivData;
+			iNumData = tvBuffer[i].iNumData;
+			break;
+		}
+	}
+	if(ivData == NULL) {
+		sprintf(sFileName, "%s/%04d%02d%02d.%02dR", sDataPath, ptTime->tm_year + 1900, ptTime->tm_mon + 1, ptTime->tm_mday, ptTime->tm_hour);
+		if(ecReadRawFile(sFileName, &ivFileData, &iNumData) != 0) return(2);
+		ivData = (const short (*)[5])ivFileData;
+	}
+
+	// Process and write
+	tvBlock = malloc(iNumBlocks * sizeof(EddyBlock));
+	if(tvBlock == NULL) {
+		free(ivFileData);
+		return(3);
+	}
+	iRetCode = ecProcessHour(ptConfig, ivData, iNumData, iHourBegin, iAveragingTime, iNumBlocks, tvBlock, ptWork);
+	if(iRetCode == 0) {
+		if(ecWriteResults(sDataPath, ptTime->tm_year + 1900, ptTime->tm_mon + 1, ptTime->tm_mday, ptTime->tm_hour, tvBlock, iNumBlocks, 1) != 0) iRetCode = 5;
+	}
+	else {
+		iRetCode = 4;
+	}
+
+	// Leave
+	free(tvBlock);
+	free(ivFileData);
+	return(iRetCode);
+
+}
+
+
+void ecResultsInit(EddyHourResults* ptResults) {
+	memset(ptResults, 0, sizeof(EddyHourResults));
+	ptResults->iHourBegin = -1;
+}
+
+
+void ecResultsFree(EddyHourResults* ptResults) {
+	free(ptResults->tvBlock);
+	ecResultsInit(ptResults);
+}
+
+
+// Process the hour containing iCurTime (epoch) up to the block containing
+// it, as ecProcessAndWrite does, but computing only the blocks completed
+// since the previous call for the same hour: results of the others are kept
+// in ptResults. Data are taken from ptBuffer, if not NULL, or from the raw
+// file of the hour otherwise. Return 0 on success.
+int ecProcessNewAndWrite(const EddyConfig* ptConfig, const EddyHourBuffer* ptBuffer, const char* sDataPath, const int iCurTime, const int iAveragingTime, EddyHourResults* ptResults, EddyWorkspace* ptWork) {
+
+	time_t      tStamp = (time_t)iCurTime;
+	struct tm   tTime;
+	int         iHourBegin;
+	int         iNumBlocks;
+	const short (*ivData)[5] = NULL;
+	short       (*ivFileData)[5] = NULL;
+	int         iNumData = 0;
+	char        sFileName[256];
+	EddyBlock*  tvNew;
+	int         iRetCode = 0;
+
+	if(iAveragingTime <= 0) return(1);
+	gmtime_r(&tStamp, &tTime);
+	iHourBegin = iCurTime - iCurTime % 3600;
+	iNumBlocks = (iCurTime - iHourBegin) / iAveragingTime + 1;
+
+	// New hour: forget the blocks of the previous one
+	if(ptResults->iHourBegin != iHourBegin) {
+		ptResults->iHourBegin = iHourBegin;
+		ptResults->iNumBlocks = 0;
+	}
+	if(iNumBlocks > ptResults->iCapacity) {
+		tvNew = realloc(ptResults->tvBlock, iNumBlocks * sizeof(EddyBlock));
+		if(tvNew == NULL) return(3);
+		ptResults->tvBlock   = tvNew;
+		ptResults->iCapacity = iNumBlocks;
+	}
+
+	// Process the blocks not done yet, if any
+	if(iNumBlocks > ptResults->iNumBlocks) {
+		if(ptBuffer != NULL) {
+			ivData   = (const short (*)[5])ptBuffer->ivData;
+			iNumData = ptBuffer->iNumData;
+		}
+		else {
+			sprintf(sFileName, "%s/%04d%02d%02d.%02dR", sDataPath, tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday, tTime.tm_hour);
+			if(ecReadRawFile(sFileName, &ivFileData, &iNumData) != 0) return(2);
+			ivData = (const short (*)[5])ivFileData;
+		}
+		iRetCode = ecProcessBlocks(ptConfig, ivData, iNumData, iHourBegin, iAveragingTime, ptResults->iNumBlocks, iNumBlocks, ptResults->tvBlock, ptWork);
+		free(ivFileData);
+		if(iRetCode != 0) return(4);
+		ptResults->iNumBlocks = iNumBlocks;
+	}
+
+	// Write all blocks of the hour so far
+	if(ecWriteResults(sDataPath, tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday, tTime.tm_hour, ptResults->tvBlock, ptResults->iNumBlocks, 1) != 0) iRetCode = 5;
+	return(iRetCode);
+
+}
+
+
+/*****************
+* Result files   *
+*****************/
+
+// Fortran "E15.7" edit descriptor
+static void fortranE(const double rValue, char* sBuffer) {
+
+	char   sNumber[48];
+	double rMantissa;
+	int    iExponent = 0;
+	long   lDigits;
+
+	if(rValue == 0.) {
+		sprintf(sBuffer, "%15s", "0.0000000E+00");
+		return;
+	}
+	if(!isfinite(rValue)) {
+		sprintf(sBuffer, "%15s", isnan(rValue) ? "NaN" : (rValue > 0. ? "Infinity" : "-Infinity"));
+		return;
+	}
+	iExponent = (int)floor(log10(fabs(rValue))) + 1;
+	rMantissa = fabs(rValue) / pow(10., iExponent);
+	lDigits   = lround(rMantissa * 1.e7);
+	if(lDigits >= 10000000L) {
+		lDigits /= 10;
+		iExponent++;
+	}
+	else if(lDigits < 1000000L) {
+		lDigits *= 10;
+		iExponent--;
+	}
+	sprintf(sNumber, "%s0.%07ldE%c%02d", rValue < 0. ? "-" : "", lDigits, iExponent < 0 ? '-' : '+', abs(iExponent));
+	sprintf(sBuffer, "%15s", sNumber);
+
+}
+
+
+static void dateTime(const int iTimeStamp, char* sBuffer) {
+
+	time_t    tStamp = (time_t)iTimeStamp;
+	struct tm tTime;
+
+	gmtime_r(&tStamp, &tTime);
+	sprintf(sBuffer, "%04d-%02d-%02d %02d:%02d:%02d", tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday, tTime.tm_hour, tTime.tm_min, tTime.tm_sec);
+
+}
+
+
+static void printReals(FILE* f, const int n, const float* rvValues) {
+	int i;
+	for(i=0; i<n; i++) fprintf(f, ",%9.3f", rvValues[i]);
+}
+
+
+static int writeProcessed(const char* sFileName, const EddyBlock* tvBlock, const int iNumBlocks) {
+
+	FILE*  f;
+	char   sDateTime[32];
+	char   sZl[32];
+	float  rvValues[20];
+	float  rvInvalid[20];
+	char   sErrZl[32];
+	int    iWithErrors;
+	int    iWithDissipation;
+	int    iBlock;
+	int    i;
+	const  EddyBlock* b;
+
+	// Random errors and dissipation rates, if requested, go after the eddy_cov columns
+	iWithErrors      = 0;
+	iWithDissipation = 0;
+	for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+		iWithErrors      |= tvBlock[iBlock].iFluxErrors;
+		iWithDissipation |= tvBlock[iBlock].iDissipation;
+	}
+
+	f = fopen(sFileName, "w");
+	if(f == NULL) return(1);
+	fprintf(f, "Date.Time,Tot.Data,Valid.Data,Vel,Vector.Vel,Scalar.Vel,Scalar.Std,Dir,Unit.Vector.Dir,Yamartino.Std.Dir,Temp,Phi.Angle,Sigma.Phi.Angle,Sigma.U,Sigma.V,Sigma.W,Sigma.T,Theta,Phi,Psi,TKE,U.star,T.star,z.L,H0,H0.Plus.Density.Effect,He,Eff.W,Q,C,Fq,Fc%s%s\n",
+		iWithErrors ? ",Err.Cov.WT,Err.Cov.UW,Err.Cov.VW,Err.H0,Err.U.star,Err.z.L" : "",
+		iWithDissipation ? ",Epsilon,Diss.Length,Lagr.Time.W" : "");
+	for(i=0; i<20; i++) rvInvalid[i] = EC_INVALID;
+	for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+		b = &tvBlock[iBlock];
+		dateTime(b->iTimeStamp, sDateTime);
+		fprintf(f, "%s,%6d,%6d", sDateTime, b->iTotData, b->iUsedData);
+		if(b->iUsedData > 1) {
+			rvValues[0]  = b->rVectorVel;
+			rvValues[1]  = b->r3DVel;
+			rvValues[2]  = b->rScalarVel;
+			rvValues[3]  = b->rScalarVelStd;
+			rvValues[4]  = b->rVectorDir;
+			rvValues[5]  = b->rUnitVectorDir;
+			rvValues[6]  = b->rEstSigmaDir;
+			rvValues[7]  = b->rvAvg[3];
+			rvValues[8]  = b->rPhiAngle;
+			rvValues[9]  = b->rSigmaPhiAngle;
+			rvValues[10] = b->rSigmaU;
+			rvValues[11] = b->rSigmaV;
+			rvValues[12] = b->rSigmaW;
+			rvValues[13] = b->rSigmaT;
+			rvValues[14] = b->rTheta;
+			rvValues[15] = b->rPhi;
+			rvValues[16] = b->rPsi;
+			rvValues[17] = b->rTKE;
+			rvValues[18] = b->rUstar;
+			rvValues[19] = b->rTstar;
+			printReals(f, 20, rvValues);
+			fortranE(b->rZl, sZl);
+			fprintf(f, ",%s,%9.3f", sZl, b->rH0);
+		}
+		else {
+			printReals(f, 20, rvInvalid);
+			fortranE(EC_INVALID, sZl);
+			fprintf(f, ",%s,%9.3f", sZl, EC_INVALID);
+		}
+		printReals(f, 7, rvInvalid);
+		if(iWithErrors) {
+			if(b->iUsedData > 1) {
+				rvValues[0] = b->rErrCovWT;
+				rvValues[1] = b->rErrCovUW;
+				rvValues[2] = b->rErrCovVW;
+				rvValues[3] = b->rErrH0;
+				rvValues[4] = b->rErrUstar;
+				fortranE(b->rErrZl, sErrZl);
+			}
+			else {
+				for(i=0; i<5; i++) rvValues[i] = EC_INVALID;
+				fortranE(EC_INVALID, sErrZl);
+			}
+			fprintf(f, ",%13.6e,%13.6e,%13.6e", rvValues[0], rvValues[1], rvValues[2]);
+			printReals(f, 2, &rvValues[3]);
+			fprintf(f, ",%s", sErrZl);
+		}
+		if(iWithDissipation) {
+			if(b->iUsedData > 1) {
+				rvValues[0] = b->rEpsilon;
+				rvValues[1] = b->rDissipationLength;
+				rvValues[2] = b->rLagrangianTimeW;
+			}
+			else {
+				for(i=0; i<3; i++) rvValues[i] = EC_INVALID;
+			}
+			fprintf(f, ",%13.6e", rvValues[0]);
+			printReals(f, 2, &rvValues[1]);
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+
+	// Leave
+	return(0);
+
+}
+
+
+// Output column: name, and offset of its float (or, for extra integer
+// columns, int) field
+typedef struct EcColumn {
+	const char* sName;
+	size_t      iOffset;
+} EcColumn;
+
+
+// Diagnostic output; extra float, then integer, columns, if any, go after
+// the eddy_cov ones
+static int writeDiagnostic(const char* sFileName, const EddyBlock* tvBlock, const int iNumBlocks, const EcColumn* tvRealColumn, const int nRealCols, const EcColumn* tvIntColumn, const int nIntCols) {
+
+	FILE*  f;
+	char   sDateTime[32];
+	float  rvValues[40];
+	int    iBlock;
+	int    i;
+	const  EddyBlock* b;
+
+	f = fopen(sFileName, "w");
+	if(f == NULL) return(1);
+	fprintf(f, "Date.Time,Tot.Data,Valid.Data,N.Dir.N,N.Dir.NNE,N.Dir.NE,N.Dir.ENE,N.Dir.E,N.Dir.ESE,N.Dir.SE,N.Dir.SSE,N.Dir.S,N.Dir.SSW,N.Dir.SW,N.Dir.WSW,N.Dir.W,N.Dir.WNW,N.Dir.NW,N.Dir.NNW,Dominant.Dir,Vel,Dir,U,V,W,T,r,Circ.Var,Circ.Std,Range.U,Range.V,Range.W,Range.T,Nrot.Sigma2.U,Nrot.Sigma2.V,Nrot.Sigma2.W,Nrot.Cov.UV,Nrot.Cov.UW,Nrot.Cov.VW,Nrot.Cov.UT,Nrot.Cov.VT,Nrot.Cov.WT,Rot.Sigma2.U,Rot.Sigma2.V,Rot.Sigma2.W,Rot.Cov.UV,Rot.Cov.UW,Rot.Cov.VW,Rot.Cov.UT,Rot.Cov.VT,Rot.Cov.WT,Ustar.Base,Ustar.Extended,Theta,Phi,Psi,Eff.W,Q,C,");	// Trailing comma as in eddy_cov
+	for(i=0; i<nRealCols; i++) fprintf(f, i > 0 ? ",%s" : "%s", tvRealColumn[i].sName);
+	for(i=0; i<nIntCols; i++) fprintf(f, i > 0 || nRealCols > 0 ? ",%s" : "%s", tvIntColumn[i].sName);
+	fprintf(f, "\n");
+	for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+		b = &tvBlock[iBlock];
+		dateTime(b->iTimeStamp, sDateTime);
+		fprintf(f, "%s,%6d,%6d", sDateTime, b->iTotData, b->iUsedData);
+		for(i=0; i<40; i++) rvValues[i] = EC_INVALID;
+		if(b->iUsedData > 1) {
+			for(i=0; i<16; i++) fprintf(f, ",%6d", b->ivDirClass[i]);
+			rvValues[0]  = b->rDominantDir;
+			rvValues[1]  = b->rVectorVel;
+			rvValues[2]  = b->rVectorDir;
+			for(i=0; i<4; i++) rvValues[3+i] = b->rvAvg[i];
+			rvValues[7]  = b->rUnitVel;
+			rvValues[8]  = b->rDirCircVar;
+			rvValues[9]  = b->rDirCircStd;
+			for(i=0; i<4; i++) rvValues[10+i] = b->rvRange[i];
+			rvValues[14] = b->rmCov[0][0];
+			rvValues[15] = b->rmCov[1][1];
+			rvValues[16] = b->rmCov[2][2];
+			rvValues[17] = b->rmCov[0][1];
+			rvValues[18] = b->rmCov[0][2];
+			rvValues[19] = b->rmCov[1][2];
+			for(i=0; i<3; i++) rvValues[20+i] = b->rvCovT[i];
+			rvValues[23] = b->rmRotCov[0][0];
+			rvValues[24] = b->rmRotCov[1][1];
+			rvValues[25] = b->rmRotCov[2][2];
+			rvValues[26] = b->rmRotCov[0][1];
+			rvValues[27] = b->rmRotCov[0][2];
+			rvValues[28] = b->rmRotCov[1][2];
+			for(i=0; i<3; i++) rvValues[29+i] = b->rvRotCovT[i];
+			rvValues[32] = b->rUstarBase;
+			rvValues[33] = b->rUstarExtended;
+			rvValues[34] = b->rTheta;
+			rvValues[35] = b->rPhi;
+			rvValues[36] = b->rPsi;
+		}
+		else {
+			for(i=0; i<16; i++) fprintf(f, ",%6d", EC_INVALID_INT);
+		}
+		printReals(f, 40, rvValues);
+		for(i=0; i<nRealCols; i++) fprintf(f, ",%9.3f", b->iUsedData > 1 ? *(const float*)((const char*)b + tvRealColumn[i].iOffset) : EC_INVALID);
+		for(i=0; i<nIntCols; i++) fprintf(f, ",%6d", *(const int*)((const char*)b + tvIntColumn[i].iOffset));
+		fprintf(f, "\n");
+	}
+	fclose(f);
+
+	// Leave
+	return(0);
+
+}
+
+
+// Spectral output: for each block, one line of bin frequencies followed by
+// one line per spectrum and ogive
+static int writeSpectral(const char* sFileName, const EddyBlock* tvBlock, const int iNumBlocks) {
+
+	static const char* svSpectrum[6] = {"S.U", "S.V", "S.W", "S.T", "Co.WT", "Co.UW"};
+	static const char* svOgive[2]    = {"Og.WT", "Og.UW"};
+	FILE*  f;
+	char   sDateTime[32];
+	int    iBlock;
+	int    i, j;
+	const  EddyBlock* b;
+
+	f = fopen(sFileName, "w");
+	if(f == NULL) return(1);
+	fprintf(f, "Date.Time,Quantity");
+	for(i=0; i<EC_SPECTRAL_BINS; i++) fprintf(f, ",Bin.%02d", i+1);
+	fprintf(f, "\n");
+	for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+		b = &tvBlock[iBlock];
+		dateTime(b->iTimeStamp, sDateTime);
+		fprintf(f, "%s,%-8s", sDateTime, "Freq");
+		for(i=0; i<EC_SPECTRAL_BINS; i++) fprintf(f, ",%13.6e", b->rvSpecFreq[i]);
+		fprintf(f, "\n");
+		for(j=0; j<6; j++) {
+			fprintf(f, "%s,%-8s", sDateTime, svSpectrum[j]);
+			for(i=0; i<EC_SPECTRAL_BINS; i++) fprintf(f, ",%13.6e", b->rmSpectrum[j][i]);
+			fprintf(f, "\n");
+		}
+		for(j=0; j<2; j++) {
+			fprintf(f, "%s,%-8s", sDateTime, svOgive[j]);
+			for(i=0; i<EC_SPECTRAL_BINS; i++) fprintf(f, ",%13.6e", b->rmOgive[j][i]);
+			fprintf(f, "\n");
+		}
+	}
+	fclose(f);
+
+	// Leave
+	return(0);
+
+}
+
+
+// Columnar output: counts and direction classes, then float columns, then
+// extra integer columns
+static int writeColumnar(const char* sFileName, const EddyBlock* tvBlock, const int iNumBlocks, const EcColumn* tvColumn, const int nRealCols, const int iWithDirClasses, const EcColumn* tvIntColumn, const int nIntCols) {
+
+	static const char* svDirName[16] = {
+		"N.Dir.N", "N.Dir.NNE", "N.Dir.NE", "N.Dir.ENE", "N.Dir.E", "N.Dir.ESE", "N.Dir.SE", "N.Dir.SSE",
+		"N.Dir.S", "N.Dir.SSW", "N.Dir.SW", "N.Dir.WSW", "N.Dir.W", "N.Dir.WNW", "N.Dir.NW", "N.Dir.NNW"
+	};
+	ColumnarFile tCol;
+	const char*  svName[128];
+	int          ivType[128];
+	int*         ivValues;
+	float*       rvValues;
+	int          nCols = 0;
+	int          iBlock;
+	int          i;
+	int          iRetCode = 0;
+
+	// Schema
+	svName[nCols] = "Time.Stamp"; ivType[nCols++] = COL_INTEGER;
+	svName[nCols] = "Tot.Data";   ivType[nCols++] = COL_INTEGER;
+	svName[nCols] = "Valid.Data"; ivType[nCols++] = COL_INTEGER;
+	if(iWithDirClasses) {
+		for(i=0; i<16; i++) {
+			svName[nCols] = svDirName[i];
+			ivType[nCols++] = COL_INTEGER;
+		}
+	}
+	for(i=0; i<nRealCols; i++) {
+		svName[nCols] = tvColumn[i].sName;
+		ivType[nCols++] = COL_REAL;
+	}
+	for(i=0; i<nIntCols; i++) {
+		svName[nCols] = tvIntColumn[i].sName;
+		ivType[nCols++] = COL_INTEGER;
+	}
+	if(colCreate(sFileName, nCols, svName, ivType, iNumBlocks, &tCol) != 0) return(1);
+
+	// Data
+	ivValues = malloc(iNumBlocks * sizeof(int) + 1);
+	rvValues = malloc(iNumBlocks * sizeof(float) + 1);
+	if(ivValues == NULL || rvValues == NULL) {
+		iRetCode = 2;
+	}
+	else {
+		for(iBlock=0; iBlock<iNumBlocks; iBlock++) ivValues[iBlock] = tvBlock[iBlock].iTimeStamp;
+		colWriteInteger(&tCol, ivValues);
+		for(iBlock=0; iBlock<iNumBlocks; iBlock++) ivValues[iBlock] = tvBlock[iBlock].iTotData;
+		colWriteInteger(&tCol, ivValues);
+		for(iBlock=0; iBlock<iNumBlocks; iBlock++) ivValues[iBlock] = tvBlock[iBlock].iUsedData;
+		colWriteInteger(&tCol, ivValues);
+		if(iWithDirClasses) {
+			for(i=0; i<16; i++) {
+				for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+					ivValues[iBlock] = tvBlock[iBlock].iUsedData > 1 ? tvBlock[iBlock].ivDirClass[i] : EC_INVALID_INT;
+				}
+				colWriteInteger(&tCol, ivValues);
+			}
+		}
+		for(i=0; i<nRealCols; i++) {
+			for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+				rvValues[iBlock] = tvBlock[iBlock].iUsedData > 1 ? *(const float*)((const char*)&tvBlock[iBlock] + tvColumn[i].iOffset) : EC_INVALID;
+			}
+			colWriteReal(&tCol, rvValues);
+		}
+		for(i=0; i<nIntCols; i++) {
+			for(iBlock=0; iBlock<iNumBlocks; iBlock++) {
+				ivValues[iBlock] = *(const int*)((const char*)&tvBlock[iBlock] + tvIntColumn[i].iOffset);
+			}
+			colWriteInteger(&tCol, ivValues);
+		}
+	}
+
+	// Leave
+	free(ivValues);
+	free(rvValues);
+	colClose(&tCol);
+	return(iRetCode);
+
+}
+
+
+// Write .p, .d, .P and .D files of an hour, and if 'iCurrentCopies' is
+// non-zero the current data copies (CurData.csv, DiaData.csv), in the same
+// form as eddy_cov, with random errors and dissipation rates as trailing
+// processed columns, and relative non-stationarities, spike counts and
+// quality control codes as trailing diagnostic columns, if requested; if
+// spectra were computed for any block, write them to the .s file. Return 0
+// on success.
+int ecWriteResults(const char* sDataPath, const int iYear, const int iMonth, const int iDay, const int iHour, const EddyBlock* tvBlock, const int iNumBlocks, const int iCurrentCopies) {
+
+	static const EcColumn tvProcessed[] = {
+		{"Vel",               offsetof(EddyBlock, rVectorVel)},
+		{"Vector.Vel",        offsetof(EddyBlock, r3DVel)},
+		{"Scalar.Vel",        offsetof(EddyBlock, rScalarVel)},
+		{"Scalar.Std",        offsetof(EddyBlock, rScalarVelStd)},
+		{"Dir",               offsetof(EddyBlock, rVectorDir)},
+		{"Unit.Vector.Dir",   offsetof(EddyBlock, rUnitVectorDir)},
+		{"Yamartino.Std.Dir", offsetof(EddyBlock, rEstSigmaDir)},
+		{"Temp",              offsetof(EddyBlock, rvAvg[3])},
+		{"Phi.Angle",         offsetof(EddyBlock, rPhiAngle)},
+		{"Sigma.Phi.Angle",   offsetof(EddyBlock, rSigmaPhiAngle)},
+		{"Sigma.U",           offsetof(EddyBlock, rSigmaU)},
+		{"Sigma.V",           offsetof(EddyBlock, rSigmaV)},
+		{"Sigma.W",           offsetof(EddyBlock, rSigmaW)},
+		{"Sigma.T",           offsetof(EddyBlock, rSigmaT)},
+		{"Theta",             offsetof(EddyBlock, rTheta)},
+		{"Phi",               offsetof(EddyBlock, rPhi)},
+		{"Psi",               offsetof(EddyBlock, rPsi)},
+		{"TKE",               offsetof(EddyBlock, rTKE)},
+		{"U.star",            offsetof(EddyBlock, rUstar)},
+		{"T.star",            offsetof(EddyBlock, rTstar)},
+		{"z.L",               offsetof(EddyBlock, rZl)},
+		{"H0",                offsetof(EddyBlock, rH0)}
+	};
+	static const EcColumn tvErrors[] = {
+		{"Err.Cov.WT",        offsetof(EddyBlock, rErrCovWT)},
+		{"Err.Cov.UW",        offsetof(EddyBlock, rErrCovUW)},
+		{"Err.Cov.VW",        offsetof(EddyBlock, rErrCovVW)},
+		{"Err.H0",            offsetof(EddyBlock, rErrH0)},
+		{"Err.U.star",        offsetof(EddyBlock, rErrUstar)},
+		{"Err.z.L",           offsetof(EddyBlock, rErrZl)}
+	};
+	static const EcColumn tvDissipation[] = {
+		{"Epsilon",           offsetof(EddyBlock, rEpsilon)},
+		{"Diss.Length",       offsetof(EddyBlock, rDissipationLength)},
+		{"Lagr.Time.W",       offsetof(EddyBlock, rLagrangianTimeW)}
+	};
+	EcColumn tvColumn[sizeof(tvProcessed)/sizeof(EcColumn) + sizeof(tvErrors)/sizeof(EcColumn) + sizeof(tvDissipation)/sizeof(EcColumn)];
+	int      nCols;
+	static const EcColumn tvDiagnostic[] = {
+		{"Dominant.Dir",      offsetof(EddyBlock, rDominantDir)},
+		{"Vel",               offsetof(EddyBlock, rVectorVel)},
+		{"Dir",               offsetof(EddyBlock, rVectorDir)},
+		{"U",                 offsetof(EddyBlock, rvAvg[0])},
+		{"V",                 offsetof(EddyBlock, rvAvg[1])},
+		{"W",                 offsetof(EddyBlock, rvAvg[2])},
+		{"T",                 offsetof(EddyBlock, rvAvg[3])},
+		{"r",                 offsetof(EddyBlock, rUnitVel)},
+		{"Circ.Var",          offsetof(EddyBlock, rDirCircVar)},
+		{"Circ.Std",          offsetof(EddyBlock, rDirCircStd)},
+		{"Range.U",           offsetof(EddyBlock, rvRange[0])},
+		{"Range.V",           offsetof(EddyBlock, rvRange[1])},
+		{"Range.W",           offsetof(EddyBlock, rvRange[2])},
+		{"Range.T",           offsetof(EddyBlock, rvRange[3])},
+		{"Nrot.Sigma2.U",     offsetof(EddyBlock, rmCov[0][0])},
+		{"Nrot.Sigma2.V",     offsetof(EddyBlock, rmCov[1][1])},
+		{"Nrot.Sigma2.W",     offsetof(EddyBlock, rmCov[2][2])},
+		{"Nrot.Cov.UV",       offsetof(EddyBlock, rmCov[0][1])},
+		{"Nrot.Cov.UW",       offsetof(EddyBlock, rmCov[0][2])},
+		{"Nrot.Cov.VW",       offsetof(EddyBlock, rmCov[1][2])},
+		{"Nrot.Cov.UT",       offsetof(EddyBlock, rvCovT[0])},
+		{"Nrot.Cov.VT",       offsetof(EddyBlock, rvCovT[1])},
+		{"Nrot.Cov.WT",       offsetof(EddyBlock, rvCovT[2])},
+		{"Rot.Sigma2.U",      offsetof(EddyBlock, rmRotCov[0][0])},
+		{"Rot.Sigma2.V",      offsetof(EddyBlock, rmRotCov[1][1])},
+		{"Rot.Sigma2.W",      offsetof(EddyBlock, rmRotCov[2][2])},
+		{"Rot.Cov.UV",        offsetof(EddyBlock, rmRotCov[0][1])},
+		{"Rot.Cov.UW",        offsetof(EddyBlock, rmRotCov[0][2])},
+		{"Rot.Cov.VW",        offsetof(EddyBlock, rmRotCov[1][2])},
+		{"Rot.Cov.UT",        offsetof(EddyBlock, rvRotCovT[0])},
+		{"Rot.Cov.VT",        offsetof(EddyBlock, rvRotCovT[1])},
+		{"Rot.Cov.WT",        offsetof(EddyBlock, rvRotCovT[2])},
+		{"Ustar.Base",        offsetof(EddyBlock, rUstarBase)},
+		{"Ustar.Extended",    offsetof(EddyBlock, rUstarExtended)},
+		{"Theta",             offsetof(EddyBlock, rTheta)},
+		{"Phi",               offsetof(EddyBlock, rPhi)},
+		{"Psi",               offsetof(EddyBlock, rPsi)}
+	};
+	EcColumn tvDiagColumn[sizeof(tvDiagnostic)/sizeof(EcColumn) + 2];
+	int      nDiagCols;
+	int      nStat = 0;
+	static const EcColumn tvStationarity[] = {
+		{"Stat.WT",           offsetof(EddyBlock, rStatWT)},
+		{"Stat.UW",           offsetof(EddyBlock, rStatUW)}
+	};
+	static const EcColumn tvSpikes[] = {
+		{"Spikes.U",          offsetof(EddyBlock, ivSpikes[0])},
+		{"Spikes.V",          offsetof(EddyBlock, ivSpikes[1])},
+		{"Spikes.W",          offsetof(EddyBlock, ivSpikes[2])},
+		{"Spikes.T",          offsetof(EddyBlock, ivSpikes[3])}
+	};
+	static const EcColumn tvQuality[] = {
+		{"QC.Resolution",     offsetof(EddyBlock, ivQuality[0])},
+		{"QC.Dropouts",       offsetof(EddyBlock, ivQuality[1])},
+		{"QC.Limits",         offsetof(EddyBlock, ivQuality[2])},
+		{"QC.Moments",        offsetof(EddyBlock, ivQuality[3])},
+		{"QC.Discontinuities", offsetof(EddyBlock, ivQuality[4])},
+		{"QC.Flag",           offsetof(EddyBlock, ivQuality[5])}
+	};
+	EcColumn tvExtra[sizeof(tvSpikes)/sizeof(EcColumn) + sizeof(tvQuality)/sizeof(EcColumn)];
+	int      nExtra = 0;
+	char sBase[256];
+	char sFileName[300];
+	char sCopy[300];
+	int  iRetCode = 0;
+	int  i;
+
+	sprintf(sBase, "%s/%04d%02d%02d.%02d", sDataPath, iYear, iMonth, iDay, iHour);
+
+	// Optional columns, if requested for any block
+	nCols = sizeof(tvProcessed)/sizeof(EcColumn);
+	memcpy(tvColumn, tvProcessed, sizeof(tvProcessed));
+	for(i=0; i<iNumBlocks; i++) {
+		if(tvBlock[i].iFluxErrors) break;
+	}
+	if(i < iNumBlocks) {
+		memcpy(tvColumn + nCols, tvErrors, sizeof(tvErrors));
+		nCols += sizeof(tvErrors)/sizeof(EcColumn);
+	}
+	for(i=0; i<iNumBlocks; i++) {
+		if(tvBlock[i].iDissipation) break;
+	}
+	if(i < iNumBlocks) {
+		memcpy(tvColumn + nCols, tvDissipation, sizeof(tvDissipation));
+		nCols += sizeof(tvDissipation)/sizeof(EcColumn);
+	}
+	nDiagCols = sizeof(tvDiagnostic)/sizeof(EcColumn);
+	memcpy(tvDiagColumn, tvDiagnostic, sizeof(tvDiagnostic));
+	for(i=0; i<iNumBlocks; i++) {
+		if(tvBlock[i].iStationarity) break;
+	}
+	if(i < iNumBlocks) {
+		nStat = sizeof(tvStationarity)/sizeof(EcColumn);
+		memcpy(tvDiagColumn + nDiagCols, tvStationarity, sizeof(tvStationarity));
+		nDiagCols += nStat;
+	}
+	for(i=0; i<iNumBlocks; i++) {
+		if(tvBlock[i].iDespiking) break;
+	}
+	if(i < iNumBlocks) {
+		memcpy(tvExtra + nExtra, tvSpikes, sizeof(tvSpikes));
+		nExtra += sizeof(tvSpikes)/sizeof(EcColumn);
+	}
+	for(i=0; i<iNumBlocks; i++) {
+		if(tvBlock[i].iQualityControl) break;
+	}
+	if(i < iNumBlocks) {
+		memcpy(tvExtra + nExtra, tvQuality, sizeof(tvQuality));
+		nExtra += sizeof(tvQuality)/sizeof(EcColumn);
+	}
+
+	// Text files, and their current data copies
+	sprintf(sFileName, "%sp", sBase);
+	if(writeProcessed(sFileName, tvBlock, iNumBlocks) != 0) iRetCode = 1;
+	sprintf(sCopy, "%s/CurData.csv", sDataPath);
+	if(iRetCode == 0 && iCurrentCopies) writeProcessed(sCopy, tvBlock, iNumBlocks);
+	sprintf(sFileName, "%sd", sBase);
+	if(writeDiagnostic(sFileName, tvBlock, iNumBlocks, tvStationarity, nStat, tvExtra, nExtra) != 0) iRetCode = 2;
+	sprintf(sCopy, "%s/DiaData.csv", sDataPath);
+	if(iRetCode == 0 && iCurrentCopies) writeDiagnostic(sCopy, tvBlock, iNumBlocks, tvStationarity, nStat, tvExtra, nExtra);
+
+	// Columnar files
+	sprintf(sFileName, "%sP", sBase);
+	if(writeColumnar(sFileName, tvBlock, iNumBlocks, tvColumn, nCols, 0, NULL, 0) != 0) iRetCode = 3;
+	sprintf(sFileName, "%sD", sBase);
+	if(writeColumnar(sFileName, tvBlock, iNumBlocks, tvDiagColumn, nDiagCols, 1, tvExtra, nExtra) != 0) iRetCode = 4;
+
+	// Spectra
+	for(i=0; i<iNumBlocks; i++) {
+		if(tvBlock[i].rvSpecFreq[0] != EC_INVALID) break;
+	}
+	if(i < iNumBlocks) {
+		sprintf(sFileName, "%ss", sBase);
+		if(writeSpectral(sFileName, tvBlock, iNumBlocks) != 0) iRetCode = 6;
+	}
+
+	// Leave
+	return(iRetCode);
+
+}
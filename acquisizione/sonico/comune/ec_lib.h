@@ -0,0 +1,190 @@
+/*
+
+	ec_lib - Eddy covariance engine, the same processing chain as "eddy_cov"
+	         (SonicLib based), as a reentrant library with a block-level API.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+// Engine version: to be increased whenever a change alters results, as it
+// is part of the key of cached results (see "rc_lib")
+#define EC_ENGINE_VERSION   4
+
+// Logarithmic frequency bins of block spectra
+#define EC_SPECTRAL_BINS   24
+
+// Maximum lag of covariance products in random error estimates (s)
+#define EC_ERROR_MAX_LAG   20
+
+// Sub-blocks of the stationarity test (Foken and Wichura, 1996: 5 minutes
+// of 30); block moments are merged from theirs in any case
+#define EC_SUBBLOCKS        6
+
+// Inertial subrange fit of structure functions, separations being lags
+// times mean wind speed (Taylor's hypothesis): from EC_DISSIPATION_MIN_DIST
+// to the anemometer height, where eddies are smaller than their distance
+// from ground
+#define EC_DISSIPATION_MIN_DIST   0.5	// m
+#define EC_DISSIPATION_MIN_VEL    0.5	// m/s, below which the hypothesis is not trusted
+#define EC_DISSIPATION_MIN_LAGS   3
+
+// Processing configuration (the "EddyConfig" namelist of eddy_cov)
+typedef struct EddyConfig {
+	int    iDetrending;			// Non-zero to remove linear trend
+	int    iRotations;			// Number of axis rotations (0 to 3); planar fit (4 in
+								// eddy_cov) is not made here, and refused by ecReadConfig
+	double rAltitude;			// Station altitude above geoid (m)
+	double rAnemometerHeight;	// Anemometer height above ground (m)
+	int    iSpectra;			// Non-zero to compute spectra, cospectra and ogives
+	int    iFluxErrors;			// Non-zero to estimate random errors of fluxes
+	int    iDespiking;			// Non-zero to replace spikes by sliding window median
+	int    iDespikingWindow;	// Sliding window (samples)
+	double rDespikingThreshold;	// Spike threshold (robust standard deviations)
+	int    iQualityControl;		// Non-zero to run quality control tests
+	int    iStationarity;		// Non-zero to run the stationarity test
+	int    iDissipation;		// Non-zero to estimate the TKE dissipation rate
+} EddyConfig;
+
+// Block status
+#define EC_BLOCK_OK         0
+#define EC_BLOCK_NO_DATA    1	// No valid data in block
+#define EC_BLOCK_IRREGULAR  2	// Time stamps unusable (most likely cause: RTC glitch)
+
+// Results of one averaging block; invalid values are -9999.9 (-9999 for counts)
+typedef struct EddyBlock {
+	int   iTimeStamp;			// Block begin, as epoch
+	int   iStatus;
+	int   iTotData;				// Data in block
+	int   iUsedData;			// Valid data in block
+	int   iFrequency;			// Estimated sampling frequency (Hz)
+	int   iRegularityCode;		// 1 = sorted data, +2 = no gaps
+	int   iFluxErrors;			// Non-zero if random errors were requested
+	int   iDespiking;			// Non-zero if despiking was requested
+	int   ivSpikes[4];			// Values replaced in valid data, for u, v, w and t
+	int   iQualityControl;		// Non-zero if quality control was requested
+	int   ivQuality[6];			// Codes of resolution, dropouts, limits, moments and
+								// discontinuity tests, then the worst of them: 0 = passed,
+								// 1 = soft flag, 2 = hard flag (see "qc_lib")
+	int   iStationarity;		// Non-zero if the stationarity test was requested
+	int   iDissipation;			// Non-zero if the dissipation rate was requested
+	float rvMin[4];				// Minima of u, v, w (m/s) and t (°C)
+	float rvMax[4];				// Maxima of u, v, w (m/s) and t (°C)
+	float rvRange[4];			// Ranges (maximum - minimum)
+	float rvAvg[4];				// Means of u, v, w (m/s) and t (°C), non rotated
+	float rmCov[3][3];			// Wind covariances, non rotated
+	float rvCovT[3];			// Wind-temperature covariances, non rotated
+	float rVarT;				// Temperature variance
+	float rvRotAvg[3];			// Wind means, rotated
+	float rmRotCov[3][3];		// Wind covariances, rotated
+	float rvRotCovT[3];			// Wind-temperature covariances, rotated
+	float rTheta;				// Rotation angles (rad)
+	float rPhi;
+	float rPsi;
+	float rVectorVel;
+	float rVectorDir;
+	float r3DVel;
+	float rScalarVel;
+	float rScalarVelStd;
+	float rUnitVectorDir;
+	float rEstSigmaDir;
+	float rPhiAngle;
+	float rSigmaPhiAngle;
+	float rUnitVel;
+	float rDirCircVar;
+	float rDirCircStd;
+	int   ivDirClass[16];
+	float rDominantDir;
+	float rUstarBase;
+	float rUstarExtended;
+	float rUstar;
+	float rTstar;
+	float rH0;
+	float rZl;
+	float rTKE;
+	float rSigmaU;
+	float rSigmaV;
+	float rSigmaW;
+	float rSigmaT;
+	float rErrCovWT;			// Random errors (standard deviations), if requested,
+	float rErrCovUW;			// of rotated covariances and derived quantities
+	float rErrCovVW;
+	float rErrH0;
+	float rErrUstar;
+	float rErrZl;
+	float rStatWT;				// Relative non-stationarity (%) of rotated w't' and u'w',
+	float rStatUW;				// if requested: |mean of sub-block ones - block one| / |block one|
+	float rEpsilon;				// TKE dissipation rate (m2/s3), if requested, and derived scales:
+	float rDissipationLength;	// TKE^(3/2)/epsilon (m)
+	float rLagrangianTimeW;		// Lagrangian time scale of w, 2 Sigma.W^2/(C0 epsilon) (s)
+	float rvSpecFreq[EC_SPECTRAL_BINS];			// Bin centre frequencies (Hz), if spectra are computed
+	float rmSpectrum[6][EC_SPECTRAL_BINS];		// Densities: u, v, w (rotated) and t spectra, w't' and u'w' cospectra
+	float rmOgive[2][EC_SPECTRAL_BINS];			// w't' and u'w' ogives, from bin up to Nyquist
+} EddyBlock;
+
+// Caller-owned workspace, making the engine reentrant: one per thread
+typedef struct EddyWorkspace {
+	int     iCapacity;
+	int*    ivTime;				// Second of hour of valid data
+	int*    ivIndex;			// Position of valid data within block
+	double* rvU;
+	double* rvV;
+	double* rvW;
+	double* rvT;
+	int     iOrderedCapacity;
+	short   (*ivOrdered)[5];		// Hour data, grouped by block
+	struct SpWorkspace* ptSpectral;	// Spectral analysis plans and buffers, made on first use
+	struct DsFilter*    ptDespiker;	// Despiking filter, made on first use
+	unsigned char*      ivFlags;	// Spike flags of valid data (DS_SPIKE_U, ...), if despiking
+	struct QcState*     ptQuality;	// Quality control pass, made on first use
+} EddyWorkspace;
+
+// Raw records of one hour, as collected by acquisition tasks
+typedef struct EddyHourBuffer {
+	int     iHourBegin;			// Hour begin, as epoch
+	int     iNumData;
+	int     iCapacity;
+	short   (*ivData)[5];
+} EddyHourBuffer;
+
+// Blocks of one hour processed so far, for incremental in-process use
+typedef struct EddyHourResults {
+	int        iHourBegin;		// Hour begin, as epoch; -1 if none yet
+	int        iNumBlocks;		// Blocks processed, from the first of hour
+	int        iCapacity;
+	EddyBlock* tvBlock;
+} EddyHourResults;
+
+// Configuration and workspace
+int  ecReadConfig(const char* sNamelistFile, EddyConfig* ptConfig);
+void ecWorkspaceInit(EddyWorkspace* ptWork);
+void ecWorkspaceFree(EddyWorkspace* ptWork);
+
+// Processing: raw records are {second of hour, u, v, w, t} in cm/s and 1/100 °C
+int ecProcessBlock(const EddyConfig* ptConfig, const short ivData[][5], const int iNumData, const int iTimeStamp, EddyBlock* ptBlock, EddyWorkspace* ptWork);
+int ecProcessHour(const EddyConfig* ptConfig, const short ivData[][5], const int iNumData, const int iHourBegin, const int iAveragingTime, const int iNumBlocks, EddyBlock* tvBlock, EddyWorkspace* ptWork);
+int ecProcessBlocks(const EddyConfig* ptConfig, const short ivData[][5], const int iNumData, const int iHourBegin, const int iAveragingTime, const int iFirstBlock, const int iNumBlocks, EddyBlock* tvBlock, EddyWorkspace* ptWork);
+int ecCompactRawData(short ivData[][5], const int iNumRecords);
+int ecReadRawFile(const char* sFileName, short (**pivData)[5], int* piNumData);
+
+// In-process use from acquisition tasks
+void ecBufferInit(EddyHourBuffer* ptBuffer);
+void ecBufferFree(EddyHourBuffer* ptBuffer);
+void ecBufferReset(EddyHourBuffer* ptBuffer, const int iHourBegin);
+int  ecBufferAppend(EddyHourBuffer* ptBuffer, const short ivData[5]);
+int  ecBufferCopy(EddyHourBuffer* ptTo, const EddyHourBuffer* ptFrom);
+int  ecProcessAndWrite(const EddyConfig* ptConfig, const EddyHourBuffer* tvBuffer, const int iNumBuffers, const char* sDataPath, const struct tm* ptTime, const int iAveragingTime, EddyWorkspace* ptWork);
+void ecResultsInit(EddyHourResults* ptResults);
+void ecResultsFree(EddyHourResults* ptResults);
+int  ecProcessNewAndWrite(const EddyConfig* ptConfig, const EddyHourBuffer* ptBuffer, const char* sDataPath, const int iCurTime, const int iAveragingTime, EddyHourResults* ptResults, EddyWorkspace* ptWork);
+
+// Result files, in the same form as eddy_cov ones, plus random errors (as
+// trailing processed columns), relative non-stationarities, spike counts
+// and quality control codes (as trailing diagnostic columns) and spectra
+// (.s) if computed; current data copies are written only if 'iCurrentCopies' is non-zero
+int ecWriteResults(const char* sDataPath, const int iYear, const int iMonth, const int iDay, const int iHour, const EddyBlock* tvBlock, const int iNumBlocks, const int iCurrentCopies);
@@ -0,0 +1,157 @@
+/*
+
+	mg_lib - Time-aligned merge of two streams of block results, coded in
+	         plain C.
+
+	Parts of blocks are put in a buffer sorted by time stamp, and blocks
+	leave it from the oldest one only, so that output is in time order. The
+	oldest block leaves as soon as it is complete, or when each side it
+	misses has already delivered a later block (each stream being in time
+	order, the part missing will never come), or when it has waited more
+	than the maximum delay since its first part arrived. A part whose
+	block has already left is late, and discarded. With the buffer full,
+	the oldest block leaves as is, so memory is bounded whatever the
+	streams do.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mg_lib.h"
+
+
+static int isReady(const MgMerger* ptMerger, const MgBlock* ptBlock, const int iNow) {
+
+	int iSide;
+
+	if(iNow - ptBlock->iArrival >= ptMerger->iMaxDelay) return(1);
+	for(iSide=0; iSide<MG_NUM_SIDES; iSide++) {
+		if(!(ptMerger->iExpected & (1 << iSide)) || (ptBlock->iSources & (1 << iSide))) continue;
+		if(ptMerger->ivLastSeen[iSide] <= ptBlock->iTimeStamp) return(0);
+	}
+	return(1);
+
+}
+
+
+// Release the oldest block pending
+static void emitOldest(MgMerger* ptMerger) {
+
+	const int iSlot   = ptMerger->ivOrder[0];
+	MgBlock*  ptBlock = &ptMerger->tvPool[iSlot];
+
+	if((ptBlock->iSources & ptMerger->iExpected) == ptMerger->iExpected) ptMerger->iComplete++;
+	else                                                                 ptMerger->iPartial++;
+	ptMerger->fEmit(ptBlock, ptMerger->pUserData);
+	ptMerger->iLastEmitted = ptBlock->iTimeStamp;
+	ptMerger->nPending--;
+	memmove(&ptMerger->ivOrder[0], &ptMerger->ivOrder[1], ptMerger->nPending * sizeof(int));
+	ptMerger->ivFree[ptMerger->iNumFree++] = iSlot;
+
+}
+
+
+int mgInit(MgMerger* ptMerger, const int iExpected, const int iMaxDelay, const int iMaxPending, MgEmitter fEmit, void* pUserData) {
+
+	int i;
+
+	memset(ptMerger, 0, sizeof(MgMerger));
+	if(iExpected <= 0 || iExpected >= (1 << MG_NUM_SIDES) || iMaxPending <= 0 || iMaxPending > MG_MAX_PENDING || fEmit == NULL) return(1);
+	ptMerger->tvPool = malloc(iMaxPending * sizeof(MgBlock));
+	if(ptMerger->tvPool == NULL) return(2);
+	ptMerger->iExpected    = iExpected;
+	ptMerger->iMaxDelay    = iMaxDelay > 0 ? iMaxDelay : 0;
+	ptMerger->iMaxPending  = iMaxPending;
+	ptMerger->iLastEmitted = -1;
+	for(i=0; i<MG_NUM_SIDES; i++) ptMerger->ivLastSeen[i] = -1;
+	for(i=0; i<iMaxPending; i++) ptMerger->ivFree[i] = iMaxPending - 1 - i;
+	ptMerger->iNumFree  = iMaxPending;
+	ptMerger->fEmit     = fEmit;
+	ptMerger->pUserData = pUserData;
+	return(0);
+
+}
+
+
+void mgFree(MgMerger* ptMerger) {
+
+	free(ptMerger->tvPool);
+	ptMerger->tvPool = NULL;
+
+}
+
+
+int mgPush(MgMerger* ptMerger, const int iSide, const int iTimeStamp, const char* sFields, const int iNow) {
+
+	MgBlock* ptBlock = NULL;
+	int      iSlot;
+	int      iPos;
+	int      i;
+
+	if(iSide < 0 || iSide >= MG_NUM_SIDES) return(1);
+	if(iTimeStamp <= ptMerger->iLastEmitted) {
+		ptMerger->iLate++;
+		return(1);
+	}
+	if(iTimeStamp > ptMerger->ivLastSeen[iSide]) ptMerger->ivLastSeen[iSide] = iTimeStamp;
+
+	// Locate block, or the place for it (parts come mostly in order: search from newest)
+	for(iPos=ptMerger->nPending; iPos>0; iPos--) {
+		ptBlock = &ptMerger->tvPool[ptMerger->ivOrder[iPos-1]];
+		if(ptBlock->iTimeStamp <= iTimeStamp) break;
+	}
+	if(iPos > 0 && ptBlock->iTimeStamp == iTimeStamp) {
+		if(ptBlock->iSources & (1 << iSide)) ptMerger->iReplaced++;
+	}
+	else {
+
+		// New block: make room if needed, leaving the oldest one out
+		if(ptMerger->iNumFree <= 0) {
+			emitOldest(ptMerger);
+			ptMerger->iForced++;
+			iPos--;
+			if(iPos < 0) {		// Older than anything left: late, then
+				ptMerger->iLate++;
+				return(1);
+			}
+		}
+		iSlot = ptMerger->ivFree[--ptMerger->iNumFree];
+		memmove(&ptMerger->ivOrder[iPos+1], &ptMerger->ivOrder[iPos], (ptMerger->nPending - iPos) * sizeof(int));
+		ptMerger->ivOrder[iPos] = iSlot;
+		ptMerger->nPending++;
+		ptBlock = &ptMerger->tvPool[iSlot];
+		ptBlock->iTimeStamp = iTimeStamp;
+		ptBlock->iArrival   = iNow;
+		ptBlock->iSources   = 0;
+		for(i=0; i<MG_NUM_SIDES; i++) ptBlock->svFields[i][0] = '\0';
+
+	}
+	strncpy(ptBlock->svFields[iSide], sFields, MG_MAX_LINE - 1);
+	ptBlock->svFields[iSide][MG_MAX_LINE - 1] = '\0';
+	ptBlock->iSources |= 1 << iSide;
+
+	// Release what is ready
+	mgAdvance(ptMerger, iNow);
+	return(0);
+
+}
+
+
+void mgAdvance(MgMerger* ptMerger, const int iNow) {
+
+	while(ptMerger->nPending > 0 && isReady(ptMerger, &ptMerger->tvPool[ptMerger->ivOrder[0]], iNow)) {
+		emitOldest(ptMerger);
+	}
+
+}
+
+
+void mgFlush(MgMerger* ptMerger) {
+
+	while(ptMerger->nPending > 0) emitOldest(ptMerger);
+
+}
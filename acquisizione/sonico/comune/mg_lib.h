@@ -0,0 +1,64 @@
+/*
+
+	mg_lib - Time-aligned merge of the block results of two streams (sonic
+	         processed data and datalogger processed data), as they are
+	         produced: one record per averaging block, with bounded
+	         waiting for late parts.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#define MG_SONIC        0
+#define MG_LOGGER       1
+#define MG_NUM_SIDES    2
+#define MG_MAX_LINE  4096		// Fields of one side of a block, as text
+#define MG_MAX_PENDING 256
+
+// Block waiting for its parts; fields are kept as text, with the time stamp removed
+typedef struct MgBlock {
+	int  iTimeStamp;
+	int  iArrival;						// Epoch its first part arrived
+	int  iSources;						// Bit (1 << side) for each part arrived
+	char svFields[MG_NUM_SIDES][MG_MAX_LINE];
+} MgBlock;
+
+// Called on each block released, in time stamp order
+typedef void (*MgEmitter)(const MgBlock* ptBlock, void* pUserData);
+
+// Merger: blocks pending are kept sorted by time stamp, as indices into a
+// pool of slots
+typedef struct MgMerger {
+	int       iExpected;				// Sides expected, as bits
+	int       iMaxDelay;				// Seconds a block may wait for its missing parts
+	int       iMaxPending;
+	MgBlock*  tvPool;
+	int       ivFree[MG_MAX_PENDING];
+	int       iNumFree;
+	int       ivOrder[MG_MAX_PENDING];
+	int       nPending;
+	int       iLastEmitted;				// Time stamp; -1 if none yet
+	int       ivLastSeen[MG_NUM_SIDES];	// Latest time stamp of each side; -1 if none yet
+	MgEmitter fEmit;
+	void*     pUserData;
+	unsigned  iComplete;				// Blocks emitted with all parts
+	unsigned  iPartial;					// Blocks emitted with parts missing
+	unsigned  iForced;					// Of these, emitted early as buffer was full
+	unsigned  iLate;					// Parts discarded, as their block was emitted already
+	unsigned  iReplaced;				// Parts received twice (the latter is kept)
+} MgMerger;
+
+// Management; 'iExpected' has bits (1 << MG_SONIC) and/or (1 << MG_LOGGER), and
+// 'iMaxPending' at most MG_MAX_PENDING. Return 0 on success
+int  mgInit(MgMerger* ptMerger, const int iExpected, const int iMaxDelay, const int iMaxPending, MgEmitter fEmit, void* pUserData);
+void mgFree(MgMerger* ptMerger);
+
+// Add the part of block 'iTimeStamp' coming from 'iSide' at epoch 'iNow',
+// and release all blocks which are ready; return 0 if accepted, 1 if late
+int mgPush(MgMerger* ptMerger, const int iSide, const int iTimeStamp, const char* sFields, const int iNow);
+
+// Release blocks which have waited too long; release all of them at end
+void mgAdvance(MgMerger* ptMerger, const int iNow);
+void mgFlush(MgMerger* ptMerger);
@@ -0,0 +1,342 @@
+/*
+
+	qc_lib - Quality control of averaging blocks, coded in plain C.
+
+	All tests use what is gathered in the one pass made by 'qcAdd': sums
+	of powers up to the fourth of each sub-block, which become moments
+	merged into the block ones (or pairwise, for the discontinuity test),
+	a compact histogram of raw values, extrema, and the longest run of
+	equal consecutive values. The pass is a few additions and products
+	per value; all divisions are left to 'qcFinish'.
+	Tests and thresholds are those of Vickers and Mahrt (1997), with these
+	adaptations to single pass operation:
+
+	- Amplitude resolution: the 100 bins over min(range, 7 sigma) are
+	  filled from the histogram; when its bins are wider than raw units
+	  (large ranges), empty bins may go unnoticed, never the converse.
+	- Dropouts: runs of equal raw values, instead of runs within one of
+	  the 100 bins.
+	- Discontinuities: Haar transform of means over windows of one sixth
+	  of block, centred on sub-block boundaries.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "qc_lib.h"
+
+// Thresholds (raw units are cm/s and 1/100 °C)
+static const int    ivMinLimit[QC_NUM_CHANNELS] = {-3000, -3000, -500, -4000};
+static const int    ivMaxLimit[QC_NUM_CHANNELS] = { 3000,  3000,  500,  5000};
+static const double rMaxEmptyBins       = 0.70;		// Resolution: fraction of 100 bins
+static const double rMaxRunInner        = 0.10;		// Dropouts: fraction of data, values within 10-90 percentiles
+static const double rMaxRunOuter        = 0.06;		// Dropouts: fraction of data, other values
+static const double rSoftSkewness       = 1.0;
+static const double rHardSkewness       = 2.0;
+static const double rvSoftKurtosis[2]   = {2.0, 5.0};
+static const double rvHardKurtosis[2]   = {1.0, 8.0};
+static const double rSoftHaar           = 2.0;		// Discontinuities: mean jump, in standard deviations
+static const double rHardHaar           = 3.0;
+
+
+/**********************
+* Moments             *
+**********************/
+
+void qcMomentsClear(QcMoments* ptMoments) {
+	memset(ptMoments, 0, sizeof(QcMoments));
+}
+
+
+// Central moments from power sums about a shift close to the mean (the
+// first value of the block, here), so that cancellation stays harmless
+void qcMomentsFromSums(QcMoments* ptMoments, const double rN, const double rShift, const double rvSum[4]) {
+
+	double m1;
+
+	qcMomentsClear(ptMoments);
+	if(rN <= 0.) return;
+	m1 = rvSum[0] / rN;
+	ptMoments->rN    = rN;
+	ptMoments->rMean = rShift + m1;
+	ptMoments->rM2   = rvSum[1] - rN*m1*m1;
+	ptMoments->rM3   = rvSum[2] - 3.*m1*rvSum[1] + 2.*rN*m1*m1*m1;
+	ptMoments->rM4   = rvSum[3] - 4.*m1*rvSum[2] + 6.*m1*m1*rvSum[1] - 3.*rN*m1*m1*m1*m1;
+	if(ptMoments->rM2 < 0.) ptMoments->rM2 = 0.;
+
+}
+
+
+void qcMomentsMerge(QcMoments* ptInto, const QcMoments* ptFrom) {
+
+	const double na = ptInto->rN;
+	const double nb = ptFrom->rN;
+	const double n  = na + nb;
+	double       delta;
+	double       delta2;
+	QcMoments    tMerged;
+
+	if(nb <= 0.) return;
+	if(na <= 0.) {
+		*ptInto = *ptFrom;
+		return;
+	}
+	delta  = ptFrom->rMean - ptInto->rMean;
+	delta2 = delta * delta;
+	tMerged.rN    = n;
+	tMerged.rMean = ptInto->rMean + delta*nb/n;
+	tMerged.rM2   = ptInto->rM2 + ptFrom->rM2 + delta2*na*nb/n;
+	tMerged.rM3   = ptInto->rM3 + ptFrom->rM3 + delta2*delta*na*nb*(na - nb)/(n*n) + 3.*delta*(na*ptFrom->rM2 - nb*ptInto->rM2)/n;
+	tMerged.rM4   = ptInto->rM4 + ptFrom->rM4 + delta2*delta2*na*nb*(na*na - na*nb + nb*nb)/(n*n*n)
+	              + 6.*delta2*(na*na*ptFrom->rM2 + nb*nb*ptInto->rM2)/(n*n) + 4.*delta*(na*ptFrom->rM3 - nb*ptInto->rM3)/n;
+	*ptInto = tMerged;
+
+}
+
+
+/**********************
+* Histograms          *
+**********************/
+
+static void histWiden(QcHistogram* ptHist, const int iValue) {
+
+	int i;
+
+	// Double bin width, extending range on the side needed
+	if(iValue >= ptHist->iOrigin) {
+		for(i=0; i<QC_HIST_BINS/2; i++) ptHist->ivCount[i] = ptHist->ivCount[2*i] + ptHist->ivCount[2*i+1];
+		for(; i<QC_HIST_BINS; i++) ptHist->ivCount[i] = 0;
+	}
+	else {
+		for(i=QC_HIST_BINS-1; i>=QC_HIST_BINS/2; i--) {
+			ptHist->ivCount[i] = ptHist->ivCount[2*(i-QC_HIST_BINS/2)] + ptHist->ivCount[2*(i-QC_HIST_BINS/2)+1];
+		}
+		for(; i>=0; i--) ptHist->ivCount[i] = 0;
+		ptHist->iOrigin -= QC_HIST_BINS << ptHist->iShift;
+	}
+	ptHist->iShift++;
+
+}
+
+
+static void histAdd(QcHistogram* ptHist, const int iValue) {
+
+	unsigned iBin = (unsigned)(iValue - ptHist->iOrigin) >> ptHist->iShift;
+
+	while(iValue < ptHist->iOrigin || iBin >= QC_HIST_BINS) {
+		histWiden(ptHist, iValue);
+		iBin = (unsigned)(iValue - ptHist->iOrigin) >> ptHist->iShift;
+	}
+	ptHist->ivCount[iBin]++;
+
+}
+
+
+// Bin of 'iValue', -1 if below range, QC_HIST_BINS if above
+static int histBin(const QcHistogram* ptHist, const int iValue) {
+
+	int iBin;
+
+	if(iValue < ptHist->iOrigin) return(-1);
+	iBin = (iValue - ptHist->iOrigin) >> ptHist->iShift;
+	return(iBin < QC_HIST_BINS ? iBin : QC_HIST_BINS);
+
+}
+
+
+/**********************
+* Pass                *
+**********************/
+
+void qcBegin(QcState* ptState, const int iNumData) {
+
+	ptState->iNumData  = iNumData;
+	ptState->iNumValid = 0;
+	ptState->iSub      = 0;
+	ptState->iSubEnd   = iNumData / QC_NUM_SUBBLOCKS;
+	memset(ptState->ivCount, 0, sizeof(ptState->ivCount));
+	memset(ptState->rmSum, 0, sizeof(ptState->rmSum));
+	memset(ptState->tvHist, 0, sizeof(ptState->tvHist));
+	memset(ptState->ivMaxRun, 0, sizeof(ptState->ivMaxRun));
+
+}
+
+
+void qcAdd(QcState* ptState, const int iPos, const short ivRecord[5]) {
+
+	double* rvSum;
+	double  d, d2;
+	int     iValue;
+	int     j;
+
+	// Sub-block of position (positions come in increasing order)
+	while(iPos >= ptState->iSubEnd && ptState->iSub < QC_NUM_SUBBLOCKS - 1) {
+		ptState->iSub++;
+		ptState->iSubEnd = (int)((long long)(ptState->iSub + 1) * ptState->iNumData / QC_NUM_SUBBLOCKS);
+	}
+	if(ptState->iNumValid++ == 0) {
+		for(j=0; j<QC_NUM_CHANNELS; j++) {
+			iValue = ivRecord[j+1];
+			ptState->ivFirst[j]        = iValue;
+			ptState->tvHist[j].iOrigin = iValue - QC_HIST_BINS/2;
+			ptState->ivMin[j]  = ptState->ivMax[j] = iValue;
+			ptState->ivLast[j] = iValue;
+			ptState->ivRun[j]  = 0;
+		}
+	}
+	ptState->ivCount[ptState->iSub]++;
+	for(j=0; j<QC_NUM_CHANNELS; j++) {
+		iValue = ivRecord[j+1];
+
+		// Power sums
+		rvSum     = ptState->rmSum[j][ptState->iSub];
+		d         = iValue - ptState->ivFirst[j];
+		d2        = d*d;
+		rvSum[0] += d;
+		rvSum[1] += d2;
+		rvSum[2] += d2*d;
+		rvSum[3] += d2*d2;
+
+		// Histogram and extrema
+		histAdd(&ptState->tvHist[j], iValue);
+		if(iValue < ptState->ivMin[j]) ptState->ivMin[j] = iValue;
+		if(iValue > ptState->ivMax[j]) ptState->ivMax[j] = iValue;
+
+		// Runs of equal values
+		if(iValue == ptState->ivLast[j]) {
+			ptState->ivRun[j]++;
+		}
+		else {
+			ptState->ivLast[j] = iValue;
+			ptState->ivRun[j]  = 1;
+		}
+		if(ptState->ivRun[j] > ptState->ivMaxRun[j]) {
+			ptState->ivMaxRun[j]      = ptState->ivRun[j];
+			ptState->ivMaxRunValue[j] = iValue;
+		}
+	}
+
+}
+
+
+// Fraction of the 100 bins over min(range, 7 sigma), centred on mean, with no data
+static double emptyBinsFraction(const QcHistogram* ptHist, const double rMean, const double rSigma, const int iMin, const int iMax) {
+
+	const double rRange = fmin((double)(iMax - iMin), 7.*rSigma);
+	const double rFrom  = rMean - 0.5*rRange;
+	int          iEmpty = 0;
+	int          iLow, iHigh;
+	int          iBinLow, iBinHigh;
+	int          iBin;
+	int          b;
+
+	for(b=0; b<100; b++) {
+		iLow  = (int)ceil(rFrom + b*rRange/100.);
+		iHigh = b < 99 ? (int)ceil(rFrom + (b+1)*rRange/100.) - 1 : (int)floor(rFrom + rRange);
+		if(iHigh < iLow) {
+			iEmpty++;
+			continue;
+		}
+		iBinLow  = histBin(ptHist, iLow);
+		iBinHigh = histBin(ptHist, iHigh);
+		if(iBinLow < 0) iBinLow = 0;
+		if(iBinHigh >= QC_HIST_BINS) iBinHigh = QC_HIST_BINS - 1;
+		for(iBin=iBinLow; iBin<=iBinHigh; iBin++) {
+			if(ptHist->ivCount[iBin] > 0) break;
+		}
+		if(iBin > iBinHigh) iEmpty++;
+	}
+	return(iEmpty / 100.);
+
+}
+
+
+// Fraction of data below 'iValue', from histogram (half its bin counted)
+static double percentile(const QcHistogram* ptHist, const int iValue, const double rN) {
+
+	const int iBin = histBin(ptHist, iValue);
+	double    rBelow = 0.;
+	int       i;
+
+	for(i=0; i<iBin && i<QC_HIST_BINS; i++) rBelow += ptHist->ivCount[i];
+	if(iBin >= 0 && iBin < QC_HIST_BINS) rBelow += 0.5*ptHist->ivCount[iBin];
+	return(rBelow / rN);
+
+}
+
+
+static void worst(int ivCode[QC_NUM_TESTS], const int iTest, const int iCode) {
+	if(iCode > ivCode[iTest]) ivCode[iTest] = iCode;
+}
+
+
+void qcFinish(const QcState* ptState, int ivCode[QC_NUM_TESTS]) {
+
+	QcMoments tmSub[QC_NUM_SUBBLOCKS];
+	QcMoments tBlock;
+	QcMoments tLeft;
+	QcMoments tRight;
+	double    rSigma;
+	double    rSkewness;
+	double    rKurtosis;
+	double    rHaar;
+	double    rPct;
+	int       i, j;
+
+	for(i=0; i<QC_NUM_TESTS; i++) ivCode[i] = QC_PASSED;
+	for(j=0; j<QC_NUM_CHANNELS; j++) {
+
+		// Block moments, from sub-block ones
+		qcMomentsClear(&tBlock);
+		for(i=0; i<QC_NUM_SUBBLOCKS; i++) {
+			qcMomentsFromSums(&tmSub[i], ptState->ivCount[i], ptState->ivFirst[j], ptState->rmSum[j][i]);
+			qcMomentsMerge(&tBlock, &tmSub[i]);
+		}
+		if(tBlock.rN < 4.) continue;
+		rSigma = sqrt(tBlock.rM2 / tBlock.rN);
+
+		// Absolute limits
+		if(ptState->ivMin[j] < ivMinLimit[j] || ptState->ivMax[j] > ivMaxLimit[j]) worst(ivCode, QC_LIMITS, QC_HARD);
+
+		// Dropouts
+		rPct = percentile(&ptState->tvHist[j], ptState->ivMaxRunValue[j], tBlock.rN);
+		if(ptState->ivMaxRun[j] > (rPct >= 0.1 && rPct <= 0.9 ? rMaxRunInner : rMaxRunOuter) * tBlock.rN) worst(ivCode, QC_DROPOUTS, QC_HARD);
+
+		// Tests below need some variability
+		if(tBlock.rM2 <= 0.) continue;
+
+		// Amplitude resolution
+		if(emptyBinsFraction(&ptState->tvHist[j], tBlock.rMean, rSigma, ptState->ivMin[j], ptState->ivMax[j]) > rMaxEmptyBins) {
+			worst(ivCode, QC_RESOLUTION, QC_HARD);
+		}
+
+		// Skewness and kurtosis
+		rSkewness = sqrt(tBlock.rN) * tBlock.rM3 / pow(tBlock.rM2, 1.5);
+		rKurtosis = tBlock.rN * tBlock.rM4 / (tBlock.rM2 * tBlock.rM2);
+		if(fabs(rSkewness) > rHardSkewness || rKurtosis < rvHardKurtosis[0] || rKurtosis > rvHardKurtosis[1]) {
+			worst(ivCode, QC_MOMENTS, QC_HARD);
+		}
+		else if(fabs(rSkewness) > rSoftSkewness || rKurtosis < rvSoftKurtosis[0] || rKurtosis > rvSoftKurtosis[1]) {
+			worst(ivCode, QC_MOMENTS, QC_SOFT);
+		}
+
+		// Discontinuities: windows of two sub-blocks on each side of boundaries
+		for(i=2; i<=QC_NUM_SUBBLOCKS-2; i++) {
+			tLeft  = tmSub[i-2];
+			tRight = tmSub[i];
+			qcMomentsMerge(&tLeft, &tmSub[i-1]);
+			qcMomentsMerge(&tRight, &tmSub[i+1]);
+			if(tLeft.rN <= 0. || tRight.rN <= 0.) continue;
+			rHaar = fabs(tRight.rMean - tLeft.rMean) / rSigma;
+			if(rHaar > rHardHaar)      worst(ivCode, QC_DISCONTINUITIES, QC_HARD);
+			else if(rHaar > rSoftHaar) worst(ivCode, QC_DISCONTINUITIES, QC_SOFT);
+		}
+
+	}
+
+}
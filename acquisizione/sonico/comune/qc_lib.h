@@ -0,0 +1,77 @@
+/*
+
+	qc_lib - Quality control of averaging blocks, after Vickers and Mahrt
+	         (1997): amplitude resolution, dropouts, absolute limits,
+	         higher moments and discontinuities, from one pass over the
+	         raw records of a block.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#define QC_NUM_CHANNELS     4		// u, v, w, t
+#define QC_NUM_SUBBLOCKS   12		// Sub-blocks with moments of their own (discontinuity test)
+#define QC_HIST_BINS     1024		// Bins of compact histograms
+
+// Tests, and their result codes
+#define QC_RESOLUTION       0
+#define QC_DROPOUTS         1
+#define QC_LIMITS           2
+#define QC_MOMENTS          3
+#define QC_DISCONTINUITIES  4
+#define QC_NUM_TESTS        5
+
+#define QC_PASSED  0
+#define QC_SOFT    1		// Suspect: to be inspected
+#define QC_HARD    2		// Failed: flux to be rejected
+
+// Moments up to fourth order, mergeable (Pebay, 2008); M2, M3 and M4 are
+// sums of powers of deviations from mean
+typedef struct QcMoments {
+	double rN;
+	double rMean;
+	double rM2;
+	double rM3;
+	double rM4;
+} QcMoments;
+
+// Histogram of raw values on QC_HIST_BINS bins, whose width (a power of
+// two, in raw units) is doubled whenever a value falls out of range
+typedef struct QcHistogram {
+	int iOrigin;			// Lowest value of first bin
+	int iShift;				// Bin width is 2^iShift
+	int ivCount[QC_HIST_BINS];
+} QcHistogram;
+
+// State of the pass over one block
+typedef struct QcState {
+	int         iNumData;								// Records in block (valid or not)
+	int         iNumValid;
+	int         iSub;									// Current sub-block, and its end position
+	int         iSubEnd;
+	int         ivCount[QC_NUM_SUBBLOCKS];				// Values in sub-blocks
+	double      rmSum[QC_NUM_CHANNELS][QC_NUM_SUBBLOCKS][4];	// Sums of powers 1 to 4 of values less the first one
+	int         ivFirst[QC_NUM_CHANNELS];
+	QcHistogram tvHist[QC_NUM_CHANNELS];
+	int         ivMin[QC_NUM_CHANNELS];
+	int         ivMax[QC_NUM_CHANNELS];
+	int         ivLast[QC_NUM_CHANNELS];				// Runs of equal consecutive values
+	int         ivRun[QC_NUM_CHANNELS];
+	int         ivMaxRun[QC_NUM_CHANNELS];
+	int         ivMaxRunValue[QC_NUM_CHANNELS];
+} QcState;
+
+// Moments, from sums of powers 1 to 4 of 'rN' values less 'rShift', and merged
+void qcMomentsClear(QcMoments* ptMoments);
+void qcMomentsFromSums(QcMoments* ptMoments, const double rN, const double rShift, const double rvSum[4]);
+void qcMomentsMerge(QcMoments* ptInto, const QcMoments* ptFrom);
+
+// Pass: start it for a block of 'iNumData' records, add each valid record
+// ({time stamp, u, v, w, t} in cm/s and 1/100 °C) with its position in
+// block (in increasing order), then get the result codes of tests (worst
+// over channels)
+void qcBegin(QcState* ptState, const int iNumData);
+void qcAdd(QcState* ptState, const int iPos, const short ivRecord[5]);
+void qcFinish(const QcState* ptState, int ivCode[QC_NUM_TESTS]);
@@ -0,0 +1,1346 @@
+/*
+
+	sk_lib - Statistics kernels, with run time dispatch.
+
+	Each kernel exists in a plain C reference form and, where the
+	compiler targets it, in SSE4.2, AVX2 (x86) and NEON (ARM 64 bit)
+	forms. The x86 forms are compiled by function attributes, so the
+	library is built with no special flag and runs on any x86; the form
+	actually used is chosen once, at first use, among those the processor
+	supports.
+
+	A SIMD form is accepted only if it passes a self-check against the
+	reference on a synthetic block, else the reference is used:
+
+		- Integer moments (counts, sums, cross-products, extrema) and
+		  direction sectors are bit-exact.
+		- Floating point sums differ from reference by summation order
+		  only (relative difference below 1.e-12).
+		- The angle to horizontal plane is computed, in SIMD forms, by a
+		  rational approximation of arctangent (Cephes): error is within
+		  2 ulp of 'atan2', that is below 1.e-13 degrees.
+
+	Direction sectors are found with no 'atan2': after folding the
+	direction into the first quadrant the sector index is the number of
+	tangent thresholds (tan 11.25° and tan 33.75°, and their reciprocals)
+	exceeded, which costs four multiplications and compares per sample.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <math.h>
+
+#include "sk_lib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SK_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SK_ARM64
+#include <arm_neon.h>
+#endif
+
+#define SK_TO_DEGREES   (180./3.14159265358979323846)
+#define SK_PI_2          1.57079632679489661923
+#define SK_PI_4          0.78539816339744830962
+#define SK_MOREBITS      6.123233995736765886130E-17
+#define SK_TAN_11_25     0.19891236737965800607
+#define SK_TAN_33_75     0.66817863791929887896
+#define SK_MIN_VEL       1.e-6
+#define SK_INVALID_RAW   -9990
+
+// Cephes 'atan' rational approximation, valid in [-0.66, 0.66]
+static const double P_ATAN[5] = {
+	-8.750608600031904122785E-1,
+	-1.615753718733365076637E1,
+	-7.500855792314704667340E1,
+	-1.228866684490136173410E2,
+	-6.485021904942025371773E1
+};
+static const double Q_ATAN[5] = {
+	 2.485846490142306297962E1,
+	 1.650270098316988542046E2,
+	 4.328810604912902668951E2,
+	 4.853903996359136964868E2,
+	 1.945506571482613964425E2
+};
+
+
+/**************************
+* Reference kernels       *
+**************************/
+
+static void scalarWindSums(const double* rvU, const double* rvV, const double* rvW, const int n, SkWindSums* ptSums) {
+
+	double rVel;
+	double rPhi;
+	int    i;
+
+	for(i=0; i<n; i++) {
+		ptSums->rSumU += rvU[i];
+		ptSums->rSumV += rvV[i];
+		ptSums->rSumW += rvW[i];
+		rVel = sqrt(rvU[i]*rvU[i] + rvV[i]*rvV[i]);
+		ptSums->rSumVel  += rVel;
+		ptSums->rSumVel2 += rVel*rVel;
+		if(rVel > 0.) {
+			ptSums->rSumUnitU += rvU[i] / rVel;
+			ptSums->rSumUnitV += rvV[i] / rVel;
+		}
+		rPhi = SK_TO_DEGREES*atan2(rvW[i], rVel);
+		ptSums->rSumPhi  += rPhi;
+		ptSums->rSumPhi2 += rPhi*rPhi;
+	}
+	ptSums->n += n;
+
+}
+
+
+// Sector (0..15, 0 = North) of the direction wind comes from; -1 if calm
+static int windSector(const double u, const double v) {
+
+	double s = -u;
+	double c = -v;
+	double a, b;
+	int    q = 0;
+	int    m;
+
+	if(!(sqrt(u*u + v*v) > SK_MIN_VEL)) return(-1);
+
+	// Fold to first quadrant
+	if(s < 0. || (s == 0. && c < 0.)) {
+		s = -s;
+		c = -c;
+		q = 2;
+	}
+	if(c <= 0.) {
+		a = s;
+		b = -c;
+		q++;
+	}
+	else {
+		a = c;
+		b = s;
+	}
+
+	// Count thresholds exceeded
+	m = (b >= SK_TAN_11_25*a) + (b >= SK_TAN_33_75*a) + (b*SK_TAN_33_75 >= a) + (b*SK_TAN_11_25 >= a);
+	return((4*q + m) & 15);
+
+}
+
+
+static void scalarDirClassify(const double* rvU, const double* rvV, const int n, int* ivDirClass) {
+
+	int iSector;
+	int i;
+
+	for(i=0; i<n; i++) {
+		iSector = windSector(rvU[i], rvV[i]);
+		if(iSector >= 0) ivDirClass[iSector]++;
+	}
+
+}
+
+
+static void scalarAddMoments(const short int* ivU, const short int* ivV, const short int* ivW, const short int* ivT, const double* rvTimeStamp, const double rTimeFrom, const double rTimeTo, const int n, SkMoments* ptMoments) {
+
+	int32_t ivRaw[4];
+	int     i, j, k, l;
+
+	for(l=0; l<n; l++) {
+		if(rvTimeStamp != NULL && !(rTimeFrom < rvTimeStamp[l] && rvTimeStamp[l] <= rTimeTo)) continue;
+		if(ivU[l] <= SK_INVALID_RAW || ivV[l] <= SK_INVALID_RAW || ivW[l] <= SK_INVALID_RAW || ivT[l] <= SK_INVALID_RAW) continue;
+		ivRaw[0] = ivU[l];
+		ivRaw[1] = ivV[l];
+		ivRaw[2] = ivW[l];
+		ivRaw[3] = ivT[l];
+		ptMoments->n++;
+		for(i=0; i<4; i++) {
+			ptMoments->ivSum[i] += ivRaw[i];
+			if(ivRaw[i] < ptMoments->ivMin[i]) ptMoments->ivMin[i] = ivRaw[i];
+			if(ivRaw[i] > ptMoments->ivMax[i]) ptMoments->ivMax[i] = ivRaw[i];
+		}
+		k = 0;
+		for(i=0; i<4; i++) {
+			for(j=i; j<4; j++) {
+				ptMoments->ivCross[k++] += ivRaw[i]*ivRaw[j];
+			}
+		}
+		ptMoments->rSumVel += sqrt((double)(ivRaw[0]*ivRaw[0]) + (double)(ivRaw[1]*ivRaw[1]));
+	}
+
+}
+
+
+static void scalarMoveParticles(const int n, const double rDeltaT, double* x, double* y, double* z, const short int* isValid, const double* smpU, const double* smpV, const double* smpW) {
+
+	int i;
+
+	for(i=0; i<n; i++) {
+		if(isValid[i] > 0) {
+			x[i] += smpU[i] * rDeltaT;
+			y[i] += smpV[i] * rDeltaT;
+			z[i] += smpW[i] * rDeltaT;
+			if(z[i] < 0) z[i] = -z[i];
+		}
+	}
+
+}
+
+
+static const SkKernels tScalar = {
+	scalarWindSums,
+	scalarDirClassify,
+	scalarAddMoments,
+	scalarMoveParticles
+};
+
+
+/**************************
+* x86 kernels, SSE4.2     *
+**************************/
+
+#ifdef SK_X86
+
+// Arctangent of 0 <= x <= 1
+__attribute__((target("sse4.2")))
+static inline __m128d atanSse(const __m128d x) {
+
+	const __m128d one = _mm_set1_pd(1.);
+	__m128d big = _mm_cmpgt_pd(x, _mm_set1_pd(0.66));
+	__m128d xr  = _mm_blendv_pd(x, _mm_div_pd(_mm_sub_pd(x, one), _mm_add_pd(x, one)), big);
+	__m128d z   = _mm_mul_pd(xr, xr);
+	__m128d p   = _mm_set1_pd(P_ATAN[0]);
+	__m128d q   = _mm_add_pd(z, _mm_set1_pd(Q_ATAN[0]));
+	int     i;
+
+	for(i=1; i<5; i++) {
+		p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(P_ATAN[i]));
+		q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(Q_ATAN[i]));
+	}
+	z = _mm_div_pd(_mm_mul_pd(z, p), q);
+	z = _mm_add_pd(_mm_mul_pd(xr, z), xr);
+	z = _mm_add_pd(z, _mm_and_pd(big, _mm_set1_pd(0.5*SK_MOREBITS)));
+	return(_mm_add_pd(_mm_and_pd(big, _mm_set1_pd(SK_PI_4)), z));
+
+}
+
+
+// Arctangent of y/x, for x >= 0, as 'atan2'
+__attribute__((target("sse4.2")))
+static inline __m128d atan2Sse(const __m128d y, const __m128d x) {
+
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d sign = _mm_set1_pd(-0.);
+	__m128d a    = _mm_andnot_pd(sign, y);
+	__m128d big  = _mm_cmpgt_pd(a, x);
+	__m128d num  = _mm_min_pd(a, x);
+	__m128d den  = _mm_max_pd(a, x);
+	__m128d t    = _mm_blendv_pd(zero, _mm_div_pd(num, den), _mm_cmpgt_pd(den, zero));
+	__m128d r    = atanSse(t);
+
+	r = _mm_blendv_pd(r, _mm_sub_pd(_mm_set1_pd(SK_PI_2), r), big);
+	return(_mm_or_pd(r, _mm_and_pd(sign, y)));
+
+}
+
+
+__attribute__((target("sse4.2")))
+static double sumSse(const __m128d x) {
+
+	double rv[2];
+
+	_mm_storeu_pd(rv, x);
+	return(rv[0] + rv[1]);
+
+}
+
+
+__attribute__((target("sse4.2")))
+static void sseWindSums(const double* rvU, const double* rvV, const double* rvW, const int n, SkWindSums* ptSums) {
+
+	const __m128d zero    = _mm_setzero_pd();
+	const __m128d degrees = _mm_set1_pd(SK_TO_DEGREES);
+	__m128d sumU = zero, sumV = zero, sumW = zero;
+	__m128d sumVel = zero, sumVel2 = zero;
+	__m128d sumUnitU = zero, sumUnitV = zero;
+	__m128d sumPhi = zero, sumPhi2 = zero;
+	__m128d u, v, w, vel, pos, phi;
+	int     i;
+
+	for(i=0; i+2<=n; i+=2) {
+		u = _mm_loadu_pd(&rvU[i]);
+		v = _mm_loadu_pd(&rvV[i]);
+		w = _mm_loadu_pd(&rvW[i]);
+		sumU = _mm_add_pd(sumU, u);
+		sumV = _mm_add_pd(sumV, v);
+		sumW = _mm_add_pd(sumW, w);
+		vel  = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(u, u), _mm_mul_pd(v, v)));
+		sumVel  = _mm_add_pd(sumVel, vel);
+		sumVel2 = _mm_add_pd(sumVel2, _mm_mul_pd(vel, vel));
+		pos = _mm_cmpgt_pd(vel, zero);
+		sumUnitU = _mm_add_pd(sumUnitU, _mm_blendv_pd(zero, _mm_div_pd(u, vel), pos));
+		sumUnitV = _mm_add_pd(sumUnitV, _mm_blendv_pd(zero, _mm_div_pd(v, vel), pos));
+		phi = _mm_mul_pd(degrees, atan2Sse(w, vel));
+		sumPhi  = _mm_add_pd(sumPhi, phi);
+		sumPhi2 = _mm_add_pd(sumPhi2, _mm_mul_pd(phi, phi));
+	}
+	ptSums->rSumU     += sumSse(sumU);
+	ptSums->rSumV     += sumSse(sumV);
+	ptSums->rSumW     += sumSse(sumW);
+	ptSums->rSumVel   += sumSse(sumVel);
+	ptSums->rSumVel2  += sumSse(sumVel2);
+	ptSums->rSumUnitU += sumSse(sumUnitU);
+	ptSums->rSumUnitV += sumSse(sumUnitV);
+	ptSums->rSumPhi   += sumSse(sumPhi);
+	ptSums->rSumPhi2  += sumSse(sumPhi2);
+	ptSums->n += i;
+	scalarWindSums(&rvU[i], &rvV[i], &rvW[i], n-i, ptSums);
+
+}
+
+
+// Sector index as double, 16 if calm (see 'windSector')
+__attribute__((target("sse4.2")))
+static inline __m128d sectorSse(const __m128d u, const __m128d v) {
+
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d sign = _mm_set1_pd(-0.);
+	const __m128d one  = _mm_set1_pd(1.);
+	const __m128d t1   = _mm_set1_pd(SK_TAN_11_25);
+	const __m128d t2   = _mm_set1_pd(SK_TAN_33_75);
+	__m128d valid = _mm_cmpgt_pd(_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(u, u), _mm_mul_pd(v, v))), _mm_set1_pd(SK_MIN_VEL));
+	__m128d s     = _mm_xor_pd(u, sign);
+	__m128d c     = _mm_xor_pd(v, sign);
+	__m128d flip  = _mm_or_pd(_mm_cmplt_pd(s, zero), _mm_and_pd(_mm_cmpeq_pd(s, zero), _mm_cmplt_pd(c, zero)));
+	__m128d rot, a, b, q, m, k;
+
+	s   = _mm_blendv_pd(s, _mm_xor_pd(s, sign), flip);
+	c   = _mm_blendv_pd(c, _mm_xor_pd(c, sign), flip);
+	q   = _mm_and_pd(flip, _mm_set1_pd(2.));
+	rot = _mm_cmple_pd(c, zero);
+	a   = _mm_blendv_pd(c, s, rot);
+	b   = _mm_blendv_pd(s, _mm_xor_pd(c, sign), rot);
+	q   = _mm_add_pd(q, _mm_and_pd(rot, one));
+	m   = _mm_and_pd(_mm_cmpge_pd(b, _mm_mul_pd(t1, a)), one);
+	m   = _mm_add_pd(m, _mm_and_pd(_mm_cmpge_pd(b, _mm_mul_pd(t2, a)), one));
+	m   = _mm_add_pd(m, _mm_and_pd(_mm_cmpge_pd(_mm_mul_pd(b, t2), a), one));
+	m   = _mm_add_pd(m, _mm_and_pd(_mm_cmpge_pd(_mm_mul_pd(b, t1), a), one));
+	k   = _mm_add_pd(_mm_mul_pd(q, _mm_set1_pd(4.)), m);
+	k   = _mm_andnot_pd(_mm_cmpeq_pd(k, _mm_set1_pd(16.)), k);
+	return(_mm_blendv_pd(_mm_set1_pd(16.), k, valid));
+
+}
+
+
+__attribute__((target("sse4.2")))
+static void sseDirClassify(const double* rvU, const double* rvV, const int n, int* ivDirClass) {
+
+	int ivCount[17];
+	int ivSector[4];
+	int i;
+
+	memset(ivCount, 0, sizeof(ivCount));
+	for(i=0; i+2<=n; i+=2) {
+		_mm_storel_epi64((__m128i*)ivSector, _mm_cvttpd_epi32(sectorSse(_mm_loadu_pd(&rvU[i]), _mm_loadu_pd(&rvV[i]))));
+		ivCount[ivSector[0]]++;
+		ivCount[ivSector[1]]++;
+	}
+	scalarDirClassify(&rvU[i], &rvV[i], n-i, ivCount);
+	for(i=0; i<16; i++) ivDirClass[i] += ivCount[i];
+
+}
+
+
+// Lane mask (all ones if valid) of 4 samples, time window included
+__attribute__((target("sse4.2")))
+static inline __m128i validSse(const __m128i* x, const double* rvTimeStamp, const __m128d from, const __m128d to) {
+
+	const __m128i limit = _mm_set1_epi32(SK_INVALID_RAW);
+	__m128i valid = _mm_and_si128(
+		_mm_and_si128(_mm_cmpgt_epi32(x[0], limit), _mm_cmpgt_epi32(x[1], limit)),
+		_mm_and_si128(_mm_cmpgt_epi32(x[2], limit), _mm_cmpgt_epi32(x[3], limit))
+	);
+	__m128d ts0, ts1;
+	int     iBits;
+
+	if(rvTimeStamp != NULL) {
+		ts0   = _mm_loadu_pd(&rvTimeStamp[0]);
+		ts1   = _mm_loadu_pd(&rvTimeStamp[2]);
+		iBits = _mm_movemask_pd(_mm_and_pd(_mm_cmplt_pd(from, ts0), _mm_cmple_pd(ts0, to)))
+		      | _mm_movemask_pd(_mm_and_pd(_mm_cmplt_pd(from, ts1), _mm_cmple_pd(ts1, to))) << 2;
+		valid = _mm_and_si128(valid, _mm_cmpgt_epi32(_mm_and_si128(_mm_set1_epi32(iBits), _mm_setr_epi32(1, 2, 4, 8)), _mm_setzero_si128()));
+	}
+	return(valid);
+
+}
+
+
+__attribute__((target("sse4.2")))
+static void sseAddMoments(const short int* ivU, const short int* ivV, const short int* ivW, const short int* ivT, const double* rvTimeStamp, const double rTimeFrom, const double rTimeTo, const int n, SkMoments* ptMoments) {
+
+	const short int* ivvData[4] = {ivU, ivV, ivW, ivT};
+	const __m128d from = _mm_set1_pd(rTimeFrom);
+	const __m128d to   = _mm_set1_pd(rTimeTo);
+	__m128i x[4];
+	__m128i sum[4];
+	__m128i cross[10];
+	__m128i mn[4];
+	__m128i mx[4];
+	__m128i valid, p, uu, vv;
+	__m128d sumVel = _mm_setzero_pd();
+	int64_t ivAcc[2];
+	int32_t ivExt[4];
+	int     iNum = 0;
+	int     i, j, k, l;
+
+	for(j=0; j<4; j++) {
+		sum[j] = _mm_setzero_si128();
+		mn[j]  = _mm_set1_epi32(32767);
+		mx[j]  = _mm_set1_epi32(-32768);
+	}
+	for(k=0; k<10; k++) cross[k] = _mm_setzero_si128();
+
+	for(l=0; l+4<=n; l+=4) {
+		for(j=0; j<4; j++) x[j] = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)&ivvData[j][l]));
+		valid = validSse(x, rvTimeStamp != NULL ? &rvTimeStamp[l] : NULL, from, to);
+		iNum += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(valid)));
+		for(j=0; j<4; j++) {
+			mn[j] = _mm_min_epi32(mn[j], _mm_blendv_epi8(_mm_set1_epi32(32767), x[j], valid));
+			mx[j] = _mm_max_epi32(mx[j], _mm_blendv_epi8(_mm_set1_epi32(-32768), x[j], valid));
+			x[j]  = _mm_and_si128(x[j], valid);
+			sum[j] = _mm_add_epi64(sum[j], _mm_add_epi64(_mm_cvtepi32_epi64(x[j]), _mm_cvtepi32_epi64(_mm_srli_si128(x[j], 8))));
+		}
+		k = 0;
+		for(i=0; i<4; i++) {
+			for(j=i; j<4; j++) {
+				p = _mm_mullo_epi32(x[i], x[j]);
+				cross[k] = _mm_add_epi64(cross[k], _mm_add_epi64(_mm_cvtepi32_epi64(p), _mm_cvtepi32_epi64(_mm_srli_si128(p, 8))));
+				if(k == 0) uu = p;
+				if(k == 4) vv = p;
+				k++;
+			}
+		}
+		sumVel = _mm_add_pd(sumVel, _mm_sqrt_pd(_mm_add_pd(_mm_cvtepi32_pd(uu), _mm_cvtepi32_pd(vv))));
+		sumVel = _mm_add_pd(sumVel, _mm_sqrt_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(uu, 8)), _mm_cvtepi32_pd(_mm_srli_si128(vv, 8)))));
+	}
+
+	// Reduce lanes
+	ptMoments->n += iNum;
+	for(j=0; j<4; j++) {
+		_mm_storeu_si128((__m128i*)ivAcc, sum[j]);
+		ptMoments->ivSum[j] += ivAcc[0] + ivAcc[1];
+		_mm_storeu_si128((__m128i*)ivExt, mn[j]);
+		for(i=0; i<4; i++) if(ivExt[i] < ptMoments->ivMin[j]) ptMoments->ivMin[j] = ivExt[i];
+		_mm_storeu_si128((__m128i*)ivExt, mx[j]);
+		for(i=0; i<4; i++) if(ivExt[i] > ptMoments->ivMax[j]) ptMoments->ivMax[j] = ivExt[i];
+	}
+	for(k=0; k<10; k++) {
+		_mm_storeu_si128((__m128i*)ivAcc, cross[k]);
+		ptMoments->ivCross[k] += ivAcc[0] + ivAcc[1];
+	}
+	ptMoments->rSumVel += sumSse(sumVel);
+	scalarAddMoments(&ivU[l], &ivV[l], &ivW[l], &ivT[l], rvTimeStamp != NULL ? &rvTimeStamp[l] : NULL, rTimeFrom, rTimeTo, n-l, ptMoments);
+
+}
+
+
+__attribute__((target("sse4.2")))
+static void sseMoveParticles(const int n, const double rDeltaT, double* x, double* y, double* z, const short int* isValid, const double* smpU, const double* smpV, const double* smpW) {
+
+	const __m128d dt   = _mm_set1_pd(rDeltaT);
+	const __m128d zero = _mm_setzero_pd();
+	__m128d valid, px, py, pz;
+	int32_t iPair;
+	int     i;
+
+	for(i=0; i+2<=n; i+=2) {
+		memcpy(&iPair, &isValid[i], sizeof(iPair));
+		valid = _mm_castsi128_pd(_mm_cmpgt_epi64(_mm_cvtepi16_epi64(_mm_cvtsi32_si128(iPair)), _mm_setzero_si128()));
+		px = _mm_add_pd(_mm_loadu_pd(&x[i]), _mm_mul_pd(_mm_loadu_pd(&smpU[i]), dt));
+		py = _mm_add_pd(_mm_loadu_pd(&y[i]), _mm_mul_pd(_mm_loadu_pd(&smpV[i]), dt));
+		pz = _mm_add_pd(_mm_loadu_pd(&z[i]), _mm_mul_pd(_mm_loadu_pd(&smpW[i]), dt));
+		pz = _mm_blendv_pd(pz, _mm_sub_pd(zero, pz), _mm_cmplt_pd(pz, zero));
+		_mm_storeu_pd(&x[i], _mm_blendv_pd(_mm_loadu_pd(&x[i]), px, valid));
+		_mm_storeu_pd(&y[i], _mm_blendv_pd(_mm_loadu_pd(&y[i]), py, valid));
+		_mm_storeu_pd(&z[i], _mm_blendv_pd(_mm_loadu_pd(&z[i]), pz, valid));
+	}
+	scalarMoveParticles(n-i, rDeltaT, &x[i], &y[i], &z[i], &isValid[i], &smpU[i], &smpV[i], &smpW[i]);
+
+}
+
+
+static const SkKernels tSse = {
+	sseWindSums,
+	sseDirClassify,
+	sseAddMoments,
+	sseMoveParticles
+};
+
+#endif
+
+
+/**************************
+* x86 kernels, AVX2       *
+**************************/
+
+#ifdef SK_X86
+
+// Arctangent of 0 <= x <= 1
+__attribute__((target("avx2")))
+static inline __m256d atanAvx(const __m256d x) {
+
+	const __m256d one = _mm256_set1_pd(1.);
+	__m256d big = _mm256_cmp_pd(x, _mm256_set1_pd(0.66), _CMP_GT_OQ);
+	__m256d xr  = _mm256_blendv_pd(x, _mm256_div_pd(_mm256_sub_pd(x, one), _mm256_add_pd(x, one)), big);
+	__m256d z   = _mm256_mul_pd(xr, xr);
+	__m256d p   = _mm256_set1_pd(P_ATAN[0]);
+	__m256d q   = _mm256_add_pd(z, _mm256_set1_pd(Q_ATAN[0]));
+	int     i;
+
+	for(i=1; i<5; i++) {
+		p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(P_ATAN[i]));
+		q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(Q_ATAN[i]));
+	}
+	z = _mm256_div_pd(_mm256_mul_pd(z, p), q);
+	z = _mm256_add_pd(_mm256_mul_pd(xr, z), xr);
+	z = _mm256_add_pd(z, _mm256_and_pd(big, _mm256_set1_pd(0.5*SK_MOREBITS)));
+	return(_mm256_add_pd(_mm256_and_pd(big, _mm256_set1_pd(SK_PI_4)), z));
+
+}
+
+
+// Arctangent of y/x, for x >= 0, as 'atan2'
+__attribute__((target("avx2")))
+static inline __m256d atan2Avx(const __m256d y, const __m256d x) {
+
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d sign = _mm256_set1_pd(-0.);
+	__m256d a    = _mm256_andnot_pd(sign, y);
+	__m256d big  = _mm256_cmp_pd(a, x, _CMP_GT_OQ);
+	__m256d num  = _mm256_min_pd(a, x);
+	__m256d den  = _mm256_max_pd(a, x);
+	__m256d t    = _mm256_blendv_pd(zero, _mm256_div_pd(num, den), _mm256_cmp_pd(den, zero, _CMP_GT_OQ));
+	__m256d r    = atanAvx(t);
+
+	r = _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(SK_PI_2), r), big);
+	return(_mm256_or_pd(r, _mm256_and_pd(sign, y)));
+
+}
+
+
+__attribute__((target("avx2")))
+static double sumAvx(const __m256d x) {
+
+	double rv[4];
+
+	_mm256_storeu_pd(rv, x);
+	return((rv[0] + rv[1]) + (rv[2] + rv[3]));
+
+}
+
+
+__attribute__((target("avx2")))
+static int64_t sumAvxInt(const __m256i x) {
+
+	int64_t iv[4];
+
+	_mm256_storeu_si256((__m256i*)iv, x);
+	return(iv[0] + iv[1] + iv[2] + iv[3]);
+
+}
+
+
+__attribute__((target("avx2")))
+static void avxWindSums(const double* rvU, const double* rvV, const double* rvW, const int n, SkWindSums* ptSums) {
+
+	const __m256d zero    = _mm256_setzero_pd();
+	const __m256d degrees = _mm256_set1_pd(SK_TO_DEGREES);
+	__m256d sumU = zero, sumV = zero, sumW = zero;
+	__m256d sumVel = zero, sumVel2 = zero;
+	__m256d sumUnitU = zero, sumUnitV = zero;
+	__m256d sumPhi = zero, sumPhi2 = zero;
+	__m256d u, v, w, vel, pos, phi;
+	int     i;
+
+	for(i=0; i+4<=n; i+=4) {
+		u = _mm256_loadu_pd(&rvU[i]);
+		v = _mm256_loadu_pd(&rvV[i]);
+		w = _mm256_loadu_pd(&rvW[i]);
+		sumU = _mm256_add_pd(sumU, u);
+		sumV = _mm256_add_pd(sumV, v);
+		sumW = _mm256_add_pd(sumW, w);
+		vel  = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(u, u), _mm256_mul_pd(v, v)));
+		sumVel  = _mm256_add_pd(sumVel, vel);
+		sumVel2 = _mm256_add_pd(sumVel2, _mm256_mul_pd(vel, vel));
+		pos = _mm256_cmp_pd(vel, zero, _CMP_GT_OQ);
+		sumUnitU = _mm256_add_pd(sumUnitU, _mm256_blendv_pd(zero, _mm256_div_pd(u, vel), pos));
+		sumUnitV = _mm256_add_pd(sumUnitV, _mm256_blendv_pd(zero, _mm256_div_pd(v, vel), pos));
+		phi = _mm256_mul_pd(degrees, atan2Avx(w, vel));
+		sumPhi  = _mm256_add_pd(sumPhi, phi);
+		sumPhi2 = _mm256_add_pd(sumPhi2, _mm256_mul_pd(phi, phi));
+	}
+	ptSums->rSumU     += sumAvx(sumU);
+	ptSums->rSumV     += sumAvx(sumV);
+	ptSums->rSumW     += sumAvx(sumW);
+	ptSums->rSumVel   += sumAvx(sumVel);
+	ptSums->rSumVel2  += sumAvx(sumVel2);
+	ptSums->rSumUnitU += sumAvx(sumUnitU);
+	ptSums->rSumUnitV += sumAvx(sumUnitV);
+	ptSums->rSumPhi   += sumAvx(sumPhi);
+	ptSums->rSumPhi2  += sumAvx(sumPhi2);
+	ptSums->n += i;
+	scalarWindSums(&rvU[i], &rvV[i], &rvW[i], n-i, ptSums);
+
+}
+
+
+// Sector index as double, 16 if calm (see 'windSector')
+__attribute__((target("avx2")))
+static inline __m256d sectorAvx(const __m256d u, const __m256d v) {
+
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d sign = _mm256_set1_pd(-0.);
+	const __m256d one  = _mm256_set1_pd(1.);
+	const __m256d t1   = _mm256_set1_pd(SK_TAN_11_25);
+	const __m256d t2   = _mm256_set1_pd(SK_TAN_33_75);
+	__m256d valid = _mm256_cmp_pd(_mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(u, u), _mm256_mul_pd(v, v))), _mm256_set1_pd(SK_MIN_VEL), _CMP_GT_OQ);
+	__m256d s     = _mm256_xor_pd(u, sign);
+	__m256d c     = _mm256_xor_pd(v, sign);
+	__m256d flip  = _mm256_or_pd(_mm256_cmp_pd(s, zero, _CMP_LT_OQ), _mm256_and_pd(_mm256_cmp_pd(s, zero, _CMP_EQ_OQ), _mm256_cmp_pd(c, zero, _CMP_LT_OQ)));
+	__m256d rot, a, b, q, m, k;
+
+	s   = _mm256_blendv_pd(s, _mm256_xor_pd(s, sign), flip);
+	c   = _mm256_blendv_pd(c, _mm256_xor_pd(c, sign), flip);
+	q   = _mm256_and_pd(flip, _mm256_set1_pd(2.));
+	rot = _mm256_cmp_pd(c, zero, _CMP_LE_OQ);
+	a   = _mm256_blendv_pd(c, s, rot);
+	b   = _mm256_blendv_pd(s, _mm256_xor_pd(c, sign), rot);
+	q   = _mm256_add_pd(q, _mm256_and_pd(rot, one));
+	m   = _mm256_and_pd(_mm256_cmp_pd(b, _mm256_mul_pd(t1, a), _CMP_GE_OQ), one);
+	m   = _mm256_add_pd(m, _mm256_and_pd(_mm256_cmp_pd(b, _mm256_mul_pd(t2, a), _CMP_GE_OQ), one));
+	m   = _mm256_add_pd(m, _mm256_and_pd(_mm256_cmp_pd(_mm256_mul_pd(b, t2), a, _CMP_GE_OQ), one));
+	m   = _mm256_add_pd(m, _mm256_and_pd(_mm256_cmp_pd(_mm256_mul_pd(b, t1), a, _CMP_GE_OQ), one));
+	k   = _mm256_add_pd(_mm256_mul_pd(q, _mm256_set1_pd(4.)), m);
+	k   = _mm256_andnot_pd(_mm256_cmp_pd(k, _mm256_set1_pd(16.), _CMP_EQ_OQ), k);
+	return(_mm256_blendv_pd(_mm256_set1_pd(16.), k, valid));
+
+}
+
+
+__attribute__((target("avx2")))
+static void avxDirClassify(const double* rvU, const double* rvV, const int n, int* ivDirClass) {
+
+	int ivCount[17];
+	int ivSector[4];
+	int i;
+
+	memset(ivCount, 0, sizeof(ivCount));
+	for(i=0; i+4<=n; i+=4) {
+		_mm_storeu_si128((__m128i*)ivSector, _mm256_cvttpd_epi32(sectorAvx(_mm256_loadu_pd(&rvU[i]), _mm256_loadu_pd(&rvV[i]))));
+		ivCount[ivSector[0]]++;
+		ivCount[ivSector[1]]++;
+		ivCount[ivSector[2]]++;
+		ivCount[ivSector[3]]++;
+	}
+	scalarDirClassify(&rvU[i], &rvV[i], n-i, ivCount);
+	for(i=0; i<16; i++) ivDirClass[i] += ivCount[i];
+
+}
+
+
+// Lane mask (all ones if valid) of 8 samples, time window included
+__attribute__((target("avx2")))
+static inline __m256i validAvx(const __m256i* x, const double* rvTimeStamp, const __m256d from, const __m256d to) {
+
+	const __m256i limit = _mm256_set1_epi32(SK_INVALID_RAW);
+	__m256i valid = _mm256_and_si256(
+		_mm256_and_si256(_mm256_cmpgt_epi32(x[0], limit), _mm256_cmpgt_epi32(x[1], limit)),
+		_mm256_and_si256(_mm256_cmpgt_epi32(x[2], limit), _mm256_cmpgt_epi32(x[3], limit))
+	);
+	__m256d ts0, ts1;
+	int     iBits;
+
+	if(rvTimeStamp != NULL) {
+		ts0   = _mm256_loadu_pd(&rvTimeStamp[0]);
+		ts1   = _mm256_loadu_pd(&rvTimeStamp[4]);
+		iBits = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(from, ts0, _CMP_LT_OQ), _mm256_cmp_pd(ts0, to, _CMP_LE_OQ)))
+		      | _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(from, ts1, _CMP_LT_OQ), _mm256_cmp_pd(ts1, to, _CMP_LE_OQ))) << 4;
+		valid = _mm256_and_si256(valid, _mm256_cmpgt_epi32(_mm256_and_si256(_mm256_set1_epi32(iBits), _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)), _mm256_setzero_si256()));
+	}
+	return(valid);
+
+}
+
+
+// Add the eight 32 bit lanes of 'x' to the four 64 bit lanes of 'acc'
+__attribute__((target("avx2")))
+static inline __m256i addLongAvx(const __m256i acc, const __m256i x) {
+
+	return(_mm256_add_epi64(acc, _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)))));
+
+}
+
+
+__attribute__((target("avx2")))
+static void avxAddMoments(const short int* ivU, const short int* ivV, const short int* ivW, const short int* ivT, const double* rvTimeStamp, const double rTimeFrom, const double rTimeTo, const int n, SkMoments* ptMoments) {
+
+	const short int* ivvData[4] = {ivU, ivV, ivW, ivT};
+	const __m256d from = _mm256_set1_pd(rTimeFrom);
+	const __m256d to   = _mm256_set1_pd(rTimeTo);
+	__m256i x[4];
+	__m256i sum[4];
+	__m256i cross[10];
+	__m256i mn[4];
+	__m256i mx[4];
+	__m256i valid, p, uu, vv;
+	__m256d sumVel = _mm256_setzero_pd();
+	int32_t ivExt[8];
+	int     iNum = 0;
+	int     i, j, k, l;
+
+	for(j=0; j<4; j++) {
+		sum[j] = _mm256_setzero_si256();
+		mn[j]  = _mm256_set1_epi32(32767);
+		mx[j]  = _mm256_set1_epi32(-32768);
+	}
+	for(k=0; k<10; k++) cross[k] = _mm256_setzero_si256();
+
+	for(l=0; l+8<=n; l+=8) {
+		for(j=0; j<4; j++) x[j] = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&ivvData[j][l]));
+		valid = validAvx(x, rvTimeStamp != NULL ? &rvTimeStamp[l] : NULL, from, to);
+		iNum += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(valid)));
+		for(j=0; j<4; j++) {
+			mn[j]  = _mm256_min_epi32(mn[j], _mm256_blendv_epi8(_mm256_set1_epi32(32767), x[j], valid));
+			mx[j]  = _mm256_max_epi32(mx[j], _mm256_blendv_epi8(_mm256_set1_epi32(-32768), x[j], valid));
+			x[j]   = _mm256_and_si256(x[j], valid);
+			sum[j] = addLongAvx(sum[j], x[j]);
+		}
+		k = 0;
+		for(i=0; i<4; i++) {
+			for(j=i; j<4; j++) {
+				p = _mm256_mullo_epi32(x[i], x[j]);
+				cross[k] = addLongAvx(cross[k], p);
+				if(k == 0) uu = p;
+				if(k == 4) vv = p;
+				k++;
+			}
+		}
+		sumVel = _mm256_add_pd(sumVel, _mm256_sqrt_pd(_mm256_add_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(uu)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(vv)))));
+		sumVel = _mm256_add_pd(sumVel, _mm256_sqrt_pd(_mm256_add_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(uu, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(vv, 1)))));
+	}
+
+	// Reduce lanes
+	ptMoments->n += iNum;
+	for(j=0; j<4; j++) {
+		ptMoments->ivSum[j] += sumAvxInt(sum[j]);
+		_mm256_storeu_si256((__m256i*)ivExt, mn[j]);
+		for(i=0; i<8; i++) if(ivExt[i] < ptMoments->ivMin[j]) ptMoments->ivMin[j] = ivExt[i];
+		_mm256_storeu_si256((__m256i*)ivExt, mx[j]);
+		for(i=0; i<8; i++) if(ivExt[i] > ptMoments->ivMax[j]) ptMoments->ivMax[j] = ivExt[i];
+	}
+	for(k=0; k<10; k++) ptMoments->ivCross[k] += sumAvxInt(cross[k]);
+	ptMoments->rSumVel += sumAvx(sumVel);
+	scalarAddMoments(&ivU[l], &ivV[l], &ivW[l], &ivT[l], rvTimeStamp != NULL ? &rvTimeStamp[l] : NULL, rTimeFrom, rTimeTo, n-l, ptMoments);
+
+}
+
+
+__attribute__((target("avx2")))
+static void avxMoveParticles(const int n, const double rDeltaT, double* x, double* y, double* z, const short int* isValid, const double* smpU, const double* smpV, const double* smpW) {
+
+	const __m256d dt   = _mm256_set1_pd(rDeltaT);
+	const __m256d zero = _mm256_setzero_pd();
+	__m256d valid, px, py, pz;
+	int     i;
+
+	for(i=0; i+4<=n; i+=4) {
+		valid = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_cvtepi16_epi64(_mm_loadl_epi64((const __m128i*)&isValid[i])), _mm256_setzero_si256()));
+		px = _mm256_add_pd(_mm256_loadu_pd(&x[i]), _mm256_mul_pd(_mm256_loadu_pd(&smpU[i]), dt));
+		py = _mm256_add_pd(_mm256_loadu_pd(&y[i]), _mm256_mul_pd(_mm256_loadu_pd(&smpV[i]), dt));
+		pz = _mm256_add_pd(_mm256_loadu_pd(&z[i]), _mm256_mul_pd(_mm256_loadu_pd(&smpW[i]), dt));
+		pz = _mm256_blendv_pd(pz, _mm256_sub_pd(zero, pz), _mm256_cmp_pd(pz, zero, _CMP_LT_OQ));
+		_mm256_storeu_pd(&x[i], _mm256_blendv_pd(_mm256_loadu_pd(&x[i]), px, valid));
+		_mm256_storeu_pd(&y[i], _mm256_blendv_pd(_mm256_loadu_pd(&y[i]), py, valid));
+		_mm256_storeu_pd(&z[i], _mm256_blendv_pd(_mm256_loadu_pd(&z[i]), pz, valid));
+	}
+	scalarMoveParticles(n-i, rDeltaT, &x[i], &y[i], &z[i], &isValid[i], &smpU[i], &smpV[i], &smpW[i]);
+
+}
+
+
+static const SkKernels tAvx = {
+	avxWindSums,
+	avxDirClassify,
+	avxAddMoments,
+	avxMoveParticles
+};
+
+#endif
+
+
+/**************************
+* ARM 64 kernels, NEON    *
+**************************/
+
+#ifdef SK_ARM64
+
+#define NEON_AND_F64(mask, x) vreinterpretq_f64_u64(vandq_u64((mask), vreinterpretq_u64_f64(x)))
+
+// Arctangent of 0 <= x <= 1
+static inline float64x2_t atanNeon(const float64x2_t x) {
+
+	const float64x2_t one = vdupq_n_f64(1.);
+	uint64x2_t  big = vcgtq_f64(x, vdupq_n_f64(0.66));
+	float64x2_t xr  = vbslq_f64(big, vdivq_f64(vsubq_f64(x, one), vaddq_f64(x, one)), x);
+	float64x2_t z   = vmulq_f64(xr, xr);
+	float64x2_t p   = vdupq_n_f64(P_ATAN[0]);
+	float64x2_t q   = vaddq_f64(z, vdupq_n_f64(Q_ATAN[0]));
+	int         i;
+
+	for(i=1; i<5; i++) {
+		p = vaddq_f64(vmulq_f64(p, z), vdupq_n_f64(P_ATAN[i]));
+		q = vaddq_f64(vmulq_f64(q, z), vdupq_n_f64(Q_ATAN[i]));
+	}
+	z = vdivq_f64(vmulq_f64(z, p), q);
+	z = vaddq_f64(vmulq_f64(xr, z), xr);
+	z = vaddq_f64(z, NEON_AND_F64(big, vdupq_n_f64(0.5*SK_MOREBITS)));
+	return(vaddq_f64(NEON_AND_F64(big, vdupq_n_f64(SK_PI_4)), z));
+
+}
+
+
+// Arctangent of y/x, for x >= 0, as 'atan2'
+static inline float64x2_t atan2Neon(const float64x2_t y, const float64x2_t x) {
+
+	const float64x2_t zero = vdupq_n_f64(0.);
+	float64x2_t a   = vabsq_f64(y);
+	uint64x2_t  big = vcgtq_f64(a, x);
+	float64x2_t num = vminq_f64(a, x);
+	float64x2_t den = vmaxq_f64(a, x);
+	float64x2_t t   = vbslq_f64(vcgtq_f64(den, zero), vdivq_f64(num, den), zero);
+	float64x2_t r   = atanNeon(t);
+
+	r = vbslq_f64(big, vsubq_f64(vdupq_n_f64(SK_PI_2), r), r);
+	return(vbslq_f64(vcltq_f64(y, zero), vnegq_f64(r), r));
+
+}
+
+
+static void neonWindSums(const double* rvU, const double* rvV, const double* rvW, const int n, SkWindSums* ptSums) {
+
+	const float64x2_t zero    = vdupq_n_f64(0.);
+	const float64x2_t degrees = vdupq_n_f64(SK_TO_DEGREES);
+	float64x2_t sumU = zero, sumV = zero, sumW = zero;
+	float64x2_t sumVel = zero, sumVel2 = zero;
+	float64x2_t sumUnitU = zero, sumUnitV = zero;
+	float64x2_t sumPhi = zero, sumPhi2 = zero;
+	float64x2_t u, v, w, vel, phi;
+	uint64x2_t  pos;
+	int         i;
+
+	for(i=0; i+2<=n; i+=2) {
+		u = vld1q_f64(&rvU[i]);
+		v = vld1q_f64(&rvV[i]);
+		w = vld1q_f64(&rvW[i]);
+		sumU = vaddq_f64(sumU, u);
+		sumV = vaddq_f64(sumV, v);
+		sumW = vaddq_f64(sumW, w);
+		vel  = vsqrtq_f64(vaddq_f64(vmulq_f64(u, u), vmulq_f64(v, v)));
+		sumVel  = vaddq_f64(sumVel, vel);
+		sumVel2 = vaddq_f64(sumVel2, vmulq_f64(vel, vel));
+		pos = vcgtq_f64(vel, zero);
+		sumUnitU = vaddq_f64(sumUnitU, vbslq_f64(pos, vdivq_f64(u, vel), zero));
+		sumUnitV = vaddq_f64(sumUnitV, vbslq_f64(pos, vdivq_f64(v, vel), zero));
+		phi = vmulq_f64(degrees, atan2Neon(w, vel));
+		sumPhi  = vaddq_f64(sumPhi, phi);
+		sumPhi2 = vaddq_f64(sumPhi2, vmulq_f64(phi, phi));
+	}
+	ptSums->rSumU     += vaddvq_f64(sumU);
+	ptSums->rSumV     += vaddvq_f64(sumV);
+	ptSums->rSumW     += vaddvq_f64(sumW);
+	ptSums->rSumVel   += vaddvq_f64(sumVel);
+	ptSums->rSumVel2  += vaddvq_f64(sumVel2);
+	ptSums->rSumUnitU += vaddvq_f64(sumUnitU);
+	ptSums->rSumUnitV += vaddvq_f64(sumUnitV);
+	ptSums->rSumPhi   += vaddvq_f64(sumPhi);
+	ptSums->rSumPhi2  += vaddvq_f64(sumPhi2);
+	ptSums->n += i;
+	scalarWindSums(&rvU[i], &rvV[i], &rvW[i], n-i, ptSums);
+
+}
+
+
+// Sector index, 16 if calm (see 'windSector')
+static inline int64x2_t sectorNeon(const float64x2_t u, const float64x2_t v) {
+
+	const float64x2_t zero = vdupq_n_f64(0.);
+	const float64x2_t one  = vdupq_n_f64(1.);
+	const float64x2_t t1   = vdupq_n_f64(SK_TAN_11_25);
+	const float64x2_t t2   = vdupq_n_f64(SK_TAN_33_75);
+	uint64x2_t  valid = vcgtq_f64(vsqrtq_f64(vaddq_f64(vmulq_f64(u, u), vmulq_f64(v, v))), vdupq_n_f64(SK_MIN_VEL));
+	float64x2_t s     = vnegq_f64(u);
+	float64x2_t c     = vnegq_f64(v);
+	uint64x2_t  flip  = vorrq_u64(vcltq_f64(s, zero), vandq_u64(vceqq_f64(s, zero), vcltq_f64(c, zero)));
+	uint64x2_t  rot;
+	float64x2_t a, b, q, m, k;
+
+	s   = vbslq_f64(flip, vnegq_f64(s), s);
+	c   = vbslq_f64(flip, vnegq_f64(c), c);
+	q   = NEON_AND_F64(flip, vdupq_n_f64(2.));
+	rot = vcleq_f64(c, zero);
+	a   = vbslq_f64(rot, s, c);
+	b   = vbslq_f64(rot, vnegq_f64(c), s);
+	q   = vaddq_f64(q, NEON_AND_F64(rot, one));
+	m   = NEON_AND_F64(vcgeq_f64(b, vmulq_f64(t1, a)), one);
+	m   = vaddq_f64(m, NEON_AND_F64(vcgeq_f64(b, vmulq_f64(t2, a)), one));
+	m   = vaddq_f64(m, NEON_AND_F64(vcgeq_f64(vmulq_f64(b, t2), a), one));
+	m   = vaddq_f64(m, NEON_AND_F64(vcgeq_f64(vmulq_f64(b, t1), a), one));
+	k   = vaddq_f64(vmulq_f64(q, vdupq_n_f64(4.)), m);
+	k   = vbslq_f64(vceqq_f64(k, vdupq_n_f64(16.)), zero, k);
+	return(vcvtq_s64_f64(vbslq_f64(valid, k, vdupq_n_f64(16.))));
+
+}
+
+
+static void neonDirClassify(const double* rvU, const double* rvV, const int n, int* ivDirClass) {
+
+	int       ivCount[17];
+	int64x2_t k;
+	int       i;
+
+	memset(ivCount, 0, sizeof(ivCount));
+	for(i=0; i+2<=n; i+=2) {
+		k = sectorNeon(vld1q_f64(&rvU[i]), vld1q_f64(&rvV[i]));
+		ivCount[vgetq_lane_s64(k, 0)]++;
+		ivCount[vgetq_lane_s64(k, 1)]++;
+	}
+	scalarDirClassify(&rvU[i], &rvV[i], n-i, ivCount);
+	for(i=0; i<16; i++) ivDirClass[i] += ivCount[i];
+
+}
+
+
+static void neonAddMoments(const short int* ivU, const short int* ivV, const short int* ivW, const short int* ivT, const double* rvTimeStamp, const double rTimeFrom, const double rTimeTo, const int n, SkMoments* ptMoments) {
+
+	const short int* ivvData[4] = {ivU, ivV, ivW, ivT};
+	const int32x4_t   limit = vdupq_n_s32(SK_INVALID_RAW);
+	const float64x2_t from  = vdupq_n_f64(rTimeFrom);
+	const float64x2_t to    = vdupq_n_f64(rTimeTo);
+	int32x4_t   x[4];
+	int64x2_t   sum[4];
+	int64x2_t   cross[10];
+	int32x4_t   mn[4];
+	int32x4_t   mx[4];
+	uint32x4_t  valid;
+	uint32x4_t  count = vdupq_n_u32(0);
+	int32x4_t   p, uu, vv;
+	float64x2_t ts0, ts1;
+	float64x2_t sumVel = vdupq_n_f64(0.);
+	int         i, j, k, l;
+
+	for(j=0; j<4; j++) {
+		sum[j] = vdupq_n_s64(0);
+		mn[j]  = vdupq_n_s32(32767);
+		mx[j]  = vdupq_n_s32(-32768);
+	}
+	for(k=0; k<10; k++) cross[k] = vdupq_n_s64(0);
+
+	for(l=0; l+4<=n; l+=4) {
+		for(j=0; j<4; j++) x[j] = vmovl_s16(vld1_s16(&ivvData[j][l]));
+		valid = vandq_u32(
+			vandq_u32(vcgtq_s32(x[0], limit), vcgtq_s32(x[1], limit)),
+			vandq_u32(vcgtq_s32(x[2], limit), vcgtq_s32(x[3], limit))
+		);
+		if(rvTimeStamp != NULL) {
+			ts0   = vld1q_f64(&rvTimeStamp[l]);
+			ts1   = vld1q_f64(&rvTimeStamp[l+2]);
+			valid = vandq_u32(valid, vcombine_u32(
+				vmovn_u64(vandq_u64(vcltq_f64(from, ts0), vcleq_f64(ts0, to))),
+				vmovn_u64(vandq_u64(vcltq_f64(from, ts1), vcleq_f64(ts1, to)))
+			));
+		}
+		count = vsubq_u32(count, valid);
+		for(j=0; j<4; j++) {
+			mn[j]  = vminq_s32(mn[j], vbslq_s32(valid, x[j], vdupq_n_s32(32767)));
+			mx[j]  = vmaxq_s32(mx[j], vbslq_s32(valid, x[j], vdupq_n_s32(-32768)));
+			x[j]   = vreinterpretq_s32_u32(vandq_u32(vreinterpretq_u32_s32(x[j]), valid));
+			sum[j] = vpadalq_s32(sum[j], x[j]);
+		}
+		k = 0;
+		for(i=0; i<4; i++) {
+			for(j=i; j<4; j++) {
+				p = vmulq_s32(x[i], x[j]);
+				cross[k] = vpadalq_s32(cross[k], p);
+				if(k == 0) uu = p;
+				if(k == 4) vv = p;
+				k++;
+			}
+		}
+		sumVel = vaddq_f64(sumVel, vsqrtq_f64(vaddq_f64(vcvtq_f64_s64(vmovl_s32(vget_low_s32(uu))), vcvtq_f64_s64(vmovl_s32(vget_low_s32(vv))))));
+		sumVel = vaddq_f64(sumVel, vsqrtq_f64(vaddq_f64(vcvtq_f64_s64(vmovl_high_s32(uu)), vcvtq_f64_s64(vmovl_high_s32(vv)))));
+	}
+
+	// Reduce lanes
+	ptMoments->n += vaddvq_u32(count);
+	for(j=0; j<4; j++) {
+		ptMoments->ivSum[j] += vaddvq_s64(sum[j]);
+		if(vminvq_s32(mn[j]) < ptMoments->ivMin[j]) ptMoments->ivMin[j] = vminvq_s32(mn[j]);
+		if(vmaxvq_s32(mx[j]) > ptMoments->ivMax[j]) ptMoments->ivMax[j] = vmaxvq_s32(mx[j]);
+	}
+	for(k=0; k<10; k++) ptMoments->ivCross[k] += vaddvq_s64(cross[k]);
+	ptMoments->rSumVel += vaddvq_f64(sumVel);
+	scalarAddMoments(&ivU[l], &ivV[l], &ivW[l], &ivT[l], rvTimeStamp != NULL ? &rvTimeStamp[l] : NULL, rTimeFrom, rTimeTo, n-l, ptMoments);
+
+}
+
+
+static void neonMoveParticles(const int n, const double rDeltaT, double* x, double* y, double* z, const short int* isValid, const double* smpU, const double* smpV, const double* smpW) {
+
+	const float64x2_t dt   = vdupq_n_f64(rDeltaT);
+	const float64x2_t zero = vdupq_n_f64(0.);
+	int32x4_t   iv;
+	uint64x2_t  valid;
+	float64x2_t px, py, pz;
+	int         i, j;
+
+	for(i=0; i+4<=n; i+=4) {
+		iv = vmovl_s16(vld1_s16(&isValid[i]));
+		for(j=0; j<4; j+=2) {
+			valid = vcgtq_s64(j == 0 ? vmovl_s32(vget_low_s32(iv)) : vmovl_high_s32(iv), vdupq_n_s64(0));
+			px = vaddq_f64(vld1q_f64(&x[i+j]), vmulq_f64(vld1q_f64(&smpU[i+j]), dt));
+			py = vaddq_f64(vld1q_f64(&y[i+j]), vmulq_f64(vld1q_f64(&smpV[i+j]), dt));
+			pz = vaddq_f64(vld1q_f64(&z[i+j]), vmulq_f64(vld1q_f64(&smpW[i+j]), dt));
+			pz = vbslq_f64(vcltq_f64(pz, zero), vnegq_f64(pz), pz);
+			vst1q_f64(&x[i+j], vbslq_f64(valid, px, vld1q_f64(&x[i+j])));
+			vst1q_f64(&y[i+j], vbslq_f64(valid, py, vld1q_f64(&y[i+j])));
+			vst1q_f64(&z[i+j], vbslq_f64(valid, pz, vld1q_f64(&z[i+j])));
+		}
+	}
+	scalarMoveParticles(n-i, rDeltaT, &x[i], &y[i], &z[i], &isValid[i], &smpU[i], &smpV[i], &smpW[i]);
+
+}
+
+
+static const SkKernels tNeon = {
+	neonWindSums,
+	neonDirClassify,
+	neonAddMoments,
+	neonMoveParticles
+};
+
+#endif
+
+
+/**************************
+* Dispatch                *
+**************************/
+
+#define SK_CHECK_SIZE 251	// Odd, so that remainders of vector loops are checked too
+
+static const SkKernels* ptKernels = NULL;
+static int              iKernels  = SK_SCALAR;
+
+
+const SkKernels* skKernels(const int iImpl) {
+
+	switch(iImpl) {
+	case SK_SCALAR:
+		return(&tScalar);
+#ifdef SK_X86
+	case SK_SSE42:
+		return(&tSse);
+	case SK_AVX2:
+		return(&tAvx);
+#endif
+#ifdef SK_ARM64
+	case SK_NEON:
+		return(&tNeon);
+#endif
+	}
+	return(NULL);
+
+}
+
+
+static int isSupported(const int iImpl) {
+
+#ifdef SK_X86
+	__builtin_cpu_init();
+	if(iImpl == SK_SSE42) return(__builtin_cpu_supports("sse4.2"));
+	if(iImpl == SK_AVX2)  return(__builtin_cpu_supports("avx2"));
+#endif
+#ifdef SK_ARM64
+	if(iImpl == SK_NEON) return(1);		// Advanced SIMD is mandatory on ARMv8-A
+#endif
+	return(iImpl == SK_SCALAR);
+
+}
+
+
+static unsigned int nextRandom(unsigned int* piSeed) {
+
+	*piSeed = *piSeed * 1103515245u + 12345u;
+	return((*piSeed >> 8) & 0xffff);
+
+}
+
+
+static int isClose(const double rRef, const double rTest, const double rScale) {
+
+	return(fabs(rTest - rRef) <= 1.e-12 * fmax(fabs(rRef), rScale));
+
+}
+
+
+static int sameMoments(const SkMoments* ptRef, const SkMoments* ptTest) {
+
+	int i;
+
+	if(ptRef->n != ptTest->n) return(0);
+	for(i=0; i<4; i++) {
+		if(ptRef->ivSum[i] != ptTest->ivSum[i]) return(0);
+		if(ptRef->ivMin[i] != ptTest->ivMin[i]) return(0);
+		if(ptRef->ivMax[i] != ptTest->ivMax[i]) return(0);
+	}
+	for(i=0; i<10; i++) {
+		if(ptRef->ivCross[i] != ptTest->ivCross[i]) return(0);
+	}
+	return(isClose(ptRef->rSumVel, ptTest->rSumVel, 1.));
+
+}
+
+
+// Compare an implementation with reference on a synthetic block; return 0 if equivalent
+static int selfCheck(const SkKernels* ptTest) {
+
+	const int  n = SK_CHECK_SIZE;
+	double     rvU[SK_CHECK_SIZE], rvV[SK_CHECK_SIZE], rvW[SK_CHECK_SIZE];
+	double     rvTimeStamp[SK_CHECK_SIZE];
+	double     rvX[2][SK_CHECK_SIZE], rvY[2][SK_CHECK_SIZE], rvZ[2][SK_CHECK_SIZE];
+	short int  ivU[SK_CHECK_SIZE], ivV[SK_CHECK_SIZE], ivW[SK_CHECK_SIZE], ivT[SK_CHECK_SIZE];
+	short int  ivValid[SK_CHECK_SIZE];
+	SkWindSums tSumsRef, tSumsTest;
+	SkMoments  tMomRef, tMomTest;
+	int        ivDirRef[16], ivDirTest[16];
+	unsigned int iSeed = 2012;
+	int        i, j;
+
+	// Synthetic block: winds from any direction, calms, directions along axes,
+	// invalid and extreme raw values
+	for(i=0; i<n; i++) {
+		rvU[i] = ((int)nextRandom(&iSeed) - 32768) / 2000.;
+		rvV[i] = ((int)nextRandom(&iSeed) - 32768) / 2000.;
+		rvW[i] = ((int)nextRandom(&iSeed) - 32768) / 10000.;
+		if(i % 29 == 0) {
+			rvU[i] = 0.;
+			rvV[i] = 0.;
+		}
+		if(i % 31 == 0) {
+			rvU[i] = 0.;
+			rvV[i] = -(i % 7);
+		}
+		if(i % 37 == 0) {
+			rvU[i] = i % 5 - 2.;
+			rvV[i] = 0.;
+		}
+		ivU[i] = (int)(nextRandom(&iSeed) % 6001) - 3000;
+		ivV[i] = (int)(nextRandom(&iSeed) % 6001) - 3000;
+		ivW[i] = (int)(nextRandom(&iSeed) % 1001) - 500;
+		ivT[i] = (int)(nextRandom(&iSeed) % 1500) + 1500;
+		if(i % 13 == 0) ivW[i] = -9999;
+		if(i % 17 == 0) ivT[i] = -9990;
+		if(i % 19 == 0) {
+			ivU[i] = 32767;
+			ivV[i] = -9989;
+		}
+		rvTimeStamp[i] = 0.1 * i;
+		ivValid[i] = (i % 5 != 0);
+		rvX[0][i] = rvX[1][i] = nextRandom(&iSeed) / 100.;
+		rvY[0][i] = rvY[1][i] = nextRandom(&iSeed) / 100.;
+		rvZ[0][i] = rvZ[1][i] = (nextRandom(&iSeed) % 100) / 100.;
+	}
+
+	// Wind sums
+	memset(&tSumsRef,  0, sizeof(tSumsRef));
+	memset(&tSumsTest, 0, sizeof(tSumsTest));
+	tScalar.windSums(rvU, rvV, rvW, n, &tSumsRef);
+	ptTest->windSums(rvU, rvV, rvW, n, &tSumsTest);
+	if(tSumsRef.n != tSumsTest.n) return(1);
+	if(!isClose(tSumsRef.rSumU, tSumsTest.rSumU, n)) return(1);
+	if(!isClose(tSumsRef.rSumV, tSumsTest.rSumV, n)) return(1);
+	if(!isClose(tSumsRef.rSumW, tSumsTest.rSumW, n)) return(1);
+	if(!isClose(tSumsRef.rSumVel, tSumsTest.rSumVel, n)) return(1);
+	if(!isClose(tSumsRef.rSumVel2, tSumsTest.rSumVel2, n)) return(1);
+	if(!isClose(tSumsRef.rSumUnitU, tSumsTest.rSumUnitU, n)) return(1);
+	if(!isClose(tSumsRef.rSumUnitV, tSumsTest.rSumUnitV, n)) return(1);
+	if(!isClose(tSumsRef.rSumPhi, tSumsTest.rSumPhi, n)) return(1);
+	if(!isClose(tSumsRef.rSumPhi2, tSumsTest.rSumPhi2, n)) return(1);
+
+	// Direction classes
+	memset(ivDirRef,  0, sizeof(ivDirRef));
+	memset(ivDirTest, 0, sizeof(ivDirTest));
+	tScalar.dirClassify(rvU, rvV, n, ivDirRef);
+	ptTest->dirClassify(rvU, rvV, n, ivDirTest);
+	if(memcmp(ivDirRef, ivDirTest, sizeof(ivDirRef)) != 0) return(2);
+
+	// Moments, on whole block and on a time window
+	skClearMoments(&tMomRef);
+	skClearMoments(&tMomTest);
+	tScalar.addMoments(ivU, ivV, ivW, ivT, NULL, 0., 0., n, &tMomRef);
+	ptTest->addMoments(ivU, ivV, ivW, ivT, NULL, 0., 0., n, &tMomTest);
+	if(!sameMoments(&tMomRef, &tMomTest)) return(3);
+	skClearMoments(&tMomRef);
+	skClearMoments(&tMomTest);
+	tScalar.addMoments(ivU, ivV, ivW, ivT, rvTimeStamp, 1.05, 17.3, n, &tMomRef);
+	ptTest->addMoments(ivU, ivV, ivW, ivT, rvTimeStamp, 1.05, 17.3, n, &tMomTest);
+	if(!sameMoments(&tMomRef, &tMomTest)) return(3);
+
+	// Particles
+	tScalar.moveParticles(n, 0.1, rvX[0], rvY[0], rvZ[0], ivValid, rvU, rvV, rvW);
+	ptTest->moveParticles(n, 0.1, rvX[1], rvY[1], rvZ[1], ivValid, rvU, rvV, rvW);
+	for(j=0; j<n; j++) {
+		if(!isClose(rvX[0][j], rvX[1][j], 1.) || !isClose(rvY[0][j], rvY[1][j], 1.) || !isClose(rvZ[0][j], rvZ[1][j], 1.)) return(4);
+	}
+
+	// Leave
+	return(0);
+
+}
+
+
+static int trySelect(const int iImpl) {
+
+	const SkKernels* ptTest = skKernels(iImpl);
+
+	if(ptTest == NULL || !isSupported(iImpl)) return(-1);
+	if(iImpl != SK_SCALAR && selfCheck(ptTest) != 0) return(-1);
+	ptKernels = ptTest;
+	iKernels  = iImpl;
+	return(0);
+
+}
+
+
+// Select implementation to use, or the fastest (SK_BEST); return the one
+// selected, or -1 if the one desired is not available or failed self-check
+int skSelect(const int iImpl) {
+
+	const int ivPreference[SK_NUM_IMPL] = {SK_AVX2, SK_SSE42, SK_NEON, SK_SCALAR};
+	int i;
+
+	if(iImpl != SK_BEST) {
+		return(trySelect(iImpl) == 0 ? iImpl : -1);
+	}
+	for(i=0; i<SK_NUM_IMPL; i++) {
+		if(trySelect(ivPreference[i]) == 0) return(ivPreference[i]);
+	}
+	return(-1);		// Not reached: reference is always available
+
+}
+
+
+int skCurrent(void) {
+
+	if(ptKernels == NULL) skSelect(SK_BEST);
+	return(iKernels);
+
+}
+
+
+const char* skName(const int iImpl) {
+
+	switch(iImpl) {
+	case SK_SCALAR:
+		return("scalar");
+	case SK_SSE42:
+		return("sse4.2");
+	case SK_AVX2:
+		return("avx2");
+	case SK_NEON:
+		return("neon");
+	}
+	return("unknown");
+
+}
+
+
+// Select at program start, before any thread may use kernels
+#ifdef __GNUC__
+__attribute__((constructor))
+static void selectAtStart(void) {
+
+	skSelect(SK_BEST);
+
+}
+#endif
+
+
+static const SkKernels* kernels(void) {
+
+	if(ptKernels == NULL) skSelect(SK_BEST);
+	return(ptKernels);
+
+}
+
+
+/**************************
+* Kernels                 *
+**************************/
+
+// Fill 'ptSums' with sums over n samples
+void skWindSums(const double* rvU, const double* rvV, const double* rvW, const int n, SkWindSums* ptSums) {
+
+	memset(ptSums, 0, sizeof(SkWindSums));
+	kernels()->windSums(rvU, rvV, rvW, n, ptSums);
+
+}
+
+
+// Add to 'ivDirClass' the counts of samples in each of the 16 direction sectors;
+// sector 0 is centered on North, and calms (speed up to 1.e-6) are not counted
+void skDirClassify(const double* rvU, const double* rvV, const int n, int ivDirClass[16]) {
+
+	kernels()->dirClassify(rvU, rvV, n, ivDirClass);
+
+}
+
+
+void skClearMoments(SkMoments* ptMoments) {
+
+	int i;
+
+	ptMoments->n = 0;
+	for(i=0; i<4; i++) {
+		ptMoments->ivSum[i] = 0;
+		ptMoments->ivMin[i] =  32767;
+		ptMoments->ivMax[i] = -32768;
+	}
+	for(i=0; i<10; i++) ptMoments->ivCross[i] = 0;
+	ptMoments->rSumVel = 0.;
+
+}
+
+
+// Add to 'ptMoments' the valid samples (invalid data, -9990 and below, are
+// ignored); if 'rvTimeStamp' is not NULL, only samples whose time stamp
+// is in (rTimeFrom, rTimeTo] are considered
+void skAddMoments(const short int* ivU, const short int* ivV, const short int* ivW, const short int* ivT, const double* rvTimeStamp, const double rTimeFrom, const double rTimeTo, const int n, SkMoments* ptMoments) {
+
+	kernels()->addMoments(ivU, ivV, ivW, ivT, rvTimeStamp, rTimeFrom, rTimeTo, n, ptMoments);
+
+}
+
+
+// Move valid particles by one time step, reflecting them at ground
+void skMoveParticles(const int n, const double rDeltaT, double* x, double* y, double* z, const short int* isValid, const double* smpU, const double* smpV, const double* smpW) {
+
+	kernels()->moveParticles(n, rDeltaT, x, y, z, isValid, smpU, smpV, smpW);
+
+}
@@ -0,0 +1,68 @@
+/*
+
+	sk_lib - Statistics kernels: the per-sample loops of wind statistics,
+	         direction classification, moments accumulation and particle
+	         transport, in a scalar reference form and in SIMD forms
+	         (SSE4.2, AVX2, NEON) selected at run time.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#include <stdint.h>
+
+// Implementations of statistics kernels
+#define SK_BEST     -1		// Fastest available on this machine (default)
+#define SK_SCALAR    0		// Plain C reference
+#define SK_SSE42     1		// x86, SSE4.2
+#define SK_AVX2      2		// x86, AVX2
+#define SK_NEON      3		// ARM 64 bit, Advanced SIMD
+#define SK_NUM_IMPL  4
+
+// Sums of wind related quantities over a block, as used by 'WindStatistics'
+typedef struct SkWindSums {
+	int    n;				// Number of samples
+	double rSumU;			// Sums of components (m/s)
+	double rSumV;
+	double rSumW;
+	double rSumVel;			// Sums of horizontal speed and its square
+	double rSumVel2;
+	double rSumUnitU;		// Sums of horizontal unit vector components
+	double rSumUnitV;
+	double rSumPhi;			// Sums of angle to horizontal plane and its square (°)
+	double rSumPhi2;
+} SkWindSums;
+
+// Moments of raw sonic quadruples, in the same integer units as 'SecondMoments'
+typedef struct SkMoments {
+	int       n;			// Number of valid samples
+	int64_t   ivSum[4];		// Sums of u, v, w (cm/s) and t (1/100 °C)
+	int64_t   ivCross[10];	// Sums of uu, uv, uw, ut, vv, vw, vt, ww, wt, tt
+	short int ivMin[4];		// Extrema, in raw units
+	short int ivMax[4];
+	double    rSumVel;		// Sum of horizontal speeds (cm/s)
+} SkMoments;
+
+// Dispatch
+int         skSelect(const int iImpl);
+int         skCurrent(void);
+const char* skName(const int iImpl);
+
+// Kernels (through the implementation selected)
+void skWindSums(const double* rvU, const double* rvV, const double* rvW, const int n, SkWindSums* ptSums);
+void skDirClassify(const double* rvU, const double* rvV, const int n, int ivDirClass[16]);
+void skClearMoments(SkMoments* ptMoments);
+void skAddMoments(const short int* ivU, const short int* ivV, const short int* ivW, const short int* ivT, const double* rvTimeStamp, const double rTimeFrom, const double rTimeTo, const int n, SkMoments* ptMoments);
+void skMoveParticles(const int n, const double rDeltaT, double* x, double* y, double* z, const short int* isValid, const double* smpU, const double* smpV, const double* smpW);
+
+// Direct access to one implementation, for comparisons; NULL if not built in
+typedef struct SkKernels {
+	void (*windSums)(const double*, const double*, const double*, const int, SkWindSums*);
+	void (*dirClassify)(const double*, const double*, const int, int*);
+	void (*addMoments)(const short int*, const short int*, const short int*, const short int*, const double*, const double, const double, const int, SkMoments*);
+	void (*moveParticles)(const int, const double, double*, double*, double*, const short int*, const double*, const double*, const double*);
+} SkKernels;
+
+const SkKernels* skKernels(const int iImpl);
@@ -0,0 +1,761 @@
+/*
+
+	sp_lib - Spectral analysis of averaging blocks, coded in plain C.
+
+	The complex FFT is a recursive mixed radix decimation in time, with
+	dedicated radix 2 and 4 butterflies and a generic one for other
+	factors; real input of even length n is transformed as a complex
+	sequence of length n/2, then split. Block lengths are padded with
+	zeros to the next length whose half has no prime factors but 2, 3 and
+	5, so that the few lengths occurring (one per averaging time and
+	sampling rate, in practice) reuse the same plans, and transforms are
+	fast. Normalisation is by the number of actual (not padded) samples,
+	so that integrating a spectrum over frequency gives the variance.
+
+	Structure functions are computed lag by lag on differences when few
+	lags are wanted, with independent partial sums the compiler may keep
+	in vector registers, and otherwise from the autocovariance (one
+	forward and one inverse transform per component, whatever the number
+	of lags) and running sums of squares.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sp_lib.h"
+
+#define SP_PI 3.14159265358979323846
+
+// Relative cost of a real FFT, per sample and binary order of length,
+// against one lag of the direct structure function kernel per sample
+#define SP_SF_FFT_COST 15.0
+
+
+/**********************
+* Complex FFT         *
+**********************/
+
+static void butterfly2(SpComplex* F, const int fstride, const SpComplex* tw, const int m) {
+
+	SpComplex t;
+	int       k;
+
+	for(k=0; k<m; k++) {
+		t.re    = F[k+m].re * tw[k*fstride].re - F[k+m].im * tw[k*fstride].im;
+		t.im    = F[k+m].re * tw[k*fstride].im + F[k+m].im * tw[k*fstride].re;
+		F[k+m].re = F[k].re - t.re;
+		F[k+m].im = F[k].im - t.im;
+		F[k].re  += t.re;
+		F[k].im  += t.im;
+	}
+
+}
+
+
+static void butterfly4(SpComplex* F, const int fstride, const SpComplex* tw, const int m) {
+
+	SpComplex s[6];
+	const SpComplex* w1;
+	const SpComplex* w2;
+	const SpComplex* w3;
+	int       k;
+
+	for(k=0; k<m; k++) {
+		w1 = &tw[k*fstride];
+		w2 = &tw[2*k*fstride];
+		w3 = &tw[3*k*fstride];
+		s[0].re = F[k+m].re*w1->re - F[k+m].im*w1->im;
+		s[0].im = F[k+m].re*w1->im + F[k+m].im*w1->re;
+		s[1].re = F[k+2*m].re*w2->re - F[k+2*m].im*w2->im;
+		s[1].im = F[k+2*m].re*w2->im + F[k+2*m].im*w2->re;
+		s[2].re = F[k+3*m].re*w3->re - F[k+3*m].im*w3->im;
+		s[2].im = F[k+3*m].re*w3->im + F[k+3*m].im*w3->re;
+		s[5].re = F[k].re - s[1].re;
+		s[5].im = F[k].im - s[1].im;
+		F[k].re += s[1].re;
+		F[k].im += s[1].im;
+		s[3].re = s[0].re + s[2].re;
+		s[3].im = s[0].im + s[2].im;
+		s[4].re = s[0].re - s[2].re;
+		s[4].im = s[0].im - s[2].im;
+		F[k+2*m].re = F[k].re - s[3].re;
+		F[k+2*m].im = F[k].im - s[3].im;
+		F[k].re += s[3].re;
+		F[k].im += s[3].im;
+		F[k+m].re   = s[5].re + s[4].im;
+		F[k+m].im   = s[5].im - s[4].re;
+		F[k+3*m].re = s[5].re - s[4].im;
+		F[k+3*m].im = s[5].im + s[4].re;
+	}
+
+}
+
+
+static void butterflyGeneric(SpComplex* F, const int fstride, const SpComplex* tw, const int m, const int p, const int n) {
+
+	SpComplex  s[16];
+	SpComplex  t;
+	int        iTw;
+	int        u, k, q, q1;
+
+	for(u=0; u<m; u++) {
+		for(q1=0, k=u; q1<p; q1++, k+=m) s[q1] = F[k];
+		for(q1=0, k=u; q1<p; q1++, k+=m) {
+			iTw = 0;
+			F[k] = s[0];
+			for(q=1; q<p; q++) {
+				iTw += fstride*k;
+				if(iTw >= n) iTw -= n;
+				t.re = s[q].re*tw[iTw].re - s[q].im*tw[iTw].im;
+				t.im = s[q].re*tw[iTw].im + s[q].im*tw[iTw].re;
+				F[k].re += t.re;
+				F[k].im += t.im;
+			}
+		}
+	}
+
+}
+
+
+// Transform 'in' (stride 'fstride') into 'out', stage by stage
+static void fftStage(SpComplex* out, const SpComplex* in, const int fstride, const int* ivFactors, const SpComplex* tw, const int n) {
+
+	const int p = ivFactors[0];
+	const int m = ivFactors[1];
+	int       k;
+
+	if(m == 1) {
+		for(k=0; k<p; k++) out[k] = in[k*fstride];
+	}
+	else {
+		for(k=0; k<p; k++) fftStage(out + k*m, in + k*fstride, fstride*p, ivFactors + 2, tw, n);
+	}
+	switch(p) {
+	case 2:  butterfly2(out, fstride, tw, m); break;
+	case 4:  butterfly4(out, fstride, tw, m); break;
+	default: butterflyGeneric(out, fstride, tw, m, p, n); break;
+	}
+
+}
+
+
+/**********************
+* Plans               *
+**********************/
+
+// Smallest even length not below n whose half has no prime factors but 2, 3 and 5
+int spGoodLength(const int n) {
+
+	int m = (n + 1) / 2;
+	int r;
+
+	if(m < 1) m = 1;
+	while(1) {
+		r = m;
+		while(r % 2 == 0) r /= 2;
+		while(r % 3 == 0) r /= 3;
+		while(r % 5 == 0) r /= 5;
+		if(r == 1) return(2*m);
+		m++;
+	}
+
+}
+
+
+static void planFree(SpPlan* ptPlan) {
+
+	if(ptPlan == NULL) return;
+	free(ptPlan->tvTwiddle);
+	free(ptPlan->tvSplit);
+	free(ptPlan);
+
+}
+
+
+static SpPlan* planNew(const int n) {
+
+	SpPlan* ptPlan;
+	int     m = n / 2;
+	int     r = m;
+	int     p = 4;
+	int     k;
+
+	if(n < 2 || n % 2 != 0) return(NULL);
+	ptPlan = calloc(1, sizeof(SpPlan));
+	if(ptPlan == NULL) return(NULL);
+	ptPlan->n = n;
+
+	// Factor n/2: fours first, then twos, then odd primes (above 16 is not
+	// supported by the generic butterfly, and never produced by 'spGoodLength')
+	do {
+		while(r % p != 0) {
+			switch(p) {
+			case 4:  p = 2; break;
+			case 2:  p = 3; break;
+			default: p += 2; break;
+			}
+			if(p*p > r) p = r;
+		}
+		if(p > 16 || ptPlan->iNumFactors >= 32) {
+			free(ptPlan);
+			return(NULL);
+		}
+		r /= p;
+		ptPlan->ivFactors[2*ptPlan->iNumFactors]   = p;
+		ptPlan->ivFactors[2*ptPlan->iNumFactors+1] = r;
+		ptPlan->iNumFactors++;
+	} while(r > 1);
+	if(m == 1) {
+		ptPlan->ivFactors[0] = 1;
+		ptPlan->ivFactors[1] = 1;
+		ptPlan->iNumFactors  = 1;
+	}
+
+	// Twiddles
+	ptPlan->tvTwiddle = malloc(m * sizeof(SpComplex));
+	ptPlan->tvSplit   = malloc(m * sizeof(SpComplex));
+	if(ptPlan->tvTwiddle == NULL || ptPlan->tvSplit == NULL) {
+		planFree(ptPlan);
+		return(NULL);
+	}
+	for(k=0; k<m; k++) {
+		ptPlan->tvTwiddle[k].re = cos(-2.*SP_PI*k/m);
+		ptPlan->tvTwiddle[k].im = sin(-2.*SP_PI*k/m);
+		ptPlan->tvSplit[k].re   = cos(-2.*SP_PI*k/n);
+		ptPlan->tvSplit[k].im   = sin(-2.*SP_PI*k/n);
+	}
+	return(ptPlan);
+
+}
+
+
+SpWorkspace* spWorkspaceNew(void) {
+	return(calloc(1, sizeof(SpWorkspace)));
+}
+
+
+void spWorkspaceFree(SpWorkspace* ptWork) {
+
+	int i;
+
+	if(ptWork == NULL) return;
+	for(i=0; i<ptWork->iNumPlans; i++) planFree(ptWork->tvPlan[i]);
+	for(i=0; i<4; i++) {
+		free(ptWork->rvSeries[i]);
+		free(ptWork->tvSpectrum[i]);
+	}
+	free(ptWork->tvScratch);
+	free(ptWork->tvProduct);
+	free(ptWork->rvLagged);
+	free(ptWork);
+
+}
+
+
+// Get the plan for length n from cache, building it (and replacing the
+// least recently used one, if cache is full) when missing
+SpPlan* spPlanGet(SpWorkspace* ptWork, const int n) {
+
+	SpPlan* ptPlan;
+	int     iOldest = 0;
+	int     i;
+
+	ptWork->iClock++;
+	for(i=0; i<ptWork->iNumPlans; i++) {
+		if(ptWork->tvPlan[i]->n == n) {
+			ptWork->tvPlan[i]->iLastUse = ptWork->iClock;
+			ptWork->iPlanHits++;
+			return(ptWork->tvPlan[i]);
+		}
+		if(ptWork->tvPlan[i]->iLastUse < ptWork->tvPlan[iOldest]->iLastUse) iOldest = i;
+	}
+	ptPlan = planNew(n);
+	if(ptPlan == NULL) return(NULL);
+	ptPlan->iLastUse = ptWork->iClock;
+	ptWork->iPlanBuilds++;
+	if(ptWork->iNumPlans < SP_MAX_PLANS) {
+		ptWork->tvPlan[ptWork->iNumPlans++] = ptPlan;
+	}
+	else {
+		planFree(ptWork->tvPlan[iOldest]);
+		ptWork->tvPlan[iOldest] = ptPlan;
+	}
+	return(ptPlan);
+
+}
+
+
+/**********************
+* Real FFT            *
+**********************/
+
+// Transform n = ptPlan->n real values into n/2+1 complex ones; 'tvScratch'
+// must hold n/2 values
+void spRealFFT(const SpPlan* ptPlan, const double* rvX, SpComplex* tvX, SpComplex* tvScratch) {
+
+	const int m = ptPlan->n / 2;
+	SpComplex e;
+	SpComplex o;
+	SpComplex z1;
+	SpComplex z2;
+	SpComplex w;
+	int       k;
+
+	// Pack even and odd values as a complex sequence, and transform it
+	for(k=0; k<m; k++) {
+		tvX[k].re = rvX[2*k];
+		tvX[k].im = rvX[2*k+1];
+	}
+	fftStage(tvScratch, tvX, 1, ptPlan->ivFactors, ptPlan->tvTwiddle, m);
+
+	// Split into the transforms of even and odd values, and combine them
+	tvX[0].re = tvScratch[0].re + tvScratch[0].im;
+	tvX[0].im = 0.;
+	tvX[m].re = tvScratch[0].re - tvScratch[0].im;
+	tvX[m].im = 0.;
+	for(k=1; k<m; k++) {
+		z1   = tvScratch[k];
+		z2.re =  tvScratch[m-k].re;
+		z2.im = -tvScratch[m-k].im;
+		e.re = 0.5*(z1.re + z2.re);
+		e.im = 0.5*(z1.im + z2.im);
+		o.re = 0.5*(z1.im - z2.im);		// (z1 - z2) / 2i
+		o.im = -0.5*(z1.re - z2.re);
+		w    = ptPlan->tvSplit[k];
+		tvX[k].re = e.re + w.re*o.re - w.im*o.im;
+		tvX[k].im = e.im + w.re*o.im + w.im*o.re;
+	}
+
+}
+
+
+// Inverse of 'spRealFFT': n/2+1 complex values (overwritten) to n real
+// ones, scaled by 1/n so that the round trip is the identity
+void spInverseRealFFT(const SpPlan* ptPlan, SpComplex* tvX, double* rvX, SpComplex* tvScratch) {
+
+	const int m = ptPlan->n / 2;
+	SpComplex a;
+	SpComplex b;
+	SpComplex e;
+	SpComplex o;
+	SpComplex w;
+	int       k;
+	int       j;
+
+	// Merge the transforms of even and odd values, in pairs (k, m-k) so that
+	// the sequence can be rebuilt in place
+	for(k=0; k<=m/2; k++) {
+		j = m - k;
+		a = tvX[k];
+		b = tvX[j];
+		w = ptPlan->tvSplit[k];
+		e.re = 0.5*(a.re + b.re);
+		e.im = 0.5*(a.im - b.im);
+		o.re = 0.5*((a.re - b.re)*w.re + (a.im + b.im)*w.im);		// (a - conj(b)) conj(w) / 2
+		o.im = 0.5*((a.im + b.im)*w.re - (a.re - b.re)*w.im);
+		tvX[k].re = e.re - o.im;		// conj(e + i o), ready for a forward transform
+		tvX[k].im = -(e.im + o.re);
+		if(k > 0 && j != k) {
+			w = ptPlan->tvSplit[j];
+			e.re = 0.5*(b.re + a.re);
+			e.im = 0.5*(b.im - a.im);
+			o.re = 0.5*((b.re - a.re)*w.re + (b.im + a.im)*w.im);
+			o.im = 0.5*((b.im + a.im)*w.re - (b.re - a.re)*w.im);
+			tvX[j].re = e.re - o.im;
+			tvX[j].im = -(e.im + o.re);
+		}
+	}
+
+	// Inverse complex transform, as the conjugate of the forward one, and unpack
+	fftStage(tvScratch, tvX, 1, ptPlan->ivFactors, ptPlan->tvTwiddle, m);
+	for(k=0; k<m; k++) {
+		rvX[2*k]   =  tvScratch[k].re / m;
+		rvX[2*k+1] = -tvScratch[k].im / m;
+	}
+
+}
+
+
+/**********************
+* Block spectra       *
+**********************/
+
+static int workspaceReserve(SpWorkspace* ptWork, const int n) {
+
+	int i;
+
+	if(n <= ptWork->iCapacity) return(0);
+	for(i=0; i<4; i++) {
+		ptWork->rvSeries[i]   = realloc(ptWork->rvSeries[i], n * sizeof(double));
+		ptWork->tvSpectrum[i] = realloc(ptWork->tvSpectrum[i], (n/2 + 1) * sizeof(SpComplex));
+		if(ptWork->rvSeries[i] == NULL || ptWork->tvSpectrum[i] == NULL) {
+			ptWork->iCapacity = 0;
+			return(1);
+		}
+	}
+	ptWork->tvScratch = realloc(ptWork->tvScratch, (n/2 + 1) * sizeof(SpComplex));
+	ptWork->tvProduct = realloc(ptWork->tvProduct, (n/2 + 1) * sizeof(SpComplex));
+	ptWork->rvLagged  = realloc(ptWork->rvLagged, n * sizeof(double));
+	if(ptWork->tvScratch == NULL || ptWork->tvProduct == NULL || ptWork->rvLagged == NULL) {
+		ptWork->iCapacity = 0;
+		return(1);
+	}
+	ptWork->iCapacity = n;
+	return(0);
+
+}
+
+
+// Rotated fluctuations of a block, filling gaps by linear interpolation,
+// then padding with zeros to a good length not below 'iSpan + iMinPad'.
+// Return the plan for that length, or NULL on failure.
+static SpPlan* blockSeries(
+	SpWorkspace*  ptWork,
+	const int*    ivIndex,
+	const double* rvU,
+	const double* rvV,
+	const double* rvW,
+	const double* rvT,
+	const int     n,
+	const double  rmRot[3][3],
+	const int     iMinPad,
+	int*          piSpan
+) {
+
+	const double* rvIn[4];
+	double        rvAvg[4];
+	double        rvVal[4];
+	double        rvPrev[4] = {0., 0., 0., 0.};
+	SpPlan*       ptPlan;
+	int           iFirst;
+	int           iSpan;
+	int           iLength;
+	int           iPrev;
+	int           iPos;
+	int           i, j, k;
+
+	iFirst  = ivIndex[0];
+	iSpan   = ivIndex[n-1] - iFirst + 1;
+	iLength = spGoodLength(iSpan + iMinPad);
+	if(workspaceReserve(ptWork, iLength) != 0) return(NULL);
+	ptPlan = spPlanGet(ptWork, iLength);
+	if(ptPlan == NULL) return(NULL);
+
+	rvIn[0] = rvU;
+	rvIn[1] = rvV;
+	rvIn[2] = rvW;
+	rvIn[3] = rvT;
+	for(j=0; j<4; j++) {
+		rvAvg[j] = 0.;
+		for(i=0; i<n; i++) rvAvg[j] += rvIn[j][i];
+		rvAvg[j] /= n;
+	}
+	iPrev = -1;
+	for(i=0; i<n; i++) {
+		for(j=0; j<3; j++) {
+			rvVal[j] = rmRot[j][0]*(rvU[i] - rvAvg[0]) + rmRot[j][1]*(rvV[i] - rvAvg[1]) + rmRot[j][2]*(rvW[i] - rvAvg[2]);
+		}
+		rvVal[3] = rvT[i] - rvAvg[3];
+		iPos = ivIndex[i] - iFirst;
+		for(j=0; j<4; j++) {
+			for(k=iPrev+1; k<iPos; k++) {
+				ptWork->rvSeries[j][k] = rvPrev[j] + (rvVal[j] - rvPrev[j]) * (k - iPrev) / (iPos - iPrev);
+			}
+			ptWork->rvSeries[j][iPos] = rvVal[j];
+			rvPrev[j] = rvVal[j];
+		}
+		iPrev = iPos;
+	}
+	for(j=0; j<4; j++) {
+		for(k=iSpan; k<iLength; k++) ptWork->rvSeries[j][k] = 0.;
+	}
+	*piSpan = iSpan;
+	return(ptPlan);
+
+}
+
+
+int spBlockSpectra(
+	SpWorkspace*  ptWork,
+	const int*    ivIndex,
+	const double* rvU,
+	const double* rvV,
+	const double* rvW,
+	const double* rvT,
+	const int     n,
+	const double  rmRot[3][3],
+	const double  rFrequency,
+	const int     iNumBins,
+	const float   rInvalid,
+	float*        rvFreq,
+	float*        rvSpectrum,
+	float*        rvOgive
+) {
+
+	double*       rvSum;
+	int*          ivCount;
+	SpPlan*       ptPlan;
+	SpComplex*    X[4];
+	double        rScale;
+	double        rDeltaF;
+	double        rLogMax;
+	double        rOgiveWT = 0.;
+	double        rOgiveUW = 0.;
+	double        rCoWT;
+	double        rCoUW;
+	int           iSpan;
+	int           iLength;
+	int           iBin;
+	int           i, j, k;
+
+	// Start from invalid results
+	for(i=0; i<iNumBins; i++) rvFreq[i] = rInvalid;
+	for(i=0; i<SP_NUM_SPECTRA*iNumBins; i++) rvSpectrum[i] = rInvalid;
+	for(i=0; i<SP_NUM_OGIVES*iNumBins; i++) rvOgive[i] = rInvalid;
+	if(n < 16 || iNumBins <= 0 || rFrequency <= 0.) return(1);
+
+	// Rotated fluctuations, gaps filled, padded
+	ptPlan = blockSeries(ptWork, ivIndex, rvU, rvV, rvW, rvT, n, rmRot, 0, &iSpan);
+	if(ptPlan == NULL) return(2);
+	iLength = ptPlan->n;
+
+	// Transform
+	for(j=0; j<4; j++) {
+		spRealFFT(ptPlan, ptWork->rvSeries[j], ptWork->tvSpectrum[j], ptWork->tvScratch);
+		X[j] = ptWork->tvSpectrum[j];
+	}
+
+	// One-sided densities, accumulated into logarithmic bins; ogives are
+	// accumulated from Nyquist down, and each bin gets the value at its
+	// lowest frequency
+	rvSum   = calloc((SP_NUM_SPECTRA + 1) * iNumBins, sizeof(double));
+	ivCount = calloc(iNumBins, sizeof(int));
+	if(rvSum == NULL || ivCount == NULL) {
+		free(rvSum);
+		free(ivCount);
+		return(3);
+	}
+	rDeltaF = rFrequency / iLength;
+	rLogMax = log(iLength / 2);
+	for(k=iLength/2; k>=1; k--) {
+		rScale = (k == iLength/2 ? 1. : 2.) / (iSpan * rFrequency);
+		iBin   = rLogMax > 0. ? (int)(iNumBins * log(k) / rLogMax) : 0;
+		if(iBin >= iNumBins) iBin = iNumBins - 1;
+		rCoWT  = rScale * (X[2][k].re*X[3][k].re + X[2][k].im*X[3][k].im);
+		rCoUW  = rScale * (X[0][k].re*X[2][k].re + X[0][k].im*X[2][k].im);
+		for(j=0; j<4; j++) rvSum[j*iNumBins + iBin] += rScale * (X[j][k].re*X[j][k].re + X[j][k].im*X[j][k].im);
+		rvSum[4*iNumBins + iBin] += rCoWT;
+		rvSum[5*iNumBins + iBin] += rCoUW;
+		rvSum[6*iNumBins + iBin] += k * rDeltaF;
+		ivCount[iBin]++;
+		rOgiveWT += rCoWT * rDeltaF;
+		rOgiveUW += rCoUW * rDeltaF;
+		rvOgive[iBin]            = rOgiveWT;
+		rvOgive[iNumBins + iBin] = rOgiveUW;
+	}
+	for(iBin=0; iBin<iNumBins; iBin++) {
+		if(ivCount[iBin] <= 0) continue;
+		rvFreq[iBin] = rvSum[6*iNumBins + iBin] / ivCount[iBin];
+		for(j=0; j<SP_NUM_SPECTRA; j++) rvSpectrum[j*iNumBins + iBin] = rvSum[j*iNumBins + iBin] / ivCount[iBin];
+	}
+	free(rvSum);
+	free(ivCount);
+
+	// Leave
+	return(0);
+
+}
+
+
+/**********************
+* Random errors       *
+**********************/
+
+// Lagged covariance (1/iSpan) sum_t x(t) y(t+p), p = -iMaxLag, ..., iMaxLag,
+// stored at 'rvCov[iMaxLag + p]', as the inverse transform of conj(X) Y
+static void laggedCovariance(SpWorkspace* ptWork, const SpPlan* ptPlan, const SpComplex* X, const SpComplex* Y, const int iSpan, const int iMaxLag, double* rvCov) {
+
+	const int iLength = ptPlan->n;
+	int       k;
+	int       p;
+
+	for(k=0; k<=iLength/2; k++) {
+		ptWork->tvProduct[k].re = X[k].re*Y[k].re + X[k].im*Y[k].im;
+		ptWork->tvProduct[k].im = X[k].re*Y[k].im - X[k].im*Y[k].re;
+	}
+	spInverseRealFFT(ptPlan, ptWork->tvProduct, ptWork->rvLagged, ptWork->tvScratch);
+	rvCov[iMaxLag] = ptWork->rvLagged[0] / iSpan;
+	for(p=1; p<=iMaxLag; p++) {
+		rvCov[iMaxLag + p] = ptWork->rvLagged[p] / iSpan;
+		rvCov[iMaxLag - p] = ptWork->rvLagged[iLength - p] / iSpan;
+	}
+
+}
+
+
+int spCovarianceErrors(
+	SpWorkspace*  ptWork,
+	const int*    ivIndex,
+	const double* rvU,
+	const double* rvV,
+	const double* rvW,
+	const double* rvT,
+	const int     n,
+	const double  rmRot[3][3],
+	const int     iMaxLag,
+	double        rvError[3]
+) {
+
+	static const int ivOther[3] = {3, 0, 1};	// t, u, v, each paired with w
+	SpPlan*    ptPlan;
+	double*    rvAutoW;
+	double*    rvAutoX;
+	double*    rvCross;
+	double     rVar;
+	int        iSpan;
+	int        iLag;
+	int        j;
+	int        p;
+
+	for(j=0; j<3; j++) rvError[j] = -1.;
+	if(n < 16 || iMaxLag < 0) return(1);
+
+	// Rotated fluctuations, padded enough for lagged products not to wrap around
+	ptPlan = blockSeries(ptWork, ivIndex, rvU, rvV, rvW, rvT, n, rmRot, iMaxLag, &iSpan);
+	if(ptPlan == NULL) return(2);
+	iLag = iMaxLag < iSpan/2 ? iMaxLag : iSpan/2;
+	for(j=0; j<4; j++) spRealFFT(ptPlan, ptWork->rvSeries[j], ptWork->tvSpectrum[j], ptWork->tvScratch);
+	rvAutoW = malloc(3 * (2*iLag + 1) * sizeof(double));
+	if(rvAutoW == NULL) return(3);
+	rvAutoX = rvAutoW + 2*iLag + 1;
+	rvCross = rvAutoX + 2*iLag + 1;
+
+	// Finkelstein and Sims (2001): the variance of the covariance of w and x
+	// is (1/N) sum_p [Cww(p) Cxx(p) + Cwx(p) Cxw(p)], with Cxw(p) = Cwx(-p)
+	laggedCovariance(ptWork, ptPlan, ptWork->tvSpectrum[2], ptWork->tvSpectrum[2], iSpan, iLag, rvAutoW);
+	for(j=0; j<3; j++) {
+		laggedCovariance(ptWork, ptPlan, ptWork->tvSpectrum[ivOther[j]], ptWork->tvSpectrum[ivOther[j]], iSpan, iLag, rvAutoX);
+		laggedCovariance(ptWork, ptPlan, ptWork->tvSpectrum[2], ptWork->tvSpectrum[ivOther[j]], iSpan, iLag, rvCross);
+		rVar = 0.;
+		for(p=-iLag; p<=iLag; p++) {
+			rVar += rvAutoW[iLag + p]*rvAutoX[iLag + p] + rvCross[iLag + p]*rvCross[iLag - p];
+		}
+		rvError[j] = sqrt(fmax(rVar, 0.) / iSpan);
+	}
+	free(rvAutoW);
+
+	// Leave
+	return(0);
+
+}
+
+
+/**********************
+* Structure functions *
+**********************/
+
+// D(p) = sum_t (x(t+p) - x(t))^2 / (iSpan - p), lag by lag
+static void directStructure(const double* rvX, const int iSpan, const int iMinLag, const int iMaxLag, double* rvD) {
+
+	const double* rvY;
+	double        s0, s1, s2, s3;
+	double        d0, d1, d2, d3;
+	int           m;
+	int           p;
+	int           t;
+
+	for(p=iMinLag; p<=iMaxLag; p++) {
+		rvY = rvX + p;
+		m   = iSpan - p;
+		s0 = s1 = s2 = s3 = 0.;
+		for(t=0; t+4<=m; t+=4) {
+			d0  = rvY[t]   - rvX[t];
+			d1  = rvY[t+1] - rvX[t+1];
+			d2  = rvY[t+2] - rvX[t+2];
+			d3  = rvY[t+3] - rvX[t+3];
+			s0 += d0*d0;
+			s1 += d1*d1;
+			s2 += d2*d2;
+			s3 += d3*d3;
+		}
+		for(; t<m; t++) {
+			d0  = rvY[t] - rvX[t];
+			s0 += d0*d0;
+		}
+		rvD[p - iMinLag] = (s0 + s1 + s2 + s3) / m;
+	}
+
+}
+
+
+int spStructureFunctions(
+	SpWorkspace*  ptWork,
+	const int*    ivIndex,
+	const double* rvU,
+	const double* rvV,
+	const double* rvW,
+	const double* rvT,
+	const int     n,
+	const double  rmRot[3][3],
+	const int     iMinLag,
+	const int     iMaxLag,
+	const int     iMethod,
+	double*       rvD
+) {
+
+	const int  iNumLags = iMaxLag - iMinLag + 1;
+	SpPlan*    ptPlan;
+	double*    rvSquares;
+	double*    rvAuto;
+	double     rFFTCost;
+	int        iUseFFT;
+	int        iSpan;
+	int        i;
+	int        j;
+	int        p;
+
+	if(n < 16 || iMinLag < 1 || iNumLags < 1) return(1);
+	iSpan = ivIndex[n-1] - ivIndex[0] + 1;
+	if(iMaxLag >= iSpan) return(1);
+
+	// Direct kernel costs one pass per lag, the FFT one a transform pair
+	// of the padded block; both then need the same preparation
+	iUseFFT = iMethod == SP_SF_FFT;
+	if(iMethod == SP_SF_BEST) {
+		rFFTCost = SP_SF_FFT_COST * (iSpan + iMaxLag) * log2((double)(iSpan + iMaxLag));
+		iUseFFT  = (double)iNumLags * iSpan > rFFTCost;
+	}
+	ptPlan = blockSeries(ptWork, ivIndex, rvU, rvV, rvW, rvT, n, rmRot, iUseFFT ? iMaxLag : 0, &iSpan);
+	if(ptPlan == NULL) return(2);
+	if(!iUseFFT) {
+		for(j=0; j<3; j++) directStructure(ptWork->rvSeries[j], iSpan, iMinLag, iMaxLag, rvD + j*iNumLags);
+		return(0);
+	}
+
+	// sum_t (x(t+p) - x(t))^2 = Q(iSpan) - Q(p) + Q(iSpan-p) - 2 iSpan C(p),
+	// Q being running sums of squares and C the autocovariance
+	rvSquares = malloc((iSpan + 1 + 2*iMaxLag + 1) * sizeof(double));
+	if(rvSquares == NULL) return(3);
+	rvAuto = rvSquares + iSpan + 1;
+	for(j=0; j<3; j++) {
+		rvSquares[0] = 0.;
+		for(i=0; i<iSpan; i++) rvSquares[i+1] = rvSquares[i] + ptWork->rvSeries[j][i]*ptWork->rvSeries[j][i];
+		spRealFFT(ptPlan, ptWork->rvSeries[j], ptWork->tvSpectrum[j], ptWork->tvScratch);
+		laggedCovariance(ptWork, ptPlan, ptWork->tvSpectrum[j], ptWork->tvSpectrum[j], iSpan, iMaxLag, rvAuto);
+		for(p=iMinLag; p<=iMaxLag; p++) {
+			rvD[j*iNumLags + p - iMinLag] = fmax(
+				rvSquares[iSpan] - rvSquares[p] + rvSquares[iSpan - p] - 2.*iSpan*rvAuto[iMaxLag + p], 0.
+			) / (iSpan - p);
+		}
+	}
+	free(rvSquares);
+
+	// Leave
+	return(0);
+
+}
@@ -0,0 +1,128 @@
+/*
+
+	sp_lib - Spectral analysis of averaging blocks: power spectra of wind
+	         components and temperature, cospectra and ogives of the w't'
+	         and u'w' covariances, log-binned, random errors of
+	         covariances from lagged auto- and cross-covariances, and
+	         structure functions of wind components, by real-input FFT
+	         with plans cached per transform length.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#define SP_NUM_SPECTRA  6		// u, v, w, t power; w't', u'w' cospectra
+#define SP_NUM_OGIVES   2		// w't', u'w'
+#define SP_MAX_PLANS    8		// Plans kept per workspace, least recently used replaced
+
+// Methods of structure functions
+#define SP_SF_BEST     -1		// Cheapest for the lags requested (default)
+#define SP_SF_DIRECT    0		// Lag by lag, on differences
+#define SP_SF_FFT       1		// From autocovariances, all lags at once
+
+typedef struct SpComplex {
+	double re;
+	double im;
+} SpComplex;
+
+// Plan of a real-input FFT of even length n, made of a complex FFT of
+// length n/2 (mixed radix) and a final split
+typedef struct SpPlan {
+	int        n;
+	int        iNumFactors;
+	int        ivFactors[64];		// Radix and remaining length of each stage of the n/2 complex transform
+	SpComplex* tvTwiddle;			// exp(-2 pi i k/(n/2)), k = 0, ..., n/2-1
+	SpComplex* tvSplit;				// exp(-2 pi i k/n), k = 0, ..., n/2-1
+	unsigned   iLastUse;
+} SpPlan;
+
+// Caller-owned workspace: plan cache and buffers, one per thread
+typedef struct SpWorkspace {
+	SpPlan*      tvPlan[SP_MAX_PLANS];
+	int          iNumPlans;
+	unsigned     iClock;
+	unsigned     iPlanHits;			// Plan requests served from cache
+	unsigned     iPlanBuilds;		// Plan requests needing a new plan
+	int          iCapacity;
+	double*      rvSeries[4];		// Rotated fluctuations, gaps filled, zero padded
+	SpComplex*   tvSpectrum[4];		// Their transforms
+	SpComplex*   tvScratch;
+	SpComplex*   tvProduct;			// Cross spectrum, for lagged covariances
+	double*      rvLagged;			// Lagged covariances, all lags
+} SpWorkspace;
+
+// Workspace and plans
+SpWorkspace* spWorkspaceNew(void);
+void         spWorkspaceFree(SpWorkspace* ptWork);
+int          spGoodLength(const int n);
+SpPlan*      spPlanGet(SpWorkspace* ptWork, const int n);
+
+// Transform: n real values to n/2+1 complex ones (DC to Nyquist)
+void spRealFFT(const SpPlan* ptPlan, const double* rvX, SpComplex* tvX, SpComplex* tvScratch);
+
+// Inverse transform, scaled by 1/n; 'tvX' is overwritten
+void spInverseRealFFT(const SpPlan* ptPlan, SpComplex* tvX, double* rvX, SpComplex* tvScratch);
+
+// Spectra of one block. Valid samples, at positions 'ivIndex' within the
+// block, are rotated by 'rmRot', deprived of their means and linearly
+// interpolated over missing positions. Results, for 'iNumBins' logarithmic
+// frequency bins from 1/(block duration) to Nyquist, are bin centre
+// frequencies (Hz), spectral densities [SP_NUM_SPECTRA][iNumBins] and
+// ogives [SP_NUM_OGIVES][iNumBins] (covariance carried by frequencies from
+// bin up to Nyquist); empty bins are set to 'rInvalid'. Return 0 on success.
+int spBlockSpectra(
+	SpWorkspace*  ptWork,
+	const int*    ivIndex,
+	const double* rvU,
+	const double* rvV,
+	const double* rvW,
+	const double* rvT,
+	const int     n,
+	const double  rmRot[3][3],
+	const double  rFrequency,
+	const int     iNumBins,
+	const float   rInvalid,
+	float*        rvFreq,
+	float*        rvSpectrum,
+	float*        rvOgive
+);
+
+// Random errors (standard deviations) of the w't', u'w' and v'w' covariances
+// of one block, by Finkelstein and Sims (2001), summing lagged covariance
+// products up to 'iMaxLag' samples (at most half the block). Data are
+// prepared as for spectra. Return 0 on success; on failure errors are
+// negative.
+int spCovarianceErrors(
+	SpWorkspace*  ptWork,
+	const int*    ivIndex,
+	const double* rvU,
+	const double* rvV,
+	const double* rvW,
+	const double* rvT,
+	const int     n,
+	const double  rmRot[3][3],
+	const int     iMaxLag,
+	double        rvError[3]
+);
+
+// Second-order structure functions of the rotated u, v and w of one block,
+// D(p) = mean over the block of (x(t+p) - x(t))^2, for lags p = 'iMinLag',
+// ..., 'iMaxLag' samples, stored at rvD[j*(iMaxLag-iMinLag+1) + p-iMinLag]
+// (j = 0, 1, 2 for u, v, w). Data are prepared as for spectra. 'iMethod'
+// is one of SP_SF_BEST, SP_SF_DIRECT or SP_SF_FFT. Return 0 on success.
+int spStructureFunctions(
+	SpWorkspace*  ptWork,
+	const int*    ivIndex,
+	const double* rvU,
+	const double* rvV,
+	const double* rvW,
+	const double* rvT,
+	const int     n,
+	const double  rmRot[3][3],
+	const int     iMinLag,
+	const int     iMaxLag,
+	const int     iMethod,
+	double*       rvD
+);
@@ -24,12 +24,15 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <dirent.h>
 
 #include "st_lib.h"
+#include "sk_lib.h"
 
 // Steering constants
 
 #define MAX_CHARLEN 64
+#define ONE_HOUR_SECONDS 3600
 
 /******************
 * Process support *
@@ -148,12 +151,45 @@ void startconsole(const char *progName) {
 }
 
 
+// Hand a processing job to the "proc_worker" task, if it is running. Jobs
+// with the same key supersede each other while queued. The job line is
+// shorter than PIPE_BUF, so that writes from different tasks never mix.
+// Return 0 if the job was queued, non-zero if the caller should run it.
+int submitProcessing(const char* sKey, const int iDeadline, const char* sExec, const char* svArgs[], const int iNumArgs) {
+
+	char    sLine[PROC_LINE_SIZE];
+	int     iLen;
+	int     iQueue;
+	int     i;
+	ssize_t iWritten;
+
+	iLen = snprintf(sLine, sizeof(sLine), "%d\t%s\t%s", iDeadline, sKey, sExec);
+	for(i=0; i<iNumArgs && iLen < (int)sizeof(sLine); i++) {
+		iLen += snprintf(sLine + iLen, sizeof(sLine) - iLen, "\t%s", svArgs[i]);
+	}
+	if(iLen >= (int)sizeof(sLine) - 1) return(1);
+	sLine[iLen++] = '\n';
+
+	// Opening for write without a reader fails immediately (ENXIO)
+	iQueue = open(PROC_QUEUE, O_WRONLY | O_NONBLOCK);
+	if(iQueue < 0) return(2);
+	iWritten = write(iQueue, sLine, iLen);
+	close(iQueue);
+	if(iWritten != iLen) return(3);
+
+	// Leave
+	return(0);
+
+}
+
+
 // Start data processing task, whose name is in "sExec", on data in subdirs of "sDirRaw" data directory, starting on "ptTime", with length "iMinutes"
 void dataProcessing(const char* sExec, const char* sProcName, const char* sIniFile, const char* sCurRaw, struct tm *ptTime, const int iMinutes, const int iFuse) {
 
 	char cvDateTime[32];
 	char cvMinutes[5];
 	char cvFuse[5];
+	char cvKey[PROC_LINE_SIZE];
 	pid_t iPID;
 	
 	// If executable name is non empty, start it
@@ -167,6 +203,11 @@ void dataProcessing(const char* sExec, const char* sProcName, const char* sIniFi
 	fprintf(fReport, "Averaging time:          %s\n", cvMinutes);
 	fprintf(fReport, "Fuse:                    %s\n", cvFuse);
 	fclose(fReport);
+
+	// Queue the job to processing worker, if any; otherwise, start it directly
+	const char* svArgs[] = {sProcName, sIniFile, sCurRaw, cvDateTime, cvMinutes, cvFuse};
+	sprintf(cvKey, "%s %s %.13s", sExec, sCurRaw, cvDateTime);
+	if(submitProcessing(cvKey, (int)time(NULL) + iMinutes, sExec, svArgs, 6) == 0) return;
 	iPID = fork();
 	if(iPID == 0) {
 		// This is the child: execute the processing program
@@ -193,6 +234,7 @@ void dataProcessing2D(const char* sExec, const char* sProcName, const char* sCur
 	char cvDateTime[32];
 	char cvMinutes[5];
 	char cvFuse[5];
+	char cvKey[PROC_LINE_SIZE];
 	pid_t iPID;
 	
 	// If executable name is non empty, start it
@@ -209,6 +251,11 @@ void dataProcessing2D(const char* sExec, const char* sProcName, const char* sCur
 	fprintf(fReport, "Averaging time:          %s\n", cvMinutes);
 	fprintf(fReport, "Fuse:                    %s\n", cvFuse);
 	fclose(fReport);
+
+	// Queue the job to processing worker, if any; otherwise, start it directly
+	const char* svArgs[] = {sProcName, sCurRaw, cvDateTime, cvMinutes, cvFuse};
+	sprintf(cvKey, "%s %s %.13s", sExec, sCurRaw, cvDateTime);
+	if(submitProcessing(cvKey, (int)time(NULL) + iMinutes, sExec, svArgs, 5) == 0) return;
 	iPID = fork();
 	if(iPID == 0) {
 		// This is the child: execute the processing program
@@ -751,6 +798,394 @@ void openDataFile2D(FILE* *f, const char* basePath, const int year, const int mo
 	
 }
 
+/*****************************
+* Per-second moments support *
+*****************************/
+
+void openMomentsFile(FILE* *f, const char* basePath, const int year, const int month, const int day, const int hour) {
+
+	char buffer[256];
+	
+	sprintf(buffer, "%s/%04d%02d%02d.%02dM", basePath, year, month, day, hour);
+	*f = fopen(buffer, "ab");
+	
+}
+
+
+void clearMoments(SecondMoments* ptMoments, const int iSecond) {
+
+	int i;
+	
+	ptMoments->iSecond = iSecond;
+	ptMoments->n       = 0;
+	for(i=0; i<4; i++) {
+		ptMoments->ivSum[i] = 0;
+		ptMoments->ivMin[i] =  32767;
+		ptMoments->ivMax[i] = -32768;
+	}
+	for(i=0; i<10; i++) ptMoments->ivCross[i] = 0;
+	
+}
+
+
+// Add a sonic quadruple to summary; invalid data (-9999 and the like) are ignored
+void addMomentsSample(SecondMoments* ptMoments, const short int u, const short int v, const short int w, const short int t) {
+
+	short int ivRaw[4];
+	int i, j, k;
+	
+	if(u <= -9990 || v <= -9990 || w <= -9990 || t <= -9990) return;
+	ivRaw[0] = u;
+	ivRaw[1] = v;
+	ivRaw[2] = w;
+	ivRaw[3] = t;
+	
+	ptMoments->n++;
+	for(i=0; i<4; i++) {
+		ptMoments->ivSum[i] += ivRaw[i];
+		if(ivRaw[i] < ptMoments->ivMin[i]) ptMoments->ivMin[i] = ivRaw[i];
+		if(ivRaw[i] > ptMoments->ivMax[i]) ptMoments->ivMax[i] = ivRaw[i];
+	}
+	k = 0;
+	for(i=0; i<4; i++) {
+		for(j=i; j<4; j++) {
+			ptMoments->ivCross[k++] += (int32_t)ivRaw[i]*(int32_t)ivRaw[j];
+		}
+	}
+	
+}
+
+
+void mergeMoments(SecondMoments* ptTotal, const SecondMoments* ptPart) {
+
+	int i;
+	
+	if(ptPart->n <= 0) return;
+	if(ptTotal->iSecond != ptPart->iSecond) ptTotal->iSecond = -1;
+	ptTotal->n += ptPart->n;
+	for(i=0; i<4; i++) {
+		ptTotal->ivSum[i] += ptPart->ivSum[i];
+		if(ptPart->ivMin[i] < ptTotal->ivMin[i]) ptTotal->ivMin[i] = ptPart->ivMin[i];
+		if(ptPart->ivMax[i] > ptTotal->ivMax[i]) ptTotal->ivMax[i] = ptPart->ivMax[i];
+	}
+	for(i=0; i<10; i++) ptTotal->ivCross[i] += ptPart->ivCross[i];
+	
+}
+
+
+// Append a summary to moments file (empty seconds are not written)
+int writeMoments(FILE* f, const SecondMoments* ptMoments) {
+
+	if(!f) return(1);
+	if(ptMoments->n <= 0) return(0);
+	if(fwrite((void*)ptMoments, sizeof(SecondMoments), (size_t)1, f) != 1) return(2);
+	return(0);
+	
+}
+
+
+// Merge all summaries in an hourly moments file whose second of hour is
+// in [iSecondFrom, iSecondTo); returns the number of records merged, or -1
+// if the file could not be read
+int sumMomentsFile(const char* sFileName, const int iSecondFrom, const int iSecondTo, SecondMoments* ptTotal) {
+
+	SecondMoments tRecord;
+	int iNumMerged = 0;
+	
+	FILE* f = fopen(sFileName, "rb");
+	if(!f) return(-1);
+	while(fread((void*)&tRecord, sizeof(SecondMoments), (size_t)1, f) == 1) {
+		if(tRecord.iSecond >= iSecondFrom && tRecord.iSecond < iSecondTo) {
+			mergeMoments(ptTotal, &tRecord);
+			iNumMerged++;
+		}
+	}
+	fclose(f);
+	return(iNumMerged);
+	
+}
+
+
+// Centered cross-product sum, Sxy - Sx*Sy/n, from exact integer sums. Writing
+// Sx = qx*n + rx and rx*Sy = q*n + r, it equals (Sxy - qx*Sy - q) - r/n: the
+// integer part is exact (no overflow for n < 2^24 samples of 16 bit data),
+// so the only rounding is the final conversion, and there is no cancellation
+// as in the "Sxy/n - mean(x)*mean(y)" formula.
+double centeredCrossSum(const int64_t n, const int64_t iSumX, const int64_t iSumY, const int64_t iSumXY) {
+
+	int64_t iQx = iSumX / n;
+	int64_t iRx = iSumX - iQx*n;
+	int64_t iP  = iRx * iSumY;
+	int64_t iQ  = iP / n;
+	int64_t iR  = iP - iQ*n;
+	
+	return((double)(iSumXY - iQx*iSumY - iQ) - (double)iR / (double)n);
+	
+}
+
+
+// Compute means (u, v, w, t) and covariances (uu, uv, uw, ut, vv, vw, vt,
+// ww, wt, tt) from a summary, in m/s and °C; returns 1 if the summary is empty
+int getMomentsStatistics(const SecondMoments* ptMoments, double* rvAvg, double* rvCov) {
+
+	int i, j, k;
+	int n = ptMoments->n;
+	
+	if(n <= 0) {
+		for(i=0; i<4; i++)  rvAvg[i] = -9999.9;
+		for(i=0; i<10; i++) rvCov[i] = -9999.9;
+		return(1);
+	}
+	for(i=0; i<4; i++) rvAvg[i] = (double)ptMoments->ivSum[i] / (100.0 * n);
+	k = 0;
+	for(i=0; i<4; i++) {
+		for(j=i; j<4; j++) {
+			rvCov[k] = centeredCrossSum(n, ptMoments->ivSum[i], ptMoments->ivSum[j], ptMoments->ivCross[k]) / (10000.0 * n);
+			k++;
+		}
+	}
+	return(0);
+	
+}
+
+/****************
+* Storage tiers *
+****************/
+
+// Hourly data segments (raw sonic files, processing outputs, datalogger
+// files, GPS events) are born on RAM disk. Once an hour is "sealed", that
+// is no more written by anyone, its files may be moved to the flash spill
+// area whenever the RAM disk budget is exceeded. Readers never look at a
+// tier directly, but ask 'resolveHourlyFile' where the (station, hour)
+// segment currently lives. The same resolution rule is replicated in
+// 'archive', which is the final consumer of all hourly segments.
+
+#define SPILL_BLOCK_SIZE 1048576
+
+typedef struct SegmentInfo {
+	char   sName[MAX_CHARLEN];
+	long   lSize;
+	time_t tHour;
+	int    iYear;
+	int    iMonth;
+} SegmentInfo;
+
+
+// Decode an hourly file name, in forms "YYYYMMDD.HHx..." (sonic) and
+// "STATION_YYYYMMDD.HHx..." (datalogger); return 1 if the name matches,
+// 0 otherwise.
+static int parseHourlyName(const char* sName, int* iYear, int* iMonth, int* iDay, int* iHour) {
+
+	int i, j;
+	int iLen = strlen(sName);
+	
+	// Locate the "YYYYMMDD.HH" part, starting either at name begin or just after a '_'
+	for(i=0; i+11 <= iLen; i++) {
+		if(i > 0 && sName[i-1] != '_') continue;
+		for(j=0; j<11; j++) {
+			if(j == 8) {
+				if(sName[i+j] != '.') break;
+			}
+			else {
+				if(!isdigit(sName[i+j])) break;
+			}
+		}
+		if(j == 11 && i+11 < iLen) {
+			sscanf(sName+i, "%4d%2d%2d.%2d", iYear, iMonth, iDay, iHour);
+			return(1);
+		}
+	}
+	return(0);
+	
+}
+
+
+static int compareSegments(const void* a, const void* b) {
+
+	const SegmentInfo* sa = (const SegmentInfo*)a;
+	const SegmentInfo* sb = (const SegmentInfo*)b;
+	if(sa->tHour < sb->tHour) return(-1);
+	if(sa->tHour > sb->tHour) return(1);
+	return(strcmp(sa->sName, sb->sName));
+
+}
+
+
+// Move one sealed segment from RAM disk to flash, using large sequential
+// writes and committing it to the medium before releasing the RAM copy.
+static int spillSegment(const char* sRamRoot, const char* sSpillRoot, const SegmentInfo* ptSeg) {
+
+	char sFrom[256];
+	char sDir[256];
+	char sTemp[256];
+	char sTo[256];
+	size_t iNumBytes;
+	int iRetCode = 0;
+	
+	// Build paths, refusing any which would not fit
+	if(
+		snprintf(sDir, sizeof(sDir), "%s/%04d%02d", sSpillRoot, ptSeg->iYear, ptSeg->iMonth) >= (int)sizeof(sDir) ||
+		snprintf(sFrom, sizeof(sFrom), "%s/%s", sRamRoot, ptSeg->sName) >= (int)sizeof(sFrom) ||
+		snprintf(sTo, sizeof(sTo), "%s/%s", sDir, ptSeg->sName) >= (int)sizeof(sTo) ||
+		snprintf(sTemp, sizeof(sTemp), "%s.tmp", sTo) >= (int)sizeof(sTemp)
+	) {
+		syslog(LOG_ERR, "ST_LIB(TIER) : Path of segment %s too long, not spilled", ptSeg->sName);
+		return(6);
+	}
+	
+	// Ensure destination directory exists
+	mkdir(sSpillRoot, 0777);
+	if(mkdir(sDir, 0777) != 0 && errno != EEXIST) {
+		syslog(LOG_ERR, "ST_LIB(TIER) : Spill directory %s not created", sDir);
+		return(1);
+	}
+	
+	// Copy data block-wise
+	FILE* fIn = fopen(sFrom, "rb");
+	if(!fIn) return(2);
+	FILE* fOut = fopen(sTemp, "wb");
+	if(!fOut) {
+		fclose(fIn);
+		return(3);
+	}
+	char* buffer = (char*)malloc(SPILL_BLOCK_SIZE);
+	if(!buffer) {
+		fclose(fIn);
+		fclose(fOut);
+		unlink(sTemp);
+		return(4);
+	}
+	while((iNumBytes = fread(buffer, 1, SPILL_BLOCK_SIZE, fIn)) > 0) {
+		if(fwrite(buffer, 1, iNumBytes, fOut) != iNumBytes) {
+			iRetCode = 5;
+			break;
+		}
+	}
+	free(buffer);
+	fclose(fIn);
+	if(fflush(fOut) != 0 || fsync(fileno(fOut)) != 0) iRetCode = 5;
+	fclose(fOut);
+	
+	// Commit: only now the RAM copy can go
+	if(iRetCode != 0 || rename(sTemp, sTo) != 0) {
+		unlink(sTemp);
+		syslog(LOG_ERR, "ST_LIB(TIER) : Segment %s not spilled", ptSeg->sName);
+		return(5);
+	}
+	unlink(sFrom);
+	return(0);
+	
+}
+
+
+// Check the space taken by files on RAM disk and, if more than the budget,
+// spill sealed hourly segments to flash, oldest first, until back within budget.
+// Segments are "sealed" when their hour ended at least 'iGraceSeconds' ago
+// (this leaves processing and archiving the time to do their job on RAM).
+//
+// Returns the number of segments spilled, or a negative value on failure.
+int enforceRamBudget(const char* sRamRoot, const char* sSpillRoot, const long lBudgetBytes, const int iGraceSeconds, const int iFuse) {
+
+	DIR* d;
+	struct dirent* ptEntry;
+	struct stat tInfo;
+	struct tm tHour;
+	char sPath[256];
+	int iYear, iMonth, iDay, iHour;
+	int iNumSegments = 0;
+	int iMaxSegments = 0;
+	int iNumSpilled  = 0;
+	long lUsed = 0;
+	SegmentInfo* svSegment = NULL;
+	int i;
+	
+	// Get current (local) time, in the same convention used for file names
+	time_t tNow = time(NULL) + (time_t)(iFuse * 3600);
+	
+	// Scan RAM disk: measure usage, and collect sealed hourly segments
+	d = opendir(sRamRoot);
+	if(!d) return(-1);
+	while((ptEntry = readdir(d)) != NULL) {
+		if(strlen(ptEntry->d_name) >= MAX_CHARLEN) continue;
+		if(snprintf(sPath, sizeof(sPath), "%s/%s", sRamRoot, ptEntry->d_name) >= (int)sizeof(sPath)) continue;
+		if(stat(sPath, &tInfo) != 0 || !S_ISREG(tInfo.st_mode)) continue;
+		lUsed += (long)tInfo.st_size;
+		if(!parseHourlyName(ptEntry->d_name, &iYear, &iMonth, &iDay, &iHour)) continue;
+		memset(&tHour, 0, sizeof(tHour));
+		tHour.tm_year = iYear - 1900;
+		tHour.tm_mon  = iMonth - 1;
+		tHour.tm_mday = iDay;
+		tHour.tm_hour = iHour;
+		time_t tBegin = timegm(&tHour);
+		if(tBegin + ONE_HOUR_SECONDS + iGraceSeconds > tNow) continue;
+		if(iNumSegments >= iMaxSegments) {
+			iMaxSegments += 64;
+			SegmentInfo* svNew = (SegmentInfo*)realloc(svSegment, iMaxSegments*sizeof(SegmentInfo));
+			if(!svNew) break;
+			svSegment = svNew;
+		}
+		strcpy(svSegment[iNumSegments].sName, ptEntry->d_name);
+		svSegment[iNumSegments].lSize  = (long)tInfo.st_size;
+		svSegment[iNumSegments].tHour  = tBegin;
+		svSegment[iNumSegments].iYear  = iYear;
+		svSegment[iNumSegments].iMonth = iMonth;
+		iNumSegments++;
+	}
+	closedir(d);
+	
+	// Spill, oldest first, while over budget
+	if(lUsed > lBudgetBytes && iNumSegments > 0) {
+		qsort(svSegment, iNumSegments, sizeof(SegmentInfo), compareSegments);
+		for(i=0; i<iNumSegments && lUsed > lBudgetBytes; i++) {
+			if(spillSegment(sRamRoot, sSpillRoot, &svSegment[i]) == 0) {
+				lUsed -= svSegment[i].lSize;
+				iNumSpilled++;
+			}
+		}
+		syslog(LOG_INFO, "ST_LIB(TIER) : %d segments spilled to %s", iNumSpilled, sSpillRoot);
+	}
+	if(svSegment) free(svSegment);
+	
+	// Leave
+	return(iNumSpilled);
+	
+}
+
+
+// Locate the tier holding the (station, hour) segment with given suffix
+// (e.g. "R", "p", "d", "a"); an empty station identifies sonic files.
+// On exit 'sPath' contains the full file name (the RAM disk one if the
+// segment is nowhere to be found). Compressed copies (".gz") count as present.
+//
+// Returns 1 if segment is on RAM disk, 2 if on flash, 0 if not found.
+int resolveHourlyFile(const char* sRamRoot, const char* sSpillRoot, const char* sStation, const int year, const int month, const int day, const int hour, const char* sSuffix, char* sPath) {
+
+	char sName[MAX_CHARLEN];
+	char sCompressed[256];
+	
+	if(sStation != NULL && sStation[0] != '\0') {
+		sprintf(sName, "%s_%04d%02d%02d.%02d%s", sStation, year, month, day, hour, sSuffix);
+	}
+	else {
+		sprintf(sName, "%04d%02d%02d.%02d%s", year, month, day, hour, sSuffix);
+	}
+	
+	// RAM disk first (it is where segments are born)
+	sprintf(sPath, "%s/%s", sRamRoot, sName);
+	sprintf(sCompressed, "%s.gz", sPath);
+	if(access(sPath, F_OK) == 0 || access(sCompressed, F_OK) == 0) return(1);
+	
+	// Then flash
+	sprintf(sPath, "%s/%04d%02d/%s", sSpillRoot, year, month, sName);
+	sprintf(sCompressed, "%s.gz", sPath);
+	if(access(sPath, F_OK) == 0 || access(sCompressed, F_OK) == 0) return(2);
+	
+	// Not found: report the place where it would be born
+	sprintf(sPath, "%s/%s", sRamRoot, sName);
+	return(0);
+	
+}
+
 /*********************************
 * Time and time stamp management *
 *********************************/
@@ -1079,17 +1514,9 @@ void moveParticles(
 	double* smpU, double* smpV, double* smpW
 ) {
 
-	// Move particles according to sample
+	// Move particles according to sample (see 'sk_lib')
 	double deltaT = 1.0 / sonicFrequency;
-	int iPart;
-	for(iPart = 0; iPart < iNumParticles; iPart++) {
-		if(isValid[iPart] > 0) {
-			x[iPart] += smpU[iPart] * deltaT;
-			y[iPart] += smpV[iPart] * deltaT;
-			z[iPart] += smpW[iPart] * deltaT;
-			if(z[iPart] < 0) z[iPart] = -z[iPart];
-		}
-	}
+	skMoveParticles(iNumParticles, deltaT, x, y, z, isValid, smpU, smpV, smpW);
 
 }
 
@@ -1232,6 +1659,171 @@ void dumpFootprint(
 
 #define MAX_AVGS 16
 
+static void toSecondMoments(const SkMoments* ptPart, SecondMoments* ptMoments) {
+
+	int i;
+	
+	clearMoments(ptMoments, -1);
+	ptMoments->n = ptPart->n;
+	for(i=0; i<4; i++) {
+		ptMoments->ivSum[i] = ptPart->ivSum[i];
+		ptMoments->ivMin[i] = ptPart->ivMin[i];
+		ptMoments->ivMax[i] = ptPart->ivMax[i];
+	}
+	for(i=0; i<10; i++) ptMoments->ivCross[i] = ptPart->ivCross[i];
+	
+}
+
+
+// Perform 2 axis rotation and other statistical calculations on the summary
+// of one averaging window; write them
+static void writeAverages(FILE* f, const double fromTime, const double depth, const SecondMoments* ptMoments, const double sumVel, const double z) {
+
+	double vel, dir, temp, scalarVel, vel2, velStd, uAvg, vAvg, wAvg, tAvg;
+	double uStd, vStd, wStd, tStd;
+	double uvCov, uwCov, vwCov;
+	double utCov, vtCov, wtCov;
+	double uStar, H0, lm1;
+	double rPhi;
+
+	double u, v, w, t;
+	double uu, uv, uw, vv, vw, ww;
+	double ut, vt, wt;
+	double tt;
+	int n = ptMoments->n;
+	if(n > 0) {
+		
+		// Current averages and covariances
+		
+		double rvAvg[4];
+		double rvCov[10];
+		getMomentsStatistics(ptMoments, rvAvg, rvCov);
+		u  = rvAvg[0];
+		v  = rvAvg[1];
+		w  = rvAvg[2];
+		t  = rvAvg[3];
+		uu = rvCov[0];
+		uv = rvCov[1];
+		uw = rvCov[2];
+		ut = rvCov[3];
+		vv = rvCov[4];
+		vw = rvCov[5];
+		vt = rvCov[6];
+		ww = rvCov[7];
+		wt = rvCov[8];
+		tt = rvCov[9];
+		
+		scalarVel = sumVel / n;
+		vel2      = (double)(ptMoments->ivCross[0] + ptMoments->ivCross[4]) / (10000.0 * n);
+		
+		// First rotation
+		
+		double rTheta = atan2(v,u);
+		double cr     = cos(rTheta);
+		double sr     = sin(rTheta);
+		double cr2    = cos(2.*rTheta);
+		double sr2    = sin(2.*rTheta);
+		
+		double ur =  u*cr + v*sr;
+		double vr = -u*sr + v*cr;
+		double wr =  w;
+		
+		double utr =  ut*cr + vt*sr;
+		double vtr = -ut*sr + vt*cr;
+		double wtr =  wt;
+		
+		double uur = uu*cr*cr + vv*sr*sr + uv*sr2;
+		double uvr = 0.5*(2.*uv*cr2 + (vv-uu)*sr2);
+		double uwr = uw*cr + vw*sr;
+		double vvr = vv*cr*cr - 2.*uv*cr*sr + uu*sr*sr;
+		double vwr = vw*cr - uw*sr;
+		double wwr = ww;
+		
+		// Second rotation
+		
+		rPhi = 0.5*atan2(2.*vw, vv-ww);
+		double cs     = cos(rPhi);
+		double ss     = sin(rPhi);
+		double cs2    = cos(2.*rPhi);
+		double ss2    = sin(2.*rPhi);
+		
+		double us =  ur*cs + wr*ss;
+		double vs =  vr;
+		double ws =  wr*cs - ur*ss;
+		
+		double uts =  utr*cs + wtr*ss;
+		double vts =  vtr;
+		double wts =  wtr*cs - utr*ss;
+		
+		double uus = uur*cs*cs + wwr*ss*ss + uwr*ss2;
+		double uvs = uvr*cs + vwr*ss;
+		double uws = 0.5*(2.*uwr*cs2 + (wwr-uur)*ss2);
+		double vvs = vvr;
+		double vws = vwr*cs - uvr*ss;
+		double wws = wwr*cs*cs - 2.*uwr*cs*ss + uur*ss*ss;
+		
+		// Quantities to display
+		vel = sqrt(u*u + v*v);
+		dir = 180.*atan2(-u,-v)/3.1415927;
+		if(dir < 0.) dir += 360.;
+		velStd = sqrt(vel2 - scalarVel*scalarVel);
+		uAvg = u;
+		vAvg = v;
+		wAvg = w;
+		tAvg = t;
+		uStd = sqrt(uus);
+		vStd = sqrt(vvs);
+		wStd = sqrt(wws);
+		tStd = sqrt(tt);
+		uvCov = uvs;
+		uwCov = uws;
+		vwCov = vws;
+		utCov = uts;
+		vtCov = vts;
+		wtCov = wts;
+		uStar = sqrt(sqrt(uwCov*uwCov + vwCov*vwCov));
+		H0    = 350.125 * 1013.0 * exp(-0.0342/(tAvg+273.15)*z) / (tAvg + 273.15) * wtCov;
+		lm1   = -0.4*9.807/(tAvg+273.15) * wtCov / (uStar*uStar*uStar);
+		
+	}
+	
+	else {
+		
+		scalarVel = -9999.9;
+		vel       = -9999.9;
+		dir       = -9999.9;
+		velStd    = -9999.9;
+		uAvg      = -9999.9;
+		vAvg      = -9999.9;
+		wAvg      = -9999.9;
+		tAvg      = -9999.9;
+		uStd      = -9999.9;
+		vStd      = -9999.9;
+		wStd      = -9999.9;
+		tStd      = -9999.9;
+		uvCov     = -9999.9;
+		uwCov     = -9999.9;
+		vwCov     = -9999.9;
+		utCov     = -9999.9;
+		vtCov     = -9999.9;
+		wtCov     = -9999.9;
+		uStar     = -9999.9;
+		H0        = -9999.9;
+		lm1       = -9999.9;
+		rPhi      = -9999.9;
+		
+	}
+	
+	// Write data
+	fprintf(f, "%f\n%f\n%d\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n",
+		fromTime, depth, n,
+		vel, dir, tAvg, scalarVel, velStd, uAvg, vAvg, wAvg, uStd, vStd, wStd, tStd,
+		uvCov, uwCov, vwCov, utCov, vtCov, wtCov, uStar, H0, lm1, rPhi*180./3.1415927
+	);
+
+}
+
+
 int dumpQuadrupleAvgs(
 	char* fileName,
 	int iNumData,
@@ -1250,95 +1842,31 @@ int dumpQuadrupleAvgs(
 		iRetCode = 1;
 		return iRetCode;
 	}
-	int numSum[MAX_AVGS];
-	double sumU[MAX_AVGS], sumV[MAX_AVGS], sumW[MAX_AVGS], sumT[MAX_AVGS];
-	double sumUU[MAX_AVGS], sumVV[MAX_AVGS], sumWW[MAX_AVGS], sumTT[MAX_AVGS];
-	double sumUV[MAX_AVGS], sumUW[MAX_AVGS], sumVW[MAX_AVGS];
-	double sumUT[MAX_AVGS], sumVT[MAX_AVGS], sumWT[MAX_AVGS];
-	double sumVel[MAX_AVGS], sumVel2[MAX_AVGS];
+	SecondMoments tvMoments[MAX_AVGS];		// Exact integer sums (see 'SecondMoments')
+	double sumVel[MAX_AVGS];
 	double fromTime[MAX_AVGS];
 	
-	// Main loop: form partial sums based on quadruples time stamps
+	// Main loop: form partial sums based on quadruples time stamps, each
+	// quadruple going to the shortest averaging time containing it
 	int curAvg;
+	double toTime = now;
 	for(curAvg=0; curAvg<iNumAvgs; curAvg++) {
-		numSum[curAvg] = 0;
-		sumU[curAvg]   = 0.;
-		sumV[curAvg]   = 0.;
-		sumW[curAvg]   = 0.;
-		sumT[curAvg]   = 0.;
-		sumUU[curAvg]  = 0.;
-		sumVV[curAvg]  = 0.;
-		sumWW[curAvg]  = 0.;
-		sumTT[curAvg]  = 0.;
-		sumUV[curAvg]  = 0.;
-		sumUW[curAvg]  = 0.;
-		sumVW[curAvg]  = 0.;
-		sumUT[curAvg]  = 0.;
-		sumVT[curAvg]  = 0.;
-		sumWT[curAvg]  = 0.;
-		sumVel[curAvg] = 0.;
-		sumVel2[curAvg] = 0.;
+		SkMoments tPart;
 		fromTime[curAvg] = now - avgDepth[curAvg];
-	}
-	double U, V, W, T;
-	int i;
-	for(i=0; i<iNumData; i++) {
-		for(curAvg=0; curAvg<iNumAvgs; curAvg++) {
-			if(fromTime[curAvg] < ordTimeStamp[i] && ordTimeStamp[i] <= now) {
-				numSum[curAvg]++;
-				U = ordU[i]/100.0;
-				V = ordV[i]/100.0;
-				W = ordW[i]/100.0;
-				T = ordT[i]/100.0;
-				sumU[curAvg]  += U;
-				sumV[curAvg]  += V;
-				sumW[curAvg]  += W;
-				sumT[curAvg]  += T;
-				sumUU[curAvg] += U*U;
-				sumVV[curAvg] += V*V;
-				sumWW[curAvg] += W*W;
-				sumTT[curAvg] += T*T;
-				sumUV[curAvg] += U*V;
-				sumUW[curAvg] += U*W;
-				sumVW[curAvg] += V*W;
-				sumUT[curAvg] += U*T;
-				sumVT[curAvg] += V*T;
-				sumWT[curAvg] += W*T;
-				sumVel2[curAvg] += U*U + V*V;
-				sumVel[curAvg]  += sqrt(U*U + V*V);
-				break;
-			}
-		}
+		skClearMoments(&tPart);
+		skAddMoments(ordU, ordV, ordW, ordT, ordTimeStamp, fromTime[curAvg], toTime, iNumData, &tPart);
+		toSecondMoments(&tPart, &tvMoments[curAvg]);
+		sumVel[curAvg] = tPart.rSumVel / 100.0;
+		if(fromTime[curAvg] < toTime) toTime = fromTime[curAvg];
 	}
 	
-	// Convert from partial to total sums
+	// Convert from partial to total sums (exact, being integer)
 	for(curAvg=1; curAvg<iNumAvgs; curAvg++) {
-		numSum[curAvg] += numSum[curAvg-1];
-		sumU[curAvg]   += sumU[curAvg-1];
-		sumV[curAvg]   += sumV[curAvg-1];
-		sumW[curAvg]   += sumW[curAvg-1];
-		sumT[curAvg]   += sumT[curAvg-1];
-		sumUU[curAvg]  += sumUU[curAvg-1];
-		sumVV[curAvg]  += sumVV[curAvg-1];
-		sumWW[curAvg]  += sumWW[curAvg-1];
-		sumTT[curAvg]  += sumTT[curAvg-1];
-		sumUV[curAvg]  += sumUV[curAvg-1];
-		sumUW[curAvg]  += sumUW[curAvg-1];
-		sumVW[curAvg]  += sumVW[curAvg-1];
-		sumUT[curAvg]  += sumUT[curAvg-1];
-		sumVT[curAvg]  += sumVT[curAvg-1];
-		sumWT[curAvg]  += sumWT[curAvg-1];
+		mergeMoments(&tvMoments[curAvg], &tvMoments[curAvg-1]);
 		sumVel[curAvg] += sumVel[curAvg-1];
-		sumVel2[curAvg] += sumVel2[curAvg-1];
 	}
 	
 	// Perform 2 axis rotation and other statistical calculations; write them
-	double vel, dir, temp, scalarVel, vel2, velStd, uAvg, vAvg, wAvg, tAvg;
-	double uStd, vStd, wStd, tStd;
-	double uvCov, uwCov, vwCov;
-	double utCov, vtCov, wtCov;
-	double uStar, H0, lm1;
-	double rPhi;
 	FILE* f = fopen(fileName, "w");
 	if(!f) {
 		iRetCode = 1;
@@ -1346,138 +1874,7 @@ int dumpQuadrupleAvgs(
 	}
 	fprintf(f, "%d\n", (int)iNumAvgs);
 	for(curAvg=0; curAvg<iNumAvgs; curAvg++) {
-		double u, v, w, t;
-		double uu, uv, uw, vv, vw, ww;
-		double ut, vt, wt;
-		double tt;
-		int n = numSum[curAvg];
-		if(n > 0) {
-			
-			// Current averages and covariances
-			
-			u  = sumU[curAvg] / n;
-			v  = sumV[curAvg] / n;
-			w  = sumW[curAvg] / n;
-			t  = sumT[curAvg] / n;
-			uu = sumUU[curAvg] / n - u*u;
-			uv = sumUV[curAvg] / n - u*v;
-			uw = sumUW[curAvg] / n - u*w;
-			vv = sumVV[curAvg] / n - v*v;
-			vw = sumVW[curAvg] / n - v*w;
-			ww = sumWW[curAvg] / n - w*w;
-			ut = sumUT[curAvg] / n - u*t;
-			vt = sumVT[curAvg] / n - v*t;
-			wt = sumWT[curAvg] / n - w*t;
-			tt = sumTT[curAvg] / n - t*t;
-			
-			scalarVel = sumVel[curAvg] / n;
-			vel2      = sumVel2[curAvg] / n;
-			
-			// First rotation
-			
-			double rTheta = atan2(v,u);
-			double cr     = cos(rTheta);
-			double sr     = sin(rTheta);
-			double cr2    = cos(2.*rTheta);
-			double sr2    = sin(2.*rTheta);
-			
-			double ur =  u*cr + v*sr;
-			double vr = -u*sr + v*cr;
-			double wr =  w;
-			
-			double utr =  ut*cr + vt*sr;
-			double vtr = -ut*sr + vt*cr;
-			double wtr =  wt;
-			
-			double uur = uu*cr*cr + vv*sr*sr + uv*sr2;
-			double uvr = 0.5*(2.*uv*cr2 + (vv-uu)*sr2);
-			double uwr = uw*cr + vw*sr;
-			double vvr = vv*cr*cr - 2.*uv*cr*sr + uu*sr*sr;
-			double vwr = vw*cr - uw*sr;
-			double wwr = ww;
-			
-			// Second rotation
-			
-			rPhi = 0.5*atan2(2.*vw, vv-ww);
-			double cs     = cos(rPhi);
-			double ss     = sin(rPhi);
-			double cs2    = cos(2.*rPhi);
-			double ss2    = sin(2.*rPhi);
-			
-			double us =  ur*cs + wr*ss;
-			double vs =  vr;
-			double ws =  wr*cs - ur*ss;
-			
-			double uts =  utr*cs + wtr*ss;
-			double vts =  vtr;
-			double wts =  wtr*cs - utr*ss;
-			
-			double uus = uur*cs*cs + wwr*ss*ss + uwr*ss2;
-			double uvs = uvr*cs + vwr*ss;
-			double uws = 0.5*(2.*uwr*cs2 + (wwr-uur)*ss2);
-			double vvs = vvr;
-			double vws = vwr*cs - uvr*ss;
-			double wws = wwr*cs*cs - 2.*uwr*cs*ss + uur*ss*ss;
-			
-			// Quantities to display
-			vel = sqrt(u*u + v*v);
-			dir = 180.*atan2(-u,-v)/3.1415927;
-			if(dir < 0.) dir += 360.;
-			velStd = sqrt(vel2 - scalarVel*scalarVel);
-			uAvg = u;
-			vAvg = v;
-			wAvg = w;
-			tAvg = t;
-			uStd = sqrt(uus);
-			vStd = sqrt(vvs);
-			wStd = sqrt(wws);
-			tStd = sqrt(tt);
-			uvCov = uvs;
-			uwCov = uws;
-			vwCov = vws;
-			utCov = uts;
-			vtCov = vts;
-			wtCov = wts;
-			uStar = sqrt(sqrt(uwCov*uwCov + vwCov*vwCov));
-			H0    = 350.125 * 1013.0 * exp(-0.0342/(tAvg+273.15)*z) / (tAvg + 273.15) * wtCov;
-			lm1   = -0.4*9.807/(tAvg+273.15) * wtCov / (uStar*uStar*uStar);
-			
-		}
-		
-		else {
-			
-			scalarVel = -9999.9;
-			vel       = -9999.9;
-			dir       = -9999.9;
-			velStd    = -9999.9;
-			uAvg      = -9999.9;
-			vAvg      = -9999.9;
-			wAvg      = -9999.9;
-			tAvg      = -9999.9;
-			uStd      = -9999.9;
-			vStd      = -9999.9;
-			wStd      = -9999.9;
-			tStd      = -9999.9;
-			uvCov     = -9999.9;
-			uwCov     = -9999.9;
-			vwCov     = -9999.9;
-			utCov     = -9999.9;
-			vtCov     = -9999.9;
-			wtCov     = -9999.9;
-			uStar     = -9999.9;
-			H0        = -9999.9;
-			lm1       = -9999.9;
-			rPhi      = -9999.9;
-			
-		}
-		
-		// Write data
-		fprintf(f, "%f\n%f\n%d\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n%f\n",
-			fromTime[curAvg], avgDepth[curAvg], numSum[curAvg],
-			vel, dir, tAvg, scalarVel, velStd, uAvg, vAvg, wAvg, uStd, vStd, wStd, tStd,
-			uvCov, uwCov, vwCov, utCov, vtCov, wtCov, uStar, H0, lm1, rPhi*180./3.1415927
-		);
-		
+		writeAverages(f, fromTime[curAvg], avgDepth[curAvg], &tvMoments[curAvg], sumVel[curAvg], z);
 	}
 	fclose(f);
 
@@ -1485,3 +1882,130 @@ int dumpQuadrupleAvgs(
 	return iRetCode;
 
 };
+
+
+/**************************
+* Sliding windows         *
+**************************/
+
+static void clearSlidingSecond(SlidingSecond* ptSecond, const int iEpoch) {
+
+	ptSecond->iEpoch  = iEpoch;
+	ptSecond->iSumVel = 0;
+	clearMoments(&ptSecond->tMoments, -1);
+	
+}
+
+
+static void addSlidingSecond(SlidingSecond* ptTotal, const SlidingSecond* ptPart, const int iSign) {
+
+	int i;
+	
+	ptTotal->tMoments.n += iSign * ptPart->tMoments.n;
+	for(i=0; i<4; i++)  ptTotal->tMoments.ivSum[i]   += iSign * ptPart->tMoments.ivSum[i];
+	for(i=0; i<10; i++) ptTotal->tMoments.ivCross[i] += iSign * ptPart->tMoments.ivCross[i];
+	ptTotal->iSumVel += iSign * ptPart->iSumVel;
+	
+}
+
+
+// Move the second being accumulated to ring and window totals, taking
+// away from each window the seconds left behind since the last one (none
+// but one, unless data were missing); after a gap longer than the deepest
+// window all is restarted
+static void closeSecond(SlidingWindows* ptWindows) {
+
+	const SlidingSecond* ptNew = &ptWindows->tCurrent;
+	const int iRing = ptWindows->iRingSize;
+	SlidingSecond* ptOld;
+	int iSecond;
+	int i;
+	
+	if(ptWindows->iLastClosed >= 0 && ptNew->iEpoch - ptWindows->iLastClosed < iRing) {
+		for(i=0; i<ptWindows->iNumWindows; i++) {
+			for(iSecond = ptWindows->iLastClosed + 1 - ptWindows->ivDepth[i]; iSecond <= ptNew->iEpoch - ptWindows->ivDepth[i]; iSecond++) {
+				ptOld = &ptWindows->tvRing[iSecond % iRing];
+				if(ptOld->iEpoch == iSecond) addSlidingSecond(&ptWindows->tvTotal[i], ptOld, -1);
+			}
+		}
+	}
+	else {
+		for(i=0; i<ptWindows->iNumWindows; i++) clearSlidingSecond(&ptWindows->tvTotal[i], -1);
+		for(i=0; i<iRing; i++) ptWindows->tvRing[i].iEpoch = -1;
+	}
+	ptWindows->tvRing[ptNew->iEpoch % iRing] = *ptNew;
+	for(i=0; i<ptWindows->iNumWindows; i++) addSlidingSecond(&ptWindows->tvTotal[i], ptNew, 1);
+	ptWindows->iLastClosed = ptNew->iEpoch;
+	
+}
+
+
+int swInit(SlidingWindows* ptWindows, const int iNumWindows, const int* ivDepth) {
+
+	int i;
+	
+	memset(ptWindows, 0, sizeof(SlidingWindows));
+	if(iNumWindows < 1 || iNumWindows > SW_MAX_WINDOWS) return(1);
+	for(i=0; i<iNumWindows; i++) {
+		if(ivDepth[i] < 1 || ivDepth[i] > SW_MAX_DEPTH || (i > 0 && ivDepth[i] <= ivDepth[i-1])) return(2);
+		ptWindows->ivDepth[i] = ivDepth[i];
+		clearSlidingSecond(&ptWindows->tvTotal[i], -1);
+	}
+	ptWindows->iNumWindows = iNumWindows;
+	ptWindows->iRingSize   = ivDepth[iNumWindows-1];
+	ptWindows->tvRing      = malloc(ptWindows->iRingSize * sizeof(SlidingSecond));
+	if(ptWindows->tvRing == NULL) return(3);
+	for(i=0; i<ptWindows->iRingSize; i++) ptWindows->tvRing[i].iEpoch = -1;
+	ptWindows->iLastClosed = -1;
+	clearSlidingSecond(&ptWindows->tCurrent, -1);
+	return(0);
+	
+}
+
+
+void swFree(SlidingWindows* ptWindows) {
+	free(ptWindows->tvRing);
+	ptWindows->tvRing = NULL;
+}
+
+
+// Records arriving late, within a second already complete (or older), are
+// accounted to the current one
+void swAddRecord(SlidingWindows* ptWindows, const int iNowEpoch, const short int ivRecord[5]) {
+
+	int iEpoch;
+	
+	if(ptWindows->tvRing == NULL) return;
+	iEpoch = iNowEpoch - ((iNowEpoch - ivRecord[0]) % ONE_HOUR_SECONDS + ONE_HOUR_SECONDS) % ONE_HOUR_SECONDS;
+	if(iEpoch > ptWindows->tCurrent.iEpoch) {
+		if(ptWindows->tCurrent.iEpoch >= 0) closeSecond(ptWindows);
+		clearSlidingSecond(&ptWindows->tCurrent, iEpoch);
+	}
+	if(ivRecord[1] <= -9990 || ivRecord[2] <= -9990 || ivRecord[3] <= -9990 || ivRecord[4] <= -9990) return;
+	addMomentsSample(&ptWindows->tCurrent.tMoments, ivRecord[1], ivRecord[2], ivRecord[3], ivRecord[4]);
+	ptWindows->tCurrent.iSumVel += llround(SW_VEL_SCALE * sqrt((double)ivRecord[1]*ivRecord[1] + (double)ivRecord[2]*ivRecord[2]));
+	
+}
+
+
+int swWrite(const SlidingWindows* ptWindows, const char* sFileName, const double z) {
+
+	int i;
+	
+	FILE* f = fopen(sFileName, "w");
+	if(!f) return(1);
+	fprintf(f, "%d\n", ptWindows->iNumWindows);
+	for(i=0; i<ptWindows->iNumWindows; i++) {
+		writeAverages(
+			f,
+			(double)(ptWindows->iLastClosed + 1 - ptWindows->ivDepth[i]),
+			(double)ptWindows->ivDepth[i],
+			&ptWindows->tvTotal[i].tMoments,
+			ptWindows->tvTotal[i].iSumVel / (100.0 * SW_VEL_SCALE),
+			z
+		);
+	}
+	fclose(f);
+	return(0);
+	
+}
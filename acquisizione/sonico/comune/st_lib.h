@@ -18,6 +18,7 @@
 #include <syslog.h>
 #include <termios.h>
 #include <time.h>
+#include <stdint.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 
@@ -32,6 +33,54 @@
 #define LOCK_FILE              "/var/run/usa_acq.pid"
 #define LOCK_FILE_2D           "/var/run/usa_2d.pid"
 #define CMD_INPUT              "/mnt/ramdisk/cmd_server"
+#define PROC_QUEUE             "/mnt/ramdisk/proc_queue"		// Job input of "proc_worker"
+#define PROC_LINE_SIZE         512		// Job line maximum length (less than PIPE_BUF)
+#define DATA_SPILL             "/mnt/data/spill"
+#define RAM_BUDGET             6144		// RAM disk budget for data files, in kByte
+
+// Per-second moments summary: count, sums, cross-products and extrema of
+// valid (u,v,w,t) samples taken within one second. Summaries are mergeable,
+// so that means and covariances over any window aligned to whole seconds
+// may be built summing them, without touching raw data again.
+// Sums are kept in 64 bit integers, in raw units, straight from samples:
+// they are exact, so merging order does not matter and results are the
+// same on any machine. Conversion to physical units happens only in
+// 'getMomentsStatistics'.
+typedef struct SecondMoments {
+	int       iSecond;		// Second of hour (0..3599); -1 for merged summaries
+	int       n;			// Number of valid samples
+	int64_t   ivSum[4];		// Sums of u, v, w (cm/s) and t (1/100 °C)
+	int64_t   ivCross[10];	// Sums of uu, uv, uw, ut, vv, vw, vt, ww, wt, tt (raw units squared)
+	short int ivMin[4];		// Minima, in raw units (cm/s, 1/100 °C)
+	short int ivMax[4];		// Maxima, in raw units (cm/s, 1/100 °C)
+} SecondMoments;
+
+// Sliding windows of per-second summaries, for online eddy covariance:
+// the summaries of the last seconds (as many as the deepest window) are
+// kept in a ring, and each window has a running total, to which each
+// second is added when complete and from which it is taken away when it
+// falls out of the window. Sums being exact integers, totals never drift,
+// and each sample costs O(1) whatever the number and depth of windows.
+// Extrema cannot be taken away, and are not maintained in totals.
+#define SW_MAX_WINDOWS  16
+#define SW_MAX_DEPTH  3600		// Deepest window (s)
+#define SW_VEL_SCALE   100		// Horizontal speed sums are in 1/SW_VEL_SCALE cm/s
+
+typedef struct SlidingSecond {
+	int           iEpoch;		// Second, as epoch; -1 if none
+	SecondMoments tMoments;
+	int64_t       iSumVel;		// Sum of horizontal speeds
+} SlidingSecond;
+
+typedef struct SlidingWindows {
+	int            iNumWindows;
+	int            ivDepth[SW_MAX_WINDOWS];		// Window depths (s), increasing
+	SlidingSecond  tvTotal[SW_MAX_WINDOWS];		// Summaries of seconds in windows
+	int            iRingSize;						// Deepest window
+	SlidingSecond* tvRing;						// Last complete seconds, at epoch % iRingSize
+	int            iLastClosed;					// Last complete second; -1 if none
+	SlidingSecond  tCurrent;					// Second being accumulated
+} SlidingWindows;
 
 // Process management
 void daemonize(const char *progName);
@@ -51,6 +100,7 @@ int readValue(const char* buffer, const int start, const int nchar);
 int readDataLine(const short int iTimeStamp, const char* buffer, short int ivData[], const int debug);
 int readDataLine3D(const short int iTimeStamp, const char* buffer, short int ivData[], const int debug);
 int readDataLine2D(const short int iTimeStamp, const char* buffer, short int ivData[], const int debug);
+int  submitProcessing(const char* sKey, const int iDeadline, const char* sExec, const char* svArgs[], const int iNumArgs);
 void dataProcessing(const char* sExec, const char* sProcName, const char* sIniFile, const char* sCurRaw, struct tm *ptTime, const int iMinutes, const int iFuse);
 void dataProcessing2D(const char* sExec, const char* sProcName, const char* sCurRaw, struct tm *ptTime, const int iMinutes, const int iFuse);
 
@@ -58,6 +108,20 @@ void dataProcessing2D(const char* sExec, const char* sProcName, const char* sCur
 void openDataFile(FILE* *f, const char* basePath, const int year, const int month, const int day, const int hour);
 void openDataFile2D(FILE* *f, const char* basePath, const int year, const int month, const int day, const int hour);
 
+// Storage tiers (RAM disk and flash spill area)
+int enforceRamBudget(const char* sRamRoot, const char* sSpillRoot, const long lBudgetBytes, const int iGraceSeconds, const int iFuse);
+int resolveHourlyFile(const char* sRamRoot, const char* sSpillRoot, const char* sStation, const int year, const int month, const int day, const int hour, const char* sSuffix, char* sPath);
+
+// Per-second moments summaries
+void openMomentsFile(FILE* *f, const char* basePath, const int year, const int month, const int day, const int hour);
+void clearMoments(SecondMoments* ptMoments, const int iSecond);
+void addMomentsSample(SecondMoments* ptMoments, const short int u, const short int v, const short int w, const short int t);
+void mergeMoments(SecondMoments* ptTotal, const SecondMoments* ptPart);
+int  writeMoments(FILE* f, const SecondMoments* ptMoments);
+int  sumMomentsFile(const char* sFileName, const int iSecondFrom, const int iSecondTo, SecondMoments* ptTotal);
+int  getMomentsStatistics(const SecondMoments* ptMoments, double* rvAvg, double* rvCov);
+double centeredCrossSum(const int64_t n, const int64_t iSumX, const int64_t iSumY, const int64_t iSumXY);
+
 // Timing support
 double nowRelative(void);
 int nowAbsolute(int iFuse, int* iEpoch, int* iYear, int* iMonth, int* iDay, int* iHour, int* iMinute, int* iSecond);
@@ -94,6 +158,16 @@ int dumpQuadrupleAvgs(
 	double* avgDepth		// Must be in increasing order, with iNumAvgs components
 );
 
+// Online eddy covariance by sliding windows: 'ivDepth' (s) must be
+// increasing, with iNumWindows in 1..SW_MAX_WINDOWS; a record {second of
+// hour, u, v, w, t} is added with the current epoch, which is at most an
+// hour after its time stamp; results of the windows ending with the last
+// complete second are written as by 'dumpQuadrupleAvgs'
+int  swInit(SlidingWindows* ptWindows, const int iNumWindows, const int* ivDepth);
+void swFree(SlidingWindows* ptWindows);
+void swAddRecord(SlidingWindows* ptWindows, const int iNowEpoch, const short int ivRecord[5]);
+int  swWrite(const SlidingWindows* ptWindows, const char* sFileName, const double z);
+
 //NanoPart and NanoWhere support
 
 void getRawData(
@@ -0,0 +1,429 @@
+/*
+
+	stream_merge - Streaming, time-aligned merge of sonic and datalogger
+	               processed data.
+
+	Sonic processed blocks ("YYYYMMDD.HHp") and the processed blocks of
+	datalogger data set Merge:DataSet ("<DataSet>_YYYYMMDD.HHq") are read
+	as they are appended, every Merge:PollInterval seconds, wherever the
+	storage tiers hold them (see 'resolveHourlyFile' in st_lib), and
+	joined by block time stamp (see "mg_lib"): one record per averaging
+	block is appended to "YYYYMMDD.HHm" on RAM disk, with the sonic
+	fields, the datalogger fields and the sources present (1 = sonic,
+	2 = datalogger, 3 = both); missing fields are -9999.9. A block waits at
+	most Merge:MaxDelay seconds for its missing part, and at most
+	Merge:MaxPending blocks wait at once. With no data set configured,
+	sonic blocks go through alone.
+
+	Each hourly file is read until Merge:MaxDelay seconds past its end, so
+	that blocks closed just after the hour change are not lost. As "archive"
+	transfers the merged file one hour after its end, Merge:MaxDelay is
+	limited to one hour less Merge:PollInterval. On restart, blocks up to
+	the last one already merged are skipped.
+
+	Counters are kept in MERGE_STATUS.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include "st_lib.h"
+#include "mg_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <syslog.h>
+#include <signal.h>
+#include "iniparser.h"
+
+#define MERGE_STATUS     "/mnt/ramdisk/MergeStatus.txt"
+#define MERGE_SUFFIX     "m"
+
+#define POLL_INTERVAL      5
+#define MAX_DELAY        900
+#define STATUS_INTERVAL   10
+#define ONE_HOUR        3600
+
+#define TRUE  -1
+#define FALSE  0
+
+// Hourly files of one side, being followed
+typedef struct Stream {
+	int      iSide;
+	char     sStation[64];				// Data set name ("" for sonic)
+	char     sSuffix[4];
+	int      iHour;						// Hour being read, as epoch
+	long     lOffset;					// Bytes of it consumed
+	int      nFields;					// Fields after time stamp; 0 until known
+	char     sHeader[MG_MAX_LINE];		// Their names, if a header was found
+	unsigned iRecords;
+	unsigned iInvalid;
+} Stream;
+
+// Output state
+typedef struct Output {
+	const Stream* tvStream;
+	int           iHour;					// Hour of the file last written, as epoch; -1 if none
+	int           ivFields[MG_NUM_SIDES];	// Field counts in that file
+	unsigned      iRecords;
+} Output;
+
+void sigterm(int signo) {
+	syslog(LOG_INFO, "Got SIGTERM, exiting");
+	exit(0);
+}
+
+
+static void hourlyFileName(const char* sStation, const int iEpoch, const char* sSuffix, char* sPath) {
+
+	time_t    tStamp = (time_t)iEpoch;
+	struct tm tTime;
+
+	gmtime_r(&tStamp, &tTime);
+	resolveHourlyFile(DATA_SET, DATA_SPILL, sStation, tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday, tTime.tm_hour, sSuffix, sPath);
+
+}
+
+
+static int parseTimeStamp(const char* sLine, int* piTimeStamp) {
+
+	struct tm tTime;
+
+	memset(&tTime, 0, sizeof(tTime));
+	if(sscanf(sLine, "%d-%d-%d %d:%d:%d", &tTime.tm_year, &tTime.tm_mon, &tTime.tm_mday, &tTime.tm_hour, &tTime.tm_min, &tTime.tm_sec) != 6) return(1);
+	tTime.tm_year -= 1900;
+	tTime.tm_mon  -= 1;
+	*piTimeStamp = (int)timegm(&tTime);
+	return(0);
+
+}
+
+
+static int countFields(const char* sFields) {
+
+	int n = 1;
+
+	if(sFields[0] == '\0') return(0);
+	for(; *sFields != '\0'; sFields++) {
+		if(*sFields == ',') n++;
+	}
+	return(n);
+
+}
+
+
+/**********************
+* Input               *
+**********************/
+
+// Push complete lines appended to the hourly file being followed; lines
+// with time stamp not after 'iResume' are skipped
+static void readStream(Stream* ptStream, MgMerger* ptMerger, const int iResume, const int iNow) {
+
+	FILE* f;
+	char  sPath[256];
+	char  sLine[MG_MAX_LINE + 64];
+	char* sFields;
+	int   iLen;
+	int   iTimeStamp;
+
+	hourlyFileName(ptStream->sStation, ptStream->iHour, ptStream->sSuffix, sPath);
+	f = fopen(sPath, "r");
+	if(f == NULL) return;
+	if(fseek(f, ptStream->lOffset, SEEK_SET) != 0) {
+		fclose(f);
+		return;
+	}
+	while(fgets(sLine, sizeof(sLine), f) != NULL) {
+
+		// Lines still being written are left for next time
+		iLen = strlen(sLine);
+		if(iLen <= 0 || sLine[iLen-1] != '\n') {
+			if(iLen < (int)sizeof(sLine) - 1) break;
+			ptStream->lOffset += iLen;		// Too long to be a block: skip it
+			ptStream->iInvalid++;
+			continue;
+		}
+		ptStream->lOffset += iLen;
+		while(iLen > 0 && (sLine[iLen-1] == '\n' || sLine[iLen-1] == '\r')) sLine[--iLen] = '\0';
+		if(iLen == 0) continue;
+		sFields = strchr(sLine, ',');
+		sFields = sFields != NULL ? sFields + 1 : sLine + iLen;
+
+		// Header, or block
+		if(!isdigit((unsigned char)sLine[0])) {
+			strncpy(ptStream->sHeader, sFields, MG_MAX_LINE - 1);
+			ptStream->sHeader[MG_MAX_LINE - 1] = '\0';
+			ptStream->nFields = countFields(sFields);
+			continue;
+		}
+		if(parseTimeStamp(sLine, &iTimeStamp) != 0) {
+			ptStream->iInvalid++;
+			continue;
+		}
+		if(ptStream->nFields <= 0) ptStream->nFields = countFields(sFields);
+		ptStream->iRecords++;
+		if(iTimeStamp <= iResume) continue;
+		mgPush(ptMerger, ptStream->iSide, iTimeStamp, sFields, iNow);
+
+	}
+	fclose(f);
+
+}
+
+
+// Follow hourly files, moving on to the next hour once the grace time
+// past its end is over
+static void pollStream(Stream* ptStream, MgMerger* ptMerger, const int iResume, const int iNow) {
+
+	while(1) {
+		readStream(ptStream, ptMerger, iResume, iNow);
+		if(iNow < ptStream->iHour + ONE_HOUR + ptMerger->iMaxDelay) break;
+		ptStream->iHour  += ONE_HOUR;
+		ptStream->lOffset = 0;
+	}
+
+}
+
+
+// Time stamp of last block in a merged file; -1 if none
+static int lastMerged(const int iHour) {
+
+	FILE* f;
+	char  sPath[256];
+	char  sLine[2*MG_MAX_LINE + 64];
+	int   iTimeStamp;
+	int   iLast = -1;
+
+	hourlyFileName("", iHour, MERGE_SUFFIX, sPath);
+	f = fopen(sPath, "r");
+	if(f == NULL) return(-1);
+	while(fgets(sLine, sizeof(sLine), f) != NULL) {
+		if(isdigit((unsigned char)sLine[0]) && parseTimeStamp(sLine, &iTimeStamp) == 0) iLast = iTimeStamp;
+	}
+	fclose(f);
+	return(iLast);
+
+}
+
+
+/**********************
+* Output              *
+**********************/
+
+// Write exactly 'nFields' fields, padding with invalid values or truncating
+static void writeFields(FILE* f, const char* sFields, const int iPresent, const int nFields) {
+
+	int i;
+
+	if(iPresent && countFields(sFields) == nFields) {
+		if(nFields > 0) fprintf(f, ",%s", sFields);
+		return;
+	}
+	for(i=0; i<nFields; i++) {
+		if(iPresent && *sFields != '\0') {
+			fputc(',', f);
+			for(; *sFields != '\0' && *sFields != ','; sFields++) fputc(*sFields, f);
+			if(*sFields == ',') sFields++;
+		}
+		else {
+			fprintf(f, ",-9999.9");
+		}
+	}
+
+}
+
+
+static void writeBlock(const MgBlock* ptBlock, void* pUserData) {
+
+	Output*   ptOutput = (Output*)pUserData;
+	FILE*     f;
+	char      sPath[256];
+	int       iHour;
+	int       iNew;
+	int       iSide;
+	time_t    tStamp = (time_t)ptBlock->iTimeStamp;
+	struct tm tTime;
+
+	// Open hourly file, with header if new
+	iHour = ptBlock->iTimeStamp - ptBlock->iTimeStamp % ONE_HOUR;
+	hourlyFileName("", iHour, MERGE_SUFFIX, sPath);
+	iNew = access(sPath, F_OK) != 0;
+	f = fopen(sPath, "a");
+	if(f == NULL) {
+		syslog(LOG_ERR, "Merged data file %s not opened", sPath);
+		return;
+	}
+	if(iHour != ptOutput->iHour || iNew) {
+		ptOutput->iHour = iHour;
+		for(iSide=0; iSide<MG_NUM_SIDES; iSide++) ptOutput->ivFields[iSide] = ptOutput->tvStream[iSide].nFields;
+	}
+	if(iNew) {
+		fprintf(f, "Date.Time");
+		for(iSide=0; iSide<MG_NUM_SIDES; iSide++) {
+			if(ptOutput->ivFields[iSide] <= 0) continue;
+			if(ptOutput->tvStream[iSide].sHeader[0] != '\0') fprintf(f, ",%s", ptOutput->tvStream[iSide].sHeader);
+			else                                             writeFields(f, "", FALSE, ptOutput->ivFields[iSide]);
+		}
+		fprintf(f, ",Sources\n");
+	}
+
+	// Write block
+	gmtime_r(&tStamp, &tTime);
+	fprintf(f, "%04d-%02d-%02d %02d:%02d:%02d",
+		tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday,
+		tTime.tm_hour, tTime.tm_min, tTime.tm_sec
+	);
+	for(iSide=0; iSide<MG_NUM_SIDES; iSide++) {
+		writeFields(f, ptBlock->svFields[iSide], ptBlock->iSources & (1 << iSide), ptOutput->ivFields[iSide]);
+	}
+	fprintf(f, ",%d\n", ptBlock->iSources);
+	fclose(f);
+	ptOutput->iRecords++;
+
+}
+
+
+static void writeStatus(const MgMerger* ptMerger, const Stream* tvStream, const Output* ptOutput) {
+
+	FILE* f;
+
+	f = fopen(MERGE_STATUS, "w");
+	if(f == NULL) return;
+	fprintf(f, "[Blocks]\n");
+	fprintf(f, "Written  = %u\n", ptOutput->iRecords);
+	fprintf(f, "Complete = %u\n", ptMerger->iComplete);
+	fprintf(f, "Partial  = %u\n", ptMerger->iPartial);
+	fprintf(f, "Forced   = %u\n", ptMerger->iForced);
+	fprintf(f, "Late     = %u\n", ptMerger->iLate);
+	fprintf(f, "Replaced = %u\n", ptMerger->iReplaced);
+	fprintf(f, "Pending  = %d\n", ptMerger->nPending);
+	fprintf(f, "\n[Sonic]\n");
+	fprintf(f, "Records  = %u\n", tvStream[MG_SONIC].iRecords);
+	fprintf(f, "Invalid  = %u\n", tvStream[MG_SONIC].iInvalid);
+	fprintf(f, "\n[Logger]\n");
+	fprintf(f, "Records  = %u\n", tvStream[MG_LOGGER].iRecords);
+	fprintf(f, "Invalid  = %u\n", tvStream[MG_LOGGER].iInvalid);
+	fclose(f);
+
+}
+
+
+int main(int argc, char** argv) {
+
+	char     configFile[256];
+	int      debug = FALSE;
+	int      iNow;
+	int      iYear, iMonth, iDay, iHour, iMinute, iSecond;
+	int      iStartHour;
+	int      iResume;
+	int      iExpected;
+	int      iLastStatus = 0;
+	unsigned iLastRecords = 0;
+	int      iSide;
+	Stream   tvStream[MG_NUM_SIDES];
+	Output   tOutput;
+	MgMerger tMerger;
+
+	// Get input parameters
+	if(argc != 2 && argc != 3) {
+		printf("stream_merge - Streaming merge of sonic and datalogger processed data\n\n");
+		printf("Usage:\n\n");
+		printf("  stream_merge <cfgFile> [--debug]\n\n");
+		exit(1);
+	}
+	strcpy(configFile, argv[1]);
+	debug = (argc==3);
+
+	// Get configuration data from configFile
+	FILE* fc = fopen(configFile, "r");
+	if(!fc) {
+		syslog(LOG_ERR, "Configuration file missing or not found");
+		exit(20);
+	}
+	fclose(fc);
+	dictionary* ini = iniparser_load(configFile);
+	int iFuse = iniparser_getint(ini, (const char *)"General:Fuse", 1);
+	if(iFuse < -12) iFuse = -12;
+	if(iFuse >  12) iFuse =  12;
+	char* sDataSet = iniparser_getstring(ini, (const char *)"Merge:DataSet", "");
+	int iPollInterval = iniparser_getint(ini, (const char *)"Merge:PollInterval", POLL_INTERVAL);
+	if(iPollInterval < 1) iPollInterval = 1;
+	int iMaxDelay = iniparser_getint(ini, (const char *)"Merge:MaxDelay", MAX_DELAY);
+	if(iMaxDelay > ONE_HOUR - iPollInterval) iMaxDelay = ONE_HOUR - iPollInterval;	// "archive" takes the hour one hour after its end
+	if(iMaxDelay < 0) iMaxDelay = 0;
+	int iMaxPending = iniparser_getint(ini, (const char *)"Merge:MaxPending", MG_MAX_PENDING);
+	if(iMaxPending > MG_MAX_PENDING) iMaxPending = MG_MAX_PENDING;
+	if(iMaxPending < 1) iMaxPending = 1;
+
+	// Manage start mode (normal is as "daemon")
+	if(debug) {
+		startconsole("stream_merge");
+	}
+	else {
+		daemonize("stream_merge");
+	}
+
+	// Assign signal handlers
+	struct sigaction sa;
+	sa.sa_handler = sigterm;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	if(sigaction(SIGTERM, &sa, NULL) < 0) {
+		syslog(LOG_ERR, "Can't catch SIGTERM: %s", strerror(errno));
+		exit(3);
+	}
+
+	// Set streams up, starting from the oldest hour still within grace time,
+	// and resuming after the last block merged already, if any
+	nowAbsolute(iFuse, &iNow, &iYear, &iMonth, &iDay, &iHour, &iMinute, &iSecond);
+	iStartHour = (iNow - iMaxDelay) - (iNow - iMaxDelay) % ONE_HOUR;
+	iResume    = lastMerged(iNow - iNow % ONE_HOUR);
+	if(iResume < 0 && iStartHour < iNow - iNow % ONE_HOUR) iResume = lastMerged(iStartHour);
+	memset(tvStream, 0, sizeof(tvStream));
+	for(iSide=0; iSide<MG_NUM_SIDES; iSide++) {
+		tvStream[iSide].iSide = iSide;
+		tvStream[iSide].iHour = iStartHour;
+	}
+	strcpy(tvStream[MG_SONIC].sSuffix, "p");
+	strcpy(tvStream[MG_LOGGER].sSuffix, "q");
+	strncpy(tvStream[MG_LOGGER].sStation, sDataSet, sizeof(tvStream[MG_LOGGER].sStation) - 1);
+	iExpected = 1 << MG_SONIC;
+	if(sDataSet[0] != '\0') iExpected |= 1 << MG_LOGGER;
+	memset(&tOutput, 0, sizeof(tOutput));
+	tOutput.tvStream = tvStream;
+	tOutput.iHour    = -1;
+	if(mgInit(&tMerger, iExpected, iMaxDelay, iMaxPending, writeBlock, &tOutput) != 0) {
+		syslog(LOG_ERR, "Merge buffer not allocated");
+		if(debug) printf("Merge buffer not allocated\n");
+		exit(4);
+	}
+	iniparser_freedict(ini);
+
+	// Main loop: follow streams, release blocks, report
+	while(1) {
+
+		nowAbsolute(iFuse, &iNow, &iYear, &iMonth, &iDay, &iHour, &iMinute, &iSecond);
+		pollStream(&tvStream[MG_SONIC], &tMerger, iResume, iNow);
+		if(iExpected & (1 << MG_LOGGER)) pollStream(&tvStream[MG_LOGGER], &tMerger, iResume, iNow);
+		mgAdvance(&tMerger, iNow);
+		if(debug && tOutput.iRecords != iLastRecords) {
+			printf("Merged: %u, pending: %d\n", tOutput.iRecords, tMerger.nPending);
+			iLastRecords = tOutput.iRecords;
+		}
+
+		if(iNow - iLastStatus >= STATUS_INTERVAL) {
+			writeStatus(&tMerger, tvStream, &tOutput);
+			iLastStatus = iNow;
+		}
+		sleep(iPollInterval);
+
+	}
+
+	// Leave
+	mgFree(&tMerger);
+	exit(0);
+
+}
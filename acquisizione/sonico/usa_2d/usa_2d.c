@@ -49,15 +49,40 @@ void sighup(int signo) {
 }
 
 
+// RAM disk budget is kept by a helper thread, as spilling hours to flash
+// takes directory scans and synchronous copies, which would otherwise
+// delay reads from the serial port
+typedef struct RamBudget {
+	long lBudgetBytes;
+	int  iInterval;			// Seconds between checks; hours are sealed two intervals after their end
+	int  iFuse;
+} RamBudget;
+
+
+static void *keepRamBudget(void *arg) {
+
+	const RamBudget* ptBudget = (const RamBudget*)arg;
+
+	while(1) {
+
+		// Wait one interval, then move sealed hours to flash if over budget
+		sleep(ptBudget->iInterval);
+		enforceRamBudget(DATA_SET, DATA_SPILL, ptBudget->lBudgetBytes, 2*ptBudget->iInterval, ptBudget->iFuse);
+
+	}
+
+}
+
+
 static void *cleanProcesses(void *arg) {
 
 	while(1) {
 
 		// Wait ten seconds, then scan process list to check if any
-		// descendant has terminated; in case, remove it from list
+		// descendant has terminated; in case, remove them all from list
 		// (that is, "delete zombie processes")
 		sleep(10);
-		pid_t iPID = waitpid(-1, NULL, WNOHANG | WUNTRACED);
+		while(waitpid(-1, NULL, WNOHANG) > 0);
 
 	}
 
@@ -122,6 +147,9 @@ int main(int argc, char** argv) {
 	int iStatusInterval = iniparser_getint(ini, (const char *)"Timing:StatusInterval", STATUS_INTERVAL);
 	if(iStatusInterval > STATUS_INTERVAL) iStatusInterval = STATUS_INTERVAL;
 	if(iStatusInterval < 1) iStatusInterval = 1;
+	// -1- Storage
+	int iRamBudget = iniparser_getint(ini, (const char *)"Storage:RamBudget", RAM_BUDGET);
+	if(iRamBudget < 1024) iRamBudget = 1024;
 	// -1- Ultrasonic anemometer configuration data
 	int iSamplingRate = iniparser_getint(ini, (const char *)"SonicAnemometer:SamplingFrequency", USA_FREQ);
 	if(iSamplingRate > USA_FREQ) iSamplingRate = USA_FREQ;
@@ -186,6 +214,16 @@ int main(int argc, char** argv) {
 	pthread_t tid;
 	pthread_create(&tid, NULL, cleanProcesses, NULL);
 	
+	// Start RAM disk budget thread
+	RamBudget tRamBudget;
+	tRamBudget.lBudgetBytes = (long)iRamBudget * 1024L;
+	tRamBudget.iInterval    = iAveragingPeriod;
+	tRamBudget.iFuse        = iFuse;
+	pthread_t tBudgetId;
+	if(pthread_create(&tBudgetId, NULL, keepRamBudget, &tRamBudget) != 0) {
+		syslog(LOG_ERR, "RAM disk budget thread not started: data will stay on RAM disk");
+	}
+	
 	// Create command input named pipe, if it does not exist yet
 	// (normally it does not on start, as pipe resides in RAM disk)
 	if(access(CMD_INPUT, F_OK) == -1) {
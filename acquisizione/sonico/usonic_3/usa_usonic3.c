@@ -11,10 +11,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "iniparser.h"
+#include "ec_lib.h"
+#include "ds_lib.h"
 
 #define ANEMOMETER_HEIGHT      3.5
 #define PROCESSING_INTERVAL  600
 #define EDDYCOV_INTERVAL      60
+#define EDDYCOV_DEPTHS       "60,300,600,1800"
+#define EDDYCOV_FILE         "/mnt/ramdisk/UsaEddyCov.txt"
 #define NANOPART_INTERVAL     10
 #define STATUS_INTERVAL       10
 #define RAWDATA_INTERVAL       5
@@ -51,15 +55,170 @@ void sighup(int signo) {
 }
 
 
+// Account a record in per-second moments, writing the previous second's
+// on second change, in online eddy covariance windows (if any) and in the
+// count of valid packets
+static void accountRecord(FILE* fm, SecondMoments* ptMoments, SlidingWindows* ptWindows, const int iNowEpoch, const short int ivRecord[5], unsigned int* piNumValid) {
+
+	if(ivRecord[0] != ptMoments->iSecond) {
+		writeMoments(fm, ptMoments);
+		clearMoments(ptMoments, ivRecord[0]);
+	}
+	addMomentsSample(ptMoments, ivRecord[1], ivRecord[2], ivRecord[3], ivRecord[4]);
+	if(ptWindows != NULL) swAddRecord(ptWindows, iNowEpoch, ivRecord);
+	if(
+		ivRecord[1] > -9999 &&
+		ivRecord[2] > -9999 &&
+		ivRecord[3] > -9999 &&
+		ivRecord[4] > -9999
+	) (*piNumValid)++;
+
+}
+
+
+// In-process eddy covariance is made by a worker thread, so that the serial
+// port is read meanwhile. At each processing time the main loop hands over a
+// copy of the hour data so far, which replaces the request for the same hour
+// if not taken yet (its data being a subset of the new ones); the worker then
+// computes only the blocks completed since its previous run on that hour.
+typedef struct ProcessingRequest {
+	int            iCurTime;		// Epoch of the interval to process up to; -1 if no request
+	int            iBuffered;		// Zero if hour data are to be read from raw file
+	EddyHourBuffer tData;
+} ProcessingRequest;
+
+typedef struct InProcessWorker {
+	pthread_mutex_t    tLock;
+	pthread_cond_t     tReady;
+	ProcessingRequest  tvRequest[2];	// One per hour, by hour parity
+	const EddyConfig*  ptConfig;
+	int                iAveragingTime;
+	EddyHourResults    tResults;
+	EddyWorkspace      tWork;
+} InProcessWorker;
+
+
+static void initInProcess(InProcessWorker* ptWorker, const EddyConfig* ptConfig, const int iAveragingTime) {
+
+	int i;
+
+	pthread_mutex_init(&ptWorker->tLock, NULL);
+	pthread_cond_init(&ptWorker->tReady, NULL);
+	for(i=0; i<2; i++) {
+		ptWorker->tvRequest[i].iCurTime = -1;
+		ecBufferInit(&ptWorker->tvRequest[i].tData);
+	}
+	ptWorker->ptConfig       = ptConfig;
+	ptWorker->iAveragingTime = iAveragingTime;
+	ecResultsInit(&ptWorker->tResults);
+	ecWorkspaceInit(&ptWorker->tWork);
+
+}
+
+
+// Hand processing up to 'iCurTime' over to the worker, with the data of its
+// hour if buffered; return 1 if a request for an earlier hour was still
+// pending and is lost, 2 if data were not copied, 0 otherwise
+static int submitInProcess(InProcessWorker* ptWorker, const EddyHourBuffer* tvBuffer, const int iNumBuffers, const int iCurTime) {
+
+	const int          iHourBegin = iCurTime - iCurTime % ONE_HOUR;
+	ProcessingRequest* ptRequest;
+	int                iRetCode = 0;
+	int                i;
+
+	pthread_mutex_lock(&ptWorker->tLock);
+	ptRequest = &ptWorker->tvRequest[(iHourBegin / ONE_HOUR) % 2];
+	if(ptRequest->iCurTime >= 0 && ptRequest->tData.iHourBegin != iHourBegin) iRetCode = 1;
+	ecBufferReset(&ptRequest->tData, iHourBegin);
+	ptRequest->iBuffered = FALSE;
+	for(i=0; i<iNumBuffers; i++) {
+		if(tvBuffer[i].iHourBegin == iHourBegin) {
+			if(ecBufferCopy(&ptRequest->tData, &tvBuffer[i]) == 0) ptRequest->iBuffered = TRUE;
+			else                                                   iRetCode = 2;
+			break;
+		}
+	}
+	ptRequest->iCurTime = iCurTime;
+	pthread_cond_signal(&ptWorker->tReady);
+	pthread_mutex_unlock(&ptWorker->tLock);
+	return(iRetCode);
+
+}
+
+
+static void *processInBackground(void *arg) {
+
+	InProcessWorker* ptWorker = (InProcessWorker*)arg;
+	EddyHourBuffer   tData;
+	EddyHourBuffer   tSwap;
+	int              iCurTime;
+	int              iBuffered;
+	int              iSlot;
+	int              iRetCode;
+
+	ecBufferInit(&tData);
+	while(1) {
+
+		// Wait for a request, and take the oldest one, leaving the
+		// buffer just used in its place
+		pthread_mutex_lock(&ptWorker->tLock);
+		while(ptWorker->tvRequest[0].iCurTime < 0 && ptWorker->tvRequest[1].iCurTime < 0) {
+			pthread_cond_wait(&ptWorker->tReady, &ptWorker->tLock);
+		}
+		if(ptWorker->tvRequest[0].iCurTime < 0)      iSlot = 1;
+		else if(ptWorker->tvRequest[1].iCurTime < 0) iSlot = 0;
+		else iSlot = ptWorker->tvRequest[0].iCurTime < ptWorker->tvRequest[1].iCurTime ? 0 : 1;
+		iCurTime  = ptWorker->tvRequest[iSlot].iCurTime;
+		iBuffered = ptWorker->tvRequest[iSlot].iBuffered;
+		tSwap     = ptWorker->tvRequest[iSlot].tData;
+		ptWorker->tvRequest[iSlot].tData    = tData;
+		ptWorker->tvRequest[iSlot].iCurTime = -1;
+		tData     = tSwap;
+		pthread_mutex_unlock(&ptWorker->tLock);
+
+		// Hours not fully buffered (the first after start) are read from raw file
+		iRetCode = ecProcessNewAndWrite(ptWorker->ptConfig, iBuffered ? &tData : NULL, DATA_SET, iCurTime, ptWorker->iAveragingTime, &ptWorker->tResults, &ptWorker->tWork);
+		if(iRetCode != 0) syslog(LOG_ERR, "In-process eddy covariance failed with code %d", iRetCode);
+
+	}
+
+}
+
+
+// RAM disk budget is kept by a helper thread, as spilling hours to flash
+// takes directory scans and synchronous copies, which would otherwise
+// delay reads from the serial port
+typedef struct RamBudget {
+	long lBudgetBytes;
+	int  iInterval;			// Seconds between checks; hours are sealed two intervals after their end
+	int  iFuse;
+} RamBudget;
+
+
+static void *keepRamBudget(void *arg) {
+
+	const RamBudget* ptBudget = (const RamBudget*)arg;
+
+	while(1) {
+
+		// Wait one interval, then move sealed hours to flash if over budget
+		sleep(ptBudget->iInterval);
+		enforceRamBudget(DATA_SET, DATA_SPILL, ptBudget->lBudgetBytes, 2*ptBudget->iInterval, ptBudget->iFuse);
+
+	}
+
+}
+
+
 static void *cleanProcesses(void *arg) {
 
 	while(1) {
 
 		// Wait ten seconds, then scan process list to check if any
-		// descendant has terminated; in case, remove it from list
+		// descendant has terminated; in case, remove them all from list
 		// (that is, "delete zombie processes")
 		sleep(10);
-		pid_t iPID = waitpid(-1, NULL, WNOHANG | WUNTRACED);
+		while(waitpid(-1, NULL, WNOHANG) > 0);
 
 	}
 
@@ -85,10 +244,24 @@ int main(int argc, char** argv) {
 	char buffer[64];
 	short int ivData[5];
 	FILE* f;
+	FILE* fm;
+	SecondMoments tSecondMoments;
 	int iRecordType;
 	int justStarted = TRUE;
 	char cmdBuffer[CMD_BUF_SIZE+1];
 	double z;
+	EddyConfig tEddyConfig;
+	InProcessWorker tInProcess;
+	EddyHourBuffer tvHourBuffer[2];
+	int iCurBuffer = 0;
+	DsFilter* ptDespiker = NULL;
+	short int ivClean[5];
+	int iSpikeFlags;
+	SlidingWindows tWindows;
+	SlidingWindows* ptWindows = NULL;
+	int ivDepth[MAX_AVGS];
+	int iNumDepths;
+	char* p;
 	
 	// Get input parameters
 	if(argc != 3 && argc != 4) {
@@ -116,6 +289,7 @@ int main(int argc, char** argv) {
 	if(iFuse >  12) iFuse =  12;
 	z = iniparser_getdouble(ini, (const char *)"General:AnemometerHeight", 10.0);
 	if(z <= 0.5) z = 0.5;
+	double rAltitude = iniparser_getdouble(ini, (const char *)"General:Altitude", 0.0);
 	// -1- Timing
 	int iProcessingInterval = iniparser_getint(ini, (const char *)"Timing:ProcessingInterval", PROCESSING_INTERVAL);
 	if(iProcessingInterval > PROCESSING_INTERVAL) iProcessingInterval = PROCESSING_INTERVAL;
@@ -123,12 +297,56 @@ int main(int argc, char** argv) {
 	int iEddyCovarianceInterval = iniparser_getint(ini, (const char *)"Timing:EddyCovarianceInterval", EDDYCOV_INTERVAL);
 	if(iEddyCovarianceInterval > EDDYCOV_INTERVAL) iEddyCovarianceInterval = EDDYCOV_INTERVAL;
 	if(iEddyCovarianceInterval < 1) iEddyCovarianceInterval = 1;
+	char* sDepths = iniparser_getstring(ini, (const char *)"Timing:EddyCovarianceDepths", EDDYCOV_DEPTHS);
 	int iStatusInterval = iniparser_getint(ini, (const char *)"Timing:StatusInterval", STATUS_INTERVAL);
 	if(iStatusInterval > STATUS_INTERVAL) iStatusInterval = STATUS_INTERVAL;
 	if(iStatusInterval < 1) iStatusInterval = 1;
 	int iRawDataInterval = iniparser_getint(ini, (const char *)"Timing:RawDataInterval", RAWDATA_INTERVAL);
 	if(iRawDataInterval > RAWDATA_INTERVAL) iRawDataInterval = RAWDATA_INTERVAL;
 	if(iRawDataInterval < 1) iRawDataInterval = 1;
+	// -1- Storage
+	int iRamBudget = iniparser_getint(ini, (const char *)"Storage:RamBudget", RAM_BUDGET);
+	if(iRamBudget < 1024) iRamBudget = 1024;
+	// -1- Processing (in-process engine, or external "eddy_cov")
+	int iInProcess = iniparser_getint(ini, (const char *)"Processing:InProcess", 0);
+	if(iInProcess) {
+		iRetCode = ecReadConfig(DATA_PROCESSING_CONFIG, &tEddyConfig);
+		if(iRetCode == 4) {
+			syslog(LOG_ERR, "Processing configuration asks for planar fit: using external eddy_cov");
+			iInProcess = FALSE;
+		}
+		else if(iRetCode != 0) {
+			syslog(LOG_ERR, "Processing configuration not read: using external eddy_cov");
+			iInProcess = FALSE;
+		}
+		initInProcess(&tInProcess, &tEddyConfig, iProcessingInterval);
+		ecBufferInit(&tvHourBuffer[0]);
+		ecBufferInit(&tvHourBuffer[1]);
+	}
+	// -1- Despiking of data entering per-second moments (raw data are stored as received)
+	if(iniparser_getint(ini, (const char *)"Despiking:Enabled", 0)) {
+		ptDespiker = dsFilterNew(
+			iniparser_getint(ini, (const char *)"Despiking:Window", DS_DEFAULT_WINDOW),
+			iniparser_getdouble(ini, (const char *)"Despiking:Threshold", DS_DEFAULT_THRESHOLD),
+			DS_MIN_DEVIATION
+		);
+		if(ptDespiker == NULL) syslog(LOG_ERR, "Despiking filter not allocated: data will not be despiked");
+	}
+	// -1- Online eddy covariance, on sliding windows of the depths given (s, increasing)
+	iNumDepths = 0;
+	p = sDepths;
+	while(iNumDepths < MAX_AVGS) {
+		ivDepth[iNumDepths] = (int)strtol(p, &p, 10);
+		if(ivDepth[iNumDepths] <= 0) break;
+		iNumDepths++;
+		while(*p == ',' || *p == ' ') p++;
+	}
+	if(swInit(&tWindows, iNumDepths, ivDepth) == 0) {
+		ptWindows = &tWindows;
+	}
+	else {
+		syslog(LOG_ERR, "Invalid eddy covariance window depths: online eddy covariance disabled");
+	}
 	// -1- Ultrasonic anemometer configuration data
 	int iSonicType = iniparser_getint(ini, (const char *)"SonicAnemometer:SensorType", 1);  // 0 = USA-1, 1 = uSonic-3
 	if(iSonicType > 1) iSonicType = 1;
@@ -209,6 +427,25 @@ int main(int argc, char** argv) {
 	pthread_t tid;
 	pthread_create(&tid, NULL, cleanProcesses, NULL);
 	
+	// Start RAM disk budget thread
+	RamBudget tRamBudget;
+	tRamBudget.lBudgetBytes = (long)iRamBudget * 1024L;
+	tRamBudget.iInterval    = iProcessingInterval;
+	tRamBudget.iFuse        = iFuse;
+	pthread_t tBudgetId;
+	if(pthread_create(&tBudgetId, NULL, keepRamBudget, &tRamBudget) != 0) {
+		syslog(LOG_ERR, "RAM disk budget thread not started: data will stay on RAM disk");
+	}
+	
+	// Start in-process eddy covariance thread
+	if(iInProcess) {
+		pthread_t tProcessingId;
+		if(pthread_create(&tProcessingId, NULL, processInBackground, &tInProcess) != 0) {
+			syslog(LOG_ERR, "In-process eddy covariance thread not started: using external eddy_cov");
+			iInProcess = FALSE;
+		}
+	}
+	
 	// Create command input named pipe, if it does not exist yet
 	// (normally it does not on start, as pipe resides in RAM disk)
 	if(access(CMD_INPUT, F_OK) == -1) {
@@ -237,9 +474,12 @@ int main(int argc, char** argv) {
 		if(debug) printf("Initial output data file not opened\n");
 		exit(6);
 	}
+	openMomentsFile(&fm, DATA_SET, iYear, iMonth, iDay, iHour);
+	clearMoments(&tSecondMoments, -1);
 	int iNumSonicPackets = 0;
 	unsigned int iNumTotPackets = 0;
 	unsigned int iNumValidPackets = 0;
+	unsigned int iNumSpikyPackets = 0;
 	while(1) {
 		
 		// Inspect command input pipe: if it contains a command execute it on the fly
@@ -267,6 +507,22 @@ int main(int argc, char** argv) {
 		if(hourChanged) {
 			fclose(f);
 			openDataFile(&f, DATA_SET, iYear, iMonth, iDay, iHour);
+			if(ptDespiker != NULL) {
+				// Release records still in filter, which belong to the hour just ended
+				while(dsFilterFlush(ptDespiker, ivClean, &iSpikeFlags)) {
+					accountRecord(fm, &tSecondMoments, ptWindows, iEpochTemp, ivClean, &iNumValidPackets);
+					if(iSpikeFlags) iNumSpikyPackets++;
+				}
+			}
+			writeMoments(fm, &tSecondMoments);
+			clearMoments(&tSecondMoments, -1);
+			if(fm) fclose(fm);
+			openMomentsFile(&fm, DATA_SET, iYear, iMonth, iDay, iHour);
+			if(iInProcess) {
+				// Previous hour is kept until its last processing step is made
+				iCurBuffer = 1 - iCurBuffer;
+				ecBufferReset(&tvHourBuffer[iCurBuffer], iEpochTemp - iEpochTemp % ONE_HOUR);
+			}
 		};
 		
 		// Start processing on "current" file
@@ -275,21 +531,29 @@ int main(int argc, char** argv) {
 			
 			// Flush data to disk, to ensure all most recent data are available
 			fflush(f);
+			if(fm) fflush(fm);
 		
 			time_t tTime;
 			struct tm *ptTime;
 			tTime = (time_t)(iEpoch1 - iProcessingInterval);
 			ptTime = gmtime(&tTime);
 			syslog(LOG_ERR, "About to start processing");
-			dataProcessing(
-				DATA_PROCESSING_EXEC,
-				"eddy_cov",
-				"/home/standard/bin/eddy_cov.nml",
-				DATA_SET,
-				ptTime,
-				iProcessingInterval,
-				iFuse
-			);
+			if(iInProcess) {
+				iRetCode = submitInProcess(&tInProcess, tvHourBuffer, 2, iEpoch1 - iProcessingInterval);
+				if(iRetCode == 1) syslog(LOG_ERR, "In-process eddy covariance late: last step of previous hour skipped");
+				if(iRetCode == 2) syslog(LOG_ERR, "In-process eddy covariance data not copied: reading raw file");
+			}
+			else {
+				dataProcessing(
+					DATA_PROCESSING_EXEC,
+					"eddy_cov",
+					"/home/standard/bin/eddy_cov.nml",
+					DATA_SET,
+					ptTime,
+					iProcessingInterval,
+					iFuse
+				);
+			}
 			
 		}
 		
@@ -303,14 +567,17 @@ int main(int argc, char** argv) {
 			if(iRecordType == 1) {
 
 				iNumTotPackets++;
-
-				// Check data validity
-				if(
-					ivData[1] > -9999 &&
-					ivData[2] > -9999 &&
-					ivData[3] > -9999 &&
-					ivData[4] > -9999
-				) iNumValidPackets++;
+				if(iInProcess) ecBufferAppend(&tvHourBuffer[iCurBuffer], ivData);
+
+				// Update per-second moments summary and validity count, on
+				// despiked data if requested (released with half window delay)
+				if(ptDespiker == NULL) {
+					accountRecord(fm, &tSecondMoments, ptWindows, iEpochTemp, ivData, &iNumValidPackets);
+				}
+				else if(dsFilterPush(ptDespiker, ivData, ivClean, &iSpikeFlags)) {
+					accountRecord(fm, &tSecondMoments, ptWindows, iEpochTemp, ivClean, &iNumValidPackets);
+					if(iSpikeFlags) iNumSpikyPackets++;
+				}
 
 			}
 
@@ -326,6 +593,12 @@ int main(int argc, char** argv) {
 			port = connect(serialPortName, B9600);
 		}
 		
+		// Write online eddy covariance results, from windows ending with the last complete second
+		timeForProcessing = isNewAbsoluteTimeStep(iFuse, &iEpoch3, iEddyCovarianceInterval);
+		if(timeForProcessing && !justStarted && ptWindows != NULL) {
+			if(swWrite(ptWindows, EDDYCOV_FILE, rAltitude) != 0) syslog(LOG_ERR, "Online eddy covariance results not written");
+		}
+		
 		// Start status assessment/notification
 		timeForProcessing = isNewAbsoluteTimeStep(iFuse, &iEpoch5, iStatusInterval);
 		if(timeForProcessing && !justStarted) {
@@ -339,6 +612,7 @@ int main(int argc, char** argv) {
 			fprintf(stt,"\n[Packets]\n");
 			fprintf(stt, "Total = %d\n", iNumTotPackets);
 			fprintf(stt, "Valid = %d\n", iNumValidPackets);
+			if(ptDespiker != NULL) fprintf(stt, "Despiked = %d\n", iNumSpikyPackets);
 			fprintf(stt, "Last data = %d, %d, %d, %d\n", ivData[1], ivData[2], ivData[3], ivData[4]);
 			fclose(stt);
 
@@ -360,6 +634,7 @@ int main(int argc, char** argv) {
 
 			iNumTotPackets = 0;
 			iNumValidPackets = 0;
+			iNumSpikyPackets = 0;
 			
 		}
 		
@@ -369,8 +644,10 @@ int main(int argc, char** argv) {
 	}
 	
 	// Leave
+	if(ptWindows != NULL) swFree(ptWindows);
 	disconnect(port);
 	fclose(f);
+	if(fm) fclose(fm);
 	exit(0);
 
 }
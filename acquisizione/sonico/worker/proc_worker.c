@@ -0,0 +1,451 @@
+/*
+
+	proc_worker - Long-lived processing worker.
+
+	Acquisition tasks hand their processing jobs (eddy_cov, proc2d) to this
+	task through the PROC_QUEUE named pipe, one line per job (see
+	'submitProcessing' in st_lib). Jobs are queued by deadline (the time
+	the next job of the same task is expected), and a queued job is
+	superseded by a newer one with the same key, as processing the same
+	hour at a later time covers all blocks of the former. At most
+	Processing:MaxRunningJobs jobs run at once, and never two with the
+	same key.
+
+	For each job, waiting and run times, CPU time and peak resident set
+	size are appended to PROC_METRICS; counters, overruns (jobs completing
+	after their deadline) included, are kept in PROC_STATUS.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include "st_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "iniparser.h"
+
+#define PROC_METRICS    "/mnt/logs/proc_worker.csv"
+#define PROC_STATUS     "/mnt/ramdisk/WorkerStatus.txt"
+
+#define MAX_QUEUED       32
+#define MAX_RUNNING       4
+#define MAX_ARGS         16
+#define STATUS_INTERVAL  10
+
+#define TRUE  -1
+#define FALSE  0
+
+typedef struct Job {
+	int    iDeadline;				// Epoch by which job should be complete
+	int    iSubmitted;				// Epoch of submission
+	double rSubmitted;				// Same, by monotonic clock
+	double rStarted;
+	pid_t  iPID;					// 0 if slot is free
+	char   sLine[PROC_LINE_SIZE];	// Job line, split in place
+	char*  sKey;
+	char*  sExec;
+	char*  svArgv[MAX_ARGS+1];
+} Job;
+
+typedef struct WorkerCounters {
+	unsigned int iSubmitted;
+	unsigned int iCoalesced;		// Superseded while queued
+	unsigned int iDropped;			// Refused, queue full or invalid
+	unsigned int iStarted;
+	unsigned int iCompleted;
+	unsigned int iFailed;			// Non-zero exit, or killed
+	unsigned int iOverruns;
+	double       rMaxWait;
+	double       rMaxRun;
+	long         lMaxRSS;
+} WorkerCounters;
+
+static Job            tvQueued[MAX_QUEUED];
+static int            iNumQueued = 0;
+static Job            tvRunning[MAX_RUNNING];
+static WorkerCounters tCounters;
+
+void sigterm(int signo) {
+	syslog(LOG_INFO, "Got SIGTERM, exiting");
+	exit(0);
+}
+
+
+// Split a job line ("deadline<TAB>key<TAB>exec<TAB>arg0<TAB>...") in place;
+// return 0 on success. Lines not fitting a job are refused, rather than
+// truncated (which could make a different, valid job of them)
+static int parseJob(const char* sLine, Job* ptJob) {
+
+	char*  p;
+	char*  sField;
+	int    iField = 0;
+	int    iNumArgs = 0;
+	size_t iLen;
+
+	memset(ptJob, 0, sizeof(Job));
+	iLen = strlen(sLine);
+	if(iLen >= PROC_LINE_SIZE) return(4);
+	memcpy(ptJob->sLine, sLine, iLen + 1);
+	p = ptJob->sLine;
+	while((sField = strsep(&p, "\t")) != NULL) {
+		switch(iField++) {
+		case 0:
+			if(sscanf(sField, "%d", &ptJob->iDeadline) != 1) return(1);
+			break;
+		case 1:
+			ptJob->sKey = sField;
+			break;
+		case 2:
+			ptJob->sExec = sField;
+			break;
+		default:
+			if(iNumArgs >= MAX_ARGS) return(2);
+			ptJob->svArgv[iNumArgs++] = sField;
+		}
+	}
+	if(iNumArgs < 1) return(3);
+	ptJob->svArgv[iNumArgs] = NULL;
+	ptJob->iSubmitted = (int)time(NULL);
+	ptJob->rSubmitted = nowRelative();
+	return(0);
+
+}
+
+
+// Pointers into 'sLine' must follow the job when it is copied
+static void copyJob(Job* ptTo, const Job* ptFrom) {
+
+	int i;
+
+	memcpy(ptTo, ptFrom, sizeof(Job));
+	ptTo->sKey  = ptTo->sLine + (ptFrom->sKey  - ptFrom->sLine);
+	ptTo->sExec = ptTo->sLine + (ptFrom->sExec - ptFrom->sLine);
+	for(i=0; ptFrom->svArgv[i] != NULL; i++) {
+		ptTo->svArgv[i] = ptTo->sLine + (ptFrom->svArgv[i] - ptFrom->sLine);
+	}
+
+}
+
+
+static void enqueueJob(const Job* ptJob) {
+
+	int i;
+
+	tCounters.iSubmitted++;
+
+	// A queued job with the same key is superseded
+	for(i=0; i<iNumQueued; i++) {
+		if(strcmp(tvQueued[i].sKey, ptJob->sKey) == 0) {
+			copyJob(&tvQueued[i], ptJob);
+			tCounters.iCoalesced++;
+			return;
+		}
+	}
+
+	// New key
+	if(iNumQueued >= MAX_QUEUED) {
+		syslog(LOG_ERR, "Queue full: job '%s' dropped", ptJob->sKey);
+		tCounters.iDropped++;
+		return;
+	}
+	copyJob(&tvQueued[iNumQueued++], ptJob);
+
+}
+
+
+static int isKeyRunning(const char* sKey) {
+
+	int i;
+
+	for(i=0; i<MAX_RUNNING; i++) {
+		if(tvRunning[i].iPID > 0 && strcmp(tvRunning[i].sKey, sKey) == 0) return(TRUE);
+	}
+	return(FALSE);
+
+}
+
+
+// Start queued jobs, earliest deadline first, while slots are available
+static void dispatchJobs(const int iMaxRunning) {
+
+	int   iSlot;
+	int   iBest;
+	int   i;
+	pid_t iPID;
+
+	while(TRUE) {
+
+		// Find a free slot and the most urgent runnable job
+		for(iSlot=0; iSlot<iMaxRunning; iSlot++) {
+			if(tvRunning[iSlot].iPID == 0) break;
+		}
+		if(iSlot >= iMaxRunning) return;
+		iBest = -1;
+		for(i=0; i<iNumQueued; i++) {
+			if(isKeyRunning(tvQueued[i].sKey)) continue;
+			if(iBest < 0 || tvQueued[i].iDeadline < tvQueued[iBest].iDeadline) iBest = i;
+		}
+		if(iBest < 0) return;
+
+		// Move job to running slot
+		copyJob(&tvRunning[iSlot], &tvQueued[iBest]);
+		for(i=iBest; i<iNumQueued-1; i++) copyJob(&tvQueued[i], &tvQueued[i+1]);
+		iNumQueued--;
+
+		// Start it
+		tvRunning[iSlot].rStarted = nowRelative();
+		iPID = fork();
+		if(iPID == 0) {
+			execv(tvRunning[iSlot].sExec, tvRunning[iSlot].svArgv);
+			_exit(127);
+		}
+		else if(iPID < 0) {
+			syslog(LOG_ERR, "Job '%s' not started: %s", tvRunning[iSlot].sKey, strerror(errno));
+			tCounters.iFailed++;
+			tvRunning[iSlot].iPID = 0;
+		}
+		else {
+			tvRunning[iSlot].iPID = iPID;
+			tCounters.iStarted++;
+		}
+
+	}
+
+}
+
+
+// Collect terminated jobs, with their resource usage
+static void reapJobs(void) {
+
+	struct rusage tUsage;
+	int           iStatus;
+	int           iSlot;
+	int           iExitCode;
+	int           iOverrun;
+	double        rNow;
+	double        rWait;
+	double        rRun;
+	pid_t         iPID;
+	time_t        tSubmitted;
+	struct tm*    ptSubmitted;
+	FILE*         f;
+
+	while((iPID = wait4(-1, &iStatus, WNOHANG, &tUsage)) > 0) {
+
+		for(iSlot=0; iSlot<MAX_RUNNING; iSlot++) {
+			if(tvRunning[iSlot].iPID == iPID) break;
+		}
+		if(iSlot >= MAX_RUNNING) continue;
+
+		// Job metrics
+		rNow      = nowRelative();
+		rWait     = tvRunning[iSlot].rStarted - tvRunning[iSlot].rSubmitted;
+		rRun      = rNow - tvRunning[iSlot].rStarted;
+		iExitCode = WIFEXITED(iStatus) ? WEXITSTATUS(iStatus) : -WTERMSIG(iStatus);
+		iOverrun  = (int)time(NULL) > tvRunning[iSlot].iDeadline;
+		tCounters.iCompleted++;
+		if(iExitCode != 0) tCounters.iFailed++;
+		if(iOverrun) tCounters.iOverruns++;
+		if(rWait > tCounters.rMaxWait) tCounters.rMaxWait = rWait;
+		if(rRun  > tCounters.rMaxRun)  tCounters.rMaxRun  = rRun;
+		if(tUsage.ru_maxrss > tCounters.lMaxRSS) tCounters.lMaxRSS = tUsage.ru_maxrss;
+		if(iOverrun) syslog(LOG_ERR, "Overrun: job '%s' completed after its deadline", tvRunning[iSlot].sKey);
+
+		// Log them
+		f = fopen(PROC_METRICS, "a");
+		if(f != NULL) {
+			if(ftell(f) == 0) fprintf(f, "Date.Time,Job,Wait,Run,CPU.User,CPU.System,Max.RSS,Exit.Code,Overrun\n");
+			tSubmitted  = (time_t)tvRunning[iSlot].iSubmitted;
+			ptSubmitted = gmtime(&tSubmitted);
+			fprintf(
+				f, "%4.4d-%2.2d-%2.2d %2.2d:%2.2d:%2.2d,%s,%.3f,%.3f,%.3f,%.3f,%ld,%d,%d\n",
+				ptSubmitted->tm_year + 1900, ptSubmitted->tm_mon + 1, ptSubmitted->tm_mday,
+				ptSubmitted->tm_hour, ptSubmitted->tm_min, ptSubmitted->tm_sec,
+				tvRunning[iSlot].sKey,
+				rWait, rRun,
+				tUsage.ru_utime.tv_sec + tUsage.ru_utime.tv_usec / 1.e6,
+				tUsage.ru_stime.tv_sec + tUsage.ru_stime.tv_usec / 1.e6,
+				tUsage.ru_maxrss,
+				iExitCode,
+				iOverrun ? 1 : 0
+			);
+			fclose(f);
+		}
+
+		// Free slot
+		tvRunning[iSlot].iPID = 0;
+
+	}
+
+}
+
+
+static void writeStatus(const int iMaxRunning) {
+
+	int   iNumRunning = 0;
+	int   i;
+	FILE* f;
+
+	for(i=0; i<MAX_RUNNING; i++) {
+		if(tvRunning[i].iPID > 0) iNumRunning++;
+	}
+	f = fopen(PROC_STATUS, "w");
+	if(f == NULL) return;
+	fprintf(f, "[Jobs]\n");
+	fprintf(f, "Submitted = %u\n", tCounters.iSubmitted);
+	fprintf(f, "Coalesced = %u\n", tCounters.iCoalesced);
+	fprintf(f, "Dropped   = %u\n", tCounters.iDropped);
+	fprintf(f, "Started   = %u\n", tCounters.iStarted);
+	fprintf(f, "Completed = %u\n", tCounters.iCompleted);
+	fprintf(f, "Failed    = %u\n", tCounters.iFailed);
+	fprintf(f, "Overruns  = %u\n", tCounters.iOverruns);
+	fprintf(f, "\n[Queue]\n");
+	fprintf(f, "Queued     = %d\n", iNumQueued);
+	fprintf(f, "Running    = %d\n", iNumRunning);
+	fprintf(f, "MaxRunning = %d\n", iMaxRunning);
+	fprintf(f, "\n[Peaks]\n");
+	fprintf(f, "Wait   = %.3f\n", tCounters.rMaxWait);
+	fprintf(f, "Run    = %.3f\n", tCounters.rMaxRun);
+	fprintf(f, "MaxRSS = %ld\n", tCounters.lMaxRSS);
+	fclose(f);
+
+}
+
+
+int main(int argc, char** argv) {
+
+	char   configFile[256];
+	int    debug = FALSE;
+	int    iRetCode;
+	int    iQueue;
+	int    iKeepOpen;
+	int    iNumRead;
+	int    iUsed = 0;
+	int    iLastStatus = 0;
+	char   sBuffer[4*PROC_LINE_SIZE];
+	char*  pEnd;
+	Job    tJob;
+	struct pollfd tPoll;
+
+	// Get input parameters
+	if(argc != 2 && argc != 3) {
+		printf("proc_worker - Processing worker for acquisition tasks\n\n");
+		printf("Usage:\n\n");
+		printf("  proc_worker <cfgFile> [--debug]\n\n");
+		exit(1);
+	}
+	strcpy(configFile, argv[1]);
+	debug = (argc==3);
+
+	// Get configuration data from configFile
+	FILE* fc = fopen(configFile, "r");
+	if(!fc) {
+		syslog(LOG_ERR, "Configuration file missing or not found");
+		exit(20);
+	}
+	fclose(fc);
+	dictionary* ini = iniparser_load(configFile);
+	int iMaxRunning = iniparser_getint(ini, (const char *)"Processing:MaxRunningJobs", 1);
+	if(iMaxRunning > MAX_RUNNING) iMaxRunning = MAX_RUNNING;
+	if(iMaxRunning < 1) iMaxRunning = 1;
+
+	// Manage start mode (normal is as "daemon")
+	if(debug) {
+		startconsole("proc_worker");
+	}
+	else {
+		daemonize("proc_worker");
+	}
+
+	// Assign signal handlers
+	struct sigaction sa;
+	sa.sa_handler = sigterm;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	if(sigaction(SIGTERM, &sa, NULL) < 0) {
+		syslog(LOG_ERR, "Can't catch SIGTERM: %s", strerror(errno));
+		exit(3);
+	}
+
+	// Create job input named pipe, if it does not exist yet
+	if(access(PROC_QUEUE, F_OK) == -1) {
+		iRetCode = mkfifo(PROC_QUEUE, 0777);
+		if(iRetCode != 0) {
+			syslog(LOG_ERR, "Job input pipe not created");
+			if(debug) printf("Job input pipe not created\n");
+			exit(4);
+		}
+	}
+
+	// Connect it for read; a write end is also kept, so that the pipe does
+	// not signal end-of-file whenever the last submitting task closes it
+	iQueue = open(PROC_QUEUE, O_RDONLY | O_NONBLOCK);
+	iKeepOpen = open(PROC_QUEUE, O_WRONLY | O_NONBLOCK);
+	if(iQueue == -1 || iKeepOpen == -1) {
+		syslog(LOG_ERR, "Job input pipe not opened");
+		if(debug) printf("Job input pipe not opened\n");
+		exit(5);
+	}
+	memset(tvRunning, 0, sizeof(tvRunning));
+	memset(&tCounters, 0, sizeof(tCounters));
+
+	// Main loop: get jobs, run them, collect their results
+	tPoll.fd     = iQueue;
+	tPoll.events = POLLIN;
+	while(1) {
+
+		// Wait for jobs, at most one second
+		if(poll(&tPoll, 1, 1000) > 0 && (tPoll.revents & POLLIN)) {
+			iNumRead = read(iQueue, sBuffer + iUsed, sizeof(sBuffer) - 1 - iUsed);
+			if(iNumRead > 0) {
+				iUsed += iNumRead;
+				sBuffer[iUsed] = '\0';
+				while((pEnd = strchr(sBuffer, '\n')) != NULL) {
+					*pEnd = '\0';
+					iRetCode = parseJob(sBuffer, &tJob);
+					if(iRetCode == 0) {
+						if(debug) printf("Job: %s\n", tJob.sKey);
+						enqueueJob(&tJob);
+					}
+					else if(iRetCode == 4) {
+						syslog(LOG_ERR, "Job line longer than %d characters discarded", PROC_LINE_SIZE - 1);
+						tCounters.iDropped++;
+					}
+					else {
+						syslog(LOG_ERR, "Invalid job line discarded");
+						tCounters.iDropped++;
+					}
+					iUsed -= (pEnd - sBuffer) + 1;
+					memmove(sBuffer, pEnd + 1, iUsed + 1);
+				}
+				if(iUsed >= (int)sizeof(sBuffer) - 1) iUsed = 0;	// Garbage: no line end in sight
+			}
+		}
+
+		// Collect terminated jobs, and start new ones
+		reapJobs();
+		dispatchJobs(iMaxRunning);
+
+		// Status
+		if((int)time(NULL) - iLastStatus >= STATUS_INTERVAL) {
+			writeStatus(iMaxRunning);
+			iLastStatus = (int)time(NULL);
+		}
+
+	}
+
+	// Leave
+	close(iQueue);
+	close(iKeepOpen);
+	exit(0);
+
+}
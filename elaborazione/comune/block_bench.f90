@@ -0,0 +1,190 @@
+! block_bench - Time the per-block SonicLib sequence of eddy_cov (regularity
+!               check, block statistics, trend removal, wind statistics and
+!               direction classification) over the blocks of a synthetic hour,
+!               with 1, 2, 4, ... threads up to the number available, and
+!               check the results do not depend on the thread count.
+!
+! Usage:
+!
+!	./block_bench [<AveragingTime> [<Frequency> [<NumRepetitions>]]]
+!
+! Copyright 2012 by Servizi Territorio srl
+!                   All rights reserved
+
+PROGRAM block_bench
+
+	!$ USE omp_lib
+	USE SonicLib
+
+	IMPLICIT NONE
+
+	! Locals
+	CHARACTER(LEN=20)					:: sBuffer
+	INTEGER								:: iAveragingTime
+	INTEGER								:: iFrequency
+	INTEGER								:: iNumRep
+	INTEGER								:: iNumData
+	INTEGER								:: iNumBlocks
+	INTEGER								:: iNumThreads
+	INTEGER								:: iMaxThreads
+	INTEGER								:: iBlock
+	INTEGER								:: iRep
+	INTEGER								:: iRetCode
+	INTEGER								:: iCount0, iCount1, iRate
+	INTEGER								:: i, j
+	REAL								:: rSeconds
+	REAL								:: rSecondsSerial
+	REAL								:: rNoise
+	REAL, DIMENSION(:,:), ALLOCATABLE	:: raData			! Columns: u, v, w, t
+	INTEGER, DIMENSION(:), ALLOCATABLE	:: ivTime
+	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvValid
+	REAL, DIMENSION(:,:), ALLOCATABLE	:: raResult			! Per block: averages, covariances, wind statistics
+	REAL, DIMENSION(:,:), ALLOCATABLE	:: raResultSerial
+	LOGICAL								:: lSame
+
+	! Get parameters
+	iAveragingTime = 60
+	iFrequency     = 20
+	iNumRep        = 5
+	IF(COMMAND_ARGUMENT_COUNT() >= 1) THEN
+		CALL GET_COMMAND_ARGUMENT(1, sBuffer)
+		READ(sBuffer, *, IOSTAT=iRetCode) iAveragingTime
+	END IF
+	IF(COMMAND_ARGUMENT_COUNT() >= 2) THEN
+		CALL GET_COMMAND_ARGUMENT(2, sBuffer)
+		READ(sBuffer, *, IOSTAT=iRetCode) iFrequency
+	END IF
+	IF(COMMAND_ARGUMENT_COUNT() >= 3) THEN
+		CALL GET_COMMAND_ARGUMENT(3, sBuffer)
+		READ(sBuffer, *, IOSTAT=iRetCode) iNumRep
+	END IF
+	IF(iAveragingTime <= 0 .OR. MOD(3600, iAveragingTime) /= 0 .OR. iFrequency <= 0 .OR. iNumRep <= 0) THEN
+		PRINT *, 'block_bench:: error: Invalid parameters'
+		STOP
+	END IF
+	iNumData   = 3600 * iFrequency
+	iNumBlocks = 3600 / iAveragingTime
+
+	! Generate a synthetic hour: slow trend plus noise, with some invalid data
+	ALLOCATE(raData(iNumData,4), ivTime(iNumData), lvValid(iNumData))
+	ALLOCATE(raResult(iNumBlocks,27), raResultSerial(iNumBlocks,27))
+	DO i = 1, iNumData
+		ivTime(i) = (i-1) / iFrequency
+		DO j = 1, 4
+			CALL RANDOM_NUMBER(rNoise)
+			raData(i,j) = 0.5*j + 1.e-5*i + (rNoise - 0.5)
+		END DO
+		raData(i,4) = raData(i,4) + 20.
+		lvValid(i) = MOD(i, 97) /= 0
+	END DO
+
+	! Time, doubling the number of threads each time
+	iMaxThreads = 1
+	!$ iMaxThreads = OMP_GET_MAX_THREADS()
+	PRINT "('Blocks in hour:      ',i8)", iNumBlocks
+	PRINT "('Data in block:       ',i8)", iNumData / iNumBlocks
+	PRINT "('Repetitions:         ',i8)", iNumRep
+	PRINT "('Threads available:   ',i8)", iMaxThreads
+	PRINT *
+	PRINT "('Threads   Time per hour (ms)   Speed-up   Same results')"
+	iNumThreads    = 1
+	rSecondsSerial = 0.
+	DO
+		!$ CALL OMP_SET_NUM_THREADS(iNumThreads)
+		raResult = -9999.9
+		CALL SYSTEM_CLOCK(iCount0, iRate)
+		DO iRep = 1, iNumRep
+			!$OMP PARALLEL DO SCHEDULE(DYNAMIC)
+			DO iBlock = 1, iNumBlocks
+				CALL ProcessBlock(iBlock)
+			END DO
+			!$OMP END PARALLEL DO
+		END DO
+		CALL SYSTEM_CLOCK(iCount1)
+		rSeconds = REAL(iCount1 - iCount0) / iRate
+		IF(iNumThreads == 1) THEN
+			rSecondsSerial = rSeconds
+			raResultSerial = raResult
+		END IF
+		lSame = ALL(raResult == raResultSerial)
+		IF(rSeconds > 0.) THEN
+			PRINT "(i7,3x,f18.3,3x,f8.2,3x,l12)", iNumThreads, 1000.*rSeconds/iNumRep, rSecondsSerial/rSeconds, lSame
+		ELSE
+			PRINT "(i7,3x,f18.3,3x,8x,3x,l12)", iNumThreads, 1000.*rSeconds/iNumRep, lSame
+		END IF
+		IF(iNumThreads >= iMaxThreads) EXIT
+		iNumThreads = MIN(2*iNumThreads, iMaxThreads)
+	END DO
+
+CONTAINS
+
+	SUBROUTINE ProcessBlock(iBlock)
+
+		! Routine arguments
+		INTEGER, INTENT(IN)					:: iBlock
+
+		! Locals
+		INTEGER								:: iBlockBegin
+		INTEGER								:: iBlockEnd
+		INTEGER								:: iTotData
+		INTEGER								:: iBlockFrequency
+		INTEGER								:: iRegularityCode
+		INTEGER								:: iRetCode
+		LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvDesiredSubset
+		REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessU
+		REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessV
+		REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessW
+		REAL, DIMENSION(4)					:: rvBlockMin
+		REAL, DIMENSION(4)					:: rvBlockMax
+		REAL, DIMENSION(4)					:: rvBlockAvg
+		REAL, DIMENSION(4,4)				:: rmBlockCov
+		REAL, DIMENSION(4)					:: rvBlockSlope
+		REAL								:: rIndexAvg
+		REAL, DIMENSION(12)					:: rvWind
+		INTEGER, DIMENSION(16)				:: ivDirClass
+		REAL								:: rDominantDir
+		INTEGER								:: k
+
+		! Delimit block
+		iTotData    = iNumData / iNumBlocks
+		iBlockBegin = (iBlock-1)*iTotData + 1
+		iBlockEnd   = iBlock*iTotData
+		ALLOCATE(lvDesiredSubset(iTotData), rvTrendlessU(iTotData), rvTrendlessV(iTotData), rvTrendlessW(iTotData))
+		lvDesiredSubset = lvValid(iBlockBegin:iBlockEnd)
+		rvTrendlessU    = -9999.9
+		rvTrendlessV    = -9999.9
+		rvTrendlessW    = -9999.9
+
+		! Same sequence as in eddy_cov
+		CALL CheckTimeRegularity(ivTime(iBlockBegin:iBlockEnd), lvDesiredSubset, iBlockFrequency, iRegularityCode, iRetCode)
+		IF(iRetCode /= 0) RETURN
+		iRetCode = BlockStatistics( &
+			raData(iBlockBegin:iBlockEnd,1), raData(iBlockBegin:iBlockEnd,2), raData(iBlockBegin:iBlockEnd,4), &
+			lvDesiredSubset, &
+			iRegularityCode >= 3, &
+			rvBlockMin, rvBlockMax, rvBlockAvg, &
+			rmBlockCov, &
+			rvBlockSlope, rIndexAvg, &
+			rvW=raData(iBlockBegin:iBlockEnd,3) &
+		)
+		IF(iRetCode /= 0) RETURN
+		CALL RemoveBlockTrend(raData(iBlockBegin:iBlockEnd,1), lvDesiredSubset, rvBlockSlope(1), rIndexAvg, rvTrendlessU)
+		CALL RemoveBlockTrend(raData(iBlockBegin:iBlockEnd,2), lvDesiredSubset, rvBlockSlope(2), rIndexAvg, rvTrendlessV)
+		CALL RemoveBlockTrend(raData(iBlockBegin:iBlockEnd,3), lvDesiredSubset, rvBlockSlope(3), rIndexAvg, rvTrendlessW)
+		iRetCode = WindStatistics( &
+			rvTrendlessU, rvTrendlessV, rvTrendlessW, &
+			lvDesiredSubset, &
+			rvWind(1), rvWind(2), rvWind(3), rvWind(4), rvWind(5), rvWind(6), &
+			rvWind(7), rvWind(8), rvWind(9), rvWind(10), rvWind(11), rvWind(12) &
+		)
+		iRetCode = WindDirClassify(rvTrendlessU, rvTrendlessV, lvDesiredSubset, ivDirClass, rDominantDir)
+
+		! Save results
+		raResult(iBlock,1:4)   = rvBlockAvg
+		raResult(iBlock,5:14)  = (/ (rmBlockCov(1:k,k), k=1,4) /)
+		raResult(iBlock,15:26) = rvWind
+		raResult(iBlock,27)    = rDominantDir + SUM(ivDirClass)
+
+	END SUBROUTINE ProcessBlock
+
+END PROGRAM block_bench
@@ -0,0 +1,192 @@
+/*
+
+	col_lib - Reader and writer of binary columnar result files, coded in
+	          plain C.
+
+	File layout is documented in "columnar.f90". The data of any column may
+	be read with a single seek, without touching the others.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "col_lib.h"
+
+// Byte offset of data in column iColumn (0-based)
+static long colOffset(const ColumnarFile* ptCol, const int iColumn) {
+	return(16L + 36L*ptCol->nCols + 4L*ptCol->nRows*iColumn);
+}
+
+
+// Open a columnar file and read its header. Return 0 on success, or
+// a positive error code otherwise (in which case ptCol is left closed)
+int colOpen(const char* sFileName, ColumnarFile* ptCol) {
+
+	char sMagic[8];
+	char sName[COL_NAME_LEN];
+	int  i;
+	int  j;
+
+	// Assume failure (will set success on completion)
+	memset(ptCol, 0, sizeof(ColumnarFile));
+
+	// Access file and check it is actually columnar
+	ptCol->f = fopen(sFileName, "rb");
+	if(ptCol->f == NULL) return(1);
+	if(fread(sMagic, 1, 8, ptCol->f) != 8 || memcmp(sMagic, COL_MAGIC, 8) != 0) {
+		colClose(ptCol);
+		return(2);
+	}
+	if(fread(&ptCol->nCols, sizeof(int), 1, ptCol->f) != 1 || fread(&ptCol->nRows, sizeof(int), 1, ptCol->f) != 1) {
+		colClose(ptCol);
+		return(3);
+	}
+	if(ptCol->nCols <= 0 || ptCol->nRows < 0) {
+		colClose(ptCol);
+		return(3);
+	}
+
+	// Get schema
+	ptCol->svName = calloc(ptCol->nCols, COL_NAME_LEN+1);
+	ptCol->ivType = calloc(ptCol->nCols, sizeof(int));
+	if(ptCol->svName == NULL || ptCol->ivType == NULL) {
+		colClose(ptCol);
+		return(4);
+	}
+	for(i=0; i<ptCol->nCols; i++) {
+		if(fread(sName, 1, COL_NAME_LEN, ptCol->f) != COL_NAME_LEN || fread(&ptCol->ivType[i], sizeof(int), 1, ptCol->f) != 1) {
+			colClose(ptCol);
+			return(5);
+		}
+		memcpy(ptCol->svName[i], sName, COL_NAME_LEN);
+		for(j=COL_NAME_LEN-1; j>=0 && ptCol->svName[i][j] == ' '; j--) ptCol->svName[i][j] = '\0';
+	}
+
+	// Leave
+	return(0);
+
+}
+
+
+// Get the 0-based index of named column, or -1 if not found
+int colFindColumn(const ColumnarFile* ptCol, const char* sName) {
+
+	int i;
+
+	for(i=0; i<ptCol->nCols; i++) {
+		if(strcmp(ptCol->svName[i], sName) == 0) return(i);
+	}
+
+	// Leave
+	return(-1);
+
+}
+
+
+// Read an integer column into ivValues, which must hold nRows values;
+// return 0 on success, or a positive error code
+int colReadInteger(const ColumnarFile* ptCol, const int iColumn, int* ivValues) {
+
+	if(ptCol->f == NULL || iColumn < 0 || iColumn >= ptCol->nCols) return(1);
+	if(ptCol->ivType[iColumn] != COL_INTEGER) return(2);
+	if(fseek(ptCol->f, colOffset(ptCol, iColumn), SEEK_SET) != 0) return(3);
+	if(fread(ivValues, sizeof(int), ptCol->nRows, ptCol->f) != (size_t)ptCol->nRows) return(4);
+
+	// Leave
+	return(0);
+
+}
+
+
+// Read a real column into rvValues, which must hold nRows values;
+// return 0 on success, or a positive error code
+int colReadReal(const ColumnarFile* ptCol, const int iColumn, float* rvValues) {
+
+	if(ptCol->f == NULL || iColumn < 0 || iColumn >= ptCol->nCols) return(1);
+	if(ptCol->ivType[iColumn] != COL_REAL) return(2);
+	if(fseek(ptCol->f, colOffset(ptCol, iColumn), SEEK_SET) != 0) return(3);
+	if(fread(rvValues, sizeof(float), ptCol->nRows, ptCol->f) != (size_t)ptCol->nRows) return(4);
+
+	// Leave
+	return(0);
+
+}
+
+
+void colClose(ColumnarFile* ptCol) {
+
+	if(ptCol->f != NULL) fclose(ptCol->f);
+	free(ptCol->svName);
+	free(ptCol->ivType);
+	memset(ptCol, 0, sizeof(ColumnarFile));
+
+}
+
+
+// Create a columnar file and write its schema header. Columns must then be
+// written, all of them and in schema order, using colWriteInteger and
+// colWriteReal, and the file closed with colClose. Return 0 on success.
+int colCreate(const char* sFileName, const int nCols, const char* svName[], const int* ivType, const int nRows, ColumnarFile* ptCol) {
+
+	char sName[COL_NAME_LEN];
+	int  i;
+	int  iLen;
+
+	memset(ptCol, 0, sizeof(ColumnarFile));
+	if(nCols <= 0 || nRows < 0) return(1);
+	ptCol->f = fopen(sFileName, "wb");
+	if(ptCol->f == NULL) return(2);
+	ptCol->nCols  = nCols;
+	ptCol->nRows  = nRows;
+	ptCol->svName = calloc(nCols, COL_NAME_LEN+1);
+	ptCol->ivType = calloc(nCols, sizeof(int));
+	if(ptCol->svName == NULL || ptCol->ivType == NULL) {
+		colClose(ptCol);
+		return(3);
+	}
+
+	// Write header
+	fwrite(COL_MAGIC, 1, 8, ptCol->f);
+	fwrite(&ptCol->nCols, sizeof(int), 1, ptCol->f);
+	fwrite(&ptCol->nRows, sizeof(int), 1, ptCol->f);
+	for(i=0; i<nCols; i++) {
+		strncpy(ptCol->svName[i], svName[i], COL_NAME_LEN);
+		ptCol->ivType[i] = ivType[i];
+		memset(sName, ' ', COL_NAME_LEN);
+		iLen = strlen(ptCol->svName[i]);
+		memcpy(sName, ptCol->svName[i], iLen);
+		fwrite(sName, 1, COL_NAME_LEN, ptCol->f);
+		fwrite(&ptCol->ivType[i], sizeof(int), 1, ptCol->f);
+	}
+
+	// Leave
+	return(0);
+
+}
+
+
+int colWriteInteger(ColumnarFile* ptCol, const int* ivValues) {
+
+	if(ptCol->f == NULL) return(1);
+	if(fwrite(ivValues, sizeof(int), ptCol->nRows, ptCol->f) != (size_t)ptCol->nRows) return(2);
+
+	// Leave
+	return(0);
+
+}
+
+
+int colWriteReal(ColumnarFile* ptCol, const float* rvValues) {
+
+	if(ptCol->f == NULL) return(1);
+	if(fwrite(rvValues, sizeof(float), ptCol->nRows, ptCol->f) != (size_t)ptCol->nRows) return(2);
+
+	// Leave
+	return(0);
+
+}
@@ -0,0 +1,37 @@
+/*
+
+	col_lib - Reader and writer of binary columnar result files (".HHP",
+	          ".HHD", ".HHO"), the same as module Columnar of eddy_cov and
+	          proc2d.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#include <stdio.h>
+
+#define COL_MAGIC    "MFCOL001"
+#define COL_NAME_LEN 32
+#define COL_INTEGER  1
+#define COL_REAL     2
+
+// Open columnar file, with its schema header
+typedef struct ColumnarFile {
+	FILE* f;
+	int   nCols;
+	int   nRows;
+	char  (*svName)[COL_NAME_LEN+1];	// Column names, blank-stripped
+	int*  ivType;						// Column types (COL_INTEGER or COL_REAL)
+} ColumnarFile;
+
+int  colOpen(const char* sFileName, ColumnarFile* ptCol);
+int  colFindColumn(const ColumnarFile* ptCol, const char* sName);
+int  colReadInteger(const ColumnarFile* ptCol, const int iColumn, int* ivValues);
+int  colReadReal(const ColumnarFile* ptCol, const int iColumn, float* rvValues);
+void colClose(ColumnarFile* ptCol);
+
+int  colCreate(const char* sFileName, const int nCols, const char* svName[], const int* ivType, const int nRows, ColumnarFile* ptCol);
+int  colWriteInteger(ColumnarFile* ptCol, const int* ivValues);
+int  colWriteReal(ColumnarFile* ptCol, const float* rvValues);
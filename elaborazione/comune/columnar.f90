@@ -0,0 +1,121 @@
+! Columnar - Binary columnar result files, with self-describing schema header
+!
+! Copyright 2012 by Servizi Territorio srl
+!                   All rights reserved
+!
+! File layout (all integers and reals are 4 bytes, native byte order):
+!
+!	Magic string, 8 characters ("MFCOL001")
+!	Number of columns, nCols
+!	Number of rows, nRows
+!	nCols column descriptors, each made of:
+!		Column name, 32 characters, blank padded (e.g. 'U.star')
+!		Column type (1 = INTEGER, 2 = REAL)
+!	nCols columns, each made of nRows values
+!
+! The data of column i (1-based) hence begin at byte offset
+!
+!	16 + 36*nCols + 4*nRows*(i-1)
+!
+! so that readers may get the columns they need with a single seek each.
+
+MODULE Columnar
+
+	IMPLICIT NONE
+
+	PRIVATE
+
+	! Public interface
+	PUBLIC	:: COL_INTEGER
+	PUBLIC	:: COL_REAL
+	PUBLIC	:: COL_NAME_LEN
+	PUBLIC	:: ColOpen
+	PUBLIC	:: ColWriteInteger
+	PUBLIC	:: ColWriteReal
+	PUBLIC	:: ColClose
+
+	! Constants
+	INTEGER, PARAMETER			:: COL_INTEGER  = 1
+	INTEGER, PARAMETER			:: COL_REAL     = 2
+	INTEGER, PARAMETER			:: COL_NAME_LEN = 32
+	CHARACTER(LEN=8), PARAMETER	:: COL_MAGIC    = "MFCOL001"
+
+CONTAINS
+
+	! Create a columnar file and write its schema header. Columns must then
+	! be written, all of them and in the order given in 'svNames', using
+	! ColWriteInteger and ColWriteReal.
+	FUNCTION ColOpen(iLUN, sFileName, svNames, ivTypes, iNumRows) RESULT(iRetCode)
+
+		! Routine arguments
+		INTEGER, INTENT(IN)							:: iLUN
+		CHARACTER(LEN=*), INTENT(IN)				:: sFileName
+		CHARACTER(LEN=*), DIMENSION(:), INTENT(IN)	:: svNames
+		INTEGER, DIMENSION(:), INTENT(IN)			:: ivTypes
+		INTEGER, INTENT(IN)							:: iNumRows
+		INTEGER										:: iRetCode
+
+		! Locals
+		INTEGER						:: iErrCode
+		INTEGER						:: i
+		CHARACTER(LEN=COL_NAME_LEN)	:: sName
+
+		! Assume success (will falsify on failure)
+		iRetCode = 0
+
+		! Check parameters
+		IF(SIZE(svNames) <= 0 .OR. SIZE(svNames) /= SIZE(ivTypes) .OR. iNumRows < 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+
+		! Write header
+		OPEN(iLUN, FILE=sFileName, STATUS='REPLACE', ACTION='WRITE', ACCESS='STREAM', FORM='UNFORMATTED', IOSTAT=iErrCode)
+		IF(iErrCode /= 0) THEN
+			iRetCode = 2
+			RETURN
+		END IF
+		WRITE(iLUN) COL_MAGIC, INT(SIZE(svNames),4), INT(iNumRows,4)
+		DO i = 1, SIZE(svNames)
+			sName = svNames(i)
+			WRITE(iLUN) sName, INT(ivTypes(i),4)
+		END DO
+
+	END FUNCTION ColOpen
+
+
+	SUBROUTINE ColWriteInteger(iLUN, ivValues)
+
+		! Routine arguments
+		INTEGER, INTENT(IN)					:: iLUN
+		INTEGER, DIMENSION(:), INTENT(IN)	:: ivValues
+
+		! Write column data
+		WRITE(iLUN) INT(ivValues,4)
+
+	END SUBROUTINE ColWriteInteger
+
+
+	SUBROUTINE ColWriteReal(iLUN, rvValues)
+
+		! Routine arguments
+		INTEGER, INTENT(IN)				:: iLUN
+		REAL, DIMENSION(:), INTENT(IN)	:: rvValues
+
+		! Write column data
+		WRITE(iLUN) REAL(rvValues,4)
+
+	END SUBROUTINE ColWriteReal
+
+
+	SUBROUTINE ColClose(iLUN)
+
+		! Routine arguments
+		INTEGER, INTENT(IN)	:: iLUN
+
+		! Leave
+		CLOSE(iLUN)
+
+	END SUBROUTINE ColClose
+
+END MODULE Columnar
@@ -0,0 +1,358 @@
+/*
+
+	footprint - Monthly flux footprint climatology of processed blocks, on
+	            all processor cores.
+
+	Usage:
+
+		footprint <StoreRoot> <From> <To> <OutPath> [<Height> <z0> [<CellSize> <NE> <NN> [<Threads>]]]
+
+	Blocks with time stamp between <From> and <To> (both "YYYY-MM-DD
+	HH:MM:SS") are read from a time-indexed store (see "ts_store"), and the
+	analytic footprint of each one (see "fp_lib") is added to the raster of
+	its month. Blocks with invalid or too slow wind, or without z/L and
+	sigma_v, are not used.
+
+	The grid has <NE> x <NN> cells (at most FP_MAX_N_E x FP_MAX_N_N, and
+	100 x 100 by default) of <CellSize> m (default 10), centred on the
+	station; <Height> and <z0>, in m, default to 10 and 0.023, as in
+	"rollup".
+
+	Blocks are dealt to <Threads> workers (default: one per processor core
+	online) in contiguous runs, each accumulating into rasters of its own,
+	which are summed at end: no locking is needed.
+
+	Each month is written to <OutPath>/YYYYMM.asc, as an ESRI ASCII grid in
+	metres from station, whose values are the mean fraction of flux coming
+	from each cell; a summary, with the fraction of flux captured by the
+	grid, goes to standard output.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#define _GNU_SOURCE		// For 'timegm'
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "ts_lib.h"
+#include "fp_lib.h"
+
+#define MAX_THREADS 256
+
+// Block data needed by footprint
+typedef struct FootBlock {
+	int   iMonth;			// Months since the one of <From>
+	float rDir;
+	float rVel;
+	float rSigmaV;
+	float rZl;
+} FootBlock;
+
+// Scan state
+typedef struct Gather {
+	int        iFirstMonth;		// Year*12 + month index of <From>
+	int        ivColumn[4];		// Dir, Vel, Sigma.V, z.L
+	int        iNumBlocks;
+	int        iCapacity;
+	FootBlock* tvBlock;
+	int        iError;			// Non-zero if the scan was stopped
+} Gather;
+
+// Worker state: run of blocks [iFirst, iLast), and rasters of all months
+typedef struct Worker {
+	pthread_t        tThread;
+	const FpKernels* ptKernels;
+	const FootBlock* tvBlock;
+	int              iFirst;
+	int              iLast;
+	double*          rvRaster;
+	int*             ivUsed;
+} Worker;
+
+
+static double now(void) {
+
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return(tNow.tv_sec + 1.e-9*tNow.tv_nsec);
+
+}
+
+
+static int parseDateTime(const char* sDateTime, int* piTimeStamp) {
+
+	struct tm tTime;
+
+	memset(&tTime, 0, sizeof(tTime));
+	if(sscanf(sDateTime, "%d-%d-%d %d:%d:%d", &tTime.tm_year, &tTime.tm_mon, &tTime.tm_mday, &tTime.tm_hour, &tTime.tm_min, &tTime.tm_sec) != 6) return(1);
+	tTime.tm_year -= 1900;
+	tTime.tm_mon  -= 1;
+	*piTimeStamp = (int)timegm(&tTime);
+	return(0);
+
+}
+
+
+static int monthIndex(const int iTimeStamp) {
+
+	time_t    tStamp = (time_t)iTimeStamp;
+	struct tm tTime;
+
+	gmtime_r(&tStamp, &tTime);
+	return((tTime.tm_year + 1900)*12 + tTime.tm_mon);
+
+}
+
+
+static int gatherBlock(const int iTimeStamp, const float* rvValues, const int nCols, void* pUserData) {
+
+	Gather*    ptGather = (Gather*)pUserData;
+	FootBlock* tvNew;
+	FootBlock* ptBlock;
+	int        j;
+
+	for(j=0; j<4; j++) {
+		if(ptGather->ivColumn[j] >= nCols) {
+			ptGather->iError = 1;
+			return(1);
+		}
+	}
+	if(ptGather->iNumBlocks >= ptGather->iCapacity) {
+		tvNew = realloc(ptGather->tvBlock, 2 * (ptGather->iCapacity + 1024) * sizeof(FootBlock));
+		if(tvNew == NULL) {
+			ptGather->iError = 2;
+			return(1);
+		}
+		ptGather->tvBlock   = tvNew;
+		ptGather->iCapacity = 2 * (ptGather->iCapacity + 1024);
+	}
+	ptBlock = &ptGather->tvBlock[ptGather->iNumBlocks++];
+	ptBlock->iMonth  = monthIndex(iTimeStamp) - ptGather->iFirstMonth;
+	ptBlock->rDir    = rvValues[ptGather->ivColumn[0]];
+	ptBlock->rVel    = rvValues[ptGather->ivColumn[1]];
+	ptBlock->rSigmaV = rvValues[ptGather->ivColumn[2]];
+	ptBlock->rZl     = rvValues[ptGather->ivColumn[3]];
+	return(0);
+
+}
+
+
+static void* workerMain(void* pArg) {
+
+	Worker*          ptWorker = (Worker*)pArg;
+	const FootBlock* ptBlock;
+	const int        nCells   = ptWorker->ptKernels->tGrid.nE * ptWorker->ptKernels->tGrid.nN;
+	int              i;
+
+	for(i=ptWorker->iFirst; i<ptWorker->iLast; i++) {
+		ptBlock = &ptWorker->tvBlock[i];
+		if(fpAccumulate(ptWorker->ptKernels, ptBlock->rDir, ptBlock->rVel, ptBlock->rSigmaV, ptBlock->rZl, &ptWorker->rvRaster[(size_t)ptBlock->iMonth * nCells]) == 0) {
+			ptWorker->ivUsed[ptBlock->iMonth]++;
+		}
+	}
+	return(NULL);
+
+}
+
+
+// Write one monthly raster, as mean of 'iUsed' blocks; return the fraction of flux captured
+static double writeRaster(const char* sFileName, const FpGrid* ptGrid, const double* rvRaster, const int iUsed) {
+
+	FILE*  f;
+	double rCaptured = 0.;
+	int    i;
+	int    j;
+
+	f = fopen(sFileName, "w");
+	if(f == NULL) return(-9999.9);
+	fprintf(f, "ncols %d\n", ptGrid->nE);
+	fprintf(f, "nrows %d\n", ptGrid->nN);
+	fprintf(f, "xllcorner %f\n", -0.5*ptGrid->nE*ptGrid->rCell);
+	fprintf(f, "yllcorner %f\n", -0.5*ptGrid->nN*ptGrid->rCell);
+	fprintf(f, "cellsize %f\n", ptGrid->rCell);
+	fprintf(f, "NODATA_value -9999\n");
+	for(j=ptGrid->nN-1; j>=0; j--) {
+		for(i=0; i<ptGrid->nE; i++) {
+			fprintf(f, "%s%.4e", i > 0 ? " " : "", rvRaster[j*ptGrid->nE + i] / iUsed);
+			rCaptured += rvRaster[j*ptGrid->nE + i] / iUsed;
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return(rCaptured);
+
+}
+
+
+int main(int argc, char** argv) {
+
+	static const char* svColumn[4] = {"Dir", "Vel", "Sigma.V", "z.L"};
+	TimeStore  tStore;
+	Gather     tGather;
+	FpGrid     tGrid;
+	FpKernels* ptKernels;
+	Worker*    tvWorker;
+	int        iNumWorkers = 0;
+	int        iFrom;
+	int        iTo;
+	int        nMonths;
+	int        nCells;
+	int        iMonth;
+	int        iUsed = 0;
+	int        iRetCode = 0;
+	char       sFileName[512];
+	double     rStart;
+	double     rElapsed;
+	double     rCaptured;
+	int        i;
+	int        j;
+
+	// Get parameters
+	if(argc != 5 && argc != 7 && argc != 10 && argc != 11) {
+		printf("footprint - Monthly flux footprint climatology of processed blocks\n\n");
+		printf("Usage:\n\n");
+		printf("  footprint <StoreRoot> <From> <To> <OutPath> [<Height> <z0> [<CellSize> <NE> <NN> [<Threads>]]]\n\n");
+		printf("Copyright 2012 by Servizi Territorio srl\n");
+		printf("                  All rights reserved\n");
+		return(1);
+	}
+	if(parseDateTime(argv[2], &iFrom) != 0 || parseDateTime(argv[3], &iTo) != 0 || iTo < iFrom) {
+		fprintf(stderr, "footprint:: error: Invalid date-time\n");
+		return(2);
+	}
+	tGrid.nE      = 100;
+	tGrid.nN      = 100;
+	tGrid.rCell   = 10.;
+	tGrid.rHeight = 10.;
+	tGrid.rZ0     = 0.023;
+	if(argc >= 7) {
+		tGrid.rHeight = atof(argv[5]);
+		tGrid.rZ0     = atof(argv[6]);
+	}
+	if(argc >= 10) {
+		tGrid.rCell = atof(argv[7]);
+		tGrid.nE    = atoi(argv[8]);
+		tGrid.nN    = atoi(argv[9]);
+	}
+	if(argc >= 11) {
+		if(sscanf(argv[10], "%d", &iNumWorkers) != 1 || iNumWorkers < 0 || iNumWorkers > MAX_THREADS) {
+			fprintf(stderr, "footprint:: error: Invalid number of threads\n");
+			return(2);
+		}
+	}
+	if(iNumWorkers == 0) {
+		iNumWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if(iNumWorkers <= 0) iNumWorkers = 1;
+		if(iNumWorkers > MAX_THREADS) iNumWorkers = MAX_THREADS;
+	}
+	ptKernels = fpKernelsNew(&tGrid);
+	if(ptKernels == NULL) {
+		fprintf(stderr, "footprint:: error: Invalid grid, height or z0 (at most %d x %d cells)\n", FP_MAX_N_E, FP_MAX_N_N);
+		return(2);
+	}
+	if(mkdir(argv[4], 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "footprint:: error: Output path not accessible\n");
+		return(3);
+	}
+
+	// Gather blocks from store
+	if(tsOpen(&tStore, argv[1]) != 0) {
+		fprintf(stderr, "footprint:: error: Store '%s' not accessible\n", argv[1]);
+		return(3);
+	}
+	memset(&tGather, 0, sizeof(tGather));
+	tGather.iFirstMonth = monthIndex(iFrom);
+	for(j=0; j<4; j++) {
+		tGather.ivColumn[j] = -1;
+		for(i=0; i<tStore.nCols; i++) {
+			if(strcmp(tStore.svName[i], svColumn[j]) == 0) tGather.ivColumn[j] = i;
+		}
+		if(tGather.ivColumn[j] < 0) {
+			fprintf(stderr, "footprint:: error: Store '%s' has no column '%s'\n", argv[1], svColumn[j]);
+			return(3);
+		}
+	}
+	if(tsScan(&tStore, iFrom, iTo, gatherBlock, &tGather) < 0 || tGather.iError != 0) {
+		fprintf(stderr, "footprint:: error: Store scan failed\n");
+		return(4);
+	}
+	nMonths = monthIndex(iTo) - tGather.iFirstMonth + 1;
+	nCells  = tGrid.nE * tGrid.nN;
+	printf("Blocks in range:  %d\n", tGather.iNumBlocks);
+	printf("Months:           %d\n", nMonths);
+	printf("Threads:          %d\n", iNumWorkers);
+
+	// Deal contiguous runs of blocks to workers, and start them
+	tvWorker = calloc(iNumWorkers, sizeof(Worker));
+	if(tvWorker == NULL) {
+		fprintf(stderr, "footprint:: error: Not enough memory\n");
+		return(4);
+	}
+	for(i=0; i<iNumWorkers; i++) {
+		tvWorker[i].ptKernels = ptKernels;
+		tvWorker[i].tvBlock   = tGather.tvBlock;
+		tvWorker[i].iFirst    = (int)((long)tGather.iNumBlocks * i / iNumWorkers);
+		tvWorker[i].iLast     = (int)((long)tGather.iNumBlocks * (i+1) / iNumWorkers);
+		tvWorker[i].rvRaster  = calloc((size_t)nMonths * nCells, sizeof(double));
+		tvWorker[i].ivUsed    = calloc(nMonths, sizeof(int));
+		if(tvWorker[i].rvRaster == NULL || tvWorker[i].ivUsed == NULL) {
+			fprintf(stderr, "footprint:: error: Not enough memory\n");
+			return(4);
+		}
+	}
+	rStart = now();
+	for(i=0; i<iNumWorkers; i++) {
+		if(pthread_create(&tvWorker[i].tThread, NULL, workerMain, &tvWorker[i]) != 0) {
+			fprintf(stderr, "footprint:: error: Thread not started\n");
+			return(5);
+		}
+	}
+	for(i=0; i<iNumWorkers; i++) pthread_join(tvWorker[i].tThread, NULL);
+
+	// Sum rasters of workers into the first one's
+	for(i=1; i<iNumWorkers; i++) {
+		for(j=0; j<nMonths*nCells; j++) tvWorker[0].rvRaster[j] += tvWorker[i].rvRaster[j];
+		for(j=0; j<nMonths; j++) tvWorker[0].ivUsed[j] += tvWorker[i].ivUsed[j];
+	}
+	rElapsed = now() - rStart;
+
+	// Write months and report
+	printf("\nMonth   Blocks  Captured\n");
+	for(j=0; j<nMonths; j++) {
+		if(tvWorker[0].ivUsed[j] <= 0) continue;
+		iMonth = tGather.iFirstMonth + j;
+		sprintf(sFileName, "%s/%04d%02d.asc", argv[4], iMonth / 12, iMonth % 12 + 1);
+		rCaptured = writeRaster(sFileName, &tGrid, &tvWorker[0].rvRaster[(size_t)j * nCells], tvWorker[0].ivUsed[j]);
+		if(rCaptured < -9990.) {
+			fprintf(stderr, "footprint:: error: Raster '%s' not written\n", sFileName);
+			iRetCode = 6;
+		}
+		printf("%04d%02d %7d %9.3f\n", iMonth / 12, iMonth % 12 + 1, tvWorker[0].ivUsed[j], rCaptured);
+		iUsed += tvWorker[0].ivUsed[j];
+	}
+	printf("\nBlocks used:      %d\n", iUsed);
+	printf("Elapsed (s):      %.3f\n", rElapsed);
+	if(rElapsed > 0.) printf("Throughput:       %.0f blocks/s\n", iUsed / rElapsed);
+
+	// Leave
+	for(i=0; i<iNumWorkers; i++) {
+		free(tvWorker[i].rvRaster);
+		free(tvWorker[i].ivUsed);
+	}
+	free(tvWorker);
+	free(tGather.tvBlock);
+	fpKernelsFree(ptKernels);
+	return(iRetCode);
+
+}
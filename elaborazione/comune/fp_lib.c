@@ -0,0 +1,189 @@
+/*
+
+	fp_lib - Analytic flux footprint of processed blocks on a regular grid,
+	         coded in plain C.
+
+	Crosswind-integrated footprint is the one of Hsieh, Katul and Chi
+	(2000), from measurement height, roughness length and Obukhov length:
+
+		f(x) = a/x^2 exp(-a/x),   a = D zu^P |L|^(1-P) / k^2
+
+	with zu = zm (ln(zm/z0) - 1 + z0/zm), and D, P depending on zu/L being
+	unstable, neutral or stable. Crosswind distribution is Gaussian, with
+	sigma_y = (sigma_v/U) x (short-range limit of Taylor diffusion), not
+	narrower than half a cell, so that plumes near the station are not
+	lost between cell centres.
+
+	Blocks are grouped in classes of z/L and sigma_v/U, whose along-wind
+	footprints and spreads are tabulated once for all on distance bins: a
+	block then costs, for each cell, a rotation to wind axes and two table
+	lookups, with no transcendental function.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fp_lib.h"
+
+#define K 0.4		// von Karman constant
+
+// Class limits (z/L, sigma_v/U), and values the tables are computed at
+static const double rvStabLimit[FP_NUM_STAB-1] = {
+	-2.0, -1.0, -0.5, -0.25, -0.125, -0.0625, -0.02, 0.02, 0.0625, 0.125, 0.25, 0.5, 1.0
+};
+static const double rvStabValue[FP_NUM_STAB] = {
+	-3.0, -1.5, -0.75, -0.375, -0.1875, -0.09375, -0.04, 0.0, 0.04, 0.09375, 0.1875, 0.375, 0.75, 1.5
+};
+static const double rvSpreadLimit[FP_NUM_SPREAD-1] = {
+	0.1, 0.15, 0.2, 0.25, 0.3, 0.4, 0.6
+};
+static const double rvSpreadValue[FP_NUM_SPREAD] = {
+	0.075, 0.125, 0.175, 0.225, 0.275, 0.35, 0.5, 0.8
+};
+
+
+static int classOf(const double rValue, const double* rvLimit, const int nLimits) {
+
+	int iClass;
+
+	for(iClass=0; iClass<nLimits && rValue >= rvLimit[iClass]; iClass++);
+	return(iClass);
+
+}
+
+
+// Hsieh et al. (2000) scale 'a' (m) of crosswind-integrated footprint
+static double hsiehScale(const FpGrid* ptGrid, const double rZl) {
+
+	const double rZu = ptGrid->rHeight * (log(ptGrid->rHeight/ptGrid->rZ0) - 1. + ptGrid->rZ0/ptGrid->rHeight);
+	double       rStab;
+	double       rD;
+	double       rP;
+
+	rStab = rZl * rZu / ptGrid->rHeight;	// zu/L
+	if(rStab < -0.04) {
+		rD = 0.28;
+		rP = 0.59;
+	}
+	else if(rStab > 0.04) {
+		rD = 2.44;
+		rP = 1.33;
+	}
+	else {
+		return(0.97 * rZu / (K*K));
+	}
+	return(rD * pow(rZu, rP) * pow(fabs(ptGrid->rHeight / rZl), 1. - rP) / (K*K));
+
+}
+
+
+FpKernels* fpKernelsNew(const FpGrid* ptGrid) {
+
+	FpKernels* ptKernels;
+	double     rArea;
+	double     rScale;
+	double     rX;
+	double     rSigmaY;
+	int        iStab;
+	int        iSpread;
+	int        i;
+
+	// Check grid
+	if(
+		ptGrid->nE <= 0 || ptGrid->nE > FP_MAX_N_E ||
+		ptGrid->nN <= 0 || ptGrid->nN > FP_MAX_N_N ||
+		ptGrid->rCell <= 0. || ptGrid->rHeight <= 0. ||
+		ptGrid->rZ0 <= 0. || ptGrid->rZ0 >= ptGrid->rHeight
+	) return(NULL);
+	ptKernels = calloc(1, sizeof(FpKernels));
+	if(ptKernels == NULL) return(NULL);
+	ptKernels->tGrid       = *ptGrid;
+	ptKernels->rBinWidth   = ptGrid->rCell * (0.5*sqrt((double)ptGrid->nE*ptGrid->nE + (double)ptGrid->nN*ptGrid->nN) + 1.) / FP_KERNEL_BINS;
+	ptKernels->rGaussWidth = FP_GAUSS_MAX / FP_GAUSS_BINS;
+	rArea = ptGrid->rCell * ptGrid->rCell;
+
+	// Crosswind Gaussian, and spreads
+	for(i=0; i<FP_GAUSS_BINS; i++) {
+		ptKernels->rvGauss[i] = (float)exp(-(i + 0.5)*ptKernels->rGaussWidth);
+	}
+	for(iSpread=0; iSpread<FP_NUM_SPREAD; iSpread++) {
+		for(i=0; i<FP_KERNEL_BINS; i++) {
+			rX      = (i + 0.5)*ptKernels->rBinWidth;
+			rSigmaY = fmax(rvSpreadValue[iSpread]*rX, 0.5*ptGrid->rCell);
+			ptKernels->rmSpread[iSpread][i] = (float)(1. / (2.*rSigmaY*rSigmaY));
+		}
+	}
+
+	// Along-wind footprints, as fraction of flux per cell on the plume axis
+	for(iStab=0; iStab<FP_NUM_STAB; iStab++) {
+		rScale = hsiehScale(ptGrid, rvStabValue[iStab]);
+		for(iSpread=0; iSpread<FP_NUM_SPREAD; iSpread++) {
+			for(i=0; i<FP_KERNEL_BINS; i++) {
+				rX      = (i + 0.5)*ptKernels->rBinWidth;
+				rSigmaY = fmax(rvSpreadValue[iSpread]*rX, 0.5*ptGrid->rCell);
+				ptKernels->rmAlong[iStab][iSpread][i] = (float)(rScale/(rX*rX) * exp(-rScale/rX) * rArea / (sqrt(2.*M_PI)*rSigmaY));
+			}
+		}
+	}
+	return(ptKernels);
+
+}
+
+
+void fpKernelsFree(FpKernels* ptKernels) {
+
+	free(ptKernels);
+
+}
+
+
+int fpAccumulate(const FpKernels* ptKernels, const double rDir, const double rVel, const double rSigmaV, const double rZl, double* rvRaster) {
+
+	const FpGrid* ptGrid = &ptKernels->tGrid;
+	const float*  rvAlong;
+	const float*  rvSpread;
+	const double  rInvBin   = 1. / ptKernels->rBinWidth;
+	const double  rInvGauss = 1. / ptKernels->rGaussWidth;
+	double        rSin;
+	double        rCos;
+	double        rE0;
+	double        rN;
+	double        rX;
+	double        rY;
+	double        rU;
+	int           iSpread;
+	int           iBin;
+	int           i;
+	int           j;
+
+	// Check block, and get its kernel
+	if(rDir < -9990. || rVel < FP_MIN_VEL || rSigmaV <= 0. || rZl < -9990.) return(1);
+	iSpread  = classOf(rSigmaV/rVel, rvSpreadLimit, FP_NUM_SPREAD-1);
+	rvAlong  = ptKernels->rmAlong[classOf(rZl, rvStabLimit, FP_NUM_STAB-1)][iSpread];
+	rvSpread = ptKernels->rmSpread[iSpread];
+
+	// Visit cells, with x upwind and y crosswind: both change linearly along rows
+	rSin = sin(rDir * M_PI / 180.);
+	rCos = cos(rDir * M_PI / 180.);
+	rE0  = (0.5 - 0.5*ptGrid->nE) * ptGrid->rCell;
+	for(j=0; j<ptGrid->nN; j++) {
+		rN = (j + 0.5 - 0.5*ptGrid->nN) * ptGrid->rCell;
+		rX = rE0*rSin + rN*rCos;
+		rY = rE0*rCos - rN*rSin;
+		for(i=0; i<ptGrid->nE; i++, rX += ptGrid->rCell*rSin, rY += ptGrid->rCell*rCos) {
+			if(rX <= 0.) continue;
+			iBin = (int)(rX * rInvBin);
+			if(iBin >= FP_KERNEL_BINS) continue;
+			rU = rY*rY * rvSpread[iBin];
+			if(rU >= FP_GAUSS_MAX) continue;
+			rvRaster[j*ptGrid->nE + i] += rvAlong[iBin] * ptKernels->rvGauss[(int)(rU * rInvGauss)];
+		}
+	}
+	return(0);
+
+}
@@ -0,0 +1,53 @@
+/*
+
+	fp_lib - Analytic flux footprint of processed blocks on a regular grid
+	         centred on the station: along-wind footprint after Hsieh et al.
+	         (2000), crosswind Gaussian spread from lateral turbulence
+	         intensity; kernels are tabulated once by stability and wind
+	         class, so that each block costs one pass over the grid.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#define FP_MAX_N_E       100		// Grid cells, east and north (as MAX_N_E, MAX_N_N of acquisition)
+#define FP_MAX_N_N       100
+#define FP_NUM_STAB       14		// Stability classes, by z/L
+#define FP_NUM_SPREAD      8		// Wind classes, by lateral turbulence intensity sigma_v/U
+#define FP_KERNEL_BINS  1024		// Kernel table bins, along wind
+#define FP_GAUSS_BINS   1024		// Crosswind Gaussian table bins
+#define FP_GAUSS_MAX     9.0		// Gaussian table range, as y^2/(2 sigma_y^2)
+#define FP_MIN_VEL       0.5		// Slower blocks (m/s) have no meaningful footprint
+
+// Grid and site; cell (i,j), from south-west, is centred at ((i+1/2-nE/2)*rCell, (j+1/2-nN/2)*rCell)
+// m from station (east, north)
+typedef struct FpGrid {
+	int    nE;
+	int    nN;
+	double rCell;			// Cell side (m)
+	double rHeight;			// Measurement height (m)
+	double rZ0;				// Roughness length (m)
+} FpGrid;
+
+// Kernel tables: footprint along wind by class and distance bin (fraction
+// of flux per cell, per unit of crosswind Gaussian), 1/(2 sigma_y^2) by
+// wind class and distance bin, and the Gaussian itself
+typedef struct FpKernels {
+	FpGrid tGrid;
+	double rBinWidth;		// Along wind (m)
+	double rGaussWidth;		// In units of y^2/(2 sigma_y^2)
+	float  rmAlong[FP_NUM_STAB][FP_NUM_SPREAD][FP_KERNEL_BINS];
+	float  rmSpread[FP_NUM_SPREAD][FP_KERNEL_BINS];
+	float  rvGauss[FP_GAUSS_BINS];
+} FpKernels;
+
+// Tables management; NULL is returned on invalid grid or lack of memory
+FpKernels* fpKernelsNew(const FpGrid* ptGrid);
+void       fpKernelsFree(FpKernels* ptKernels);
+
+// Add the footprint of one block (direction wind comes from, in degrees,
+// vector speed and sigma_v in m/s, z/L) to raster 'rvRaster' (nE*nN values,
+// row by row from south); return 0 if added, 1 if block is not usable
+int fpAccumulate(const FpKernels* ptKernels, const double rDir, const double rVel, const double rSigmaV, const double rZl, double* rvRaster);
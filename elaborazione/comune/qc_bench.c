@@ -0,0 +1,131 @@
+/*
+
+	qc_bench - Time block processing by the "ec_lib" engine with and without
+	           quality control tests, on synthetic blocks of the usual
+	           averaging times and sampling rates, and report the overhead
+	           and the test codes (on clean blocks, and on blocks with a
+	           dropout and a discontinuity).
+
+	Usage:
+
+		./qc_bench [<NumRepetitions>]
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "ec_lib.h"
+
+static double elapsed(const struct timespec* ptFrom) {
+
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return((tNow.tv_sec - ptFrom->tv_sec) + 1.e-9*(tNow.tv_nsec - ptFrom->tv_nsec));
+
+}
+
+
+int main(int argc, char** argv) {
+
+	static const int ivCase[][2] = {	// Averaging time (s), sampling rate (Hz)
+		{  60, 10}, {  60, 20},
+		{ 300, 10}, { 300, 20},
+		{ 600, 10}, { 600, 20},
+		{1800, 10}, {1800, 20},
+		{3600, 20}
+	};
+	int             iNumRep = 20;
+	EddyConfig      tConfig;
+	EddyWorkspace   tWork;
+	EddyBlock       tBlock;
+	short           (*ivData)[5];
+	struct timespec tStart;
+	double          rBase;
+	double          rQuality;
+	double          rNoise;
+	double          rW;
+	int             ivClean[6];
+	int             iNumData;
+	int             iCase;
+	int             iRep;
+	int             i, j;
+
+	// Get parameters
+	if(argc >= 2) iNumRep = atoi(argv[1]);
+	if(iNumRep <= 0) {
+		fprintf(stderr, "qc_bench:: error: Invalid parameters\n");
+		return(1);
+	}
+	memset(&tConfig, 0, sizeof(tConfig));
+	tConfig.iDetrending       = 1;
+	tConfig.iRotations        = 2;
+	tConfig.rAltitude         = 100.;
+	tConfig.rAnemometerHeight = 10.;
+
+	printf("Repetitions:    %d\n\n", iNumRep);
+	printf("AvgTime  Rate   Data  Base (ms)  QC (ms)  Overhead  Codes (clean)  Codes (faulty)\n");
+	srand(2012);
+	for(iCase=0; iCase<(int)(sizeof(ivCase)/sizeof(ivCase[0])); iCase++) {
+
+		// Synthetic block: correlated w and t, with some invalid data
+		iNumData = ivCase[iCase][0] * ivCase[iCase][1];
+		ivData   = malloc(iNumData * sizeof(ivData[0]));
+		if(ivData == NULL) {
+			fprintf(stderr, "qc_bench:: error: Not enough memory\n");
+			return(2);
+		}
+		for(i=0; i<iNumData; i++) {
+			rNoise = rand()/(double)RAND_MAX - 0.5;
+			rW     = 30.*rNoise + 20.*(rand()/(double)RAND_MAX - 0.5);
+			ivData[i][0] = i / ivCase[iCase][1];
+			ivData[i][1] = (short)(300. + 100.*rNoise + 50.*sin(i*0.01));
+			ivData[i][2] = (short)(100. + 100.*(rand()/(double)RAND_MAX - 0.5));
+			ivData[i][3] = (short)rW;
+			ivData[i][4] = (short)(2000. + 0.8*rW + 20.*(rand()/(double)RAND_MAX - 0.5));
+			if(i % 997 == 0) ivData[i][3] = -9999;
+		}
+
+		// Time processing without quality control, then with
+		ecWorkspaceInit(&tWork);
+		tConfig.iQualityControl = 0;
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) ecProcessBlock(&tConfig, (const short (*)[5])ivData, iNumData, 0, &tBlock, &tWork);
+		rBase = elapsed(&tStart) / iNumRep;
+		tConfig.iQualityControl = 1;
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) ecProcessBlock(&tConfig, (const short (*)[5])ivData, iNumData, 0, &tBlock, &tWork);
+		rQuality = elapsed(&tStart) / iNumRep;
+		memcpy(ivClean, tBlock.ivQuality, sizeof(ivClean));
+
+		// Same block, with temperature stuck for 15% of it and a step in u
+		for(i=iNumData/3; i<iNumData/3 + (15*iNumData)/100; i++) ivData[i][4] = 2000;
+		for(i=(2*iNumData)/3; i<iNumData; i++) ivData[i][1] += 200;
+		ecProcessBlock(&tConfig, (const short (*)[5])ivData, iNumData, 0, &tBlock, &tWork);
+
+		printf("%7d %5d %6d %10.3f %8.3f %8.1f%%   ",
+			ivCase[iCase][0], ivCase[iCase][1], iNumData,
+			1000.*rBase, 1000.*rQuality,
+			rBase > 0. ? 100.*(rQuality - rBase)/rBase : 0.
+		);
+		for(j=0; j<6; j++) printf("%d", ivClean[j]);
+		printf("         ");
+		for(j=0; j<6; j++) printf("%d", tBlock.ivQuality[j]);
+		printf("\n");
+		ecWorkspaceFree(&tWork);
+		free(ivData);
+
+	}
+	printf("\nCodes: resolution, dropouts, limits, moments, discontinuities, worst (0 = passed, 1 = soft, 2 = hard)\n");
+
+	// Leave
+	return(0);
+
+}
@@ -0,0 +1,395 @@
+/*
+
+	rc_lib - Content-addressed cache of eddy covariance results, coded in
+	         plain C.
+
+	Keys are computed by an embedded SHA-256, so that no crypto library is
+	needed on the station. Entries are written to a temporary file and then
+	renamed, so a reader never sees a partial one, and the modification
+	time of an entry is refreshed on each hit, making it the "last used"
+	time eviction goes by. Size is counted at open by a scan of the cache
+	directory, and then kept up to date in memory.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "ec_lib.h"
+#include "rc_lib.h"
+
+#define RC_HEADER_SIZE 16L		// Magic string, number of blocks, size of a block
+
+
+/**********************
+* SHA-256             *
+**********************/
+
+typedef struct Sha256 {
+	uint32_t ivState[8];
+	uint64_t lLength;			// Bytes hashed so far
+	uint8_t  ivBuffer[64];
+	int      iBuffered;
+} Sha256;
+
+static const uint32_t ivK[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Block(Sha256* ptHash, const uint8_t* ivBlock) {
+
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h;
+	uint32_t t1, t2;
+	int      i;
+
+	for(i=0; i<16; i++) {
+		w[i] = ((uint32_t)ivBlock[4*i] << 24) | ((uint32_t)ivBlock[4*i+1] << 16) | ((uint32_t)ivBlock[4*i+2] << 8) | ivBlock[4*i+3];
+	}
+	for(i=16; i<64; i++) {
+		w[i] = w[i-16] + (ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3)) + w[i-7] + (ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10));
+	}
+	a = ptHash->ivState[0]; b = ptHash->ivState[1]; c = ptHash->ivState[2]; d = ptHash->ivState[3];
+	e = ptHash->ivState[4]; f = ptHash->ivState[5]; g = ptHash->ivState[6]; h = ptHash->ivState[7];
+	for(i=0; i<64; i++) {
+		t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + ivK[i] + w[i];
+		t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	ptHash->ivState[0] += a; ptHash->ivState[1] += b; ptHash->ivState[2] += c; ptHash->ivState[3] += d;
+	ptHash->ivState[4] += e; ptHash->ivState[5] += f; ptHash->ivState[6] += g; ptHash->ivState[7] += h;
+
+}
+
+
+static void sha256Init(Sha256* ptHash) {
+
+	static const uint32_t ivInit[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(ptHash->ivState, ivInit, sizeof(ivInit));
+	ptHash->lLength   = 0;
+	ptHash->iBuffered = 0;
+
+}
+
+
+static void sha256Update(Sha256* ptHash, const void* pData, size_t n) {
+
+	const uint8_t* ivData = (const uint8_t*)pData;
+	size_t         iTake;
+
+	ptHash->lLength += n;
+	if(ptHash->iBuffered > 0) {
+		iTake = 64 - ptHash->iBuffered;
+		if(iTake > n) iTake = n;
+		memcpy(ptHash->ivBuffer + ptHash->iBuffered, ivData, iTake);
+		ptHash->iBuffered += iTake;
+		ivData += iTake;
+		n      -= iTake;
+		if(ptHash->iBuffered < 64) return;
+		sha256Block(ptHash, ptHash->ivBuffer);
+		ptHash->iBuffered = 0;
+	}
+	while(n >= 64) {
+		sha256Block(ptHash, ivData);
+		ivData += 64;
+		n      -= 64;
+	}
+	memcpy(ptHash->ivBuffer, ivData, n);
+	ptHash->iBuffered = n;
+
+}
+
+
+static void sha256Final(Sha256* ptHash, char sHex[RC_KEY_LEN+1]) {
+
+	uint8_t  ivPad[72];
+	uint64_t lBits = ptHash->lLength * 8;
+	int      iPad;
+	int      i;
+
+	iPad = (ptHash->iBuffered < 56 ? 56 : 120) - ptHash->iBuffered;
+	memset(ivPad, 0, sizeof(ivPad));
+	ivPad[0] = 0x80;
+	for(i=0; i<8; i++) ivPad[iPad + i] = (uint8_t)(lBits >> (56 - 8*i));
+	sha256Update(ptHash, ivPad, iPad + 8);
+	for(i=0; i<8; i++) sprintf(sHex + 8*i, "%08x", ptHash->ivState[i]);
+
+}
+
+
+/**********************
+* Entry internals     *
+**********************/
+
+static void entryName(const ResultCache* ptCache, const char* sKey, char* sName) {
+	sprintf(sName, "%s/%.2s/%s", ptCache->sRoot, sKey, sKey);
+}
+
+
+// Size and last use of an entry found while scanning
+typedef struct RcEntry {
+	time_t    tUsed;
+	long long lSize;
+	char      sName[384];
+} RcEntry;
+
+static int compareEntries(const void* p1, const void* p2) {
+
+	const RcEntry* ptE1 = (const RcEntry*)p1;
+	const RcEntry* ptE2 = (const RcEntry*)p2;
+
+	return(ptE1->tUsed < ptE2->tUsed ? -1 : ptE1->tUsed > ptE2->tUsed ? 1 : 0);
+
+}
+
+
+// List all entries of the cache; return their number, or -1 on error
+static int listEntries(const ResultCache* ptCache, RcEntry** ptvEntry) {
+
+	RcEntry*       tvEntry   = NULL;
+	int            iCapacity = 0;
+	int            n         = 0;
+	char           sDir[300];
+	DIR*           d;
+	struct dirent* ptDirEntry;
+	struct stat    tStat;
+	int            iSub;
+	void*          pNew;
+
+	*ptvEntry = NULL;
+	for(iSub=0; iSub<256; iSub++) {
+		sprintf(sDir, "%s/%02x", ptCache->sRoot, iSub);
+		d = opendir(sDir);
+		if(d == NULL) continue;
+		while((ptDirEntry = readdir(d)) != NULL) {
+			if(strlen(ptDirEntry->d_name) != RC_KEY_LEN) continue;
+			if(n >= iCapacity) {
+				iCapacity = iCapacity > 0 ? 2*iCapacity : 256;
+				pNew = realloc(tvEntry, iCapacity * sizeof(RcEntry));
+				if(pNew == NULL) {
+					closedir(d);
+					free(tvEntry);
+					return(-1);
+				}
+				tvEntry = pNew;
+			}
+			sprintf(tvEntry[n].sName, "%s/%.64s", sDir, ptDirEntry->d_name);
+			if(stat(tvEntry[n].sName, &tStat) != 0) continue;
+			tvEntry[n].tUsed = tStat.st_mtime;
+			tvEntry[n].lSize = tStat.st_size;
+			n++;
+		}
+		closedir(d);
+	}
+	*ptvEntry = tvEntry;
+	return(n);
+
+}
+
+
+/**********************
+* Public interface    *
+**********************/
+
+// Open (creating it if needed) the cache rooted at 'sRoot', bound to
+// 'lMaxBytes' bytes; return 0 on success
+int rcOpen(ResultCache* ptCache, const char* sRoot, const long long lMaxBytes) {
+
+	RcEntry* tvEntry;
+	int      n;
+	int      i;
+
+	memset(ptCache, 0, sizeof(ResultCache));
+	if(strlen(sRoot) >= sizeof(ptCache->sRoot) - 72) return(1);
+	strcpy(ptCache->sRoot, sRoot);
+	ptCache->lMaxBytes = lMaxBytes;
+	if(mkdir(sRoot, 0755) != 0 && errno != EEXIST) return(2);
+
+	// Count what is already there
+	n = listEntries(ptCache, &tvEntry);
+	if(n < 0) return(3);
+	for(i=0; i<n; i++) ptCache->lBytes += tvEntry[i].lSize;
+	ptCache->iEntries = n;
+	free(tvEntry);
+
+	pthread_mutex_init(&ptCache->tLock, NULL);
+	return(0);
+
+}
+
+
+void rcClose(ResultCache* ptCache) {
+	pthread_mutex_destroy(&ptCache->tLock);
+}
+
+
+// Compute the key of an hour's results from all they depend on
+void rcKey(const EddyConfig* ptConfig, const int iAveragingTime, const int iHourBegin, const short ivData[][5], const int iNumData, char sKey[RC_KEY_LEN+1]) {
+
+	Sha256 tHash;
+	char   sHeader[512];
+
+	sprintf(sHeader, "ec_lib %d\ndetrending=%d\nrotations=%d\naltitude=%.6f\nanemometer_height=%.6f\nspectra=%d\nflux_errors=%d\ndespiking=%d,%d,%.6f\nquality_control=%d\nstationarity=%d\ndissipation=%d\naveraging_time=%d\nhour=%d\n",
+		EC_ENGINE_VERSION,
+		ptConfig->iDetrending != 0, ptConfig->iRotations,
+		ptConfig->rAltitude, ptConfig->rAnemometerHeight,
+		ptConfig->iSpectra != 0, ptConfig->iFluxErrors != 0,
+		ptConfig->iDespiking != 0, ptConfig->iDespiking ? ptConfig->iDespikingWindow : 0, ptConfig->iDespiking ? ptConfig->rDespikingThreshold : 0.,
+		ptConfig->iQualityControl != 0, ptConfig->iStationarity != 0, ptConfig->iDissipation != 0,
+		iAveragingTime, iHourBegin
+	);
+	sha256Init(&tHash);
+	sha256Update(&tHash, sHeader, strlen(sHeader));
+	sha256Update(&tHash, ivData, (size_t)iNumData * sizeof(ivData[0]));
+	sha256Final(&tHash, sKey);
+
+}
+
+
+// Get the results stored under 'sKey'; return 0 on hit, non-zero on miss
+int rcGet(ResultCache* ptCache, const char* sKey, EddyBlock* tvBlock, const int iNumBlocks) {
+
+	char  sName[320];
+	char  sMagic[8];
+	int   ivSize[2];
+	FILE* f;
+	int   iHit = 0;
+
+	entryName(ptCache, sKey, sName);
+	f = fopen(sName, "rb");
+	if(f != NULL) {
+		iHit =
+			fread(sMagic, 1, 8, f) == 8 && memcmp(sMagic, RC_MAGIC, 8) == 0 &&
+			fread(ivSize, sizeof(int), 2, f) == 2 && ivSize[0] == iNumBlocks && ivSize[1] == (int)sizeof(EddyBlock) &&
+			fread(tvBlock, sizeof(EddyBlock), iNumBlocks, f) == (size_t)iNumBlocks;
+		fclose(f);
+	}
+	if(iHit) utimes(sName, NULL);		// Mark as just used
+
+	pthread_mutex_lock(&ptCache->tLock);
+	if(iHit) ptCache->iHits++;
+	else     ptCache->iMisses++;
+	pthread_mutex_unlock(&ptCache->tLock);
+	return(iHit ? 0 : 1);
+
+}
+
+
+// Store results under 'sKey', evicting old entries if the cache gets
+// over its bound; return 0 on success
+int rcPut(ResultCache* ptCache, const char* sKey, const EddyBlock* tvBlock, const int iNumBlocks) {
+
+	char        sName[320];
+	char        sTemp[340];
+	int         ivSize[2];
+	FILE*       f;
+	struct stat tStat;
+	long long   lSize;
+	int         iExisted;
+	int         iOver;
+
+	// Write entry aside, then move it in place
+	entryName(ptCache, sKey, sName);
+	sprintf(sTemp, "%s/%.2s", ptCache->sRoot, sKey);
+	if(mkdir(sTemp, 0755) != 0 && errno != EEXIST) return(1);
+	sprintf(sTemp, "%s.%lx.tmp", sName, (unsigned long)pthread_self());
+	f = fopen(sTemp, "wb");
+	if(f == NULL) return(2);
+	ivSize[0] = iNumBlocks;
+	ivSize[1] = (int)sizeof(EddyBlock);
+	if(
+		fwrite(RC_MAGIC, 1, 8, f) != 8 ||
+		fwrite(ivSize, sizeof(int), 2, f) != 2 ||
+		fwrite(tvBlock, sizeof(EddyBlock), iNumBlocks, f) != (size_t)iNumBlocks
+	) {
+		fclose(f);
+		unlink(sTemp);
+		return(3);
+	}
+	if(fclose(f) != 0) {
+		unlink(sTemp);
+		return(3);
+	}
+	iExisted = stat(sName, &tStat) == 0;
+	if(rename(sTemp, sName) != 0) {
+		unlink(sTemp);
+		return(4);
+	}
+
+	// Account for it
+	lSize = RC_HEADER_SIZE + (long long)iNumBlocks * sizeof(EddyBlock);
+	pthread_mutex_lock(&ptCache->tLock);
+	if(iExisted) {
+		ptCache->lBytes -= tStat.st_size;
+		ptCache->iEntries--;
+	}
+	ptCache->lBytes += lSize;
+	ptCache->iEntries++;
+	ptCache->iStores++;
+	iOver = ptCache->lMaxBytes > 0 && ptCache->lBytes > ptCache->lMaxBytes;
+	pthread_mutex_unlock(&ptCache->tLock);
+
+	// Trim with some slack, so that a full cache is not scanned at each store
+	if(iOver) rcTrim(ptCache, ptCache->lMaxBytes - ptCache->lMaxBytes / 10);
+	return(0);
+
+}
+
+
+// Evict least recently used entries until the cache holds at most
+// 'lMaxBytes' bytes; return the number of entries evicted
+int rcTrim(ResultCache* ptCache, const long long lMaxBytes) {
+
+	RcEntry*  tvEntry;
+	long long lBytes = 0;
+	int       iEvicted = 0;
+	int       n;
+	int       i;
+
+	pthread_mutex_lock(&ptCache->tLock);
+	n = listEntries(ptCache, &tvEntry);
+	if(n < 0) {
+		pthread_mutex_unlock(&ptCache->tLock);
+		return(0);
+	}
+	for(i=0; i<n; i++) lBytes += tvEntry[i].lSize;
+	qsort(tvEntry, n, sizeof(RcEntry), compareEntries);
+	for(i=0; i<n && lBytes > lMaxBytes; i++) {
+		if(unlink(tvEntry[i].sName) != 0) continue;
+		lBytes -= tvEntry[i].lSize;
+		iEvicted++;
+	}
+	ptCache->lBytes      = lBytes;
+	ptCache->iEntries    = n - iEvicted;
+	ptCache->iEvictions += iEvicted;
+	pthread_mutex_unlock(&ptCache->tLock);
+	free(tvEntry);
+	return(iEvicted);
+
+}
@@ -0,0 +1,45 @@
+/*
+
+	rc_lib - Content-addressed cache of eddy covariance results.
+
+	Results of one hour (its "EddyBlock" array) are stored under a key
+	which is the SHA-256 of everything they depend on: the raw data, the
+	effective configuration, the averaging time, the hour and the engine
+	version (EC_ENGINE_VERSION). Unchanged inputs are then served from the
+	cache instead of being processed again.
+
+	The cache is a directory with one file per entry, "xx/<key>", where
+	"xx" are the first two hex digits of the key. Entries are evicted,
+	least recently used first, when their total size exceeds the bound.
+	A cache may be shared by many threads.
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#include <pthread.h>
+
+#define RC_MAGIC    "MFRC0001"
+#define RC_KEY_LEN  64			// Hex digits of a key
+
+// Cache descriptor and statistics
+typedef struct ResultCache {
+	char            sRoot[256];
+	long long       lMaxBytes;		// Size bound
+	long long       lBytes;			// Current size of entries
+	int             iEntries;
+	unsigned int    iHits;
+	unsigned int    iMisses;
+	unsigned int    iStores;
+	unsigned int    iEvictions;
+	pthread_mutex_t tLock;
+} ResultCache;
+
+int  rcOpen(ResultCache* ptCache, const char* sRoot, const long long lMaxBytes);
+void rcClose(ResultCache* ptCache);
+void rcKey(const EddyConfig* ptConfig, const int iAveragingTime, const int iHourBegin, const short ivData[][5], const int iNumData, char sKey[RC_KEY_LEN+1]);
+int  rcGet(ResultCache* ptCache, const char* sKey, EddyBlock* tvBlock, const int iNumBlocks);
+int  rcPut(ResultCache* ptCache, const char* sKey, const EddyBlock* tvBlock, const int iNumBlocks);
+int  rcTrim(ResultCache* ptCache, const long long lMaxBytes);
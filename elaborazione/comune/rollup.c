@@ -0,0 +1,449 @@
+/*
+
+	rollup - Incrementally maintained hourly, daily, monthly and yearly
+	         aggregates of processed blocks.
+
+	Usage:
+
+		rollup update <RollupRoot> <ColumnarFile> [<Height> <z0>]
+		rollup show   <RollupRoot> <YYYY|YYYYMM|YYYYMMDD>
+
+	"update" adds the blocks of a binary columnar result file (".HHP") to
+	the aggregates of the hours they belong to. Each hour aggregate is
+	kept, in slot files, together with the day, month and year ones: on
+	update the hour aggregate is replaced and only its difference from the
+	previous one is added to day, month and year, so the cost does not
+	depend on how far into the month or year we are, and reprocessing an
+	hour never counts it twice.
+
+	Aggregates are sums and counts: vector wind, wind rose (the 16 sectors
+	of 'WindDirClassify'), temperature, fluxes and a histogram of stability
+	categories, obtained from z/L by Golder (1972) limits (the ones used in
+	"averager.R"; <Height> and <z0>, in m, default to 10 and 0.023).
+
+	"show" writes to standard output, in CSV form, the aggregate of the
+	year, month or day given.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "col_lib.h"
+
+#define HOUR_SLOTS  (31*24)
+#define DAY_SLOTS   31
+#define MONTH_SLOTS 12
+#define YEAR_SLOTS  1
+
+// Aggregate of a time period; all fields are additive
+typedef struct Rollup {
+	int    nBlocks;			// Blocks seen
+	int    nWind;			// Blocks with valid wind
+	double rSumU;			// Sum of block vector wind components (m/s, flow convention)
+	double rSumV;
+	double rSumScalarVel;	// Sum of block scalar speeds (m/s)
+	int    ivDirClass[16];	// Wind rose: blocks per sector, sector 1 centered on N
+	int    nTemp;
+	double rSumTemp;		// Sum of temperatures (°C)
+	int    nH0;
+	double rSumH0;			// Sum of sensible heat fluxes (W/m2)
+	int    nUstar;
+	double rSumUstar;		// Sum of friction velocities (m/s)
+	int    nTKE;
+	double rSumTKE;			// Sum of turbulent kinetic energies (m2/s2)
+	int    ivStabClass[6];	// Blocks per stability category, A to F
+} Rollup;
+
+
+/******************
+* Rollup algebra  *
+******************/
+
+static void rollupAdd(Rollup* ptTotal, const Rollup* ptPart, const int iSign) {
+
+	int i;
+
+	ptTotal->nBlocks       += iSign * ptPart->nBlocks;
+	ptTotal->nWind         += iSign * ptPart->nWind;
+	ptTotal->rSumU         += iSign * ptPart->rSumU;
+	ptTotal->rSumV         += iSign * ptPart->rSumV;
+	ptTotal->rSumScalarVel += iSign * ptPart->rSumScalarVel;
+	for(i=0; i<16; i++) ptTotal->ivDirClass[i] += iSign * ptPart->ivDirClass[i];
+	ptTotal->nTemp         += iSign * ptPart->nTemp;
+	ptTotal->rSumTemp      += iSign * ptPart->rSumTemp;
+	ptTotal->nH0           += iSign * ptPart->nH0;
+	ptTotal->rSumH0        += iSign * ptPart->rSumH0;
+	ptTotal->nUstar        += iSign * ptPart->nUstar;
+	ptTotal->rSumUstar     += iSign * ptPart->rSumUstar;
+	ptTotal->nTKE          += iSign * ptPart->nTKE;
+	ptTotal->rSumTKE       += iSign * ptPart->rSumTKE;
+	for(i=0; i<6; i++) ptTotal->ivStabClass[i] += iSign * ptPart->ivStabClass[i];
+
+}
+
+
+// Sector index (0..15) of a direction, the same way as 'WindDirClassify'
+static int dirClass(const float rDir) {
+
+	const float CLASS_WIDTH = 360.f/16.f;
+	const float HALF_CLASS  = CLASS_WIDTH / 2.f;
+	float       rShifted;
+	int         iClass;
+
+	rShifted = rDir + HALF_CLASS;
+	if(rShifted <    0.f) rShifted += 360.f;
+	if(rShifted >= 360.f) rShifted -= 360.f;
+	iClass = (int)floorf(rShifted / CLASS_WIDTH);
+	if(iClass < 0)  iClass = 0;
+	if(iClass > 15) iClass = 15;
+	return(iClass);
+
+}
+
+
+// Golder (1972) stability category index (0 = A .. 5 = F), from Obukhov length,
+// with the approximated separation lines of CTDM+ LSTAB (as in "averager.R")
+static int stabClass(const double rL, double rZ0) {
+
+	double rLogZ0;
+	double rLimit[5];
+
+	// Ensure z0 to be within common range
+	if(rZ0 > 0.5)  rZ0 = 0.5;
+	if(rZ0 < 0.01) rZ0 = 0.01;
+	rLogZ0 = log(rZ0);
+
+	// Separation lines, as |L|; neutral conditions belong to D
+	rLimit[0] = -70.0 / (rLogZ0 - 4.35);	// A/B
+	rLimit[1] = -85.2 / (rLogZ0 - 0.502);	// B/C
+	rLimit[2] = -245. / (rLogZ0 - 0.050);	// C/D
+	rLimit[3] = -327. / (rLogZ0 - 0.627);	// D/E
+	rLimit[4] = -70.0 / (rLogZ0 - 0.295);	// E/F
+	if(!isfinite(rL)) return(3);
+	if(rL < 0.) {
+		if(-rL < rLimit[0]) return(0);
+		if(-rL < rLimit[1]) return(1);
+		if(-rL < rLimit[2]) return(2);
+		return(3);
+	}
+	if(rL < rLimit[4]) return(5);
+	if(rL < rLimit[3]) return(4);
+	return(3);
+
+}
+
+
+/***************
+* Slot files   *
+***************/
+
+// Read slot iSlot of a slot file, creating the file if missing, and then
+// either replace it with ptValue (iAdd == 0) or add ptValue to it.
+// The previous content is returned in ptOld. Return 0 on success.
+static int slotApply(const char* sFileName, const int nSlots, const int iSlot, const Rollup* ptValue, const int iAdd, Rollup* ptOld) {
+
+	FILE*  f;
+	Rollup tEmpty;
+	Rollup tNew;
+	int    i;
+
+	memset(&tEmpty, 0, sizeof(Rollup));
+	f = fopen(sFileName, "r+b");
+	if(f == NULL) {
+		f = fopen(sFileName, "w+b");
+		if(f == NULL) return(1);
+		for(i=0; i<nSlots; i++) fwrite(&tEmpty, sizeof(Rollup), 1, f);
+	}
+
+	// Get old value
+	fseek(f, (long)iSlot * sizeof(Rollup), SEEK_SET);
+	if(fread(ptOld, sizeof(Rollup), 1, f) != 1) *ptOld = tEmpty;
+
+	// Update it
+	if(iAdd) {
+		tNew = *ptOld;
+		rollupAdd(&tNew, ptValue, 1);
+	}
+	else {
+		tNew = *ptValue;
+	}
+	fseek(f, (long)iSlot * sizeof(Rollup), SEEK_SET);
+	if(fwrite(&tNew, sizeof(Rollup), 1, f) != 1) {
+		fclose(f);
+		return(2);
+	}
+	fclose(f);
+
+	// Leave
+	return(0);
+
+}
+
+
+// Replace the aggregate of one hour, and propagate the change to its day, month and year
+static int updateHour(const char* sRoot, const int iHourStamp, const Rollup* ptHour) {
+
+	time_t    tStamp = (time_t)iHourStamp;
+	struct tm tTime;
+	char      sFileName[512];
+	Rollup    tOld;
+	Rollup    tDelta;
+	Rollup    tDummy;
+	int       iYear;
+	int       iMonth;
+
+	gmtime_r(&tStamp, &tTime);
+	iYear  = tTime.tm_year + 1900;
+	iMonth = tTime.tm_mon + 1;
+
+	// Hour: replace, getting the difference
+	sprintf(sFileName, "%s/%04d%02d.rh", sRoot, iYear, iMonth);
+	if(slotApply(sFileName, HOUR_SLOTS, (tTime.tm_mday-1)*24 + tTime.tm_hour, ptHour, 0, &tOld) != 0) return(1);
+	tDelta = *ptHour;
+	rollupAdd(&tDelta, &tOld, -1);
+
+	// Day, month and year: add difference
+	sprintf(sFileName, "%s/%04d%02d.rd", sRoot, iYear, iMonth);
+	if(slotApply(sFileName, DAY_SLOTS, tTime.tm_mday-1, &tDelta, 1, &tDummy) != 0) return(2);
+	sprintf(sFileName, "%s/%04d.rm", sRoot, iYear);
+	if(slotApply(sFileName, MONTH_SLOTS, iMonth-1, &tDelta, 1, &tDummy) != 0) return(3);
+	sprintf(sFileName, "%s/%04d.ry", sRoot, iYear);
+	if(slotApply(sFileName, YEAR_SLOTS, 0, &tDelta, 1, &tDummy) != 0) return(4);
+
+	// Leave
+	return(0);
+
+}
+
+
+/*************
+* Commands   *
+*************/
+
+static int readRealColumn(const ColumnarFile* ptCol, const char* sName, float** prvValues) {
+
+	int iColumn;
+
+	*prvValues = malloc(ptCol->nRows * sizeof(float) + 1);
+	if(*prvValues == NULL) return(1);
+	iColumn = colFindColumn(ptCol, sName);
+	if(colReadReal(ptCol, iColumn, *prvValues) != 0) return(2);
+	return(0);
+
+}
+
+
+static int update(const char* sRoot, const char* sColFile, const double rHeight, const double rZ0) {
+
+	ColumnarFile tCol;
+	int*         ivTimeStamp;
+	float*       rvVel         = NULL;
+	float*       rvDir         = NULL;
+	float*       rvScalarVel   = NULL;
+	float*       rvTemp        = NULL;
+	float*       rvH0          = NULL;
+	float*       rvUstar       = NULL;
+	float*       rvTKE         = NULL;
+	float*       rvZl          = NULL;
+	Rollup       tHour;
+	int          iHourStamp;
+	int          iRow;
+	int          iRetCode = 0;
+	double       rDirRad;
+
+	if(colOpen(sColFile, &tCol) != 0) {
+		fprintf(stderr, "rollup:: error: Columnar file '%s' not readable\n", sColFile);
+		return(2);
+	}
+	ivTimeStamp = malloc(tCol.nRows * sizeof(int) + 1);
+	if(
+		ivTimeStamp == NULL ||
+		colReadInteger(&tCol, colFindColumn(&tCol, "Time.Stamp"), ivTimeStamp) != 0 ||
+		readRealColumn(&tCol, "Vel", &rvVel) != 0 ||
+		readRealColumn(&tCol, "Dir", &rvDir) != 0 ||
+		readRealColumn(&tCol, "Scalar.Vel", &rvScalarVel) != 0 ||
+		readRealColumn(&tCol, "Temp", &rvTemp) != 0 ||
+		readRealColumn(&tCol, "H0", &rvH0) != 0 ||
+		readRealColumn(&tCol, "U.star", &rvUstar) != 0 ||
+		readRealColumn(&tCol, "TKE", &rvTKE) != 0 ||
+		readRealColumn(&tCol, "z.L", &rvZl) != 0
+	) {
+		fprintf(stderr, "rollup:: error: Columnar file '%s' does not contain processed data\n", sColFile);
+		iRetCode = 3;
+	}
+
+	// Aggregate blocks by hour (rows are in time order), and apply each hour
+	for(iRow=0; iRow<tCol.nRows && iRetCode == 0; ) {
+		iHourStamp = ivTimeStamp[iRow] - ivTimeStamp[iRow] % 3600;
+		memset(&tHour, 0, sizeof(Rollup));
+		for(; iRow<tCol.nRows && ivTimeStamp[iRow] - ivTimeStamp[iRow] % 3600 == iHourStamp; iRow++) {
+			tHour.nBlocks++;
+			if(rvVel[iRow] > -9990.f && rvDir[iRow] > -9990.f && rvScalarVel[iRow] > -9990.f) {
+				rDirRad = rvDir[iRow] * M_PI / 180.;
+				tHour.nWind++;
+				tHour.rSumU         += -rvVel[iRow] * sin(rDirRad);
+				tHour.rSumV         += -rvVel[iRow] * cos(rDirRad);
+				tHour.rSumScalarVel += rvScalarVel[iRow];
+				tHour.ivDirClass[dirClass(rvDir[iRow])]++;
+			}
+			if(rvTemp[iRow]  > -9990.f) { tHour.nTemp++;  tHour.rSumTemp  += rvTemp[iRow]; }
+			if(rvH0[iRow]    > -9990.f) { tHour.nH0++;    tHour.rSumH0    += rvH0[iRow]; }
+			if(rvUstar[iRow] > -9990.f) { tHour.nUstar++; tHour.rSumUstar += rvUstar[iRow]; }
+			if(rvTKE[iRow]   > -9990.f) { tHour.nTKE++;   tHour.rSumTKE   += rvTKE[iRow]; }
+			if(rvZl[iRow]    > -9990.f) tHour.ivStabClass[stabClass(rHeight / rvZl[iRow], rZ0)]++;
+		}
+		if(updateHour(sRoot, iHourStamp, &tHour) != 0) {
+			fprintf(stderr, "rollup:: error: Aggregates not updated\n");
+			iRetCode = 4;
+		}
+	}
+
+	// Leave
+	free(ivTimeStamp);
+	free(rvVel);
+	free(rvDir);
+	free(rvScalarVel);
+	free(rvTemp);
+	free(rvH0);
+	free(rvUstar);
+	free(rvTKE);
+	free(rvZl);
+	colClose(&tCol);
+	return(iRetCode);
+
+}
+
+
+static double mean(const double rSum, const int n) {
+	return(n > 0 ? rSum / n : -9999.9);
+}
+
+
+static int show(const char* sRoot, const char* sPeriod) {
+
+	static const char* svDir[16] = {"N","NNE","NE","ENE","E","ESE","SE","SSE","S","SSW","SW","WSW","W","WNW","NW","NNW"};
+	char   sFileName[512];
+	FILE*  f;
+	Rollup tRollup;
+	int    iYear  = 0;
+	int    iMonth = 0;
+	int    iDay   = 0;
+	int    iSlot;
+	int    i;
+	double rU;
+	double rV;
+	double rVel  = -9999.9;
+	double rDir  = -9999.9;
+
+	// Locate aggregate
+	switch(strlen(sPeriod)) {
+	case 4:
+		sscanf(sPeriod, "%4d", &iYear);
+		sprintf(sFileName, "%s/%04d.ry", sRoot, iYear);
+		iSlot = 0;
+		break;
+	case 6:
+		sscanf(sPeriod, "%4d%2d", &iYear, &iMonth);
+		sprintf(sFileName, "%s/%04d.rm", sRoot, iYear);
+		iSlot = iMonth - 1;
+		break;
+	case 8:
+		sscanf(sPeriod, "%4d%2d%2d", &iYear, &iMonth, &iDay);
+		sprintf(sFileName, "%s/%04d%02d.rd", sRoot, iYear, iMonth);
+		iSlot = iDay - 1;
+		break;
+	default:
+		fprintf(stderr, "rollup:: error: Invalid period '%s'\n", sPeriod);
+		return(3);
+	}
+	memset(&tRollup, 0, sizeof(Rollup));
+	f = fopen(sFileName, "rb");
+	if(f != NULL) {
+		if(iSlot >= 0 && fseek(f, (long)iSlot * sizeof(Rollup), SEEK_SET) == 0) {
+			if(fread(&tRollup, sizeof(Rollup), 1, f) != 1) memset(&tRollup, 0, sizeof(Rollup));
+		}
+		fclose(f);
+	}
+
+	// Vector wind
+	if(tRollup.nWind > 0) {
+		rU   = tRollup.rSumU / tRollup.nWind;
+		rV   = tRollup.rSumV / tRollup.nWind;
+		rVel = sqrt(rU*rU + rV*rV);
+		rDir = 180. / M_PI * atan2(-rU, -rV);
+		if(rDir < 0.) rDir += 360.;
+	}
+
+	// Print
+	printf("Period,N.Blocks,N.Wind,Vel,Dir,Scalar.Vel,Temp,H0,U.star,TKE");
+	for(i=0; i<16; i++) printf(",N.Dir.%s", svDir[i]);
+	for(i=0; i<6; i++) printf(",N.Stab.%c", 'A' + i);
+	printf("\n");
+	printf("%s,%6d,%6d,%9.3f,%9.3f,%9.3f,%9.3f,%9.3f,%9.3f,%9.3f",
+		sPeriod, tRollup.nBlocks, tRollup.nWind, rVel, rDir,
+		mean(tRollup.rSumScalarVel, tRollup.nWind),
+		mean(tRollup.rSumTemp, tRollup.nTemp),
+		mean(tRollup.rSumH0, tRollup.nH0),
+		mean(tRollup.rSumUstar, tRollup.nUstar),
+		mean(tRollup.rSumTKE, tRollup.nTKE)
+	);
+	for(i=0; i<16; i++) printf(",%6d", tRollup.ivDirClass[i]);
+	for(i=0; i<6; i++) printf(",%6d", tRollup.ivStabClass[i]);
+	printf("\n");
+
+	// Leave
+	return(0);
+
+}
+
+
+int main(int argc, char** argv) {
+
+	double rHeight = 10.;
+	double rZ0     = 0.023;
+
+	// Get parameters
+	if(argc < 4 || (strcmp(argv[1], "update") == 0 && argc != 4 && argc != 6) || (strcmp(argv[1], "show") == 0 && argc != 4)) {
+		printf("rollup - Incrementally maintained aggregates of processed blocks\n\n");
+		printf("Usage:\n\n");
+		printf("  rollup update <RollupRoot> <ColumnarFile> [<Height> <z0>]\n");
+		printf("  rollup show   <RollupRoot> <YYYY|YYYYMM|YYYYMMDD>\n\n");
+		printf("Copyright 2012 by Servizi Territorio srl\n");
+		printf("                  All rights reserved\n");
+		return(1);
+	}
+
+	// Dispatch command
+	if(strcmp(argv[1], "update") == 0) {
+		if(argc == 6) {
+			rHeight = atof(argv[4]);
+			rZ0     = atof(argv[5]);
+			if(rHeight <= 0. || rZ0 <= 0.) {
+				fprintf(stderr, "rollup:: error: Invalid height or z0\n");
+				return(1);
+			}
+		}
+		if(mkdir(argv[2], 0777) != 0 && errno != EEXIST) {
+			fprintf(stderr, "rollup:: error: Rollup directory '%s' not accessible\n", argv[2]);
+			return(2);
+		}
+		return(update(argv[2], argv[3], rHeight, rZ0));
+	}
+	else if(strcmp(argv[1], "show") == 0) {
+		return(show(argv[2], argv[3]));
+	}
+	fprintf(stderr, "rollup:: error: Unknown command '%s'\n", argv[1]);
+
+	// Leave
+	return(1);
+
+}
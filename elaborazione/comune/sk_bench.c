@@ -0,0 +1,127 @@
+/*
+
+	sk_bench - Check and time every statistics kernel implementation
+	           available on this machine against the scalar reference,
+	           on a synthetic block.
+
+	Usage:
+
+		./sk_bench [<NumData> [<NumRepetitions>]]
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "sk_lib.h"
+
+static double elapsed(const struct timespec* ptFrom) {
+
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return((tNow.tv_sec - ptFrom->tv_sec) + 1.e-9*(tNow.tv_nsec - ptFrom->tv_nsec));
+
+}
+
+
+int main(int argc, char** argv) {
+
+	int             iNumData = 36000;	// One hour at 10 Hz, or a half hour at 20 Hz
+	int             iNumRep  = 200;
+	double*         rvU;
+	double*         rvV;
+	double*         rvW;
+	short int*      ivvRaw[4];
+	SkWindSums      tSums, tSumsRef;
+	SkMoments       tMoments, tMomentsRef;
+	int             ivDirClass[16], ivDirClassRef[16];
+	struct timespec tStart;
+	double          rWind, rDir, rMoments;
+	int             iImpl;
+	int             iRep;
+	int             i, j;
+
+	// Get parameters
+	if(argc >= 2) iNumData = atoi(argv[1]);
+	if(argc >= 3) iNumRep  = atoi(argv[2]);
+	if(iNumData <= 1 || iNumRep <= 0) {
+		fprintf(stderr, "sk_bench:: error: Invalid parameters\n");
+		return(1);
+	}
+
+	// Generate a synthetic block, with some invalid data
+	rvU = (double*)malloc(iNumData*sizeof(double));
+	rvV = (double*)malloc(iNumData*sizeof(double));
+	rvW = (double*)malloc(iNumData*sizeof(double));
+	for(j=0; j<4; j++) ivvRaw[j] = (short int*)malloc(iNumData*sizeof(short int));
+	if(rvU == NULL || rvV == NULL || rvW == NULL || ivvRaw[0] == NULL || ivvRaw[1] == NULL || ivvRaw[2] == NULL || ivvRaw[3] == NULL) {
+		fprintf(stderr, "sk_bench:: error: Not enough memory\n");
+		return(2);
+	}
+	srand(2012);
+	for(i=0; i<iNumData; i++) {
+		rvU[i] = 2. + 4.*(rand()/(double)RAND_MAX - 0.5);
+		rvV[i] = 1. + 4.*(rand()/(double)RAND_MAX - 0.5);
+		rvW[i] = rand()/(double)RAND_MAX - 0.5;
+		for(j=0; j<3; j++) ivvRaw[j][i] = (short int)(100.*(j == 0 ? rvU[i] : j == 1 ? rvV[i] : rvW[i]));
+		ivvRaw[3][i] = 2000 + rand() % 200;
+		if(i % 97 == 0) ivvRaw[2][i] = -9999;
+	}
+
+	// Reference
+	skSelect(SK_SCALAR);
+	skWindSums(rvU, rvV, rvW, iNumData, &tSumsRef);
+	memset(ivDirClassRef, 0, sizeof(ivDirClassRef));
+	skDirClassify(rvU, rvV, iNumData, ivDirClassRef);
+	skClearMoments(&tMomentsRef);
+	skAddMoments(ivvRaw[0], ivvRaw[1], ivvRaw[2], ivvRaw[3], NULL, 0., 0., iNumData, &tMomentsRef);
+
+	// Time all implementations
+	printf("Data in block:  %d\n", iNumData);
+	printf("Repetitions:    %d\n\n", iNumRep);
+	printf("Kernels    Wind (ms)  Dir (ms)  Mom (ms)  Max rel. diff.  Exact\n");
+	for(iImpl=0; iImpl<SK_NUM_IMPL; iImpl++) {
+		if(skKernels(iImpl) == NULL) continue;
+		if(skSelect(iImpl) != iImpl) {
+			printf("%-8s   not supported, or failed self-check\n", skName(iImpl));
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) skWindSums(rvU, rvV, rvW, iNumData, &tSums);
+		rWind = elapsed(&tStart);
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) {
+			memset(ivDirClass, 0, sizeof(ivDirClass));
+			skDirClassify(rvU, rvV, iNumData, ivDirClass);
+		}
+		rDir = elapsed(&tStart);
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) {
+			skClearMoments(&tMoments);
+			skAddMoments(ivvRaw[0], ivvRaw[1], ivvRaw[2], ivvRaw[3], NULL, 0., 0., iNumData, &tMoments);
+		}
+		rMoments = elapsed(&tStart);
+		printf("%-8s %10.3f %9.3f %9.3f %15.3e  %s\n",
+			skName(iImpl),
+			1000.*rWind/iNumRep, 1000.*rDir/iNumRep, 1000.*rMoments/iNumRep,
+			fmax(fabs(tSums.rSumPhi - tSumsRef.rSumPhi) / fabs(tSumsRef.rSumPhi), fabs(tSums.rSumVel - tSumsRef.rSumVel) / tSumsRef.rSumVel),
+			memcmp(ivDirClass, ivDirClassRef, sizeof(ivDirClass)) == 0 &&
+			tMoments.n == tMomentsRef.n &&
+			memcmp(tMoments.ivSum, tMomentsRef.ivSum, sizeof(tMoments.ivSum)) == 0 &&
+			memcmp(tMoments.ivCross, tMomentsRef.ivCross, sizeof(tMoments.ivCross)) == 0 ? "yes" : "NO"
+		);
+	}
+	skSelect(SK_BEST);
+	printf("\nSelected:       %s\n", skName(skCurrent()));
+
+	// Leave
+	return(0);
+
+}
@@ -19,13 +19,38 @@ MODULE SonicLib
 	PUBLIC	:: OPERATOR(.VALID.)
 	PUBLIC	:: Average
 	PUBLIC	:: Covariance
+	PUBLIC	:: BlockStatistics
+	PUBLIC	:: BlockStatisticsExact
+	PUBLIC	:: RemoveBlockTrend
 	PUBLIC	:: RotationMatrix
+	PUBLIC	:: PlanarFit
+	PUBLIC	:: PlanarFitInit
+	PUBLIC	:: PlanarFitRead
+	PUBLIC	:: PlanarFitWrite
+	PUBLIC	:: PlanarFitAdd
+	PUBLIC	:: PlanarFitMatrix
 	PUBLIC	:: BasicAnemology
 	PUBLIC	:: WindDirClassify
 	PUBLIC	:: WindStatistics
 	PUBLIC	:: WindStatistics2D
 	PUBLIC	:: BasicTurbulence
 	
+	! Planar fit (Wilczak et al., 2001), by wind sector: for each sector, the
+	! sums of normal equations regressing block mean w on mean u and v, from
+	! all blocks accounted so far (possibly over many runs, as the state is
+	! kept on file), and the tilt matrix they yield
+	INTEGER, PARAMETER	:: PF_MAX_SECTORS = 36
+	INTEGER, PARAMETER	:: PF_MIN_BLOCKS  = 24		! Blocks in sector before its fit is used
+	REAL, PARAMETER		:: PF_MIN_VEL     = 0.5		! Blocks with slower mean horizontal wind (m/s) are not accounted
+	TYPE PlanarFit
+		INTEGER										:: iNumSectors
+		INTEGER										:: iLastBlock	! Time stamp of last block accounted (blocks are accounted once)
+		DOUBLE PRECISION, DIMENSION(9,PF_MAX_SECTORS)	:: raSums		! n, Su, Sv, Sw, Suu, Suv, Svv, Suw, Svw
+		LOGICAL, DIMENSION(PF_MAX_SECTORS)			:: lvFitted
+		REAL, DIMENSION(3,3,PF_MAX_SECTORS)			:: raTilt		! Rows: new x, y, z axes (z normal to plane)
+		REAL, DIMENSION(2,PF_MAX_SECTORS)			:: raAngles		! Pitch and roll of plane (rad)
+	END TYPE PlanarFit
+	
 	! Interfaces
 	
 	INTERFACE OPERATOR(.VALID.)
@@ -342,6 +367,278 @@ CONTAINS
 	END SUBROUTINE Covariance
 	
 	
+	! Fused block statistics: in one sweep over the desired subset, computes
+	! ranges, means and the full covariance matrix of the variables passed,
+	! in the order u, v, w, t (3D) or u, v, t (2D, vertical component omitted).
+	! Means and co-moments are updated in double precision with Welford's
+	! method, which does not suffer from the cancellation of "sum of squares"
+	! formulas. Co-moments with data position are accumulated too: when
+	! detrending is requested, the linear trend on position (the same fictive
+	! time RemoveLinearTrend uses) is removed from covariances analytically,
+	! and its slopes are returned for use with RemoveBlockTrend. Ranges are
+	! always of original data, and means are not affected by detrending.
+	FUNCTION BlockStatistics( &
+		rvU, rvV, rvT, &
+		lvDesiredSubset, &
+		lDetrend, &
+		rvMin, rvMax, rvAvg, &
+		rmCov, &
+		rvSlope, rIndexAvg, &
+		rvW &
+	) RESULT(iRetCode)
+	
+		! Routine arguments
+		REAL, DIMENSION(:), INTENT(IN)				:: rvU
+		REAL, DIMENSION(:), INTENT(IN)				:: rvV
+		REAL, DIMENSION(:), INTENT(IN)				:: rvT
+		LOGICAL, DIMENSION(:), INTENT(IN)			:: lvDesiredSubset
+		LOGICAL, INTENT(IN)							:: lDetrend
+		REAL, DIMENSION(:), INTENT(OUT)				:: rvMin		! Minima (one per variable)
+		REAL, DIMENSION(:), INTENT(OUT)				:: rvMax		! Maxima
+		REAL, DIMENSION(:), INTENT(OUT)				:: rvAvg		! Means
+		REAL, DIMENSION(:,:), INTENT(OUT)			:: rmCov		! Covariances (detrended, if requested)
+		REAL, DIMENSION(:), INTENT(OUT)				:: rvSlope		! Trend slopes per data position (0 if not detrending)
+		REAL, INTENT(OUT)							:: rIndexAvg	! Mean data position
+		REAL, DIMENSION(:), INTENT(IN), OPTIONAL	:: rvW
+		INTEGER										:: iRetCode
+		
+		! Locals
+		INTEGER								:: iNumVar
+		INTEGER								:: iNumValid
+		INTEGER								:: i
+		INTEGER								:: j, k
+		DOUBLE PRECISION					:: rN
+		DOUBLE PRECISION, DIMENSION(0:4)	:: rvX		! Data position, then variables
+		DOUBLE PRECISION, DIMENSION(0:4)	:: rvMean
+		DOUBLE PRECISION, DIMENSION(0:4)	:: rvDelta
+		DOUBLE PRECISION, DIMENSION(0:4,0:4):: rmM2		! Co-moments (upper triangle)
+		REAL, DIMENSION(4)					:: rvLo
+		REAL, DIMENSION(4)					:: rvHi
+		
+		! Assume success (will falsify on failure)
+		iRetCode = 0
+		
+		! Check parameters
+		iNumVar = 3
+		IF(PRESENT(rvW)) iNumVar = 4
+		IF(SIZE(rvMin) < iNumVar .OR. SIZE(rvMax) < iNumVar .OR. SIZE(rvAvg) < iNumVar .OR. SIZE(rvSlope) < iNumVar .OR. &
+		   SIZE(rmCov, DIM=1) < iNumVar .OR. SIZE(rmCov, DIM=2) < iNumVar) THEN
+			iRetCode = 2
+			RETURN
+		END IF
+		rvMin     = -9999.9
+		rvMax     = -9999.9
+		rvAvg     = -9999.9
+		rmCov     = -9999.9
+		rvSlope   = 0.
+		rIndexAvg = 0.
+		
+		! Single sweep
+		iNumValid = 0
+		rvMean    = 0.d0
+		rmM2      = 0.d0
+		rvX       = 0.d0
+		rvLo      = HUGE(rvLo)
+		rvHi      = -HUGE(rvHi)
+		DO i = 1, SIZE(rvU)
+			IF(.NOT.lvDesiredSubset(i)) CYCLE
+			
+			! Gather variables
+			rvX(0) = i
+			rvX(1) = rvU(i)
+			rvX(2) = rvV(i)
+			IF(iNumVar == 4) rvX(3) = rvW(i)
+			rvX(iNumVar) = rvT(i)
+			
+			! Update extrema
+			DO j = 1, iNumVar
+				rvLo(j) = MIN(rvLo(j), REAL(rvX(j)))
+				rvHi(j) = MAX(rvHi(j), REAL(rvX(j)))
+			END DO
+			
+			! Update means and co-moments
+			iNumValid = iNumValid + 1
+			rN = iNumValid
+			rvDelta(0:iNumVar) = rvX(0:iNumVar) - rvMean(0:iNumVar)
+			rvMean(0:iNumVar)  = rvMean(0:iNumVar) + rvDelta(0:iNumVar) / rN
+			DO k = 0, iNumVar
+				DO j = 0, k
+					rmM2(j,k) = rmM2(j,k) + rvDelta(j) * (rvX(k) - rvMean(k))
+				END DO
+			END DO
+			
+		END DO
+		IF(iNumValid <= 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		
+		! Remove linear trend from co-moments, if requested (and defined: a single
+		! datum has no trend)
+		IF(lDetrend .AND. rmM2(0,0) > 0.d0) THEN
+			DO k = 1, iNumVar
+				DO j = 1, k
+					rmM2(j,k) = rmM2(j,k) - rmM2(0,j)*rmM2(0,k)/rmM2(0,0)
+				END DO
+				rvSlope(k) = REAL(rmM2(0,k)/rmM2(0,0))
+			END DO
+		END IF
+		
+		! Yield results
+		rN = iNumValid
+		DO k = 1, iNumVar
+			rvMin(k) = rvLo(k)
+			rvMax(k) = rvHi(k)
+			rvAvg(k) = REAL(rvMean(k))
+			DO j = 1, k
+				rmCov(j,k) = REAL(rmM2(j,k) / rN)
+				rmCov(k,j) = rmCov(j,k)
+			END DO
+		END DO
+		rIndexAvg = REAL(rvMean(0))
+		
+	END FUNCTION BlockStatistics
+	
+	
+	! Same as BlockStatistics, but working on raw integer data (cm/s, 1/100 °C,
+	! columns u, v, w, t or u, v, t) as read from file: counts, sums and cross
+	! products, data position included, are accumulated in 64 bit integers,
+	! so all moments are exact and bit-reproducible; conversion to physical
+	! units (and trend removal, if requested) happens at end only.
+	FUNCTION BlockStatisticsExact( &
+		iaData, &
+		lvDesiredSubset, &
+		lDetrend, &
+		rvMin, rvMax, rvAvg, &
+		rmCov, &
+		rvSlope, rIndexAvg &
+	) RESULT(iRetCode)
+	
+		! Routine arguments
+		INTEGER(2), DIMENSION(:,:), INTENT(IN)	:: iaData		! Raw data (one column per variable)
+		LOGICAL, DIMENSION(:), INTENT(IN)		:: lvDesiredSubset
+		LOGICAL, INTENT(IN)						:: lDetrend
+		REAL, DIMENSION(:), INTENT(OUT)			:: rvMin		! Minima (one per variable)
+		REAL, DIMENSION(:), INTENT(OUT)			:: rvMax		! Maxima
+		REAL, DIMENSION(:), INTENT(OUT)			:: rvAvg		! Means
+		REAL, DIMENSION(:,:), INTENT(OUT)		:: rmCov		! Covariances (detrended, if requested)
+		REAL, DIMENSION(:), INTENT(OUT)			:: rvSlope		! Trend slopes per data position (0 if not detrending)
+		REAL, INTENT(OUT)						:: rIndexAvg	! Mean data position
+		INTEGER									:: iRetCode
+		
+		! Locals
+		INTEGER								:: iNumVar
+		INTEGER								:: i
+		INTEGER								:: j, k
+		INTEGER(8)							:: iNumValid
+		INTEGER(8), DIMENSION(0:4)			:: ivX		! Data position, then variables
+		INTEGER(8), DIMENSION(0:4)			:: ivSum
+		INTEGER(8), DIMENSION(0:4,0:4)		:: iaCross	! Cross products (upper triangle)
+		INTEGER(2), DIMENSION(4)			:: ivLo
+		INTEGER(2), DIMENSION(4)			:: ivHi
+		DOUBLE PRECISION, DIMENSION(0:4,0:4):: rmM2		! Centered co-moments (upper triangle)
+		
+		! Assume success (will falsify on failure)
+		iRetCode = 0
+		
+		! Check parameters
+		iNumVar = SIZE(iaData, DIM=2)
+		IF(iNumVar < 1 .OR. iNumVar > 4 .OR. SIZE(lvDesiredSubset) /= SIZE(iaData, DIM=1) .OR. &
+		   SIZE(rvMin) < iNumVar .OR. SIZE(rvMax) < iNumVar .OR. SIZE(rvAvg) < iNumVar .OR. SIZE(rvSlope) < iNumVar .OR. &
+		   SIZE(rmCov, DIM=1) < iNumVar .OR. SIZE(rmCov, DIM=2) < iNumVar) THEN
+			iRetCode = 2
+			RETURN
+		END IF
+		rvMin     = -9999.9
+		rvMax     = -9999.9
+		rvAvg     = -9999.9
+		rmCov     = -9999.9
+		rvSlope   = 0.
+		rIndexAvg = 0.
+		
+		! Single sweep, in integer arithmetic
+		iNumValid = 0
+		ivSum     = 0
+		iaCross   = 0
+		ivX       = 0
+		ivLo      = HUGE(ivLo)
+		ivHi      = -HUGE(ivHi)
+		DO i = 1, SIZE(iaData, DIM=1)
+			IF(.NOT.lvDesiredSubset(i)) CYCLE
+			iNumValid = iNumValid + 1
+			ivX(0) = i
+			DO j = 1, iNumVar
+				ivX(j)  = iaData(i,j)
+				ivLo(j) = MIN(ivLo(j), iaData(i,j))
+				ivHi(j) = MAX(ivHi(j), iaData(i,j))
+			END DO
+			DO k = 0, iNumVar
+				ivSum(k) = ivSum(k) + ivX(k)
+				DO j = 0, k
+					iaCross(j,k) = iaCross(j,k) + ivX(j)*ivX(k)
+				END DO
+			END DO
+		END DO
+		IF(iNumValid <= 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		
+		! Convert to centered co-moments
+		DO k = 0, iNumVar
+			DO j = 0, k
+				rmM2(j,k) = CenteredCrossSum(iNumValid, ivSum(j), ivSum(k), iaCross(j,k))
+			END DO
+		END DO
+		
+		! Remove linear trend from co-moments, if requested
+		IF(lDetrend .AND. rmM2(0,0) > 0.d0) THEN
+			DO k = 1, iNumVar
+				DO j = 1, k
+					rmM2(j,k) = rmM2(j,k) - rmM2(0,j)*rmM2(0,k)/rmM2(0,0)
+				END DO
+				rvSlope(k) = REAL(rmM2(0,k)/rmM2(0,0) / 100.d0)
+			END DO
+		END IF
+		
+		! Yield results, in physical units
+		DO k = 1, iNumVar
+			rvMin(k) = ivLo(k) / 100.
+			rvMax(k) = ivHi(k) / 100.
+			rvAvg(k) = REAL(DBLE(ivSum(k)) / (100.d0 * iNumValid))
+			DO j = 1, k
+				rmCov(j,k) = REAL(rmM2(j,k) / (10000.d0 * iNumValid))
+				rmCov(k,j) = rmCov(j,k)
+			END DO
+		END DO
+		rIndexAvg = REAL(DBLE(ivSum(0)) / iNumValid)
+		
+	END FUNCTION BlockStatisticsExact
+	
+	
+	! Remove from data the linear trend whose slope and mean position have been
+	! estimated by BlockStatistics; means are preserved. With null slope, data
+	! are just copied.
+	SUBROUTINE RemoveBlockTrend(rvX, lvDesiredSubset, rSlope, rIndexAvg, rvTrendless)
+	
+		! Routine arguments
+		REAL, DIMENSION(:), INTENT(IN)		:: rvX
+		LOGICAL, DIMENSION(:), INTENT(IN)	:: lvDesiredSubset
+		REAL, INTENT(IN)					:: rSlope
+		REAL, INTENT(IN)					:: rIndexAvg
+		REAL, DIMENSION(:), INTENT(INOUT)	:: rvTrendless
+		
+		! Locals
+		INTEGER	:: i
+		
+		! Remove trend, limiting attention to desired data
+		DO i = 1, SIZE(rvX)
+			IF(lvDesiredSubset(i)) rvTrendless(i) = rvX(i) - rSlope*(i - rIndexAvg)
+		END DO
+		
+	END SUBROUTINE RemoveBlockTrend
+	
+	
 	FUNCTION RotationMatrix(iNumRot, rvAvgWind, rmCovWind, rTheta, rPhi, rPsi) RESULT(rmRot)
 	
 		! Routine arguments
@@ -413,6 +710,186 @@ CONTAINS
 	END FUNCTION RotationMatrix
 	
 	
+	! Start an empty planar fit, on 'iNumSectors' wind sectors of equal width
+	! (the first centred on the sonic x axis)
+	SUBROUTINE PlanarFitInit(tFit, iNumSectors)
+	
+		! Routine arguments
+		TYPE(PlanarFit), INTENT(OUT)	:: tFit
+		INTEGER, INTENT(IN)				:: iNumSectors
+		
+		! Locals
+		! -none-
+		
+		! Clean state
+		tFit % iNumSectors = MAX(1, MIN(PF_MAX_SECTORS, iNumSectors))
+		tFit % iLastBlock  = 0
+		tFit % raSums      = 0.d0
+		tFit % lvFitted    = .FALSE.
+		tFit % raTilt      = 0.
+		tFit % raAngles    = 0.
+		
+	END SUBROUTINE PlanarFitInit
+	
+	
+	! Get planar fit state from file; if missing, or made with a different number
+	! of sectors, an empty state is started and a non-zero code is returned (1 or 2).
+	! Tilt matrices are computed once here, for all sectors.
+	FUNCTION PlanarFitRead(iLUN, sFileName, iNumSectors, tFit) RESULT(iRetCode)
+	
+		! Routine arguments
+		INTEGER, INTENT(IN)				:: iLUN
+		CHARACTER(LEN=*), INTENT(IN)	:: sFileName
+		INTEGER, INTENT(IN)				:: iNumSectors
+		TYPE(PlanarFit), INTENT(OUT)	:: tFit
+		INTEGER							:: iRetCode
+		
+		! Locals
+		INTEGER				:: iErrCode
+		CHARACTER(LEN=8)	:: sMagic
+		INTEGER				:: n
+		INTEGER				:: iSector
+		
+		! Assume success (will falsify on failure)
+		iRetCode = 0
+		CALL PlanarFitInit(tFit, iNumSectors)
+		
+		! Get sums
+		OPEN(iLUN, FILE=sFileName, STATUS='OLD', ACTION='READ', ACCESS='STREAM', IOSTAT=iErrCode)
+		IF(iErrCode /= 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		READ(iLUN, IOSTAT=iErrCode) sMagic, n
+		IF(iErrCode /= 0 .OR. sMagic /= 'MFPFT001' .OR. n /= tFit % iNumSectors) THEN
+			iRetCode = 2
+			CLOSE(iLUN)
+			RETURN
+		END IF
+		READ(iLUN, IOSTAT=iErrCode) tFit % iLastBlock, tFit % raSums(:,1:n)
+		CLOSE(iLUN)
+		IF(iErrCode /= 0) THEN
+			CALL PlanarFitInit(tFit, iNumSectors)
+			iRetCode = 2
+			RETURN
+		END IF
+		
+		! Compute tilt matrices
+		DO iSector = 1, n
+			CALL FitSector(tFit, iSector)
+		END DO
+		
+	END FUNCTION PlanarFitRead
+	
+	
+	FUNCTION PlanarFitWrite(iLUN, sFileName, tFit) RESULT(iRetCode)
+	
+		! Routine arguments
+		INTEGER, INTENT(IN)				:: iLUN
+		CHARACTER(LEN=*), INTENT(IN)	:: sFileName
+		TYPE(PlanarFit), INTENT(IN)		:: tFit
+		INTEGER							:: iRetCode
+		
+		! Locals
+		INTEGER	:: iErrCode
+		INTEGER	:: n
+		
+		! Assume success (will falsify on failure)
+		iRetCode = 0
+		
+		! Write sums (tilt matrices are recomputed on read)
+		n = tFit % iNumSectors
+		OPEN(iLUN, FILE=sFileName, STATUS='REPLACE', ACTION='WRITE', ACCESS='STREAM', IOSTAT=iErrCode)
+		IF(iErrCode /= 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		WRITE(iLUN, IOSTAT=iErrCode) 'MFPFT001', n, tFit % iLastBlock, tFit % raSums(:,1:n)
+		IF(iErrCode /= 0) iRetCode = 2
+		CLOSE(iLUN)
+		
+	END FUNCTION PlanarFitWrite
+	
+	
+	! Account a block's non rotated mean wind into the sums of its sector, and
+	! refresh the sector's tilt matrix; cost does not depend on history length.
+	! Blocks must come in time order: those not after the last one accounted
+	! (as when an hour is processed again) are ignored, as are near calms.
+	SUBROUTINE PlanarFitAdd(tFit, iTimeStamp, rvAvgWind)
+	
+		! Routine arguments
+		TYPE(PlanarFit), INTENT(INOUT)		:: tFit
+		INTEGER, INTENT(IN)					:: iTimeStamp
+		REAL, DIMENSION(3), INTENT(IN)		:: rvAvgWind
+		
+		! Locals
+		INTEGER				:: iSector
+		DOUBLE PRECISION	:: u, v, w
+		
+		! Check block is to be accounted
+		IF(iTimeStamp <= tFit % iLastBlock) RETURN
+		IF(.NOT.ALL(.VALID.rvAvgWind)) RETURN
+		IF(SQRT(rvAvgWind(1)**2 + rvAvgWind(2)**2) < PF_MIN_VEL) RETURN
+		tFit % iLastBlock = iTimeStamp
+		
+		! Update sums, and fit
+		iSector = WindSector(tFit, rvAvgWind)
+		u = rvAvgWind(1)
+		v = rvAvgWind(2)
+		w = rvAvgWind(3)
+		tFit % raSums(:,iSector) = tFit % raSums(:,iSector) + (/1.d0, u, v, w, u*u, u*v, v*v, u*w, v*w/)
+		CALL FitSector(tFit, iSector)
+		
+	END SUBROUTINE PlanarFitAdd
+	
+	
+	! Rotation matrix of a block by planar fit: tilt of the sector of its mean
+	! wind, then yaw aligning x with the tilted mean wind. Angles returned are
+	! yaw (rTheta), and pitch and roll of the plane (rPhi, rPsi). Return 0 on
+	! success, non-zero if the sector has no usable fit yet (the caller should
+	! then fall back to another rotation).
+	FUNCTION PlanarFitMatrix(tFit, rvAvgWind, rmRot, rTheta, rPhi, rPsi) RESULT(iRetCode)
+	
+		! Routine arguments
+		TYPE(PlanarFit), INTENT(IN)			:: tFit
+		REAL, DIMENSION(3), INTENT(IN)		:: rvAvgWind
+		REAL, DIMENSION(3,3), INTENT(OUT)	:: rmRot
+		REAL, INTENT(OUT)					:: rTheta
+		REAL, INTENT(OUT)					:: rPhi
+		REAL, INTENT(OUT)					:: rPsi
+		INTEGER								:: iRetCode
+		
+		! Locals
+		INTEGER					:: iSector
+		REAL, DIMENSION(3)		:: rvTilted
+		REAL, DIMENSION(3,3)	:: rmYaw
+		
+		! Assume success (will falsify on failure)
+		iRetCode = 0
+		
+		! Get sector fit
+		iSector = WindSector(tFit, rvAvgWind)
+		IF(.NOT.tFit % lvFitted(iSector)) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		
+		! Tilt, then yaw
+		rvTilted = MATMUL(tFit % raTilt(:,:,iSector), rvAvgWind)
+		rTheta   = ATAN2(rvTilted(2), rvTilted(1))
+		rmYaw      = 0.
+		rmYaw(1,1) = COS(rTheta)
+		rmYaw(2,2) = rmYaw(1,1)
+		rmYaw(3,3) = 1.
+		rmYaw(1,2) = SIN(rTheta)
+		rmYaw(2,1) = -rmYaw(1,2)
+		rmRot = MATMUL(rmYaw, tFit % raTilt(:,:,iSector))
+		rPhi  = tFit % raAngles(1,iSector)
+		rPsi  = tFit % raAngles(2,iSector)
+		
+	END FUNCTION PlanarFitMatrix
+	
+	
 	FUNCTION BasicAnemology(rvWindAvg, rVel, rDir, r3dVel) RESULT(iRetCode)
 	
 		! Routine arguments
@@ -833,6 +1310,100 @@ CONTAINS
 	END FUNCTION IsValidInteger
 	
 	
+	! Centered cross-product sum, Sxy - Sx*Sy/n, from exact integer sums. Writing
+	! Sx = qx*n + rx and rx*Sy = q*n + r, it equals (Sxy - qx*Sy - q) - r/n, whose
+	! integer part is computed exactly: the only rounding is in final conversion.
+	FUNCTION CenteredCrossSum(iN, iSumX, iSumY, iSumXY) RESULT(rCrossSum)
+	
+		! Routine arguments
+		INTEGER(8), INTENT(IN)	:: iN
+		INTEGER(8), INTENT(IN)	:: iSumX
+		INTEGER(8), INTENT(IN)	:: iSumY
+		INTEGER(8), INTENT(IN)	:: iSumXY
+		DOUBLE PRECISION		:: rCrossSum
+		
+		! Locals
+		INTEGER(8)	:: iQx, iRx, iP, iQ, iR
+		
+		! Compute the information desired
+		iQx = iSumX / iN
+		iRx = iSumX - iQx*iN
+		iP  = iRx * iSumY
+		iQ  = iP / iN
+		iR  = iP - iQ*iN
+		rCrossSum = DBLE(iSumXY - iQx*iSumY - iQ) - DBLE(iR) / DBLE(iN)
+	
+	END FUNCTION CenteredCrossSum
+	
+	
+	! Sector of a mean wind, from 1 to tFit % iNumSectors
+	FUNCTION WindSector(tFit, rvAvgWind) RESULT(iSector)
+	
+		! Routine arguments
+		TYPE(PlanarFit), INTENT(IN)			:: tFit
+		REAL, DIMENSION(3), INTENT(IN)		:: rvAvgWind
+		INTEGER								:: iSector
+		
+		! Locals
+		REAL				:: rWidth
+		REAL				:: rAngle
+		REAL, PARAMETER		:: PI = 3.1415927
+		
+		! Compute the information desired
+		rWidth  = 2.*PI / tFit % iNumSectors
+		rAngle  = MODULO(ATAN2(rvAvgWind(2), rvAvgWind(1)) + 0.5*rWidth, 2.*PI)
+		iSector = MIN(INT(rAngle / rWidth) + 1, tFit % iNumSectors)
+		
+	END FUNCTION WindSector
+	
+	
+	! Solve the normal equations of a sector for w = b0 + b1*u + b2*v (Cramer's
+	! rule), and build the tilt matrix whose z axis is normal to the plane
+	SUBROUTINE FitSector(tFit, iSector)
+	
+		! Routine arguments
+		TYPE(PlanarFit), INTENT(INOUT)		:: tFit
+		INTEGER, INTENT(IN)					:: iSector
+		
+		! Locals
+		DOUBLE PRECISION					:: n, Su, Sv, Sw, Suu, Suv, Svv, Suw, Svw
+		DOUBLE PRECISION					:: rDet
+		DOUBLE PRECISION					:: b1, b2
+		DOUBLE PRECISION, DIMENSION(3)		:: k
+		DOUBLE PRECISION					:: s
+		
+		! Check enough data are there
+		tFit % lvFitted(iSector) = .FALSE.
+		n   = tFit % raSums(1,iSector)
+		IF(n < PF_MIN_BLOCKS) RETURN
+		Su  = tFit % raSums(2,iSector)
+		Sv  = tFit % raSums(3,iSector)
+		Sw  = tFit % raSums(4,iSector)
+		Suu = tFit % raSums(5,iSector)
+		Suv = tFit % raSums(6,iSector)
+		Svv = tFit % raSums(7,iSector)
+		Suw = tFit % raSums(8,iSector)
+		Svw = tFit % raSums(9,iSector)
+		
+		! Solve for slopes (intercept, the sonic w offset, is not needed)
+		rDet = n*(Suu*Svv - Suv*Suv) - Su*(Su*Svv - Suv*Sv) + Sv*(Su*Suv - Suu*Sv)
+		IF(ABS(rDet) <= 1.d-9 * n*Suu*Svv) RETURN
+		b1 = (n*(Suw*Svv - Suv*Svw) - Sw*(Su*Svv - Suv*Sv) + Sv*(Su*Svw - Suw*Sv)) / rDet
+		b2 = (n*(Suu*Svw - Suw*Suv) - Su*(Su*Svw - Suw*Sv) + Sw*(Su*Suv - Suu*Sv)) / rDet
+		
+		! New axes: z normal to plane, y normal to z and old x, x completing the triad
+		k = (/-b1, -b2, 1.d0/) / SQRT(1.d0 + b1*b1 + b2*b2)
+		s = SQRT(k(2)**2 + k(3)**2)
+		tFit % raTilt(1,:,iSector) = REAL((/s, -k(1)*k(2)/s, -k(1)*k(3)/s/))
+		tFit % raTilt(2,:,iSector) = REAL((/0.d0, k(3)/s, -k(2)/s/))
+		tFit % raTilt(3,:,iSector) = REAL(k)
+		tFit % raAngles(1,iSector) = REAL(ATAN2(k(1), s))
+		tFit % raAngles(2,iSector) = REAL(ATAN2(-k(2), k(3)))
+		tFit % lvFitted(iSector)   = .TRUE.
+		
+	END SUBROUTINE FitSector
+	
+	
 	FUNCTION RhoCp(rHeight, rTemperature) RESULT(rRhoCp)
 	
 		! Routine arguments
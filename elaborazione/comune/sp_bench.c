@@ -0,0 +1,143 @@
+/*
+
+	sp_bench - Time block processing by the "ec_lib" engine with and without
+	           spectra, cospectra and ogives, and with the dissipation rate
+	           from structure functions, on synthetic blocks of the usual
+	           averaging times and sampling rates, and report the cost per
+	           hour of data.
+
+	Usage:
+
+		./sp_bench [<NumRepetitions>]
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "ec_lib.h"
+#include "sp_lib.h"
+
+static double elapsed(const struct timespec* ptFrom) {
+
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return((tNow.tv_sec - ptFrom->tv_sec) + 1.e-9*(tNow.tv_nsec - ptFrom->tv_nsec));
+
+}
+
+
+int main(int argc, char** argv) {
+
+	static const int ivCase[][2] = {	// Averaging time (s), sampling rate (Hz)
+		{  60, 10}, {  60, 20},
+		{ 300, 10}, { 300, 20},
+		{ 600, 10}, { 600, 20},
+		{1800, 10}, {1800, 20},
+		{3600, 20}
+	};
+	int             iNumRep = 20;
+	EddyConfig      tConfig;
+	EddyWorkspace   tWork;
+	EddyBlock       tBlock;
+	short           (*ivData)[5];
+	struct timespec tStart;
+	double          rBase;
+	double          rSpectra;
+	double          rDissipation;
+	double          rPlan;
+	double          rNoise;
+	double          rW;
+	int             iNumData;
+	int             iCase;
+	int             iRep;
+	int             i;
+
+	// Get parameters
+	if(argc >= 2) iNumRep = atoi(argv[1]);
+	if(iNumRep <= 0) {
+		fprintf(stderr, "sp_bench:: error: Invalid parameters\n");
+		return(1);
+	}
+	tConfig.iDetrending       = 1;
+	tConfig.iRotations        = 2;
+	tConfig.rAltitude         = 100.;
+	tConfig.rAnemometerHeight = 10.;
+	tConfig.iFluxErrors       = 0;
+	tConfig.iDespiking        = 0;
+	tConfig.iQualityControl   = 0;
+	tConfig.iStationarity     = 0;
+	tConfig.iDissipation      = 0;
+
+	printf("Repetitions:    %d\n\n", iNumRep);
+	printf("AvgTime  Rate   Data  Length  Plan (ms)  Base (ms)  Spectra (ms)  Overhead  Spectra per hour (ms)  Dissipation (ms)  Dissipation per hour (ms)\n");
+	srand(2012);
+	for(iCase=0; iCase<(int)(sizeof(ivCase)/sizeof(ivCase[0])); iCase++) {
+
+		// Synthetic block: correlated w and t, with some invalid data
+		iNumData = ivCase[iCase][0] * ivCase[iCase][1];
+		ivData   = malloc(iNumData * sizeof(ivData[0]));
+		if(ivData == NULL) {
+			fprintf(stderr, "sp_bench:: error: Not enough memory\n");
+			return(2);
+		}
+		for(i=0; i<iNumData; i++) {
+			rNoise = rand()/(double)RAND_MAX - 0.5;
+			rW     = 30.*rNoise + 20.*(rand()/(double)RAND_MAX - 0.5);
+			ivData[i][0] = i / ivCase[iCase][1];
+			ivData[i][1] = (short)(300. + 100.*rNoise + 50.*sin(i*0.01));
+			ivData[i][2] = (short)(100. + 100.*(rand()/(double)RAND_MAX - 0.5));
+			ivData[i][3] = (short)rW;
+			ivData[i][4] = (short)(2000. + 0.8*rW + 20.*(rand()/(double)RAND_MAX - 0.5));
+			if(i % 997 == 0) ivData[i][3] = -9999;
+		}
+
+		// Time processing without spectra, then with (first call builds the plan)
+		ecWorkspaceInit(&tWork);
+		tConfig.iSpectra = 0;
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) ecProcessBlock(&tConfig, (const short (*)[5])ivData, iNumData, 0, &tBlock, &tWork);
+		rBase = elapsed(&tStart) / iNumRep;
+		tConfig.iSpectra = 1;
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		ecProcessBlock(&tConfig, (const short (*)[5])ivData, iNumData, 0, &tBlock, &tWork);
+		rPlan = elapsed(&tStart);
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) ecProcessBlock(&tConfig, (const short (*)[5])ivData, iNumData, 0, &tBlock, &tWork);
+		rSpectra = elapsed(&tStart) / iNumRep;
+		rPlan   -= rSpectra;
+
+		// Time processing with the dissipation rate too
+		tConfig.iDissipation = 1;
+		clock_gettime(CLOCK_MONOTONIC, &tStart);
+		for(iRep=0; iRep<iNumRep; iRep++) ecProcessBlock(&tConfig, (const short (*)[5])ivData, iNumData, 0, &tBlock, &tWork);
+		rDissipation = elapsed(&tStart) / iNumRep;
+		tConfig.iDissipation = 0;
+		printf("%7d %5d %6d %7d %10.3f %10.3f %13.3f %8.0f%% %22.3f %17.3f %26.3f\n",
+			ivCase[iCase][0], ivCase[iCase][1], iNumData,
+			tWork.ptSpectral != NULL ? tWork.ptSpectral->tvPlan[0]->n : 0,
+			1000.*rPlan, 1000.*rBase, 1000.*rSpectra,
+			rBase > 0. ? 100.*(rSpectra - rBase)/rBase : 0.,
+			1000.*(rSpectra - rBase) * 3600. / ivCase[iCase][0],
+			1000.*(rDissipation - rSpectra),
+			1000.*(rDissipation - rSpectra) * 3600. / ivCase[iCase][0]
+		);
+		if(iCase == 0) {
+			printf("                 (Og.WT at lowest bin: %.5f, covariance: %.5f; epsilon: %.5f)\n", tBlock.rmOgive[0][0], tBlock.rvRotCovT[2], tBlock.rEpsilon);
+		}
+		ecWorkspaceFree(&tWork);
+		free(ivData);
+
+	}
+
+	// Leave
+	return(0);
+
+}
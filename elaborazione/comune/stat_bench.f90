@@ -0,0 +1,127 @@
+! stat_bench - Compare the per-statistic SonicLib sequence used so far
+!              (GetRange, RemoveLinearTrend, Average, Covariance) with the
+!              fused single-sweep kernel, BlockStatistics, on a synthetic block.
+!
+! Usage:
+!
+!	./stat_bench [<NumData> [<NumRepetitions>]]
+!
+! Copyright 2012 by Servizi Territorio srl
+!                   All rights reserved
+
+PROGRAM stat_bench
+
+	USE SonicLib
+
+	IMPLICIT NONE
+
+	! Locals
+	CHARACTER(LEN=20)					:: sBuffer
+	INTEGER								:: iNumData
+	INTEGER								:: iNumRep
+	INTEGER								:: iRep
+	INTEGER								:: iRetCode
+	INTEGER								:: iCount0, iCount1, iRate
+	INTEGER								:: i, j
+	REAL								:: rSeconds
+	REAL								:: rSecondsFused
+	REAL								:: rNoise
+	REAL, DIMENSION(:,:), ALLOCATABLE	:: raData			! Columns: u, v, w, t
+	REAL, DIMENSION(:,:), ALLOCATABLE	:: raTrendless
+	INTEGER, DIMENSION(:), ALLOCATABLE	:: ivTime
+	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvDesiredSubset
+	REAL, DIMENSION(4)					:: rvMin, rvMax, rvAvg
+	REAL, DIMENSION(4,4)				:: rmCov
+	REAL, DIMENSION(4)					:: rvMinF, rvMaxF, rvAvgF
+	REAL, DIMENSION(4,4)				:: rmCovF
+	REAL, DIMENSION(4)					:: rvSlope
+	REAL								:: rIndexAvg
+	REAL								:: rMaxDiff
+
+	! Get parameters
+	iNumData = 36000	! One hour at 10 Hz, or a half hour at 20 Hz
+	iNumRep  = 200
+	IF(COMMAND_ARGUMENT_COUNT() >= 1) THEN
+		CALL GET_COMMAND_ARGUMENT(1, sBuffer)
+		READ(sBuffer, *, IOSTAT=iRetCode) iNumData
+	END IF
+	IF(COMMAND_ARGUMENT_COUNT() >= 2) THEN
+		CALL GET_COMMAND_ARGUMENT(2, sBuffer)
+		READ(sBuffer, *, IOSTAT=iRetCode) iNumRep
+	END IF
+	IF(iNumData <= 1 .OR. iNumRep <= 0) THEN
+		PRINT *, 'stat_bench:: error: Invalid parameters'
+		STOP
+	END IF
+
+	! Generate a synthetic block: trend plus noise, with some invalid data
+	ALLOCATE(raData(iNumData,4), raTrendless(iNumData,4), ivTime(iNumData), lvDesiredSubset(iNumData))
+	DO i = 1, iNumData
+		ivTime(i) = (i-1) / 10
+		DO j = 1, 4
+			CALL RANDOM_NUMBER(rNoise)
+			raData(i,j) = 0.5*j + 1.e-4*i + (rNoise - 0.5)
+		END DO
+		raData(i,4) = raData(i,4) + 20.
+		lvDesiredSubset(i) = MOD(i, 97) /= 0
+	END DO
+	raTrendless = -9999.9
+
+	! Current sequence
+	CALL SYSTEM_CLOCK(iCount0, iRate)
+	DO iRep = 1, iNumRep
+		DO j = 1, 4
+			iRetCode = GetRange(raData(:,j), lvDesiredSubset, rvMin(j), rvMax(j))
+		END DO
+		CALL RemoveLinearTrend( &
+			ivTime, &
+			raData(:,1), raData(:,2), raData(:,3), raData(:,4), &
+			10, &
+			lvDesiredSubset, &
+			raTrendless(:,1), raTrendless(:,2), raTrendless(:,3), raTrendless(:,4), &
+			iRetCode &
+		)
+		DO j = 1, 4
+			CALL Average(raTrendless(:,j), lvDesiredSubset, rvAvg(j))
+		END DO
+		DO j = 1, 4
+			DO i = j, 4
+				CALL Covariance(raTrendless(:,i), raTrendless(:,j), lvDesiredSubset, rvAvg(i), rvAvg(j), rmCov(i,j))
+				rmCov(j,i) = rmCov(i,j)
+			END DO
+		END DO
+	END DO
+	CALL SYSTEM_CLOCK(iCount1)
+	rSeconds = REAL(iCount1 - iCount0) / iRate
+
+	! Fused kernel
+	CALL SYSTEM_CLOCK(iCount0, iRate)
+	DO iRep = 1, iNumRep
+		iRetCode = BlockStatistics( &
+			raData(:,1), raData(:,2), raData(:,4), &
+			lvDesiredSubset, &
+			.TRUE., &
+			rvMinF, rvMaxF, rvAvgF, &
+			rmCovF, &
+			rvSlope, rIndexAvg, &
+			rvW=raData(:,3) &
+		)
+	END DO
+	CALL SYSTEM_CLOCK(iCount1)
+	rSecondsFused = REAL(iCount1 - iCount0) / iRate
+
+	! Report
+	rMaxDiff = MAX( &
+		MAXVAL(ABS(rvMin - rvMinF)), &
+		MAXVAL(ABS(rvMax - rvMaxF)), &
+		MAXVAL(ABS(rvAvg - rvAvgF) / MAX(ABS(rvAvg), 1.e-6)), &
+		MAXVAL(ABS(rmCov - rmCovF) / MAX(ABS(rmCov), 1.e-6)) &
+	)
+	PRINT "('Data in block:       ',i8)", iNumData
+	PRINT "('Repetitions:         ',i8)", iNumRep
+	PRINT "('Current sequence:    ',f10.3,' ms per block')", 1000.*rSeconds/iNumRep
+	PRINT "('Fused kernel:        ',f10.3,' ms per block')", 1000.*rSecondsFused/iNumRep
+	IF(rSecondsFused > 0.) PRINT "('Speed-up:            ',f10.2)", rSeconds/rSecondsFused
+	PRINT "('Max relative diff.:  ',e10.3)", rMaxDiff
+
+END PROGRAM stat_bench
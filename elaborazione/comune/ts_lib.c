@@ -0,0 +1,444 @@
+/*
+
+	ts_lib - Small embedded time-indexed store for processed blocks, coded
+	         in plain C.
+
+	Records within a partition are kept sorted by time stamp. Appending a
+	newer record (the common case) touches only the file end; reprocessing
+	an existing block overwrites its record in place; filling a gap shifts
+	the partition tail, which is small (one month of blocks). Retention is
+	enforced by removing whole partitions, two unlinks per month.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#define _GNU_SOURCE		// For 'timegm'
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+
+#include "ts_lib.h"
+
+#define TS_HEADER_SIZE 12L		// Magic string plus number of columns
+
+// Index entry: time stamp of record 'iRecord'
+typedef struct TsIndexEntry {
+	int iTimeStamp;
+	int iRecord;
+} TsIndexEntry;
+
+
+/**********************
+* Partition internals *
+**********************/
+
+static long recordSize(const TimeStore* ptStore) {
+	return(4L + 4L*ptStore->nCols);
+}
+
+
+static void partitionName(const TimeStore* ptStore, const int iYear, const int iMonth, const char* sExt, char* sName) {
+	sprintf(sName, "%s/%04d%02d.%s", ptStore->sRoot, iYear, iMonth, sExt);
+}
+
+
+// Open the partition holding a given year and month, optionally creating it.
+// Return 0 on success, 1 if partition does not exist, > 1 on error.
+static int partitionOpen(const TimeStore* ptStore, const int iYear, const int iMonth, const int iCreate, FILE** pf, long* plRecords) {
+
+	char  sName[512];
+	char  sMagic[8];
+	int   nCols;
+	FILE* f;
+	long  lSize;
+
+	*pf        = NULL;
+	*plRecords = 0L;
+	partitionName(ptStore, iYear, iMonth, "tsd", sName);
+
+	// Access partition, creating it if desired
+	f = fopen(sName, iCreate ? "r+b" : "rb");
+	if(f == NULL) {
+		if(errno != ENOENT) return(2);
+		if(!iCreate) return(1);
+		f = fopen(sName, "w+b");
+		if(f == NULL) return(2);
+		nCols = ptStore->nCols;
+		if(fwrite(TS_MAGIC, 1, 8, f) != 8 || fwrite(&nCols, sizeof(int), 1, f) != 1) {
+			fclose(f);
+			return(3);
+		}
+	}
+
+	// Check header is consistent with schema
+	fseek(f, 0L, SEEK_SET);
+	if(fread(sMagic, 1, 8, f) != 8 || memcmp(sMagic, TS_MAGIC, 8) != 0 || fread(&nCols, sizeof(int), 1, f) != 1 || nCols != ptStore->nCols) {
+		fclose(f);
+		return(4);
+	}
+
+	// Get number of records (a trailing partial record, as left by an
+	// interrupted write, is ignored and will be overwritten)
+	fseek(f, 0L, SEEK_END);
+	lSize = ftell(f);
+	*plRecords = (lSize - TS_HEADER_SIZE) / recordSize(ptStore);
+	*pf = f;
+
+	// Leave
+	return(0);
+
+}
+
+
+static int readTimeStamp(const TimeStore* ptStore, FILE* f, const long lRecord, int* piTimeStamp) {
+	if(fseek(f, TS_HEADER_SIZE + lRecord*recordSize(ptStore), SEEK_SET) != 0) return(1);
+	if(fread(piTimeStamp, sizeof(int), 1, f) != 1) return(2);
+	return(0);
+}
+
+
+// Locate the first record whose time stamp is not smaller than iTimeStamp
+// (lRecords if none), starting from the last index entry preceding it.
+static long findRecord(const TimeStore* ptStore, FILE* f, const int iYear, const int iMonth, const long lRecords, const int iTimeStamp) {
+
+	char         sName[512];
+	FILE*        g;
+	TsIndexEntry tEntry;
+	long         lRecord = 0L;
+	int          iCurTime;
+
+	// Use index, if any, to skip ahead
+	partitionName(ptStore, iYear, iMonth, "tsi", sName);
+	g = fopen(sName, "rb");
+	if(g != NULL) {
+		while(fread(&tEntry, sizeof(TsIndexEntry), 1, g) == 1) {
+			if(tEntry.iTimeStamp >= iTimeStamp) break;
+			if(tEntry.iRecord < lRecords) lRecord = tEntry.iRecord;
+		}
+		fclose(g);
+	}
+
+	// Scan sequentially the remaining stride
+	for(; lRecord < lRecords; lRecord++) {
+		if(readTimeStamp(ptStore, f, lRecord, &iCurTime) != 0) break;
+		if(iCurTime >= iTimeStamp) break;
+	}
+
+	// Leave
+	return(lRecord);
+
+}
+
+
+// Rewrite the sparse index of a partition
+static int rebuildIndex(const TimeStore* ptStore, FILE* f, const int iYear, const int iMonth, const long lRecords) {
+
+	char         sName[512];
+	char         sTemp[520];
+	FILE*        g;
+	TsIndexEntry tEntry;
+	long         lRecord;
+
+	partitionName(ptStore, iYear, iMonth, "tsi", sName);
+	sprintf(sTemp, "%s.tmp", sName);
+	g = fopen(sTemp, "wb");
+	if(g == NULL) return(1);
+	for(lRecord = 0L; lRecord < lRecords; lRecord += TS_INDEX_STRIDE) {
+		if(readTimeStamp(ptStore, f, lRecord, &tEntry.iTimeStamp) != 0) break;
+		tEntry.iRecord = (int)lRecord;
+		fwrite(&tEntry, sizeof(TsIndexEntry), 1, g);
+	}
+	fclose(g);
+	if(rename(sTemp, sName) != 0) {
+		unlink(sTemp);
+		return(2);
+	}
+
+	// Leave
+	return(0);
+
+}
+
+
+/******************
+* Store interface *
+******************/
+
+// Access a store, creating its directory if needed, and load its schema
+// if already defined. Return 0 on success, non-zero on failure.
+int tsOpen(TimeStore* ptStore, const char* sRoot) {
+
+	char  sName[512];
+	char  sLine[256];
+	FILE* f;
+	int   iLen;
+
+	memset(ptStore, 0, sizeof(TimeStore));
+	strncpy(ptStore->sRoot, sRoot, sizeof(ptStore->sRoot)-1);
+	if(mkdir(ptStore->sRoot, 0777) != 0 && errno != EEXIST) return(1);
+
+	// Get schema, if any
+	sprintf(sName, "%s/schema", ptStore->sRoot);
+	f = fopen(sName, "r");
+	if(f != NULL) {
+		while(fgets(sLine, sizeof(sLine), f) != NULL && ptStore->nCols < TS_MAX_COLS) {
+			iLen = strlen(sLine);
+			while(iLen > 0 && isspace((unsigned char)sLine[iLen-1])) sLine[--iLen] = '\0';
+			if(iLen <= 0) continue;
+			if(iLen > TS_NAME_LEN) iLen = TS_NAME_LEN;
+			memcpy(ptStore->svName[ptStore->nCols], sLine, iLen);
+			ptStore->svName[ptStore->nCols][iLen] = '\0';
+			ptStore->nCols++;
+		}
+		fclose(f);
+	}
+
+	// Leave
+	return(0);
+
+}
+
+
+// Define the store schema on first use, or check it matches the one
+// defined. Return 0 on success, non-zero on failure or mismatch.
+int tsSetSchema(TimeStore* ptStore, const int nCols, char svName[][TS_NAME_LEN+1]) {
+
+	char  sName[512];
+	char  sTemp[520];
+	FILE* f;
+	int   i;
+
+	if(nCols <= 0 || nCols > TS_MAX_COLS) return(1);
+
+	// Schema already defined: check it is the same
+	if(ptStore->nCols > 0) {
+		if(nCols != ptStore->nCols) return(2);
+		for(i=0; i<nCols; i++) {
+			if(strncmp(svName[i], ptStore->svName[i], TS_NAME_LEN) != 0) return(2);
+		}
+		return(0);
+	}
+
+	// New schema: save it
+	sprintf(sName, "%s/schema", ptStore->sRoot);
+	sprintf(sTemp, "%s.tmp", sName);
+	f = fopen(sTemp, "w");
+	if(f == NULL) return(3);
+	for(i=0; i<nCols; i++) {
+		snprintf(ptStore->svName[i], TS_NAME_LEN+1, "%s", svName[i]);
+		fprintf(f, "%s\n", ptStore->svName[i]);
+	}
+	fclose(f);
+	if(rename(sTemp, sName) != 0) {
+		unlink(sTemp);
+		return(4);
+	}
+	ptStore->nCols = nCols;
+
+	// Leave
+	return(0);
+
+}
+
+
+// Insert a record, or replace the one with the same time stamp if it
+// already exists. Return 0 on success, non-zero on failure.
+int tsUpsert(const TimeStore* ptStore, const int iTimeStamp, const float* rvValues) {
+
+	time_t       tStamp = (time_t)iTimeStamp;
+	struct tm    tTime;
+	FILE*        f;
+	FILE*        g;
+	char         sName[512];
+	long         lRecords;
+	long         lRecord;
+	long         lRecSize;
+	long         lTailSize;
+	int          iLastTime;
+	int          iCurTime;
+	int          iRetCode;
+	char*        pcTail;
+	TsIndexEntry tEntry;
+
+	if(ptStore->nCols <= 0) return(1);
+	lRecSize = recordSize(ptStore);
+	gmtime_r(&tStamp, &tTime);
+	iRetCode = partitionOpen(ptStore, tTime.tm_year + 1900, tTime.tm_mon + 1, 1, &f, &lRecords);
+	if(iRetCode != 0) return(10 + iRetCode);
+
+	// Newer than all records: append, adding an index entry at stride start
+	iRetCode = 0;
+	if(lRecords <= 0 || (readTimeStamp(ptStore, f, lRecords-1, &iLastTime) == 0 && iTimeStamp > iLastTime)) {
+		fseek(f, TS_HEADER_SIZE + lRecords*lRecSize, SEEK_SET);
+		if(fwrite(&iTimeStamp, sizeof(int), 1, f) != 1 || fwrite(rvValues, sizeof(float), ptStore->nCols, f) != (size_t)ptStore->nCols) {
+			iRetCode = 2;
+		}
+		else if(lRecords % TS_INDEX_STRIDE == 0) {
+			partitionName(ptStore, tTime.tm_year + 1900, tTime.tm_mon + 1, "tsi", sName);
+			g = fopen(sName, "ab");
+			if(g != NULL) {
+				tEntry.iTimeStamp = iTimeStamp;
+				tEntry.iRecord    = (int)lRecords;
+				fwrite(&tEntry, sizeof(TsIndexEntry), 1, g);
+				fclose(g);
+			}
+		}
+		fclose(f);
+		return(iRetCode);
+	}
+
+	// Otherwise locate position: if the record exists replace its values in place
+	lRecord = findRecord(ptStore, f, tTime.tm_year + 1900, tTime.tm_mon + 1, lRecords, iTimeStamp);
+	if(readTimeStamp(ptStore, f, lRecord, &iCurTime) == 0 && iCurTime == iTimeStamp) {
+		fseek(f, TS_HEADER_SIZE + lRecord*lRecSize + 4L, SEEK_SET);
+		if(fwrite(rvValues, sizeof(float), ptStore->nCols, f) != (size_t)ptStore->nCols) iRetCode = 3;
+		fclose(f);
+		return(iRetCode);
+	}
+
+	// Gap filling: shift the tail one record forward. The index is removed
+	// first, so that an interrupted shift never leaves it pointing wrong.
+	lTailSize = (lRecords - lRecord) * lRecSize;
+	pcTail = malloc(lTailSize);
+	if(pcTail == NULL) {
+		fclose(f);
+		return(4);
+	}
+	fseek(f, TS_HEADER_SIZE + lRecord*lRecSize, SEEK_SET);
+	if(fread(pcTail, 1, lTailSize, f) != (size_t)lTailSize) {
+		free(pcTail);
+		fclose(f);
+		return(5);
+	}
+	partitionName(ptStore, tTime.tm_year + 1900, tTime.tm_mon + 1, "tsi", sName);
+	unlink(sName);
+	fseek(f, TS_HEADER_SIZE + lRecord*lRecSize, SEEK_SET);
+	if(
+		fwrite(&iTimeStamp, sizeof(int), 1, f) != 1 ||
+		fwrite(rvValues, sizeof(float), ptStore->nCols, f) != (size_t)ptStore->nCols ||
+		fwrite(pcTail, 1, lTailSize, f) != (size_t)lTailSize
+	) {
+		iRetCode = 6;
+	}
+	free(pcTail);
+	fflush(f);
+	if(iRetCode == 0) rebuildIndex(ptStore, f, tTime.tm_year + 1900, tTime.tm_mon + 1, lRecords + 1);
+	fclose(f);
+
+	// Leave
+	return(iRetCode);
+
+}
+
+
+// Visit, in time order, all records whose time stamp is in [iFrom, iTo].
+// Return the number of records visited, or a negative value on failure.
+int tsScan(const TimeStore* ptStore, const int iFrom, const int iTo, TsVisitor fVisit, void* pUserData) {
+
+	time_t    tFrom = (time_t)iFrom;
+	time_t    tTo   = (time_t)iTo;
+	struct tm tTime;
+	int       iMonthFrom;
+	int       iMonthTo;
+	int       iMonth;
+	int       iYear;
+	int       iMon;
+	int       iRetCode;
+	int       iTimeStamp;
+	int       iNumVisited = 0;
+	FILE*     f;
+	long      lRecords;
+	long      lRecord;
+	float*    rvValues;
+
+	if(ptStore->nCols <= 0 || iTo < iFrom) return(0);
+	rvValues = malloc(ptStore->nCols * sizeof(float));
+	if(rvValues == NULL) return(-1);
+
+	// Iterate over monthly partitions in range
+	gmtime_r(&tFrom, &tTime);
+	iMonthFrom = (tTime.tm_year + 1900)*12 + tTime.tm_mon;
+	gmtime_r(&tTo, &tTime);
+	iMonthTo   = (tTime.tm_year + 1900)*12 + tTime.tm_mon;
+	for(iMonth = iMonthFrom; iMonth <= iMonthTo; iMonth++) {
+		iYear = iMonth / 12;
+		iMon  = iMonth % 12 + 1;
+		iRetCode = partitionOpen(ptStore, iYear, iMon, 0, &f, &lRecords);
+		if(iRetCode == 1) continue;
+		if(iRetCode != 0) {
+			free(rvValues);
+			return(-2);
+		}
+
+		// Seek to first record in range, then read sequentially
+		lRecord = findRecord(ptStore, f, iYear, iMon, lRecords, iFrom);
+		fseek(f, TS_HEADER_SIZE + lRecord*recordSize(ptStore), SEEK_SET);
+		for(; lRecord < lRecords; lRecord++) {
+			if(fread(&iTimeStamp, sizeof(int), 1, f) != 1) break;
+			if(fread(rvValues, sizeof(float), ptStore->nCols, f) != (size_t)ptStore->nCols) break;
+			if(iTimeStamp > iTo) break;
+			iNumVisited++;
+			if(fVisit(iTimeStamp, rvValues, ptStore->nCols, pUserData) != 0) {
+				fclose(f);
+				free(rvValues);
+				return(iNumVisited);
+			}
+		}
+		fclose(f);
+	}
+
+	// Leave
+	free(rvValues);
+	return(iNumVisited);
+
+}
+
+
+// Drop all partitions of months preceding the one given.
+// Return the number of partitions removed, or a negative value on failure.
+int tsDropBefore(const TimeStore* ptStore, const int iYear, const int iMonth) {
+
+	DIR*           d;
+	struct dirent* ptEntry;
+	char           sName[512];
+	int            iPartYear;
+	int            iPartMonth;
+	int            i;
+	int            iNumDropped = 0;
+
+	d = opendir(ptStore->sRoot);
+	if(d == NULL) return(-1);
+	while((ptEntry = readdir(d)) != NULL) {
+
+		// Select partition data and index files only
+		if(strlen(ptEntry->d_name) != 10 || ptEntry->d_name[6] != '.') continue;
+		for(i=0; i<6; i++) {
+			if(!isdigit((unsigned char)ptEntry->d_name[i])) break;
+		}
+		if(i < 6) continue;
+		if(strcmp(ptEntry->d_name+7, "tsd") != 0 && strcmp(ptEntry->d_name+7, "tsi") != 0) continue;
+		sscanf(ptEntry->d_name, "%4d%2d", &iPartYear, &iPartMonth);
+
+		// Remove the old ones
+		if(iPartYear*12 + iPartMonth < iYear*12 + iMonth) {
+			sprintf(sName, "%s/%s", ptStore->sRoot, ptEntry->d_name);
+			if(unlink(sName) == 0 && ptEntry->d_name[9] == 'd') iNumDropped++;
+		}
+
+	}
+	closedir(d);
+
+	// Leave
+	return(iNumDropped);
+
+}
@@ -0,0 +1,36 @@
+/*
+
+	ts_lib - Small embedded time-indexed store for processed blocks.
+
+	A store is a directory holding one partition per month ("YYYYMM.tsd"),
+	each made of fixed-size records sorted by time stamp, plus a sparse
+	index ("YYYYMM.tsi") with the time stamp of one record every
+	TS_INDEX_STRIDE. Column names are common to the whole store, and kept
+	in text file "schema".
+
+	Warning: This code is *intentionally* not compatible with C++
+
+	Copyright 2012 by Servizi Territorio srl
+
+*/
+
+#define TS_MAGIC        "MFTSD001"
+#define TS_NAME_LEN     32
+#define TS_MAX_COLS     128
+#define TS_INDEX_STRIDE 32
+
+// Store descriptor
+typedef struct TimeStore {
+	char sRoot[256];
+	int  nCols;									// 0 until a schema is defined
+	char svName[TS_MAX_COLS][TS_NAME_LEN+1];
+} TimeStore;
+
+// Range scan visitor: return 0 to continue scanning, non-zero to stop
+typedef int (*TsVisitor)(const int iTimeStamp, const float* rvValues, const int nCols, void* pUserData);
+
+int tsOpen(TimeStore* ptStore, const char* sRoot);
+int tsSetSchema(TimeStore* ptStore, const int nCols, char svName[][TS_NAME_LEN+1]);
+int tsUpsert(const TimeStore* ptStore, const int iTimeStamp, const float* rvValues);
+int tsScan(const TimeStore* ptStore, const int iFrom, const int iTo, TsVisitor fVisit, void* pUserData);
+int tsDropBefore(const TimeStore* ptStore, const int iYear, const int iMonth);
@@ -0,0 +1,204 @@
+/*
+
+	ts_store - Command line access to time-indexed stores of processed blocks.
+
+	Usage:
+
+		ts_store put  <StoreRoot> <ColumnarFile>
+		ts_store scan <StoreRoot> <From> <To>
+		ts_store drop <StoreRoot> <YYYYMM>
+
+	"put" upserts all rows of a binary columnar result file (".HHP", ".HHD",
+	".HHO"); "scan" writes to standard output, in CSV form, all blocks with
+	time stamp between <From> and <To> (both "YYYY-MM-DD HH:MM:SS");
+	"drop" removes all monthly partitions preceding <YYYYMM>.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#define _GNU_SOURCE		// For 'timegm'
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "col_lib.h"
+#include "ts_lib.h"
+
+static int parseDateTime(const char* sDateTime, int* piTimeStamp) {
+
+	struct tm tTime;
+
+	memset(&tTime, 0, sizeof(tTime));
+	if(sscanf(sDateTime, "%d-%d-%d %d:%d:%d", &tTime.tm_year, &tTime.tm_mon, &tTime.tm_mday, &tTime.tm_hour, &tTime.tm_min, &tTime.tm_sec) != 6) return(1);
+	tTime.tm_year -= 1900;
+	tTime.tm_mon  -= 1;
+	*piTimeStamp = (int)timegm(&tTime);
+	return(0);
+
+}
+
+
+static int printRecord(const int iTimeStamp, const float* rvValues, const int nCols, void* pUserData) {
+
+	time_t    tStamp = (time_t)iTimeStamp;
+	struct tm tTime;
+	int       i;
+
+	(void)pUserData;
+	gmtime_r(&tStamp, &tTime);
+	printf("%04d-%02d-%02d %02d:%02d:%02d",
+		tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday,
+		tTime.tm_hour, tTime.tm_min, tTime.tm_sec
+	);
+	for(i=0; i<nCols; i++) printf(",%9.3f", rvValues[i]);
+	printf("\n");
+	return(0);
+
+}
+
+
+static int put(TimeStore* ptStore, const char* sColFile) {
+
+	ColumnarFile tCol;
+	char         svName[TS_MAX_COLS][TS_NAME_LEN+1];
+	int*         ivTimeStamp;
+	int*         ivColumn;
+	float*       rvColumn;
+	float*       raValues;
+	int          iTimeColumn;
+	int          nCols = 0;
+	int          i;
+	int          j;
+	int          iRow;
+	int          iRetCode = 0;
+
+	if(colOpen(sColFile, &tCol) != 0) {
+		fprintf(stderr, "ts_store:: error: Columnar file '%s' not readable\n", sColFile);
+		return(2);
+	}
+	iTimeColumn = colFindColumn(&tCol, "Time.Stamp");
+	if(iTimeColumn < 0 || tCol.nCols - 1 > TS_MAX_COLS) {
+		fprintf(stderr, "ts_store:: error: Columnar file '%s' has no time stamps, or too many columns\n", sColFile);
+		colClose(&tCol);
+		return(3);
+	}
+	for(i=0; i<tCol.nCols; i++) {
+		if(i == iTimeColumn) continue;
+		strncpy(svName[nCols], tCol.svName[i], TS_NAME_LEN);
+		svName[nCols][TS_NAME_LEN] = '\0';
+		nCols++;
+	}
+	if(tsSetSchema(ptStore, nCols, svName) != 0) {
+		fprintf(stderr, "ts_store:: error: Columnar file '%s' does not match store schema\n", sColFile);
+		colClose(&tCol);
+		return(4);
+	}
+
+	// Gather data by row
+	ivTimeStamp = malloc(tCol.nRows * sizeof(int) + 1);
+	ivColumn    = malloc(tCol.nRows * sizeof(int) + 1);
+	rvColumn    = malloc(tCol.nRows * sizeof(float) + 1);
+	raValues    = malloc(tCol.nRows * nCols * sizeof(float) + 1);
+	if(ivTimeStamp == NULL || ivColumn == NULL || rvColumn == NULL || raValues == NULL) {
+		iRetCode = 5;
+	}
+	else if(colReadInteger(&tCol, iTimeColumn, ivTimeStamp) != 0) {
+		iRetCode = 6;
+	}
+	else {
+		for(i=0, j=0; i<tCol.nCols && iRetCode == 0; i++) {
+			if(i == iTimeColumn) continue;
+			if(tCol.ivType[i] == COL_INTEGER) {
+				if(colReadInteger(&tCol, i, ivColumn) != 0) iRetCode = 6;
+				for(iRow=0; iRow<tCol.nRows; iRow++) raValues[iRow*nCols + j] = (float)ivColumn[iRow];
+			}
+			else {
+				if(colReadReal(&tCol, i, rvColumn) != 0) iRetCode = 6;
+				for(iRow=0; iRow<tCol.nRows; iRow++) raValues[iRow*nCols + j] = rvColumn[iRow];
+			}
+			j++;
+		}
+	}
+
+	// Upsert rows
+	for(iRow=0; iRow<tCol.nRows && iRetCode == 0; iRow++) {
+		if(tsUpsert(ptStore, ivTimeStamp[iRow], &raValues[iRow*nCols]) != 0) iRetCode = 7;
+	}
+	if(iRetCode != 0) fprintf(stderr, "ts_store:: error: Data from '%s' not stored (code %d)\n", sColFile, iRetCode);
+
+	// Leave
+	free(ivTimeStamp);
+	free(ivColumn);
+	free(rvColumn);
+	free(raValues);
+	colClose(&tCol);
+	return(iRetCode);
+
+}
+
+
+int main(int argc, char** argv) {
+
+	TimeStore tStore;
+	int       iFrom;
+	int       iTo;
+	int       iYear;
+	int       iMonth;
+	int       i;
+
+	// Get parameters
+	if(argc < 3 || (strcmp(argv[1], "put") == 0 && argc != 4) || (strcmp(argv[1], "scan") == 0 && argc != 5) || (strcmp(argv[1], "drop") == 0 && argc != 4)) {
+		printf("ts_store - Access to time-indexed stores of processed blocks\n\n");
+		printf("Usage:\n\n");
+		printf("  ts_store put  <StoreRoot> <ColumnarFile>\n");
+		printf("  ts_store scan <StoreRoot> <From> <To>\n");
+		printf("  ts_store drop <StoreRoot> <YYYYMM>\n\n");
+		printf("Copyright 2012 by Servizi Territorio srl\n");
+		printf("                  All rights reserved\n");
+		return(1);
+	}
+	if(tsOpen(&tStore, argv[2]) != 0) {
+		fprintf(stderr, "ts_store:: error: Store '%s' not accessible\n", argv[2]);
+		return(2);
+	}
+
+	// Dispatch command
+	if(strcmp(argv[1], "put") == 0) {
+		return(put(&tStore, argv[3]));
+	}
+	else if(strcmp(argv[1], "scan") == 0) {
+		if(parseDateTime(argv[3], &iFrom) != 0 || parseDateTime(argv[4], &iTo) != 0) {
+			fprintf(stderr, "ts_store:: error: Invalid date-time\n");
+			return(3);
+		}
+		printf("Date.Time");
+		for(i=0; i<tStore.nCols; i++) printf(",%s", tStore.svName[i]);
+		printf("\n");
+		if(tsScan(&tStore, iFrom, iTo, printRecord, NULL) < 0) {
+			fprintf(stderr, "ts_store:: error: Store scan failed\n");
+			return(4);
+		}
+	}
+	else if(strcmp(argv[1], "drop") == 0) {
+		if(strlen(argv[3]) != 6 || sscanf(argv[3], "%4d%2d", &iYear, &iMonth) != 2) {
+			fprintf(stderr, "ts_store:: error: Invalid month\n");
+			return(3);
+		}
+		if(tsDropBefore(&tStore, iYear, iMonth) < 0) {
+			fprintf(stderr, "ts_store:: error: Partitions not dropped\n");
+			return(4);
+		}
+	}
+	else {
+		fprintf(stderr, "ts_store:: error: Unknown command '%s'\n", argv[1]);
+		return(1);
+	}
+
+	// Leave
+	return(0);
+
+}
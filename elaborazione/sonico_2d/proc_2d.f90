@@ -2,6 +2,8 @@ PROGRAM eddy_cov
 
 	USE SonicLib
 	USE Calendar
+	USE Columnar
+	!$ USE omp_lib
 
 	IMPLICIT NONE
 	
@@ -10,6 +12,7 @@ PROGRAM eddy_cov
 	CHARACTER(LEN=256)		:: sToFile
 	CHARACTER(LEN=256)		:: sInputFile
 	CHARACTER(LEN=256)		:: sProcessedFile
+	CHARACTER(LEN=256)		:: sProcessedColFile
 	CHARACTER(LEN=512)		:: sCommand
 	CHARACTER(LEN=20)		:: sDateTime
 	CHARACTER(LEN=20)		:: sAvgTime
@@ -18,11 +21,11 @@ PROGRAM eddy_cov
 	INTEGER					:: iRetCode
 	INTEGER, DIMENSION(10)	:: ivValues
 	INTEGER					:: iAveragingTime
+	CHARACTER(LEN=20)		:: sNumThreads
+	INTEGER					:: iNumThreads		! Threads processing blocks (0: as many as processors, or OMP_NUM_THREADS)
 	INTEGER					:: iYear, iMonth, iDay, iHour, iMinute, iSecond
 	INTEGER					:: iYear1, iMonth1, iDay1, iHour1, iMinute1, iSecond1
 	INTEGER					:: iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
-	CHARACTER(LEN=20)		:: sBlockTime
-	INTEGER					:: iBlockTime
 	LOGICAL					:: lIsFile
 	INTEGER					:: i
 	INTEGER, DIMENSION(:), ALLOCATABLE	:: ivTime
@@ -30,22 +33,24 @@ PROGRAM eddy_cov
 	REAL, DIMENSION(:), ALLOCATABLE		:: rvV	! N->S wind component (m/s, flow convention)
 	REAL, DIMENSION(:), ALLOCATABLE		:: rvT	! Sonic temperature (°C)
 	INTEGER, DIMENSION(:), ALLOCATABLE	:: ivQ	! Data quality (%)
-	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvDesiredSubset
 	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvValid
-	REAL								:: rMinValue
-	REAL								:: rMaxValue
+	INTEGER, DIMENSION(0:3601)			:: ivSecondBegin	! Index of first datum whose time stamp is at or past each second of hour
 	INTEGER								:: iNumInvalid
-	INTEGER								:: iFrequency
 	INTEGER								:: iMaxBlock
 	INTEGER								:: iBlockLimit
 	INTEGER								:: iBlock
 	INTEGER								:: iCurTime
 	INTEGER								:: iHourBegin
-	INTEGER								:: iRegularityCode
-	INTEGER								:: iTotData
-	INTEGER								:: iValidData
 	INTEGER								:: iMaxTimeStamp
 	INTEGER								:: iMaxYear, iMaxMonth, iMaxDay, iMaxHour, iMaxMinute, iMaxSecond
+	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvRow
+	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvGood
+	INTEGER								:: iNumRows
+	INTEGER								:: iDir
+	CHARACTER(LEN=20), DIMENSION(:), ALLOCATABLE			:: svBlockTime		! Block time stamps, as text, for status file
+	CHARACTER(LEN=128), DIMENSION(:), ALLOCATABLE			:: svBlockWarning	! Block warnings (blank if none), for status file
+	CHARACTER(LEN=COL_NAME_LEN), DIMENSION(:), ALLOCATABLE	:: svColNames
+	INTEGER, DIMENSION(:), ALLOCATABLE						:: ivColTypes
 	
 	! Data set
 	INTEGER, DIMENSION(:), ALLOCATABLE		:: ivTimeStamp
@@ -81,14 +86,15 @@ PROGRAM eddy_cov
 	INTEGER, PARAMETER	:: STAT_SOUNDNESS_PERCENTAGE = 75
 	
 	! Get input parameters
-	IF(COMMAND_ARGUMENT_COUNT() /= 4) THEN
+	IF(COMMAND_ARGUMENT_COUNT() /= 4 .AND. COMMAND_ARGUMENT_COUNT() /= 5) THEN
 		PRINT *,'proc2d - Program implementing simple processing for uSonic-2 anemometers'
 		PRINT *
 		PRINT *,'Usage:'
 		PRINT *
-		PRINT *,'  ./proc2d <DataPath> <DateTime> <AvgTime> <Fuse>'
+		PRINT *,'  ./proc2d <DataPath> <DateTime> <AvgTime> <Fuse> [<Threads>]'
 		PRINT *
 		PRINT *,'Averaging time, <AvgTime>, in seconds'
+		PRINT *,'Threads processing blocks, <Threads>, default 0 (as many as processors)'
 		PRINT *
 		PRINT *,'Copyright 2017 by Servizi Territorio srl'
 		PRINT *,'                  All rights reserved'
@@ -113,6 +119,16 @@ PROGRAM eddy_cov
 		PRINT *,'proc2d:: error: Invalid fuse'
 		STOP
 	END IF
+	iNumThreads = 0
+	IF(COMMAND_ARGUMENT_COUNT() == 5) THEN
+		CALL GET_COMMAND_ARGUMENT(5, sNumThreads)
+		READ(sNumThreads, *, IOSTAT=iRetCode) iNumThreads
+		IF(iRetCode /= 0 .OR. iNumThreads < 0) THEN
+			PRINT *,'proc2d:: error: Invalid number of threads'
+			STOP
+		END IF
+	END IF
+	!$ IF(iNumThreads > 0) CALL OMP_SET_NUM_THREADS(iNumThreads)
 	
 	! Get current date and time, for diagnostic purposes
 	CALL DATE_AND_TIME(VALUES=ivValues)
@@ -149,18 +165,18 @@ PROGRAM eddy_cov
 		rvUnitVectorDir(iMaxBlock), rvEstSigmaDir(iMaxBlock), &
 		rvUnitVel(iMaxBlock), rvDirCircVar(iMaxBlock), rvDirCircStd(iMaxBlock), &
 		iaDirClass(iMaxBlock, 16), rvDominantDir(iMaxBlock), &
-		rvSigmaU(iMaxBlock), rvSigmaV(iMaxBlock), rvSigmaT(iMaxBlock) &
+		rvSigmaU(iMaxBlock), rvSigmaV(iMaxBlock), rvSigmaT(iMaxBlock), &
+		svBlockTime(iMaxBlock), svBlockWarning(iMaxBlock) &
 	)
+	svBlockWarning = ' '
 	
 	! Get input file
-	iRetCode = ReadInputFile2d(10, sInputFile, ivTime, rvU, rvV, rvT, ivQ)
+	iRetCode = ReadInputFile2d(10, sInputFile, ivTime, rvU, rvV, rvT, ivQ, ivSecondBegin)
 	IF(iRetCode /= 0) THEN
 		PRINT *,'eddy_cov:: error: Input file not read (empty or missing)'
 		STOP
 	END IF
-	ALLOCATE( &
-		lvDesiredSubset(SIZE(ivTime)), lvValid(SIZE(ivTime)) &
-	)
+	ALLOCATE(lvValid(SIZE(ivTime)))
 	
 	! Which data are valid?
 	do i = 1, size(ivTime)
@@ -174,6 +190,8 @@ PROGRAM eddy_cov
 	! Prepare output file names
 	WRITE(sProcessedFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'o')") &
 		TRIM(sDataPath), iYear, iMonth, iDay, iHour
+	WRITE(sProcessedColFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'O')") &
+		TRIM(sDataPath), iYear, iMonth, iDay, iHour
 	
 	! OK, now the context is clear. Inform users, by writing configuration and
 	! other data to file 'status.txt'
@@ -188,110 +206,26 @@ PROGRAM eddy_cov
 		WRITE(10, "('Time zone:        ',i2)") iFuse
 		WRITE(10, "('Input file:       ',a)") TRIM(sInputFile)
 		WRITE(10, "('Output file:      ',a)") TRIM(sProcessedFile)
-		WRITE(10, "('Data on input:    ',i5)") COUNT(lvDesiredSubset)
+		WRITE(10, "('Data on input:    ',i5)") SIZE(ivTime)
 		WRITE(10, "('Valid data   :    ',i5)") COUNT(lvValid)
 		WRITE(10, "('Number of blocks: ',i2)") iMaxBlock
 		WRITE(10, "('Epoch of current time: ',i2)") iHourBegin
 	END IF
 	FLUSH(10)
 
-	! Main loop: process blocks, in order
+	! Main loop: process blocks, shared among threads (each one has its own
+	! workspace and writes its own row of results only); status messages
+	! are written afterwards, in order
+	!$OMP PARALLEL DO SCHEDULE(DYNAMIC)
+	DO iBlock = 1, iMaxBlock
+		CALL ProcessBlock(iBlock)
+	END DO
+	!$OMP END PARALLEL DO
 	DO iBlock = 1, iMaxBlock
-	
 		WRITE(10, "(' ')")
 		WRITE(10, "('--> Block ',i2)") iBlock
-		FLUSH(10)
-		
-		! Assign block time stamp
-		iBlockTime = iHourBegin + (iBlock-1)*iAveragingTime
-		ivTimeStamp(iBlock) = iBlockTime
-		CALL UnpackTime(iBlockTime, iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond)
-		WRITE(sBlockTime, "(i4.4,2('-',i2.2),1x,i2.2,2(':',i2.2))") &
-			iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
-		WRITE(10, "('    This block time: ',a)") TRIM(sBlockTime)
-		
-		! Delimit current block
-		CALL GetTimeSubset(ivTime, iAveragingTime, iBlock, lvDesiredSubset, iRetCode)
-		iTotData = count(lvDesiredSubset)
-		lvDesiredSubset = lvDesiredSubset .AND. lvValid
-		iValidData = count(lvDesiredSubset)
-		ivTotData(iBlock) = iTotData
-		ivUsedData(iBlock) = iValidData
-		IF(COUNT(lvDesiredSubset) <= 0) THEN
-			WRITE(10, "('    Warning: no data in block')")
-			CYCLE
-		END IF
-		
-		! Compute time stamp regularity indices
-		CALL CheckTimeRegularity(ivTime, lvDesiredSubset, iFrequency, iRegularityCode, iRetCode)
-		IF(iRetCode /= 0) THEN
-			WRITE(10, "('    Warning: block skipped because of sonic data regularity problem (most likely cause: RTC glitch)')")
-			CYCLE
-		END IF
-		FLUSH(10)
-		ivFrequency(iBlock)      = iFrequency
-		ivRegularityCode(iBlock) = iRegularityCode
-		
-		! Compute data ranges
-		iRetCode = GetRange(rvU, lvDesiredSubset, rMinValue, rMaxValue)
-		IF(iRetCode /= 0) CYCLE
-		raMin(iBlock, 1) = rMinValue
-		raMax(iBlock, 1) = rMaxValue
-		iRetCode = GetRange(rvV, lvDesiredSubset, rMinValue, rMaxValue)
-		raMin(iBlock, 2) = rMinValue
-		raMax(iBlock, 2) = rMaxValue
-		iRetCode = GetRange(rvT, lvDesiredSubset, rMinValue, rMaxValue)
-		rvMinT(iBlock) = rMinValue
-		rvMaxT(iBlock) = rMaxValue
-		
-		! Compute non-rotated averages and (co)variances
-		CALL Average(rvU, lvDesiredSubset, raAvg(iBlock,1))
-		CALL Average(rvV, lvDesiredSubset, raAvg(iBlock,2))
-		CALL Average(rvT, lvDesiredSubset, rvAvgT(iBlock))
-		CALL Covariance(rvU, rvU, lvDesiredSubset, raAvg(iBlock,1), raAvg(iBlock,1), raCov(iBlock,1,1))
-		CALL Covariance(rvU, rvV, lvDesiredSubset, raAvg(iBlock,1), raAvg(iBlock,2), raCov(iBlock,1,2))
-		CALL Covariance(rvV, rvV, lvDesiredSubset, raAvg(iBlock,2), raAvg(iBlock,2), raCov(iBlock,2,2))
-		raCov(iBlock,2,1) = raCov(iBlock,1,2)
-		CALL Covariance(rvU, rvT, lvDesiredSubset, raAvg(iBlock,1), rvAvgT(iBlock), raCovT(iBlock,1))
-		CALL Covariance(rvV, rvT, lvDesiredSubset, raAvg(iBlock,2), rvAvgT(iBlock), raCovT(iBlock,2))
-		CALL Covariance(rvT, rvT, lvDesiredSubset, rvAvgT(iBlock),  rvAvgT(iBlock), rvVarT(iBlock))
-		
-		! Compute non-turbulent wind statistics
-		iRetCode = WindStatistics2D( &
-			rvU, rvV, &
-			lvDesiredSubset, &
-			rvVectorVel(iBlock), &
-			rvVectorDir(iBlock), &
-			rvScalarVel(iBlock), &
-			rvScalarVelStd(iBlock), &
-			rvUnitVectorDir(iBlock), &
-			rvEstSigmaDir(iBlock), &
-			rvUnitVel(iBlock), &
-			rvDirCircVar(iBlock), &
-			rvDirCircStd(iBlock) &
-		)
-		IF(iRetCode /= 0) THEN
-			rvVectorVel(iBlock)     = -9999.9
-			rvVectorDir(iBlock)     = -9999.9
-			rvScalarVel(iBlock)     = -9999.9
-			rvScalarVelStd(iBlock)  = -9999.9
-			rvUnitVectorDir(iBlock) = -9999.9
-			rvEstSigmaDir(iBlock)   = -9999.9
-			rvUnitVel(iBlock)       = -9999.9
-			rvDirCircVar(iBlock)    = -9999.9
-			rvDirCircStd(iBlock)    = -9999.9
-		END IF
-		iRetCode = WindDirClassify( &
-			rvU, rvV, &
-			lvDesiredSubset, &
-			iaDirClass(iBlock,:), &
-			rvDominantDir(iBlock) &
-		)
-		IF(iRetCode /= 0) THEN
-			iaDirClass(iBlock,:)  = -9999
-			rvDominantDir(iBlock) = -9999.9
-		END IF
-		
+		WRITE(10, "('    This block time: ',a)") TRIM(svBlockTime(iBlock))
+		IF(LEN_TRIM(svBlockWarning(iBlock)) > 0) WRITE(10, "('    Warning: ',a)") TRIM(svBlockWarning(iBlock))
 	END DO
 	CLOSE(10)
 	! ENDTAG: P9
@@ -351,6 +285,58 @@ PROGRAM eddy_cov
 		END DO
 	CLOSE(10)
 	
+	! Write binary columnar copy of main results (invalid blocks get the
+	! same -9999.9 values as in text file)
+	ALLOCATE(lvRow(iMaxBlock), lvGood(iMaxBlock))
+	lvRow    = ivTimeStamp > 0
+	lvGood   = ivUsedData > 1
+	iNumRows = COUNT(lvRow)
+	svColNames = [CHARACTER(LEN=COL_NAME_LEN) :: &
+		'Time.Stamp', 'Tot.Data', 'Valid.Data', &
+		'Vel', 'Scalar.Vel', 'Scalar.Std', &
+		'Dir', 'Unit.Vector.Dir', 'Yamartino.Std.Dir', &
+		'Temp', &
+		'Sigma.U', 'Sigma.V', 'Sigma.T', &
+		'N.Dir.N', 'N.Dir.NNE', 'N.Dir.NE', 'N.Dir.ENE', &
+		'N.Dir.E', 'N.Dir.ESE', 'N.Dir.SE', 'N.Dir.SSE', &
+		'N.Dir.S', 'N.Dir.SSW', 'N.Dir.SW', 'N.Dir.WSW', &
+		'N.Dir.W', 'N.Dir.WNW', 'N.Dir.NW', 'N.Dir.NNW', &
+		'Dominant.Dir', &
+		'Circ.Var', 'Circ.Std', 'U.Avg', 'V.Avg' &
+	]
+	ALLOCATE(ivColTypes(SIZE(svColNames)))
+	ivColTypes        = COL_REAL
+	ivColTypes(1:3)   = COL_INTEGER
+	ivColTypes(14:29) = COL_INTEGER
+	iRetCode = ColOpen(10, sProcessedColFile, svColNames, ivColTypes, iNumRows)
+	IF(iRetCode /= 0) THEN
+		PRINT *,"proc2d:: warning: Impossible to write columnar result file"
+	ELSE
+		CALL ColWriteInteger(10, PACK(ivTimeStamp, lvRow))
+		CALL ColWriteInteger(10, PACK(ivTotData, lvRow))
+		CALL ColWriteInteger(10, PACK(ivUsedData, lvRow))
+		CALL ColWriteReal(10, ValidColumn(rvVectorVel))
+		CALL ColWriteReal(10, ValidColumn(rvScalarVel))
+		CALL ColWriteReal(10, ValidColumn(rvScalarVelStd))
+		CALL ColWriteReal(10, ValidColumn(rvVectorDir))
+		CALL ColWriteReal(10, ValidColumn(rvUnitVectorDir))
+		CALL ColWriteReal(10, ValidColumn(rvEstSigmaDir))
+		CALL ColWriteReal(10, ValidColumn(rvAvgT))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaU))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaV))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaT))
+		DO iDir = 1, 16
+			CALL ColWriteInteger(10, PACK(MERGE(iaDirClass(:,iDir), -9999, lvGood), lvRow))
+		END DO
+		CALL ColWriteReal(10, ValidColumn(rvDominantDir))
+		CALL ColWriteReal(10, ValidColumn(rvDirCircVar))
+		CALL ColWriteReal(10, ValidColumn(rvDirCircStd))
+		CALL ColWriteReal(10, ValidColumn(raAvg(:,1)))
+		CALL ColWriteReal(10, ValidColumn(raAvg(:,2)))
+		CALL ColClose(10)
+	END IF
+	DEALLOCATE(svColNames, ivColTypes)
+	
 	! Copy main results file to local root for protocol gathering
 	WRITE(sCommand, "('cp ',a,1x,a,'/CurData2D.csv')") TRIM(sProcessedFile), TRIM(sDataPath)
 	CALL SYSTEM(sCommand)
@@ -359,7 +345,146 @@ PROGRAM eddy_cov
 	
 CONTAINS
 	
-	FUNCTION ReadInputFile2D(iLUN, sInputFile, ivTime, rvU, rvV, rvT, ivQ) RESULT(iRetCode)
+	! Process one averaging block, storing results at its index of data set
+	! arrays. Blocks are processed concurrently: anything else a block changes
+	! is local to this routine.
+	SUBROUTINE ProcessBlock(iBlock)
+	
+		! Routine arguments
+		INTEGER, INTENT(IN)					:: iBlock
+		
+		! Locals
+		CHARACTER(LEN=20)					:: sBlockTime
+		INTEGER								:: iBlockTime
+		INTEGER								:: iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
+		INTEGER								:: iBlockBegin		! First datum in block
+		INTEGER								:: iBlockEnd		! Last datum in block
+		INTEGER								:: iTotData
+		INTEGER								:: iValidData
+		INTEGER								:: iFrequency
+		INTEGER								:: iRegularityCode
+		INTEGER								:: iRetCode
+		LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvDesiredSubset
+		REAL, DIMENSION(3)					:: rvBlockMin		! Block statistics of u, v, t
+		REAL, DIMENSION(3)					:: rvBlockMax
+		REAL, DIMENSION(3)					:: rvBlockAvg
+		REAL, DIMENSION(3,3)				:: rmBlockCov
+		REAL, DIMENSION(3)					:: rvBlockSlope
+		REAL								:: rIndexAvg
+		
+		! Assign block time stamp
+		iBlockTime = iHourBegin + (iBlock-1)*iAveragingTime
+		ivTimeStamp(iBlock) = iBlockTime
+		CALL UnpackTime(iBlockTime, iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond)
+		WRITE(sBlockTime, "(i4.4,2('-',i2.2),1x,i2.2,2(':',i2.2))") &
+			iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
+		svBlockTime(iBlock) = sBlockTime
+		
+		! Delimit current block (a contiguous run, data being in time stamp order),
+		! and copy its subset to block workspace
+		iBlockBegin = ivSecondBegin(iAveragingTime*(iBlock-1))
+		iBlockEnd   = ivSecondBegin(iAveragingTime*iBlock) - 1
+		iTotData    = iBlockEnd - iBlockBegin + 1
+		ALLOCATE(lvDesiredSubset(iTotData))
+		lvDesiredSubset = lvValid(iBlockBegin:iBlockEnd)
+		iValidData  = COUNT(lvDesiredSubset)
+		ivTotData(iBlock) = iTotData
+		ivUsedData(iBlock) = iValidData
+		IF(iValidData <= 0) THEN
+			svBlockWarning(iBlock) = 'no data in block'
+			RETURN
+		END IF
+		
+		! Compute time stamp regularity indices
+		CALL CheckTimeRegularity(ivTime(iBlockBegin:iBlockEnd), lvDesiredSubset, iFrequency, iRegularityCode, iRetCode)
+		IF(iRetCode /= 0) THEN
+			svBlockWarning(iBlock) = 'block skipped because of sonic data regularity problem (most likely cause: RTC glitch)'
+			RETURN
+		END IF
+		ivFrequency(iBlock)      = iFrequency
+		ivRegularityCode(iBlock) = iRegularityCode
+		
+		! Compute data ranges, averages and (co)variances in a single sweep
+		iRetCode = BlockStatistics( &
+			rvU(iBlockBegin:iBlockEnd), rvV(iBlockBegin:iBlockEnd), rvT(iBlockBegin:iBlockEnd), &
+			lvDesiredSubset, &
+			.FALSE., &
+			rvBlockMin, rvBlockMax, rvBlockAvg, &
+			rmBlockCov, &
+			rvBlockSlope, rIndexAvg &
+		)
+		IF(iRetCode /= 0) RETURN
+		raMin(iBlock,:)   = rvBlockMin(1:2)
+		raMax(iBlock,:)   = rvBlockMax(1:2)
+		rvMinT(iBlock)    = rvBlockMin(3)
+		rvMaxT(iBlock)    = rvBlockMax(3)
+		raAvg(iBlock,:)   = rvBlockAvg(1:2)
+		rvAvgT(iBlock)    = rvBlockAvg(3)
+		raCov(iBlock,:,:) = rmBlockCov(1:2,1:2)
+		raCovT(iBlock,:)  = rmBlockCov(1:2,3)
+		rvVarT(iBlock)    = rmBlockCov(3,3)
+		
+		! Compute non-turbulent wind statistics
+		iRetCode = WindStatistics2D( &
+			rvU(iBlockBegin:iBlockEnd), rvV(iBlockBegin:iBlockEnd), &
+			lvDesiredSubset, &
+			rvVectorVel(iBlock), &
+			rvVectorDir(iBlock), &
+			rvScalarVel(iBlock), &
+			rvScalarVelStd(iBlock), &
+			rvUnitVectorDir(iBlock), &
+			rvEstSigmaDir(iBlock), &
+			rvUnitVel(iBlock), &
+			rvDirCircVar(iBlock), &
+			rvDirCircStd(iBlock) &
+		)
+		IF(iRetCode /= 0) THEN
+			rvVectorVel(iBlock)     = -9999.9
+			rvVectorDir(iBlock)     = -9999.9
+			rvScalarVel(iBlock)     = -9999.9
+			rvScalarVelStd(iBlock)  = -9999.9
+			rvUnitVectorDir(iBlock) = -9999.9
+			rvEstSigmaDir(iBlock)   = -9999.9
+			rvUnitVel(iBlock)       = -9999.9
+			rvDirCircVar(iBlock)    = -9999.9
+			rvDirCircStd(iBlock)    = -9999.9
+		END IF
+		iRetCode = WindDirClassify( &
+			rvU(iBlockBegin:iBlockEnd), rvV(iBlockBegin:iBlockEnd), &
+			lvDesiredSubset, &
+			iaDirClass(iBlock,:), &
+			rvDominantDir(iBlock) &
+		)
+		IF(iRetCode /= 0) THEN
+			iaDirClass(iBlock,:)  = -9999
+			rvDominantDir(iBlock) = -9999.9
+		END IF
+		
+	END SUBROUTINE ProcessBlock
+	
+	
+	! Columnar output support: values of rows written (blocks with a time
+	! stamp), with invalid blocks set to -9999.9
+	FUNCTION ValidColumn(rvValues) RESULT(rvColumn)
+	
+		! Routine arguments
+		REAL, DIMENSION(:), INTENT(IN)	:: rvValues
+		REAL, DIMENSION(:), ALLOCATABLE	:: rvColumn
+		
+		! Locals
+		! -none-
+		
+		! Get the information desired
+		rvColumn = PACK(MERGE(rvValues, -9999.9, lvGood), lvRow)
+		
+	END FUNCTION ValidColumn
+	
+	
+	! Raw data are read in a single pass, and stored in time stamp order (stable
+	! counting sort on second of hour). On exit ivSecondBegin(s) is the index of
+	! the first datum whose time stamp is s or more, so any time interval [s1, s2)
+	! of the hour is the contiguous run ivSecondBegin(s1):ivSecondBegin(s2)-1.
+	FUNCTION ReadInputFile2D(iLUN, sInputFile, ivTime, rvU, rvV, rvT, ivQ, ivSecondBegin) RESULT(iRetCode)
 	
 		! Routine arguments
 		INTEGER, INTENT(IN)								:: iLUN
@@ -369,18 +494,25 @@ CONTAINS
 		REAL, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: rvV
 		REAL, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: rvT
 		INTEGER, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: ivQ
+		INTEGER, DIMENSION(0:3601), INTENT(OUT)			:: ivSecondBegin
 		INTEGER											:: iRetCode
 		
 		! Locals
-		INTEGER		:: iErrCode
-		INTEGER		:: iNumData
-		INTEGER		:: iData
-		INTEGER(2)	:: iTimeStamp, iU, iV, iT, iQ
+		INTEGER									:: iErrCode
+		INTEGER									:: iFileSize
+		INTEGER									:: iNumRecords
+		INTEGER									:: iNumData
+		INTEGER									:: iData
+		INTEGER									:: iRecord
+		INTEGER									:: iSecond
+		INTEGER(2), DIMENSION(:,:), ALLOCATABLE	:: iaRaw
+		INTEGER, DIMENSION(0:3601)				:: ivNext
 		
 		! Assume success (will falsify on failure)
 		iRetCode = 0
+		ivSecondBegin = 1
 		
-		! Count how many data are available, and reserve workspace based on this information
+		! Get all records at once
 		OPEN(iLUN, FILE=sInputFile, STATUS='OLD', ACTION='READ', ACCESS='STREAM', IOSTAT=iErrCode)
 		IF(iErrCode /= 0) THEN
 			iRetCode = 1
@@ -388,47 +520,59 @@ CONTAINS
 			print *,"Open non riuscita, codice ", iErrCode
 			RETURN
 		END IF
-		iNumData = 0
-		DO
-			
-			! Get data in binary form
-			READ(10, IOSTAT=iErrCode) iTimeStamp, iV, iU, iT, iQ
-			IF(iErrCode /= 0) EXIT
-			iNumData = iNumData + 1
-			
+		INQUIRE(UNIT=iLUN, SIZE=iFileSize)
+		iNumRecords = MAX(iFileSize, 0) / 10
+		IF(iNumRecords <= 0) THEN
+			iRetCode = 2
+			CLOSE(iLUN)
+			RETURN
+		END IF
+		ALLOCATE(iaRaw(5, iNumRecords))
+		READ(iLUN, IOSTAT=iErrCode) iaRaw
+		CLOSE(iLUN)
+		IF(iErrCode /= 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		
+		! Count data per second of hour, and turn counts into positions
+		ivNext = 0
+		DO iRecord = 1, iNumRecords
+			iSecond = iaRaw(1, iRecord)
+			IF(iSecond > 3600 .OR. iSecond < 0) CYCLE
+			ivNext(iSecond) = ivNext(iSecond) + 1
 		END DO
+		iNumData = SUM(ivNext)
 		IF(iNumData <= 0) THEN
 			iRetCode = 2
-			CLOSE(iLUN)
 			RETURN
 		END IF
-		ALLOCATE(ivTime(iNumData), rvU(iNumData), rvV(iNumData), rvT(iNumData), ivQ(iNumData))
-		REWIND(iLUN)
+		DO iSecond = 1, 3601
+			ivSecondBegin(iSecond) = ivSecondBegin(iSecond-1) + ivNext(iSecond-1)
+		END DO
+		ivNext = ivSecondBegin
 		
-		! Perform actual data read
-		iData = 0
-		DO
-			
-			! Get data in binary form
-			READ(10, IOSTAT=iErrCode) iTimeStamp, iU, iV, iT, iQ
-			IF(iErrCode /= 0) EXIT
-			IF(iTimeStamp < 0) CYCLE
-			iData = iData + 1
-			ivTime(iData) = iTimeStamp
-			IF(iU > -9990 .AND. iV > -9990 .AND. iT > -9990 .AND. iQ > -9990) THEN
-				rvU(iData) = iU / 100.
-				rvV(iData) = iV / 100.
-				rvT(iData) = iT / 100.
-				ivQ(iData) = iQ
+		! Place data
+		ALLOCATE(ivTime(iNumData), rvU(iNumData), rvV(iNumData), rvT(iNumData), ivQ(iNumData))
+		DO iRecord = 1, iNumRecords
+			iSecond = iaRaw(1, iRecord)
+			IF(iSecond > 3600 .OR. iSecond < 0) CYCLE
+			iData = ivNext(iSecond)
+			ivNext(iSecond) = iData + 1
+			ivTime(iData) = iSecond
+			IF(ALL(iaRaw(2:5, iRecord) > -9990)) THEN
+				rvU(iData) = iaRaw(2, iRecord) / 100.
+				rvV(iData) = iaRaw(3, iRecord) / 100.
+				rvT(iData) = iaRaw(4, iRecord) / 100.
+				ivQ(iData) = iaRaw(5, iRecord)
 			ELSE
 				rvU(iData) = -9999.9
 				rvV(iData) = -9999.9
 				rvT(iData) = -9999.9
 				ivQ(iData) = -9999
 			END IF
-			
 		END DO
-		CLOSE(iLUN)
+		DEALLOCATE(iaRaw)
 		
 	END FUNCTION ReadInputFile2D
 
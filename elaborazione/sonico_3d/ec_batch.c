@@ -0,0 +1,469 @@
+/*
+
+	ec_batch - Bulk reprocessing of archived raw sonic data, by the "ec_lib"
+	           engine, on all processor cores.
+
+	Usage:
+
+		ec_batch <IniFile> <RawPath> <OutPath> <From> <To> <AvgTime> [<Threads> [<CacheDir> [<CacheMB>]]]
+
+	Hours from <From> to <To> (both "YYYY-MM-DD HH", inclusive) are looked
+	for in the raw data archive, as <RawPath>/YYYYMM/YYYYMMDD.HHR.gz (or not
+	compressed, as YYYYMMDD.HHR). Each hour found is a job: decompress, load,
+	process all its blocks and write .p, .d, .P and .D files, in the same form
+	as eddy_cov, to <OutPath>/YYYYMM/. Configuration file, <IniFile>, is in
+	eddy_cov namelist format.
+
+	Jobs run on a pool of <Threads> workers (default: one per processor
+	core online). Hours are dealt to workers in contiguous runs, so that
+	each one reads consecutive files, and a worker left without jobs steals
+	half of the remaining run of another; load stays balanced when hours
+	differ in size or some are missing, without any shared queue to contend
+	for. Throughput, in hours per second, is printed at end.
+
+	If a cache directory is given, results of each hour are kept there
+	under a hash of raw data, configuration, averaging time and engine
+	version (see "rc_lib"), and served from it, without processing, when
+	the same hour is reprocessed with nothing changed. The cache is bound
+	to <CacheMB> megabytes (default 1024), least recently used hours being
+	evicted first.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#define _GNU_SOURCE		// For 'timegm'
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "ec_lib.h"
+#include "rc_lib.h"
+
+#define MAX_THREADS  256
+#define READ_CHUNK   65536		// Records decompressed at a time
+#define CACHE_MB      1024		// Default cache bound
+
+// One archived hour to process
+typedef struct HourJob {
+	int  iHourBegin;			// Hour begin, as epoch
+	char sFileName[256];
+} HourJob;
+
+// Per-worker run of jobs, [iFirst, iLast), taken from the front by its owner
+// and from the back by thieves
+typedef struct JobRun {
+	pthread_mutex_t tLock;
+	int             iFirst;
+	int             iLast;
+} JobRun;
+
+// Worker state and counters
+typedef struct Worker {
+	int           iWorker;
+	pthread_t     tThread;
+	JobRun        tRun;
+	EddyWorkspace tWork;
+	short         (*ivData)[5];	// Decompressed hour, reused between jobs
+	int           iCapacity;
+	EddyBlock*    tvBlock;
+	int           iDone;
+	int           iFailed;
+	int           iCached;		// Hours served from cache
+	int           iSteals;
+	double        rReadTime;	// Seconds spent decompressing and loading
+	double        rProcTime;	// Seconds spent processing
+	double        rWriteTime;	// Seconds spent writing results
+} Worker;
+
+static EddyConfig tConfig;
+static const char* sOutPath;
+static int         iAveragingTime;
+static int         iNumBlocks;
+static HourJob*    tvJob;
+static int         iNumJobs;
+static Worker*     tvWorker;
+static int         iNumWorkers;
+static ResultCache tCache;
+static int         iUseCache = 0;
+
+
+static double now(void) {
+
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return(tNow.tv_sec + 1.e-9*tNow.tv_nsec);
+
+}
+
+
+// Decompress and load one hour into the worker buffer, retaining sonic
+// records only; return the number of records, or -1 on failure. Files not
+// compressed are read as they are.
+static int readHour(Worker* ptWorker, const char* sFileName) {
+
+	gzFile f;
+	int    iNumRecords = 0;
+	int    iRead;
+	void*  pNew;
+
+	f = gzopen(sFileName, "rb");
+	if(f == NULL) return(-1);
+	gzbuffer(f, 128*1024);
+	while(1) {
+		if(ptWorker->iCapacity - iNumRecords < READ_CHUNK) {
+			pNew = realloc(ptWorker->ivData, (ptWorker->iCapacity + READ_CHUNK) * sizeof(ptWorker->ivData[0]));
+			if(pNew == NULL) {
+				gzclose(f);
+				return(-1);
+			}
+			ptWorker->ivData     = pNew;
+			ptWorker->iCapacity += READ_CHUNK;
+		}
+		iRead = gzread(f, ptWorker->ivData[iNumRecords], READ_CHUNK * sizeof(ptWorker->ivData[0]));
+		if(iRead < 0) {
+			gzclose(f);
+			return(-1);
+		}
+		iNumRecords += iRead / sizeof(ptWorker->ivData[0]);
+		if(iRead < READ_CHUNK * (int)sizeof(ptWorker->ivData[0])) break;
+	}
+	gzclose(f);
+	return(ecCompactRawData(ptWorker->ivData, iNumRecords));
+
+}
+
+
+// Decompress, load, process and write one hour; return 0 on success
+static int runJob(Worker* ptWorker, const HourJob* ptJob) {
+
+	time_t    tStamp = ptJob->iHourBegin;
+	struct tm tTime;
+	char      sDirName[256];
+	char      sKey[RC_KEY_LEN+1];
+	double    rStart;
+	int       iNumData;
+	int       iRetCode;
+
+	// Decompress and load
+	rStart   = now();
+	iNumData = readHour(ptWorker, ptJob->sFileName);
+	ptWorker->rReadTime += now() - rStart;
+	if(iNumData <= 0) return(1);
+
+	// Process, unless results are in cache already
+	rStart = now();
+	if(iUseCache) {
+		rcKey(&tConfig, iAveragingTime, ptJob->iHourBegin, (const short (*)[5])ptWorker->ivData, iNumData, sKey);
+		iRetCode = rcGet(&tCache, sKey, ptWorker->tvBlock, iNumBlocks);
+	}
+	else {
+		iRetCode = 1;
+	}
+	if(iRetCode == 0) {
+		ptWorker->iCached++;
+	}
+	else {
+		iRetCode = ecProcessHour(&tConfig, (const short (*)[5])ptWorker->ivData, iNumData, ptJob->iHourBegin, iAveragingTime, iNumBlocks, ptWorker->tvBlock, &ptWorker->tWork);
+		if(iRetCode == 0 && iUseCache) rcPut(&tCache, sKey, ptWorker->tvBlock, iNumBlocks);
+	}
+	ptWorker->rProcTime += now() - rStart;
+	if(iRetCode != 0) return(2);
+
+	// Write, leaving current data copies alone as hours complete out of order
+	rStart = now();
+	gmtime_r(&tStamp, &tTime);
+	sprintf(sDirName, "%s/%04d%02d", sOutPath, tTime.tm_year + 1900, tTime.tm_mon + 1);
+	if(mkdir(sDirName, 0755) != 0 && errno != EEXIST) iRetCode = 3;
+	else if(ecWriteResults(sDirName, tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday, tTime.tm_hour, ptWorker->tvBlock, iNumBlocks, 0) != 0) iRetCode = 4;
+	ptWorker->rWriteTime += now() - rStart;
+	return(iRetCode);
+
+}
+
+
+// Take the next job of a worker's own run; return its index, or -1 if none left
+static int takeOwn(Worker* ptWorker) {
+
+	int iJob = -1;
+
+	pthread_mutex_lock(&ptWorker->tRun.tLock);
+	if(ptWorker->tRun.iFirst < ptWorker->tRun.iLast) iJob = ptWorker->tRun.iFirst++;
+	pthread_mutex_unlock(&ptWorker->tRun.tLock);
+	return(iJob);
+
+}
+
+
+// Steal the back half of the longest run left among other workers, making
+// it the worker's own run; return 0 if nothing was left to steal
+static int steal(Worker* ptWorker) {
+
+	Worker* ptVictim;
+	int     iBest;
+	int     iLeft;
+	int     iFirst = 0;
+	int     iLast  = 0;
+	int     i;
+
+	while(1) {
+
+		// Find the longest run (no lock needed, as it is only a hint)
+		iBest = -1;
+		iLeft = 0;
+		for(i=0; i<iNumWorkers; i++) {
+			if(i == ptWorker->iWorker) continue;
+			if(tvWorker[i].tRun.iLast - tvWorker[i].tRun.iFirst > iLeft) {
+				iLeft = tvWorker[i].tRun.iLast - tvWorker[i].tRun.iFirst;
+				iBest = i;
+			}
+		}
+		if(iBest < 0) return(0);
+
+		// Take its back half, or its last job, if still there
+		ptVictim = &tvWorker[iBest];
+		pthread_mutex_lock(&ptVictim->tRun.tLock);
+		iLeft = ptVictim->tRun.iLast - ptVictim->tRun.iFirst;
+		if(iLeft > 0) {
+			iLast  = ptVictim->tRun.iLast;
+			iFirst = iLast - (iLeft + 1) / 2;
+			ptVictim->tRun.iLast = iFirst;
+		}
+		pthread_mutex_unlock(&ptVictim->tRun.tLock);
+		if(iLeft > 0) break;
+
+	}
+
+	pthread_mutex_lock(&ptWorker->tRun.tLock);
+	ptWorker->tRun.iFirst = iFirst;
+	ptWorker->tRun.iLast  = iLast;
+	pthread_mutex_unlock(&ptWorker->tRun.tLock);
+	ptWorker->iSteals++;
+	return(1);
+
+}
+
+
+static void* workerMain(void* pArg) {
+
+	Worker* ptWorker = (Worker*)pArg;
+	int     iJob;
+
+	while(1) {
+		iJob = takeOwn(ptWorker);
+		if(iJob < 0) {
+			if(!steal(ptWorker)) break;
+			continue;
+		}
+		if(runJob(ptWorker, &tvJob[iJob]) == 0) {
+			ptWorker->iDone++;
+		}
+		else {
+			ptWorker->iFailed++;
+			fprintf(stderr, "ec_batch:: warning: Hour not processed: %s\n", tvJob[iJob].sFileName);
+		}
+	}
+	return(NULL);
+
+}
+
+
+// Parse "YYYY-MM-DD HH" into the epoch of hour begin; return -1 if invalid
+static int parseHour(const char* sDateTime) {
+
+	struct tm tTime;
+
+	memset(&tTime, 0, sizeof(tTime));
+	if(sscanf(sDateTime, "%d-%d-%d %d", &tTime.tm_year, &tTime.tm_mon, &tTime.tm_mday, &tTime.tm_hour) != 4) return(-1);
+	if(tTime.tm_mon < 1 || tTime.tm_mon > 12 || tTime.tm_mday < 1 || tTime.tm_mday > 31 || tTime.tm_hour < 0 || tTime.tm_hour > 23) return(-1);
+	tTime.tm_year -= 1900;
+	tTime.tm_mon  -= 1;
+	return((int)timegm(&tTime));
+
+}
+
+
+int main(int argc, char** argv) {
+
+	int         iFrom;
+	int         iTo;
+	int         iHour;
+	int         iCapacity;
+	long long   lCacheMB = CACHE_MB;
+	time_t      tStamp;
+	struct tm   tTime;
+	struct stat tStat;
+	double      rStart;
+	double      rElapsed;
+	int         iDone   = 0;
+	int         iFailed = 0;
+	int         iRetCode;
+	int         i;
+
+	// Get parameters
+	if(argc < 7 || argc > 10) {
+		printf("ec_batch - Bulk eddy covariance reprocessing of archived raw data\n\n");
+		printf("Usage:\n\n");
+		printf("  ./ec_batch <IniFile> <RawPath> <OutPath> <From> <To> <AvgTime> [<Threads> [<CacheDir> [<CacheMB>]]]\n\n");
+		printf("Configuration file, <IniFile>, in eddy_cov namelist format.\n");
+		printf("Hours <From> and <To> as \"YYYY-MM-DD HH\", both included.\n");
+		printf("Averaging time, <AvgTime>, in seconds, must divide the hour.\n");
+		printf("Threads, <Threads>, defaults (or if 0) to the number of processor cores.\n");
+		printf("Results cache, <CacheDir>, not used unless given; its size\n");
+		printf("bound, <CacheMB>, in megabytes (default %d).\n\n", CACHE_MB);
+		printf("Copyright 2012 by Servizi Territorio srl\n");
+		printf("                  All rights reserved\n");
+		return(1);
+	}
+	sOutPath = argv[3];
+	iFrom    = parseHour(argv[4]);
+	iTo      = parseHour(argv[5]);
+	if(iFrom < 0 || iTo < iFrom) {
+		fprintf(stderr, "ec_batch:: error: Invalid time range\n");
+		return(2);
+	}
+	if(sscanf(argv[6], "%d", &iAveragingTime) != 1 || iAveragingTime <= 0 || 3600 % iAveragingTime != 0) {
+		fprintf(stderr, "ec_batch:: error: Invalid averaging time\n");
+		return(2);
+	}
+	iNumBlocks = 3600 / iAveragingTime;
+	iNumWorkers = 0;
+	if(argc >= 8) {
+		if(sscanf(argv[7], "%d", &iNumWorkers) != 1 || iNumWorkers < 0 || iNumWorkers > MAX_THREADS) {
+			fprintf(stderr, "ec_batch:: error: Invalid number of threads\n");
+			return(2);
+		}
+	}
+	if(argc >= 10) {
+		if(sscanf(argv[9], "%lld", &lCacheMB) != 1 || lCacheMB <= 0) {
+			fprintf(stderr, "ec_batch:: error: Invalid cache size\n");
+			return(2);
+		}
+	}
+	if(iNumWorkers == 0) {
+		iNumWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if(iNumWorkers <= 0) iNumWorkers = 1;
+		if(iNumWorkers > MAX_THREADS) iNumWorkers = MAX_THREADS;
+	}
+
+	// Get configuration
+	iRetCode = ecReadConfig(argv[1], &tConfig);
+	if(iRetCode == 4) {
+		fprintf(stderr, "ec_batch:: error: Rotation type not supported (planar fit is made by eddy_cov only)\n");
+		return(3);
+	}
+	else if(iRetCode != 0) {
+		fprintf(stderr, "ec_batch:: error: Invalid initialization file\n");
+		return(3);
+	}
+	if(mkdir(sOutPath, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "ec_batch:: error: Output path not accessible\n");
+		return(3);
+	}
+	if(argc >= 9) {
+		if(rcOpen(&tCache, argv[8], lCacheMB * 1024 * 1024) != 0) {
+			fprintf(stderr, "ec_batch:: error: Cache directory not accessible\n");
+			return(3);
+		}
+		iUseCache = 1;
+	}
+
+	// Discover archived hours, in time order
+	iCapacity = (iTo - iFrom) / 3600 + 1;
+	tvJob     = malloc(iCapacity * sizeof(HourJob));
+	if(tvJob == NULL) {
+		fprintf(stderr, "ec_batch:: error: Not enough memory\n");
+		return(4);
+	}
+	iNumJobs = 0;
+	for(iHour=iFrom; iHour<=iTo; iHour+=3600) {
+		tStamp = iHour;
+		gmtime_r(&tStamp, &tTime);
+		sprintf(tvJob[iNumJobs].sFileName, "%s/%04d%02d/%04d%02d%02d.%02dR.gz", argv[2],
+			tTime.tm_year + 1900, tTime.tm_mon + 1,
+			tTime.tm_year + 1900, tTime.tm_mon + 1, tTime.tm_mday, tTime.tm_hour);
+		if(stat(tvJob[iNumJobs].sFileName, &tStat) != 0) {
+			tvJob[iNumJobs].sFileName[strlen(tvJob[iNumJobs].sFileName) - 3] = '\0';
+			if(stat(tvJob[iNumJobs].sFileName, &tStat) != 0) continue;
+		}
+		tvJob[iNumJobs].iHourBegin = iHour;
+		iNumJobs++;
+	}
+	printf("Hours in range:   %d\n", iCapacity);
+	printf("Hours archived:   %d\n", iNumJobs);
+	printf("Threads:          %d\n", iNumWorkers);
+	if(iNumJobs <= 0) return(0);
+
+	// Deal contiguous runs of hours to workers, and start them
+	tvWorker = calloc(iNumWorkers, sizeof(Worker));
+	if(tvWorker == NULL) {
+		fprintf(stderr, "ec_batch:: error: Not enough memory\n");
+		return(4);
+	}
+	for(i=0; i<iNumWorkers; i++) {
+		tvWorker[i].iWorker = i;
+		pthread_mutex_init(&tvWorker[i].tRun.tLock, NULL);
+		tvWorker[i].tRun.iFirst = (int)((long)iNumJobs * i / iNumWorkers);
+		tvWorker[i].tRun.iLast  = (int)((long)iNumJobs * (i+1) / iNumWorkers);
+		ecWorkspaceInit(&tvWorker[i].tWork);
+		tvWorker[i].tvBlock = malloc(iNumBlocks * sizeof(EddyBlock));
+		if(tvWorker[i].tvBlock == NULL) {
+			fprintf(stderr, "ec_batch:: error: Not enough memory\n");
+			return(4);
+		}
+	}
+	rStart = now();
+	for(i=0; i<iNumWorkers; i++) {
+		if(pthread_create(&tvWorker[i].tThread, NULL, workerMain, &tvWorker[i]) != 0) {
+			fprintf(stderr, "ec_batch:: error: Thread not started\n");
+			return(5);
+		}
+	}
+	for(i=0; i<iNumWorkers; i++) pthread_join(tvWorker[i].tThread, NULL);
+	rElapsed = now() - rStart;
+
+	// Report
+	printf("\nWorker  Hours  Failed  Cached  Steals  Read (s)  Proc (s)  Write (s)\n");
+	for(i=0; i<iNumWorkers; i++) {
+		printf("%6d %6d %7d %7d %7d %9.3f %9.3f %10.3f\n",
+			i, tvWorker[i].iDone, tvWorker[i].iFailed, tvWorker[i].iCached, tvWorker[i].iSteals,
+			tvWorker[i].rReadTime, tvWorker[i].rProcTime, tvWorker[i].rWriteTime);
+		iDone   += tvWorker[i].iDone;
+		iFailed += tvWorker[i].iFailed;
+	}
+	printf("\nHours processed:  %d\n", iDone);
+	printf("Hours failed:     %d\n", iFailed);
+	printf("Elapsed (s):      %.3f\n", rElapsed);
+	if(rElapsed > 0.) printf("Throughput:       %.2f hours/s\n", iDone / rElapsed);
+	if(iUseCache) {
+		printf("Cache hits:       %u\n", tCache.iHits);
+		printf("Cache misses:     %u\n", tCache.iMisses);
+		if(tCache.iHits + tCache.iMisses > 0) printf("Cache hit ratio:  %.1f%%\n", 100.0 * tCache.iHits / (tCache.iHits + tCache.iMisses));
+		printf("Cache stores:     %u\n", tCache.iStores);
+		printf("Cache evictions:  %u\n", tCache.iEvictions);
+		printf("Cache size:       %d entries, %.1f MB\n", tCache.iEntries, tCache.lBytes / (1024.0 * 1024.0));
+		rcClose(&tCache);
+	}
+
+	// Leave
+	for(i=0; i<iNumWorkers; i++) {
+		ecWorkspaceFree(&tvWorker[i].tWork);
+		free(tvWorker[i].ivData);
+		free(tvWorker[i].tvBlock);
+		pthread_mutex_destroy(&tvWorker[i].tRun.tLock);
+	}
+	free(tvWorker);
+	free(tvJob);
+	return(iFailed > 0 ? 6 : 0);
+
+}
@@ -0,0 +1,85 @@
+/*
+
+	ec_proc - Batch eddy covariance processing, by the "ec_lib" engine.
+
+	Usage:
+
+		ec_proc <IniFile> <DataPath> <DateTime> <AvgTime> <Fuse>
+
+	Parameters and result files are the same as "eddy_cov", of which this
+	program is a drop-in replacement.
+
+	Copyright 2012 by Servizi Territorio srl
+	                  All rights reserved
+
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "ec_lib.h"
+
+int main(int argc, char** argv) {
+
+	EddyConfig    tConfig;
+	EddyWorkspace tWork;
+	struct tm     tTime;
+	int           iAveragingTime;
+	int           iFuse;
+	int           iRetCode;
+
+	// Get parameters
+	if(argc != 6) {
+		printf("ec_proc - Program implementing simple classical eddy covariance\n\n");
+		printf("Usage:\n\n");
+		printf("  ./ec_proc <IniFile> <DataPath> <DateTime> <AvgTime> <Fuse>\n\n");
+		printf("Configuration file, <IniFile>, in eddy_cov namelist format.\n");
+		printf("Averaging time, <AvgTime>, in seconds\n\n");
+		printf("Copyright 2012 by Servizi Territorio srl\n");
+		printf("                  All rights reserved\n");
+		return(1);
+	}
+	if(sscanf(argv[4], "%d", &iAveragingTime) != 1 || iAveragingTime <= 0 || iAveragingTime > 3600) {
+		fprintf(stderr, "ec_proc:: error: Invalid averaging time\n");
+		return(2);
+	}
+	if(sscanf(argv[5], "%d", &iFuse) != 1) {
+		fprintf(stderr, "ec_proc:: error: Invalid fuse\n");
+		return(2);
+	}
+	memset(&tTime, 0, sizeof(tTime));
+	if(sscanf(argv[3], "%d-%d-%d %d:%d:%d", &tTime.tm_year, &tTime.tm_mon, &tTime.tm_mday, &tTime.tm_hour, &tTime.tm_min, &tTime.tm_sec) != 6) {
+		fprintf(stderr, "ec_proc:: error: Invalid start of acquisition block\n");
+		return(2);
+	}
+	tTime.tm_year -= 1900;
+	tTime.tm_mon  -= 1;
+
+	// Get configuration
+	iRetCode = ecReadConfig(argv[1], &tConfig);
+	if(iRetCode == 4) {
+		fprintf(stderr, "ec_proc:: error: Rotation type not supported (planar fit is made by eddy_cov only)\n");
+		return(3);
+	}
+	else if(iRetCode != 0) {
+		fprintf(stderr, "ec_proc:: error: Invalid initialization file\n");
+		return(3);
+	}
+
+	// Process
+	ecWorkspaceInit(&tWork);
+	iRetCode = ecProcessAndWrite(&tConfig, NULL, 0, argv[2], &tTime, iAveragingTime, &tWork);
+	ecWorkspaceFree(&tWork);
+	if(iRetCode == 2) {
+		fprintf(stderr, "ec_proc:: error: Input file not read (empty or missing)\n");
+	}
+	else if(iRetCode != 0) {
+		fprintf(stderr, "ec_proc:: error: Processing failed (code %d)\n", iRetCode);
+	}
+
+	// Leave
+	return(iRetCode);
+
+}
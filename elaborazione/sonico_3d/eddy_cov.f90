@@ -2,6 +2,8 @@ PROGRAM eddy_cov
 
 	USE SonicLib
 	USE Calendar
+	USE Columnar
+	!$ USE omp_lib
 
 	IMPLICIT NONE
 	
@@ -12,6 +14,10 @@ PROGRAM eddy_cov
 	CHARACTER(LEN=256)		:: sInputFile
 	CHARACTER(LEN=256)		:: sProcessedFile
 	CHARACTER(LEN=256)		:: sDiagnosticFile
+	CHARACTER(LEN=256)		:: sProcessedColFile
+	CHARACTER(LEN=256)		:: sDiagnosticColFile
+	CHARACTER(LEN=256)		:: sCheckpointFile
+	CHARACTER(LEN=256)		:: sPlanarFitFile		! Planar fit state, kept across runs (iRotations = 4 only)
 	CHARACTER(LEN=2048)		:: sCommand
 	CHARACTER(LEN=20)		:: sDateTime
 	CHARACTER(LEN=20)		:: sAvgTime
@@ -21,14 +27,15 @@ PROGRAM eddy_cov
 	INTEGER, DIMENSION(10)	:: ivValues
 	INTEGER					:: iAveragingTime
 	LOGICAL					:: lDetrending
-	INTEGER					:: iRotations
+	LOGICAL					:: lExactMoments		! Accumulate block moments in integer arithmetic, from raw data
+	INTEGER					:: iRotations			! 0 to 3, or 4 for planar fit by wind sector
+	INTEGER					:: iPlanarFitSectors
+	INTEGER					:: iNumThreads		! Threads processing blocks (0: as many as processors, or OMP_NUM_THREADS)
 	REAL					:: rAltitude
 	REAL					:: rAnemometerHeight
 	INTEGER					:: iYear, iMonth, iDay, iHour, iMinute, iSecond
 	INTEGER					:: iYear1, iMonth1, iDay1, iHour1, iMinute1, iSecond1
 	INTEGER					:: iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
-	CHARACTER(LEN=20)		:: sBlockTime
-	INTEGER					:: iBlockTime
 	LOGICAL					:: lIsFile
 	INTEGER					:: i
 	INTEGER, DIMENSION(:), ALLOCATABLE	:: ivTime
@@ -36,28 +43,32 @@ PROGRAM eddy_cov
 	REAL, DIMENSION(:), ALLOCATABLE		:: rvV
 	REAL, DIMENSION(:), ALLOCATABLE		:: rvW
 	REAL, DIMENSION(:), ALLOCATABLE		:: rvT
-	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvDesiredSubset
 	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvValid
-	REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessU
-	REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessV
-	REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessW
-	REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessT
-	REAL								:: rMinValue
-	REAL								:: rMaxValue
 	INTEGER								:: iNumInvalid
-	INTEGER								:: iFrequency
 	INTEGER								:: iMaxBlock
 	INTEGER								:: iBlockLimit
 	INTEGER								:: iBlock
 	INTEGER								:: iCurTime
 	INTEGER								:: iHourBegin
-	INTEGER								:: iRegularityCode
-	INTEGER								:: iTotData
-	INTEGER								:: iValidData
-	REAL, DIMENSION(3,3)				:: rmRot
-	REAL, DIMENSION(3,1)				:: rmAux
 	INTEGER								:: iMaxTimeStamp
 	INTEGER								:: iMaxYear, iMaxMonth, iMaxDay, iMaxHour, iMaxMinute, iMaxSecond
+	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvRow
+	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvGood
+	INTEGER								:: iNumRows
+	INTEGER								:: iDir
+	INTEGER								:: iFirstBlock		! First block to compute (previous ones come from checkpoint)
+	INTEGER								:: iFirstRecord		! First raw record not consumed by checkpointed blocks
+	INTEGER								:: iDoneBlocks		! Blocks wholly covered by data read, hence checkpointed
+	INTEGER								:: iNumRecords		! Raw records in input file
+	INTEGER, DIMENSION(:), ALLOCATABLE	:: ivRecord			! Raw record index of each datum
+	INTEGER(2), DIMENSION(:,:), ALLOCATABLE	:: iaQuad		! Raw u, v, w, t of each datum (cm/s, 1/100 °C)
+	INTEGER, DIMENSION(0:3601)			:: ivSecondBegin	! Index of first datum whose time stamp is at or past each second of hour
+	TYPE(PlanarFit)						:: tFit				! Planar fit state, as of run begin (read-only while processing blocks)
+	LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvRotated		! Blocks whose mean wind reached axis rotation
+	CHARACTER(LEN=20), DIMENSION(:), ALLOCATABLE			:: svBlockTime		! Block time stamps, as text, for status file
+	CHARACTER(LEN=128), DIMENSION(:), ALLOCATABLE			:: svBlockWarning	! Block warnings (blank if none), for status file
+	CHARACTER(LEN=COL_NAME_LEN), DIMENSION(:), ALLOCATABLE	:: svColNames
+	INTEGER, DIMENSION(:), ALLOCATABLE						:: ivColTypes
 	
 	! Data set
 	INTEGER, DIMENSION(:), ALLOCATABLE		:: ivTimeStamp
@@ -106,7 +117,8 @@ PROGRAM eddy_cov
 	REAL, DIMENSION(:), ALLOCATABLE			:: rvSigmaW
 	REAL, DIMENSION(:), ALLOCATABLE			:: rvSigmaT
 	
-	NAMELIST /EddyConfig/ lDetrending, iRotations, rAltitude, rAnemometerHeight
+	NAMELIST /EddyConfig/ lDetrending, iRotations, rAltitude, rAnemometerHeight, lExactMoments, iNumThreads, &
+		sPlanarFitFile, iPlanarFitSectors
 
 	OPEN(101, FILE="/mnt/logs/eddy_cov.log", STATUS="UNKNOWN", ACTION="WRITE")
 	WRITE(101,"('Starting execution')")
@@ -170,6 +182,10 @@ PROGRAM eddy_cov
 		PRINT *,'eddy_cov:: error: Initialization file not accessible (nonexistent?)'
 		STOP
 	END IF
+	lExactMoments     = .FALSE.
+	iNumThreads       = 0
+	sPlanarFitFile    = ' '
+	iPlanarFitSectors = 8
 	READ(10, EddyConfig, IOSTAT=iRetCode)
 	IF(iRetCode /= 0) THEN
 		PRINT *,'eddy_cov:: error: Invalid initialization file ', iRetCode
@@ -178,7 +194,20 @@ PROGRAM eddy_cov
 	CLOSE(10)
 	WRITE(101,"('Configuration data read:')")
 	WRITE(101,"('  Trend removed? ',l1)") lDetrending
+	WRITE(101,"('  Exact moments? ',l1)") lExactMoments
+	WRITE(101,"('  Threads:       ',i3)") iNumThreads
+	!$ IF(iNumThreads > 0) CALL OMP_SET_NUM_THREADS(iNumThreads)
 	WRITE(101,"('  Rotations:     ',i1)") iRotations
+	IF(iRotations == 4) THEN
+		IF(LEN_TRIM(sPlanarFitFile) <= 0) THEN
+			PRINT *,'eddy_cov:: error: Planar fit requested, but no planar fit file given'
+			STOP
+		END IF
+		iRetCode = PlanarFitRead(10, sPlanarFitFile, iPlanarFitSectors, tFit)
+		WRITE(101,"('  Planar fit:    ',a,'  (',i2,' sectors, ',i6,' blocks)')") &
+			TRIM(sPlanarFitFile), tFit % iNumSectors, NINT(SUM(tFit % raSums(1,1:tFit % iNumSectors)))
+		IF(iRetCode /= 0) WRITE(101,"('  Planar fit state not found or not matching: starting anew')")
+	END IF
 	WRITE(101,"('  Altitude:      ',f6.1)") rAltitude
 	WRITE(101,"('  An.height:     ',f5.1)") rAnemometerHeight
 	FLUSH(101)
@@ -204,6 +233,24 @@ PROGRAM eddy_cov
 	FLUSH(101)
 	! ENDTAG: P4
 	
+	! Prepare output file names
+	WRITE(sProcessedFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'p')") &
+		TRIM(sDataPath), iYear, iMonth, iDay, iHour
+	WRITE(sDiagnosticFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'd')") &
+		TRIM(sDataPath), iYear, iMonth, iDay, iHour
+	WRITE(sProcessedColFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'P')") &
+		TRIM(sDataPath), iYear, iMonth, iDay, iHour
+	WRITE(sDiagnosticColFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'D')") &
+		TRIM(sDataPath), iYear, iMonth, iDay, iHour
+	WRITE(sCheckpointFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'K')") &
+		TRIM(sDataPath), iYear, iMonth, iDay, iHour
+	WRITE(101,"('Output file names defined:')")
+	WRITE(101,"('  Processed data:  ',a)") TRIM(sProcessedFile)
+	WRITE(101,"('  Diagnostic data: ',a)") TRIM(sDiagnosticFile)
+	WRITE(101,"('  Processed data (columnar):  ',a)") TRIM(sProcessedColFile)
+	WRITE(101,"('  Diagnostic data (columnar): ',a)") TRIM(sDiagnosticColFile)
+	WRITE(101,"('  Checkpoint:      ',a)") TRIM(sCheckpointFile)
+	
 	! TAG: P5
 	! Compute number of blocks to process, and reserve block-related workspace
 	CALL PackTime(iCurTime, iYear, iMonth, iDay, iHour, iMinute, iSecond)
@@ -229,25 +276,46 @@ PROGRAM eddy_cov
 		rvUstarBase(iMaxBlock), rvUstarExtended(iMaxBlock), &
 		rvUstar(iMaxBlock), rvTstar(iMaxBlock), rvH0(iMaxBlock), &
 		rvZl(iMaxBlock), rvTKE(iMaxBlock), &
-		rvSigmaU(iMaxBlock), rvSigmaV(iMaxBlock), rvSigmaW(iMaxBlock), rvSigmaT(iMaxBlock) &
+		rvSigmaU(iMaxBlock), rvSigmaV(iMaxBlock), rvSigmaW(iMaxBlock), rvSigmaT(iMaxBlock), &
+		svBlockTime(iMaxBlock), svBlockWarning(iMaxBlock), lvRotated(iMaxBlock) &
 	)
+	svBlockWarning = ' '
+	lvRotated      = .FALSE.
 	! ENDTAG: P5
 	
+	! TAG: P5.1
+	! Resume from checkpoint, if it refers to this same hour and averaging time,
+	! covers fewer blocks than now desired, and its result files still exist:
+	! in this case only new blocks are computed, from raw data not consumed yet.
+	! Otherwise all blocks are computed from scratch, as usual.
+	iFirstBlock  = 1
+	iFirstRecord = 0
+	INQUIRE(FILE=sProcessedFile, EXIST=lIsFile)
+	IF(lIsFile) INQUIRE(FILE=sDiagnosticFile, EXIST=lIsFile)
+	IF(lIsFile) THEN
+		iRetCode = ReadCheckpoint(10, sCheckpointFile, iBlock, iFirstRecord)
+		IF(iRetCode == 0) THEN
+			iFirstBlock = iBlock + 1
+		ELSE
+			iFirstRecord = 0
+		END IF
+	END IF
+	WRITE(101,"('First block to compute: ',i2,'  (first raw record: ',i6,')')") iFirstBlock, iFirstRecord
+	FLUSH(101)
+	! ENDTAG: P5.1
+	
 	! TAG: P6
 	! Get input file
-	iRetCode = ReadInputFile(10, sInputFile, ivTime, rvU, rvV, rvW, rvT)
-	IF(iRetCode /= 0) THEN
+	iRetCode = ReadInputFile(10, sInputFile, iFirstRecord, ivTime, rvU, rvV, rvW, rvT, iaQuad, ivRecord, ivSecondBegin, iNumRecords)
+	IF(iRetCode == 2 .AND. iFirstBlock > 1) THEN
+		! No new data since checkpoint: new blocks will be empty
+		ALLOCATE(ivTime(0), rvU(0), rvV(0), rvW(0), rvT(0), iaQuad(0,4), ivRecord(0))
+		ivSecondBegin = 1
+	ELSEIF(iRetCode /= 0) THEN
 		PRINT *,'eddy_cov:: error: Input file not read (empty or missing)'
 		STOP
 	END IF
-	ALLOCATE( &
-		rvTrendlessU(SIZE(rvU)), rvTrendlessV(SIZE(rvV)), rvTrendlessW(SIZE(rvW)), rvTrendlessT(SIZE(rvT)), &
-		lvDesiredSubset(SIZE(ivTime)), lvValid(SIZE(ivTime)) &
-	)
-	rvTrendlessU = -9999.9
-	rvTrendlessV = -9999.9
-	rvTrendlessW = -9999.9
-	rvTrendlessT = -9999.9
+	ALLOCATE(lvValid(SIZE(ivTime)))
 	WRITE(101,"('Input file read')")
 	! ENDTAG: P6
 	
@@ -259,15 +327,6 @@ PROGRAM eddy_cov
 	WRITE(101,"('Valid data counted')")
 	! ENDTAG: P7
 	
-	! Prepare output file names
-	WRITE(sProcessedFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'p')") &
-		TRIM(sDataPath), iYear, iMonth, iDay, iHour
-	WRITE(sDiagnosticFile, "(a, '/', i4.4, 2i2.2, '.', i2.2, 'd')") &
-		TRIM(sDataPath), iYear, iMonth, iDay, iHour
-	WRITE(101,"('Output file names defined:')")
-	WRITE(101,"('  Processed data:  ',a)") TRIM(sProcessedFile)
-	WRITE(101,"('  Diagnostic data: ',a)") TRIM(sDiagnosticFile)
-	
 	! TAG: P8
 	! OK, now the context is clear. Inform users, by writing configuration and
 	! other data to file 'status.txt'
@@ -283,7 +342,7 @@ PROGRAM eddy_cov
 		WRITE(10, "('Input file:       ',a)") TRIM(sInputFile)
 		WRITE(10, "('Output file:      ',a)") TRIM(sProcessedFile)
 		WRITE(10, "('Diag file:        ',a)") TRIM(sDiagnosticFile)
-		WRITE(10, "('Data on input:    ',i5)") COUNT(lvDesiredSubset)
+		WRITE(10, "('Data on input:    ',i5)") SIZE(ivTime)
 		WRITE(10, "('Number of blocks: ',i2)") iMaxBlock
 		WRITE(10, "('Epoch of current time: ',i2)") iHourBegin
 	END IF
@@ -291,220 +350,36 @@ PROGRAM eddy_cov
 	! ENDTAG: P8
 
 	! TAG: P9
-	! Main loop: process blocks, in order
-	DO iBlock = 1, iMaxBlock
-	
+	! Main loop: process blocks not yet checkpointed. Blocks are independent,
+	! and are shared among threads: each one works on its own workspace and
+	! writes its own row of results only, so results do not depend on the
+	! number of threads. Status messages are written afterwards, in order.
+	!$OMP PARALLEL DO SCHEDULE(DYNAMIC)
+	DO iBlock = iFirstBlock, iMaxBlock
+		CALL ProcessBlock(iBlock)
+	END DO
+	!$OMP END PARALLEL DO
+	DO iBlock = iFirstBlock, iMaxBlock
 		WRITE(10, "(' ')")
 		WRITE(10, "('--> Now processing block ',i2)") iBlock
-		FLUSH(10)
-		
-		! TAG: P9.2
-		! Assign block time stamp
-		iBlockTime = iHourBegin + (iBlock-1)*iAveragingTime
-		ivTimeStamp(iBlock) = iBlockTime
-		CALL UnpackTime(iBlockTime, iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond)
-		WRITE(sBlockTime, "(i4.4,2('-',i2.2),1x,i2.2,2(':',i2.2))") &
-			iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
-		WRITE(10, "('    This block time: ',a)") TRIM(sBlockTime)
-		! ENDTAG: P9.2
-		
-		! TAG: P9.1
-		! Delimit current block
-		CALL GetTimeSubset(ivTime, iAveragingTime, iBlock, lvDesiredSubset, iRetCode)
-		iTotData = count(lvDesiredSubset)
-		lvDesiredSubset = lvDesiredSubset .AND. lvValid
-		iValidData = count(lvDesiredSubset)
-		ivTotData(iBlock) = iTotData
-		ivUsedData(iBlock) = iValidData
-		IF(COUNT(lvDesiredSubset) <= 0) THEN
-			WRITE(10, "('    Warning: no data in block')")
-			CYCLE
-		END IF
-		! ENDTAG: P9.1
-		
-		! TAG: P9.3
-		! Compute time stamp regularity indices
-		CALL CheckTimeRegularity(ivTime, lvDesiredSubset, iFrequency, iRegularityCode, iRetCode)
-		IF(iRetCode /= 0) THEN
-			WRITE(10, "('    Warning: block skipped because of sonic data regularity problem (most likely cause: RTC glitch)')")
-			CYCLE
-		END IF
-		FLUSH(10)
-		ivFrequency(iBlock)      = iFrequency
-		ivRegularityCode(iBlock) = iRegularityCode
-		! ENDTAG: P9.3
-		
-		! TAG: P9.4
-		! Compute data ranges
-		iRetCode = GetRange(rvU, lvDesiredSubset, rMinValue, rMaxValue)
-		IF(iRetCode /= 0) CYCLE
-		raMin(iBlock, 1) = rMinValue
-		raMax(iBlock, 1) = rMaxValue
-		iRetCode = GetRange(rvV, lvDesiredSubset, rMinValue, rMaxValue)
-		raMin(iBlock, 2) = rMinValue
-		raMax(iBlock, 2) = rMaxValue
-		iRetCode = GetRange(rvW, lvDesiredSubset, rMinValue, rMaxValue)
-		raMin(iBlock, 3) = rMinValue
-		raMax(iBlock, 3) = rMaxValue
-		iRetCode = GetRange(rvT, lvDesiredSubset, rMinValue, rMaxValue)
-		rvMinT(iBlock) = rMinValue
-		rvMaxT(iBlock) = rMaxValue
-		! ENDTAG: P9.4
-		
-		! TAG: P9.5
-		! Remove trend, if requested
-		IF(lDetrending .AND. iRegularityCode >= 3) THEN
-			CALL RemoveLinearTrend( &
-				ivTime, &
-				rvU, rvV, rvW, rvT, &
-				iFrequency, &
-				lvDesiredSubset, &
-				rvTrendlessU, rvTrendlessV, rvTrendlessW, rvTrendlessT, &
-				iRetCode &
-			)
-		ELSE
-			WHERE(lvDesiredSubset)
-				rvTrendlessU = rvU
-				rvTrendlessV = rvV
-				rvTrendlessW = rvW
-				rvTrendlessT = rvT
-			ENDWHERE
-		END IF
-		! ENDTAG: P9.5
-	
-		! TAG: P9.6
-		! Compute non-rotated averages and (co)variances
-		CALL Average(rvTrendlessU, lvDesiredSubset, raAvg(iBlock,1))
-		CALL Average(rvTrendlessV, lvDesiredSubset, raAvg(iBlock,2))
-		CALL Average(rvTrendlessW, lvDesiredSubset, raAvg(iBlock,3))
-		CALL Average(rvTrendlessT, lvDesiredSubset, rvAvgT(iBlock))
-		CALL Covariance(rvTrendlessU, rvTrendlessU, lvDesiredSubset, raAvg(iBlock,1), raAvg(iBlock,1), raCov(iBlock,1,1))
-		CALL Covariance(rvTrendlessU, rvTrendlessV, lvDesiredSubset, raAvg(iBlock,1), raAvg(iBlock,2), raCov(iBlock,1,2))
-		CALL Covariance(rvTrendlessU, rvTrendlessW, lvDesiredSubset, raAvg(iBlock,1), raAvg(iBlock,3), raCov(iBlock,1,3))
-		CALL Covariance(rvTrendlessV, rvTrendlessV, lvDesiredSubset, raAvg(iBlock,2), raAvg(iBlock,2), raCov(iBlock,2,2))
-		CALL Covariance(rvTrendlessV, rvTrendlessW, lvDesiredSubset, raAvg(iBlock,2), raAvg(iBlock,3), raCov(iBlock,2,3))
-		CALL Covariance(rvTrendlessW, rvTrendlessW, lvDesiredSubset, raAvg(iBlock,3), raAvg(iBlock,3), raCov(iBlock,3,3))
-		raCov(iBlock,2,1) = raCov(iBlock,1,2)
-		raCov(iBlock,3,1) = raCov(iBlock,1,3)
-		raCov(iBlock,3,2) = raCov(iBlock,2,3)
-		rvTKE(iBlock)     = (raCov(iBlock,1,1) + raCov(iBlock,2,2) + raCov(iBlock,3,3)) / 2.0
-		CALL Covariance(rvTrendlessU, rvTrendlessT, lvDesiredSubset, raAvg(iBlock,1), rvAvgT(iBlock), raCovT(iBlock,1))
-		CALL Covariance(rvTrendlessV, rvTrendlessT, lvDesiredSubset, raAvg(iBlock,2), rvAvgT(iBlock), raCovT(iBlock,2))
-		CALL Covariance(rvTrendlessW, rvTrendlessT, lvDesiredSubset, raAvg(iBlock,3), rvAvgT(iBlock), raCovT(iBlock,3))
-		CALL Covariance(rvTrendlessT, rvTrendlessT, lvDesiredSubset, rvAvgT(iBlock),  rvAvgT(iBlock), rvVarT(iBlock))
-		! ENDTAG: P9.6
-		
-		! TAG: P9.7
-		! Perform axis rotation
-		rmRot = RotationMatrix(iRotations, raAvg(iBlock,:), raCov(iBlock,:,:), rvTheta(iBlock), rvPhi(iBlock), rvPsi(iBlock))
-		rmAux                = MATMUL(rmRot,RESHAPE(raAvg(iBlock,:),(/3,1/)))
-		raRotAvg(iBlock,:)   = rmAux(:,1)
-		raRotCov(iBlock,:,:) = MATMUL(MATMUL(rmRot,raCov(iBlock,:,:)),TRANSPOSE(rmRot))
-		rmAux                = MATMUL(rmRot,RESHAPE(raCovT(iBlock,:),(/3,1/)))
-		raRotCovT(iBlock,:)  = rmAux(:,1)
-		! ENDTAG: P9.7
-		
-		! TAG: P9.8
-		! Compute non-turbulent wind statistics
-		iRetCode = WindStatistics( &
-			rvTrendlessU, rvTrendlessV, rvTrendlessW, &
-			lvDesiredSubset, &
-			rvVectorVel(iBlock), &
-			rvVectorDir(iBlock), &
-			rv3DVel(iBlock), &
-			rvScalarVel(iBlock), &
-			rvScalarVelStd(iBlock), &
-			rvUnitVectorDir(iBlock), &
-			rvEstSigmaDir(iBlock), &
-			rvPhiAngle(iBlock), &	
-			rvSigmaPhiAngle(iBlock), &
-			rvUnitVel(iBlock), &
-			rvDirCircVar(iBlock), &
-			rvDirCircStd(iBlock) &
-		)
-		IF(iRetCode /= 0) THEN
-			rvVectorVel(iBlock)     = -9999.9
-			rvVectorDir(iBlock)     = -9999.9
-			rv3DVel(iBlock)         = -9999.9
-			rvScalarVel(iBlock)     = -9999.9
-			rvScalarVelStd(iBlock)  = -9999.9
-			rvUnitVectorDir(iBlock) = -9999.9
-			rvEstSigmaDir(iBlock)   = -9999.9
-			rvPhiAngle(iBlock)      = -9999.9
-			rvSigmaPhiAngle(iBlock) = -9999.9
-			rvUnitVel(iBlock)       = -9999.9
-			rvDirCircVar(iBlock)    = -9999.9
-			rvDirCircStd(iBlock)    = -9999.9
-		END IF
-		iRetCode = WindDirClassify( &
-			rvTrendlessU, rvTrendlessV, &
-			lvDesiredSubset, &
-			iaDirClass(iBlock,:), &
-			rvDominantDir(iBlock) &
-		)
-		IF(iRetCode /= 0) THEN
-			iaDirClass(iBlock,:)  = -9999
-			rvDominantDir(iBlock) = -9999.9
-		END IF
-		! ENDTAG: P9.8
-		
-		! TAG: P9.9
-		! Compute turbulence indices
-		iRetCode = BasicTurbulence( &
-			rAltitude, &
-			rAnemometerHeight, &
-			rvAvgT(iBlock), &
-			raRotCov(iBlock,:,:), &
-			raRotCovT(iBlock,:), &
-			rvVarT(iBlock), &
-			rvUstar(iBlock), &
-			rvTstar(iBlock), &
-			rvH0(iBlock), &
-			rvZl(iBlock), &
-			rvTKE(iBlock), &
-			rvSigmaU(iBlock), &
-			rvSigmaV(iBlock), &
-			rvSigmaW(iBlock), &
-			rvSigmaT(iBlock) &
-		)
-		IF(iRetCode == 0) THEN
-			rvUstarBase(iBlock) = SIGN( &
-				SQRT(ABS(raRotCov(iBlock,1,3))), &
-				raRotCov(iBlock,1,3) &
-			)
-			rvUstarExtended(iBlock) = SIGN( &
-				(raRotCov(iBlock,1,3)**2 + raRotCov(iBlock,2,3)**2)**0.25, &
-				raRotCov(iBlock,1,3) &
-			)
-		ELSE
-			rvAvgT(iBlock)          = -9999.9
-			raRotCov(iBlock,:,:)    = -9999.9
-			rvUstar(iBlock)         = -9999.9
-			rvUstarBase(iBlock)     = -9999.9
-			rvUstarExtended(iBlock) = -9999.9
-			rvTstar(iBlock)         = -9999.9
-			rvH0(iBlock)            = -9999.9
-			rvZl(iBlock)            = -9999.9
-			rvTKE(iBlock)           = -9999.9
-			rvSigmaU(iBlock)        = -9999.9
-			rvSigmaV(iBlock)        = -9999.9
-			rvSigmaW(iBlock)        = -9999.9
-			rvSigmaT(iBlock)        = -9999.9
-		END IF
-		! ENDTAG: P9.9
-		
+		WRITE(10, "('    This block time: ',a)") TRIM(svBlockTime(iBlock))
+		IF(LEN_TRIM(svBlockWarning(iBlock)) > 0) WRITE(10, "('    Warning: ',a)") TRIM(svBlockWarning(iBlock))
 	END DO
 	CLOSE(10)
 	! ENDTAG: P9
 	
 	! TAG: P10
-	! Write main result file
-	OPEN(10, FILE=sProcessedFile, STATUS='UNKNOWN', ACTION='WRITE', IOSTAT=iRetCode)
+	! Write main result file (when resuming from checkpoint, new blocks only are appended)
+	IF(iFirstBlock > 1) THEN
+		OPEN(10, FILE=sProcessedFile, STATUS='OLD', ACTION='WRITE', POSITION='APPEND', IOSTAT=iRetCode)
+	ELSE
+		OPEN(10, FILE=sProcessedFile, STATUS='UNKNOWN', ACTION='WRITE', IOSTAT=iRetCode)
+	END IF
 	IF(iRetCode /= 0) THEN
 		PRINT *,"eddy_cov:: error: Impossible to write main result file"
 		STOP
 	END IF
-	WRITE(10,"(a,31(',',a))") &
+	IF(iFirstBlock <= 1) WRITE(10,"(a,31(',',a))") &
 		'Date.Time', 'Tot.Data', 'Valid.Data', &
 		'Vel', 'Vector.Vel', 'Scalar.Vel', 'Scalar.Std', &
 		'Dir', 'Unit.Vector.Dir', 'Yamartino.Std.Dir', &
@@ -519,7 +394,7 @@ PROGRAM eddy_cov
 		! Write final data, provided "enough" raw data have been found on this
 		! specific slice.
 		iMaxTimeStamp = 0
-		DO iBlock = 1, iMaxBlock
+		DO iBlock = iFirstBlock, iMaxBlock
 			CALL UnpackTime(ivTimeStamp(iBlock), iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond)
 			IF(ivTimeStamp(iBlock) > 0) THEN
 				IF(ivUsedData(iBlock) > 1) THEN
@@ -560,13 +435,17 @@ PROGRAM eddy_cov
 	! ENDTAG: P11
 	
 	! TAG: P12
-	! Write diagnostic file
-	OPEN(10, FILE=sDiagnosticFile, STATUS='UNKNOWN', ACTION='WRITE', IOSTAT=iRetCode)
+	! Write diagnostic file (when resuming from checkpoint, new blocks only are appended)
+	IF(iFirstBlock > 1) THEN
+		OPEN(10, FILE=sDiagnosticFile, STATUS='OLD', ACTION='WRITE', POSITION='APPEND', IOSTAT=iRetCode)
+	ELSE
+		OPEN(10, FILE=sDiagnosticFile, STATUS='UNKNOWN', ACTION='WRITE', IOSTAT=iRetCode)
+	END IF
 	IF(iRetCode /= 0) THEN
 		PRINT *,"eddy_cov:: error: Impossible to write diagnostic file"
 		STOP
 	END IF
-	WRITE(10,"(a,66(',',a))") &
+	IF(iFirstBlock <= 1) WRITE(10,"(a,66(',',a))") &
 		'Date.Time', 'Tot.Data', 'Valid.Data', &
 		'N.Dir.N', 'N.Dir.NNE', 'N.Dir.NE', 'N.Dir.ENE', &
 		'N.Dir.E', 'N.Dir.ESE', 'N.Dir.SE', 'N.Dir.SSE', &
@@ -584,7 +463,7 @@ PROGRAM eddy_cov
 		'Ustar.Base', 'Ustar.Extended', &
 		'Theta', 'Phi', 'Psi', &
 		'Eff.W', 'Q', 'C'
-		DO iBlock = 1, iMaxBlock
+		DO iBlock = iFirstBlock, iMaxBlock
 			IF(ivTimeStamp(iBlock) > 0) THEN
 				CALL UnpackTime(ivTimeStamp(iBlock), iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond)
 				IF(ivUsedData(iBlock) > 1) THEN
@@ -640,6 +519,166 @@ PROGRAM eddy_cov
 	CALL SYSTEM(sCommand)
 	! ENDTAG: P12.1
 	
+	! TAG: P12.2
+	! Write binary columnar copies of main and diagnostic results (invalid
+	! blocks get the same -9999.9 values as in text files); placeholder
+	! columns of text files, not yet computed, are not replicated here.
+	ALLOCATE(lvRow(iMaxBlock), lvGood(iMaxBlock))
+	lvRow    = ivTimeStamp > 0
+	lvGood   = ivUsedData > 1
+	iNumRows = COUNT(lvRow)
+	! -1- Main results
+	svColNames = [CHARACTER(LEN=COL_NAME_LEN) :: &
+		'Time.Stamp', 'Tot.Data', 'Valid.Data', &
+		'Vel', 'Vector.Vel', 'Scalar.Vel', 'Scalar.Std', &
+		'Dir', 'Unit.Vector.Dir', 'Yamartino.Std.Dir', &
+		'Temp', &
+		'Phi.Angle', 'Sigma.Phi.Angle', &
+		'Sigma.U', 'Sigma.V', 'Sigma.W', 'Sigma.T', &
+		'Theta', 'Phi', 'Psi', &
+		'TKE', 'U.star', 'T.star', 'z.L', &
+		'H0' &
+	]
+	ALLOCATE(ivColTypes(SIZE(svColNames)))
+	ivColTypes      = COL_REAL
+	ivColTypes(1:3) = COL_INTEGER
+	iRetCode = ColOpen(10, sProcessedColFile, svColNames, ivColTypes, iNumRows)
+	IF(iRetCode /= 0) THEN
+		PRINT *,"eddy_cov:: warning: Impossible to write columnar result file"
+	ELSE
+		CALL ColWriteInteger(10, PACK(ivTimeStamp, lvRow))
+		CALL ColWriteInteger(10, PACK(ivTotData, lvRow))
+		CALL ColWriteInteger(10, PACK(ivUsedData, lvRow))
+		CALL ColWriteReal(10, ValidColumn(rvVectorVel))
+		CALL ColWriteReal(10, ValidColumn(rv3DVel))
+		CALL ColWriteReal(10, ValidColumn(rvScalarVel))
+		CALL ColWriteReal(10, ValidColumn(rvScalarVelStd))
+		CALL ColWriteReal(10, ValidColumn(rvVectorDir))
+		CALL ColWriteReal(10, ValidColumn(rvUnitVectorDir))
+		CALL ColWriteReal(10, ValidColumn(rvEstSigmaDir))
+		CALL ColWriteReal(10, ValidColumn(rvAvgT))
+		CALL ColWriteReal(10, ValidColumn(rvPhiAngle))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaPhiAngle))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaU))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaV))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaW))
+		CALL ColWriteReal(10, ValidColumn(rvSigmaT))
+		CALL ColWriteReal(10, ValidColumn(rvTheta))
+		CALL ColWriteReal(10, ValidColumn(rvPhi))
+		CALL ColWriteReal(10, ValidColumn(rvPsi))
+		CALL ColWriteReal(10, ValidColumn(rvTKE))
+		CALL ColWriteReal(10, ValidColumn(rvUstar))
+		CALL ColWriteReal(10, ValidColumn(rvTstar))
+		CALL ColWriteReal(10, ValidColumn(rvZl))
+		CALL ColWriteReal(10, ValidColumn(rvH0))
+		CALL ColClose(10)
+	END IF
+	DEALLOCATE(svColNames, ivColTypes)
+	! -1- Diagnostic results
+	svColNames = [CHARACTER(LEN=COL_NAME_LEN) :: &
+		'Time.Stamp', 'Tot.Data', 'Valid.Data', &
+		'N.Dir.N', 'N.Dir.NNE', 'N.Dir.NE', 'N.Dir.ENE', &
+		'N.Dir.E', 'N.Dir.ESE', 'N.Dir.SE', 'N.Dir.SSE', &
+		'N.Dir.S', 'N.Dir.SSW', 'N.Dir.SW', 'N.Dir.WSW', &
+		'N.Dir.W', 'N.Dir.WNW', 'N.Dir.NW', 'N.Dir.NNW', &
+		'Dominant.Dir', &
+		'Vel', 'Dir', 'U', 'V', 'W', 'T', 'r', 'Circ.Var', 'Circ.Std', &
+		'Range.U', 'Range.V', 'Range.W', 'Range.T', &
+		'Nrot.Sigma2.U', 'Nrot.Sigma2.V', 'Nrot.Sigma2.W', &
+		'Nrot.Cov.UV', 'Nrot.Cov.UW', 'Nrot.Cov.VW', &
+		'Nrot.Cov.UT', 'Nrot.Cov.VT', 'Nrot.Cov.WT', &
+		'Rot.Sigma2.U', 'Rot.Sigma2.V', 'Rot.Sigma2.W', &
+		'Rot.Cov.UV', 'Rot.Cov.UW', 'Rot.Cov.VW', &
+		'Rot.Cov.UT', 'Rot.Cov.VT', 'Rot.Cov.WT', &
+		'Ustar.Base', 'Ustar.Extended', &
+		'Theta', 'Phi', 'Psi' &
+	]
+	ALLOCATE(ivColTypes(SIZE(svColNames)))
+	ivColTypes       = COL_REAL
+	ivColTypes(1:19) = COL_INTEGER
+	iRetCode = ColOpen(10, sDiagnosticColFile, svColNames, ivColTypes, iNumRows)
+	IF(iRetCode /= 0) THEN
+		PRINT *,"eddy_cov:: warning: Impossible to write columnar diagnostic file"
+	ELSE
+		CALL ColWriteInteger(10, PACK(ivTimeStamp, lvRow))
+		CALL ColWriteInteger(10, PACK(ivTotData, lvRow))
+		CALL ColWriteInteger(10, PACK(ivUsedData, lvRow))
+		DO iDir = 1, 16
+			CALL ColWriteInteger(10, PACK(MERGE(iaDirClass(:,iDir), -9999, lvGood), lvRow))
+		END DO
+		CALL ColWriteReal(10, ValidColumn(rvDominantDir))
+		CALL ColWriteReal(10, ValidColumn(rvVectorVel))
+		CALL ColWriteReal(10, ValidColumn(rvVectorDir))
+		CALL ColWriteReal(10, ValidColumn(raAvg(:,1)))
+		CALL ColWriteReal(10, ValidColumn(raAvg(:,2)))
+		CALL ColWriteReal(10, ValidColumn(raAvg(:,3)))
+		CALL ColWriteReal(10, ValidColumn(rvAvgT))
+		CALL ColWriteReal(10, ValidColumn(rvUnitVel))
+		CALL ColWriteReal(10, ValidColumn(rvDirCircVar))
+		CALL ColWriteReal(10, ValidColumn(rvDirCircStd))
+		CALL ColWriteReal(10, ValidColumn(raMax(:,1) - raMin(:,1)))
+		CALL ColWriteReal(10, ValidColumn(raMax(:,2) - raMin(:,2)))
+		CALL ColWriteReal(10, ValidColumn(raMax(:,3) - raMin(:,3)))
+		CALL ColWriteReal(10, ValidColumn(rvMaxT - rvMinT))
+		CALL ColWriteReal(10, ValidColumn(raCov(:,1,1)))
+		CALL ColWriteReal(10, ValidColumn(raCov(:,2,2)))
+		CALL ColWriteReal(10, ValidColumn(raCov(:,3,3)))
+		CALL ColWriteReal(10, ValidColumn(raCov(:,1,2)))
+		CALL ColWriteReal(10, ValidColumn(raCov(:,1,3)))
+		CALL ColWriteReal(10, ValidColumn(raCov(:,2,3)))
+		CALL ColWriteReal(10, ValidColumn(raCovT(:,1)))
+		CALL ColWriteReal(10, ValidColumn(raCovT(:,2)))
+		CALL ColWriteReal(10, ValidColumn(raCovT(:,3)))
+		CALL ColWriteReal(10, ValidColumn(raRotCov(:,1,1)))
+		CALL ColWriteReal(10, ValidColumn(raRotCov(:,2,2)))
+		CALL ColWriteReal(10, ValidColumn(raRotCov(:,3,3)))
+		CALL ColWriteReal(10, ValidColumn(raRotCov(:,1,2)))
+		CALL ColWriteReal(10, ValidColumn(raRotCov(:,1,3)))
+		CALL ColWriteReal(10, ValidColumn(raRotCov(:,2,3)))
+		CALL ColWriteReal(10, ValidColumn(raRotCovT(:,1)))
+		CALL ColWriteReal(10, ValidColumn(raRotCovT(:,2)))
+		CALL ColWriteReal(10, ValidColumn(raRotCovT(:,3)))
+		CALL ColWriteReal(10, ValidColumn(rvUstarBase))
+		CALL ColWriteReal(10, ValidColumn(rvUstarExtended))
+		CALL ColWriteReal(10, ValidColumn(rvTheta))
+		CALL ColWriteReal(10, ValidColumn(rvPhi))
+		CALL ColWriteReal(10, ValidColumn(rvPsi))
+		CALL ColClose(10)
+	END IF
+	DEALLOCATE(svColNames, ivColTypes)
+	! ENDTAG: P12.2
+	
+	! TAG: P12.3
+	! Checkpoint the blocks ending at or before the last second read, along
+	! with the first raw record belonging to blocks still to come: the last
+	! block is often partly filled, and will be computed again on next run
+	IF(SIZE(ivTime) > 0) THEN
+		iDoneBlocks = MIN(iMaxBlock, (MAXVAL(ivTime) + 1) / iAveragingTime)
+	ELSE
+		iDoneBlocks = 0
+	END IF
+	iDoneBlocks  = MAX(iDoneBlocks, iFirstBlock - 1)
+	iFirstRecord = MIN(iNumRecords, MINVAL(ivRecord(ivSecondBegin(iDoneBlocks*iAveragingTime):)))
+	iRetCode = WriteCheckpoint(10, sCheckpointFile, iDoneBlocks, iFirstRecord)
+	IF(iRetCode /= 0) THEN
+		PRINT *,"eddy_cov:: warning: Impossible to write checkpoint file"
+	END IF
+	! ENDTAG: P12.3
+	
+	! TAG: P12.4
+	! Account new blocks for planar fit, in time order, and save its state for
+	! next runs (blocks already accounted by previous runs are ignored)
+	IF(iRotations == 4) THEN
+		DO iBlock = iFirstBlock, iMaxBlock
+			IF(lvRotated(iBlock)) CALL PlanarFitAdd(tFit, ivTimeStamp(iBlock), raAvg(iBlock,:))
+		END DO
+		iRetCode = PlanarFitWrite(10, sPlanarFitFile, tFit)
+		IF(iRetCode /= 0) THEN
+			PRINT *,"eddy_cov:: warning: Impossible to write planar fit file"
+		END IF
+	END IF
+	! ENDTAG: P12.4
+	
 	! TAG: P13
 	! At this point processing has completed successfully. If also last
 	! data average in hour, start program to dispatch data to final destinations.
@@ -667,82 +706,468 @@ PROGRAM eddy_cov
 	
 CONTAINS
 	
-	FUNCTION ReadInputFile(iLUN, sInputFile, ivTime, rvU, rvV, rvW, rvT) RESULT(iRetCode)
+	! Process one averaging block, storing results at its index of data set
+	! arrays. Blocks are processed concurrently: anything else a block changes
+	! is local to this routine.
+	SUBROUTINE ProcessBlock(iBlock)
+	
+		! Routine arguments
+		INTEGER, INTENT(IN)					:: iBlock
+		
+		! Locals
+		CHARACTER(LEN=20)					:: sBlockTime
+		INTEGER								:: iBlockTime
+		INTEGER								:: iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
+		INTEGER								:: iBlockBegin		! First datum in block
+		INTEGER								:: iBlockEnd		! Last datum in block
+		INTEGER								:: iTotData
+		INTEGER								:: iValidData
+		INTEGER								:: iFrequency
+		INTEGER								:: iRegularityCode
+		INTEGER								:: iRetCode
+		LOGICAL, DIMENSION(:), ALLOCATABLE	:: lvDesiredSubset
+		REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessU
+		REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessV
+		REAL, DIMENSION(:), ALLOCATABLE		:: rvTrendlessW
+		LOGICAL								:: lDetrendBlock
+		REAL, DIMENSION(4)					:: rvBlockMin		! Block statistics of u, v, w, t
+		REAL, DIMENSION(4)					:: rvBlockMax
+		REAL, DIMENSION(4)					:: rvBlockAvg
+		REAL, DIMENSION(4,4)				:: rmBlockCov
+		REAL, DIMENSION(4)					:: rvBlockSlope
+		REAL								:: rIndexAvg
+		REAL, DIMENSION(3,3)				:: rmRot
+		REAL, DIMENSION(3,1)				:: rmAux
+		
+		! TAG: P9.2
+		! Assign block time stamp
+		iBlockTime = iHourBegin + (iBlock-1)*iAveragingTime
+		ivTimeStamp(iBlock) = iBlockTime
+		CALL UnpackTime(iBlockTime, iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond)
+		WRITE(sBlockTime, "(i4.4,2('-',i2.2),1x,i2.2,2(':',i2.2))") &
+			iBlockYear, iBlockMonth, iBlockDay, iBlockHour, iBlockMinute, iBlockSecond
+		svBlockTime(iBlock) = sBlockTime
+		! ENDTAG: P9.2
+		
+		! TAG: P9.1
+		! Delimit current block: data are in time stamp order, so the block
+		! is the contiguous run [iBlockBegin, iBlockEnd] given by the index;
+		! its subset and trendless components are in block workspace
+		iBlockBegin = ivSecondBegin(iAveragingTime*(iBlock-1))
+		iBlockEnd   = ivSecondBegin(iAveragingTime*iBlock) - 1
+		iTotData    = iBlockEnd - iBlockBegin + 1
+		ALLOCATE(lvDesiredSubset(iTotData), rvTrendlessU(iTotData), rvTrendlessV(iTotData), rvTrendlessW(iTotData))
+		lvDesiredSubset = lvValid(iBlockBegin:iBlockEnd)
+		rvTrendlessU    = -9999.9
+		rvTrendlessV    = -9999.9
+		rvTrendlessW    = -9999.9
+		iValidData  = COUNT(lvDesiredSubset)
+		ivTotData(iBlock) = iTotData
+		ivUsedData(iBlock) = iValidData
+		IF(iValidData <= 0) THEN
+			svBlockWarning(iBlock) = 'no data in block'
+			RETURN
+		END IF
+		! ENDTAG: P9.1
+		
+		! TAG: P9.3
+		! Compute time stamp regularity indices
+		CALL CheckTimeRegularity(ivTime(iBlockBegin:iBlockEnd), lvDesiredSubset, iFrequency, iRegularityCode, iRetCode)
+		IF(iRetCode /= 0) THEN
+			svBlockWarning(iBlock) = 'block skipped because of sonic data regularity problem (most likely cause: RTC glitch)'
+			RETURN
+		END IF
+		ivFrequency(iBlock)      = iFrequency
+		ivRegularityCode(iBlock) = iRegularityCode
+		! ENDTAG: P9.3
+		
+		! TAG: P9.4
+		! Compute data ranges, averages and (co)variances in a single sweep, removing
+		! linear trend if requested
+		lDetrendBlock = lDetrending .AND. iRegularityCode >= 3
+		IF(lExactMoments) THEN
+			iRetCode = BlockStatisticsExact( &
+				iaQuad(iBlockBegin:iBlockEnd,:), &
+				lvDesiredSubset, &
+				lDetrendBlock, &
+				rvBlockMin, rvBlockMax, rvBlockAvg, &
+				rmBlockCov, &
+				rvBlockSlope, rIndexAvg &
+			)
+		ELSE
+			iRetCode = BlockStatistics( &
+				rvU(iBlockBegin:iBlockEnd), rvV(iBlockBegin:iBlockEnd), rvT(iBlockBegin:iBlockEnd), &
+				lvDesiredSubset, &
+				lDetrendBlock, &
+				rvBlockMin, rvBlockMax, rvBlockAvg, &
+				rmBlockCov, &
+				rvBlockSlope, rIndexAvg, &
+				rvW=rvW(iBlockBegin:iBlockEnd) &
+			)
+		END IF
+		IF(iRetCode /= 0) RETURN
+		raMin(iBlock,:)   = rvBlockMin(1:3)
+		raMax(iBlock,:)   = rvBlockMax(1:3)
+		rvMinT(iBlock)    = rvBlockMin(4)
+		rvMaxT(iBlock)    = rvBlockMax(4)
+		raAvg(iBlock,:)   = rvBlockAvg(1:3)
+		rvAvgT(iBlock)    = rvBlockAvg(4)
+		raCov(iBlock,:,:) = rmBlockCov(1:3,1:3)
+		raCovT(iBlock,:)  = rmBlockCov(1:3,4)
+		rvVarT(iBlock)    = rmBlockCov(4,4)
+		rvTKE(iBlock)     = (raCov(iBlock,1,1) + raCov(iBlock,2,2) + raCov(iBlock,3,3)) / 2.0
+		! ENDTAG: P9.4
+		
+		! TAG: P9.5
+		! Get wind components deprived of their trend (if any was estimated), for
+		! use by wind statistics
+		CALL RemoveBlockTrend(rvU(iBlockBegin:iBlockEnd), lvDesiredSubset, rvBlockSlope(1), rIndexAvg, rvTrendlessU)
+		CALL RemoveBlockTrend(rvV(iBlockBegin:iBlockEnd), lvDesiredSubset, rvBlockSlope(2), rIndexAvg, rvTrendlessV)
+		CALL RemoveBlockTrend(rvW(iBlockBegin:iBlockEnd), lvDesiredSubset, rvBlockSlope(3), rIndexAvg, rvTrendlessW)
+		! ENDTAG: P9.5
+		
+		! TAG: P9.7
+		! Perform axis rotation; by planar fit, sectors not fitted yet fall back
+		! to double rotation
+		IF(iRotations == 4) THEN
+			iRetCode = PlanarFitMatrix(tFit, raAvg(iBlock,:), rmRot, rvTheta(iBlock), rvPhi(iBlock), rvPsi(iBlock))
+			IF(iRetCode /= 0) THEN
+				rmRot = RotationMatrix(2, raAvg(iBlock,:), raCov(iBlock,:,:), rvTheta(iBlock), rvPhi(iBlock), rvPsi(iBlock))
+				svBlockWarning(iBlock) = 'planar fit not yet available for wind sector: double rotation used'
+			END IF
+		ELSE
+			rmRot = RotationMatrix(iRotations, raAvg(iBlock,:), raCov(iBlock,:,:), rvTheta(iBlock), rvPhi(iBlock), rvPsi(iBlock))
+		END IF
+		lvRotated(iBlock)    = .TRUE.
+		rmAux                = MATMUL(rmRot,RESHAPE(raAvg(iBlock,:),(/3,1/)))
+		raRotAvg(iBlock,:)   = rmAux(:,1)
+		raRotCov(iBlock,:,:) = MATMUL(MATMUL(rmRot,raCov(iBlock,:,:)),TRANSPOSE(rmRot))
+		rmAux                = MATMUL(rmRot,RESHAPE(raCovT(iBlock,:),(/3,1/)))
+		raRotCovT(iBlock,:)  = rmAux(:,1)
+		! ENDTAG: P9.7
+		
+		! TAG: P9.8
+		! Compute non-turbulent wind statistics
+		iRetCode = WindStatistics( &
+			rvTrendlessU, rvTrendlessV, rvTrendlessW, &
+			lvDesiredSubset, &
+			rvVectorVel(iBlock), &
+			rvVectorDir(iBlock), &
+			rv3DVel(iBlock), &
+			rvScalarVel(iBlock), &
+			rvScalarVelStd(iBlock), &
+			rvUnitVectorDir(iBlock), &
+			rvEstSigmaDir(iBlock), &
+			rvPhiAngle(iBlock), &	
+			rvSigmaPhiAngle(iBlock), &
+			rvUnitVel(iBlock), &
+			rvDirCircVar(iBlock), &
+			rvDirCircStd(iBlock) &
+		)
+		IF(iRetCode /= 0) THEN
+			rvVectorVel(iBlock)     = -9999.9
+			rvVectorDir(iBlock)     = -9999.9
+			rv3DVel(iBlock)         = -9999.9
+			rvScalarVel(iBlock)     = -9999.9
+			rvScalarVelStd(iBlock)  = -9999.9
+			rvUnitVectorDir(iBlock) = -9999.9
+			rvEstSigmaDir(iBlock)   = -9999.9
+			rvPhiAngle(iBlock)      = -9999.9
+			rvSigmaPhiAngle(iBlock) = -9999.9
+			rvUnitVel(iBlock)       = -9999.9
+			rvDirCircVar(iBlock)    = -9999.9
+			rvDirCircStd(iBlock)    = -9999.9
+		END IF
+		iRetCode = WindDirClassify( &
+			rvTrendlessU, rvTrendlessV, &
+			lvDesiredSubset, &
+			iaDirClass(iBlock,:), &
+			rvDominantDir(iBlock) &
+		)
+		IF(iRetCode /= 0) THEN
+			iaDirClass(iBlock,:)  = -9999
+			rvDominantDir(iBlock) = -9999.9
+		END IF
+		! ENDTAG: P9.8
+		
+		! TAG: P9.9
+		! Compute turbulence indices
+		iRetCode = BasicTurbulence( &
+			rAltitude, &
+			rAnemometerHeight, &
+			rvAvgT(iBlock), &
+			raRotCov(iBlock,:,:), &
+			raRotCovT(iBlock,:), &
+			rvVarT(iBlock), &
+			rvUstar(iBlock), &
+			rvTstar(iBlock), &
+			rvH0(iBlock), &
+			rvZl(iBlock), &
+			rvTKE(iBlock), &
+			rvSigmaU(iBlock), &
+			rvSigmaV(iBlock), &
+			rvSigmaW(iBlock), &
+			rvSigmaT(iBlock) &
+		)
+		IF(iRetCode == 0) THEN
+			rvUstarBase(iBlock) = SIGN( &
+				SQRT(ABS(raRotCov(iBlock,1,3))), &
+				raRotCov(iBlock,1,3) &
+			)
+			rvUstarExtended(iBlock) = SIGN( &
+				(raRotCov(iBlock,1,3)**2 + raRotCov(iBlock,2,3)**2)**0.25, &
+				raRotCov(iBlock,1,3) &
+			)
+		ELSE
+			rvAvgT(iBlock)          = -9999.9
+			raRotCov(iBlock,:,:)    = -9999.9
+			rvUstar(iBlock)         = -9999.9
+			rvUstarBase(iBlock)     = -9999.9
+			rvUstarExtended(iBlock) = -9999.9
+			rvTstar(iBlock)         = -9999.9
+			rvH0(iBlock)            = -9999.9
+			rvZl(iBlock)            = -9999.9
+			rvTKE(iBlock)           = -9999.9
+			rvSigmaU(iBlock)        = -9999.9
+			rvSigmaV(iBlock)        = -9999.9
+			rvSigmaW(iBlock)        = -9999.9
+			rvSigmaT(iBlock)        = -9999.9
+		END IF
+		! ENDTAG: P9.9
+		
+	END SUBROUTINE ProcessBlock
+	
+	
+	! Columnar output support: values of rows written (blocks with a time
+	! stamp), with invalid blocks set to -9999.9
+	FUNCTION ValidColumn(rvValues) RESULT(rvColumn)
+	
+		! Routine arguments
+		REAL, DIMENSION(:), INTENT(IN)	:: rvValues
+		REAL, DIMENSION(:), ALLOCATABLE	:: rvColumn
+		
+		! Locals
+		! -none-
+		
+		! Get the information desired
+		rvColumn = PACK(MERGE(rvValues, -9999.9, lvGood), lvRow)
+		
+	END FUNCTION ValidColumn
+	
+	
+	! Raw data are read in a single pass, and sonic data are stored in time
+	! stamp order (stable counting sort on second of hour: data arriving in
+	! order keep it). On exit ivSecondBegin(s) is the index of the first datum
+	! whose time stamp is s or more, so any time interval [s1, s2) of the hour
+	! is the contiguous run ivSecondBegin(s1):ivSecondBegin(s2)-1.
+	FUNCTION ReadInputFile( &
+		iLUN, sInputFile, iFirstRecord, &
+		ivTime, rvU, rvV, rvW, rvT, &
+		iaQuad, ivRecord, ivSecondBegin, &
+		iNumRecords &
+	) RESULT(iRetCode)
 	
 		! Routine arguments
 		INTEGER, INTENT(IN)								:: iLUN
 		CHARACTER(LEN=*), INTENT(IN)					:: sInputFile
+		INTEGER, INTENT(IN)								:: iFirstRecord	! Records before this one (0-based) are skipped
 		INTEGER, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: ivTime
 		REAL, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: rvU
 		REAL, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: rvV
 		REAL, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: rvW
 		REAL, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: rvT
+		INTEGER(2), DIMENSION(:,:), ALLOCATABLE, INTENT(OUT)	:: iaQuad	! Raw u, v, w, t of each datum
+		INTEGER, DIMENSION(:), ALLOCATABLE, INTENT(OUT)	:: ivRecord		! Record index (0-based) of each datum
+		INTEGER, DIMENSION(0:3601), INTENT(OUT)			:: ivSecondBegin
+		INTEGER, INTENT(OUT)							:: iNumRecords	! Records in file
 		INTEGER											:: iRetCode
 		
 		! Locals
-		INTEGER		:: iErrCode
-		INTEGER		:: iNumData
-		INTEGER		:: iData
-		INTEGER(2)	:: iTimeStamp, iU, iV, iW, iT
+		INTEGER									:: iErrCode
+		INTEGER									:: iFileSize
+		INTEGER									:: iFirst
+		INTEGER									:: iNumRead
+		INTEGER									:: iNumData
+		INTEGER									:: iData
+		INTEGER									:: iRecord
+		INTEGER									:: iSecond
+		INTEGER(2), DIMENSION(:,:), ALLOCATABLE	:: iaRaw
+		INTEGER, DIMENSION(0:3601)				:: ivNext
 		
 		! Assume success (will falsify on failure)
 		iRetCode = 0
+		iNumRecords = 0
+		ivSecondBegin = 1
 		
-		! Count how many data are available, and reserve workspace based on this information
+		! Get all records not yet consumed, at once
 		OPEN(iLUN, FILE=sInputFile, STATUS='OLD', ACTION='READ', ACCESS='STREAM', IOSTAT=iErrCode)
 		IF(iErrCode /= 0) THEN
 			iRetCode = 1
 			CLOSE(iLUN)
 			RETURN
 		END IF
-		iNumData = 0
-		DO
-			
-			! Get data in binary form
-			READ(10, IOSTAT=iErrCode) iTimeStamp, iV, iU, iW, iT
-			IF(iErrCode /= 0) EXIT
-			
-			! Retain data record pertaining to sonic quadruples only
-			IF(iTimeStamp > 3600 .OR. iTimeStamp < 0) CYCLE
-			iNumData = iNumData + 1
-			
+		INQUIRE(UNIT=iLUN, SIZE=iFileSize)
+		iNumRecords = MAX(iFileSize, 0) / 10
+		iFirst      = MIN(MAX(iFirstRecord, 0), iNumRecords)
+		iNumRead    = iNumRecords - iFirst
+		ALLOCATE(iaRaw(5, iNumRead))
+		IF(iNumRead > 0) THEN
+			READ(iLUN, POS=10*iFirst+1, IOSTAT=iErrCode) iaRaw
+			IF(iErrCode /= 0) THEN
+				iRetCode = 1
+				CLOSE(iLUN)
+				RETURN
+			END IF
+		END IF
+		CLOSE(iLUN)
+		
+		! Count sonic data per second of hour (other records are not sonic quadruples),
+		! and turn counts into positions
+		ivNext = 0
+		DO iRecord = 1, iNumRead
+			iSecond = iaRaw(1, iRecord)
+			IF(iSecond > 3600 .OR. iSecond < 0) CYCLE
+			ivNext(iSecond) = ivNext(iSecond) + 1
 		END DO
+		iNumData = SUM(ivNext)
 		IF(iNumData <= 0) THEN
 			iRetCode = 2
-			CLOSE(iLUN)
 			RETURN
 		END IF
-		ALLOCATE(ivTime(iNumData), rvU(iNumData), rvV(iNumData), rvW(iNumData), rvT(iNumData))
-		REWIND(iLUN)
+		DO iSecond = 1, 3601
+			ivSecondBegin(iSecond) = ivSecondBegin(iSecond-1) + ivNext(iSecond-1)
+		END DO
+		ivNext = ivSecondBegin
 		
-		! Perform actual data read
-		iData = 0
-		DO
-			
-			! Get data in binary form
-			READ(10, IOSTAT=iErrCode) iTimeStamp, iU, iV, iW, iT
-			IF(iErrCode /= 0) EXIT
-			
-			! Retain data record pertaining to sonic quadruples only
-			IF(iTimeStamp > 3600 .OR. iTimeStamp < 0) CYCLE
-			iData = iData + 1
-			ivTime(iData) = iTimeStamp
-			IF(iU > -9990 .AND. iV > -9990 .AND. iW > -9990 .AND. iT > -9990) THEN
-				rvU(iData) = iU / 100.
-				rvV(iData) = iV / 100.
-				rvW(iData) = iW / 100.
-				rvT(iData) = iT / 100.
+		! Place data
+		ALLOCATE(ivTime(iNumData), rvU(iNumData), rvV(iNumData), rvW(iNumData), rvT(iNumData), iaQuad(iNumData,4), ivRecord(iNumData))
+		DO iRecord = 1, iNumRead
+			iSecond = iaRaw(1, iRecord)
+			IF(iSecond > 3600 .OR. iSecond < 0) CYCLE
+			iData = ivNext(iSecond)
+			ivNext(iSecond) = iData + 1
+			ivTime(iData)   = iSecond
+			ivRecord(iData) = iFirst + iRecord - 1
+			iaQuad(iData,:) = iaRaw(2:5, iRecord)
+			IF(ALL(iaRaw(2:5, iRecord) > -9990)) THEN
+				rvU(iData) = iaRaw(2, iRecord) / 100.
+				rvV(iData) = iaRaw(3, iRecord) / 100.
+				rvW(iData) = iaRaw(4, iRecord) / 100.
+				rvT(iData) = iaRaw(5, iRecord) / 100.
 			ELSE
 				rvU(iData) = -9999.9
 				rvV(iData) = -9999.9
 				rvW(iData) = -9999.9
 				rvT(iData) = -9999.9
 			END IF
-			
 		END DO
-		CLOSE(iLUN)
+		DEALLOCATE(iaRaw)
 		
 	END FUNCTION ReadInputFile
+	
+	
+	! Block checkpoint support. The sidecar file holds all block results computed
+	! so far for an hour, and the first raw record not yet consumed by them; read
+	! and write lists must be kept identical.
+	FUNCTION ReadCheckpoint(iLUN, sCheckpointFile, iNumBlocks, iNextRecord) RESULT(iRetCode)
+	
+		! Routine arguments
+		INTEGER, INTENT(IN)				:: iLUN
+		CHARACTER(LEN=*), INTENT(IN)	:: sCheckpointFile
+		INTEGER, INTENT(OUT)			:: iNumBlocks
+		INTEGER, INTENT(OUT)			:: iNextRecord
+		INTEGER							:: iRetCode
+		
+		! Locals
+		INTEGER				:: iErrCode
+		CHARACTER(LEN=8)	:: sMagic
+		INTEGER				:: iAvgTime
+		INTEGER				:: iBegin
+		INTEGER				:: n
+		
+		! Assume success (will falsify on failure)
+		iRetCode    = 0
+		iNumBlocks  = 0
+		iNextRecord = 0
+		
+		! Get header, and check it refers to the current run
+		OPEN(iLUN, FILE=sCheckpointFile, STATUS='OLD', ACTION='READ', ACCESS='STREAM', IOSTAT=iErrCode)
+		IF(iErrCode /= 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		READ(iLUN, IOSTAT=iErrCode) sMagic, iAvgTime, iBegin, n, iNextRecord
+		IF(iErrCode /= 0) THEN
+			iRetCode = 2
+			CLOSE(iLUN)
+			RETURN
+		END IF
+		IF(sMagic /= 'MFCKP001' .OR. iAvgTime /= iAveragingTime .OR. iBegin /= iHourBegin .OR. n < 1 .OR. n >= iMaxBlock) THEN
+			iRetCode = 3
+			CLOSE(iLUN)
+			RETURN
+		END IF
+		
+		! Get block results
+		READ(iLUN, IOSTAT=iErrCode) &
+			ivTimeStamp(1:n), ivFrequency(1:n), ivRegularityCode(1:n), ivTotData(1:n), ivUsedData(1:n), &
+			raMin(1:n,:), raMax(1:n,:), rvMinT(1:n), rvMaxT(1:n), &
+			raAvg(1:n,:), raRotAvg(1:n,:), rvAvgT(1:n), rvVarT(1:n), &
+			raCov(1:n,:,:), raRotCov(1:n,:,:), raCovT(1:n,:), raRotCovT(1:n,:), &
+			rvTheta(1:n), rvPhi(1:n), rvPsi(1:n), &
+			rvVectorVel(1:n), rvVectorDir(1:n), rv3DVel(1:n), rvScalarVel(1:n), rvScalarVelStd(1:n), &
+			rvUnitVectorDir(1:n), rvEstSigmaDir(1:n), rvPhiAngle(1:n), rvSigmaPhiAngle(1:n), &
+			rvUnitVel(1:n), rvDirCircVar(1:n), rvDirCircStd(1:n), iaDirClass(1:n,:), rvDominantDir(1:n), &
+			rvUstar(1:n), rvUstarBase(1:n), rvUstarExtended(1:n), rvTstar(1:n), rvH0(1:n), rvZl(1:n), rvTKE(1:n), &
+			rvSigmaU(1:n), rvSigmaV(1:n), rvSigmaW(1:n), rvSigmaT(1:n)
+		CLOSE(iLUN)
+		IF(iErrCode /= 0) THEN
+			iRetCode = 4
+			RETURN
+		END IF
+		iNumBlocks = n
+		
+	END FUNCTION ReadCheckpoint
+	
+	
+	FUNCTION WriteCheckpoint(iLUN, sCheckpointFile, iNumBlocks, iNextRecord) RESULT(iRetCode)
+	
+		! Routine arguments
+		INTEGER, INTENT(IN)				:: iLUN
+		CHARACTER(LEN=*), INTENT(IN)	:: sCheckpointFile
+		INTEGER, INTENT(IN)				:: iNumBlocks
+		INTEGER, INTENT(IN)				:: iNextRecord
+		INTEGER							:: iRetCode
+		
+		! Locals
+		INTEGER	:: iErrCode
+		INTEGER	:: n
+		
+		! Assume success (will falsify on failure)
+		iRetCode = 0
+		
+		! Write header and block results
+		n = iNumBlocks
+		OPEN(iLUN, FILE=sCheckpointFile, STATUS='REPLACE', ACTION='WRITE', ACCESS='STREAM', IOSTAT=iErrCode)
+		IF(iErrCode /= 0) THEN
+			iRetCode = 1
+			RETURN
+		END IF
+		WRITE(iLUN, IOSTAT=iErrCode) 'MFCKP001', iAveragingTime, iHourBegin, n, iNextRecord, &
+			ivTimeStamp(1:n), ivFrequency(1:n), ivRegularityCode(1:n), ivTotData(1:n), ivUsedData(1:n), &
+			raMin(1:n,:), raMax(1:n,:), rvMinT(1:n), rvMaxT(1:n), &
+			raAvg(1:n,:), raRotAvg(1:n,:), rvAvgT(1:n), rvVarT(1:n), &
+			raCov(1:n,:,:), raRotCov(1:n,:,:), raCovT(1:n,:), raRotCovT(1:n,:), &
+			rvTheta(1:n), rvPhi(1:n), rvPsi(1:n), &
+			rvVectorVel(1:n), rvVectorDir(1:n), rv3DVel(1:n), rvScalarVel(1:n), rvScalarVelStd(1:n), &
+			rvUnitVectorDir(1:n), rvEstSigmaDir(1:n), rvPhiAngle(1:n), rvSigmaPhiAngle(1:n), &
+			rvUnitVel(1:n), rvDirCircVar(1:n), rvDirCircStd(1:n), iaDirClass(1:n,:), rvDominantDir(1:n), &
+			rvUstar(1:n), rvUstarBase(1:n), rvUstarExtended(1:n), rvTstar(1:n), rvH0(1:n), rvZl(1:n), rvTKE(1:n), &
+			rvSigmaU(1:n), rvSigmaV(1:n), rvSigmaW(1:n), rvSigmaT(1:n)
+		IF(iErrCode /= 0) iRetCode = 2
+		CLOSE(iLUN)
+		
+	END FUNCTION WriteCheckpoint
 
 END PROGRAM eddy_cov
 
@@ -0,0 +1,109 @@
+#!/usr/bin/python
+
+# columnar.py - Reader of binary columnar result files (".HHP", ".HHD", ".HHO"),
+#               and exporter to the same CSV form as text result files.
+#
+# Usage:
+#
+#	./columnar.py <ColumnarFile> [<Column> ...]
+#
+# Without column names, all columns are exported.
+
+import sys
+import time
+import struct
+
+COL_MAGIC    = "MFCOL001"
+COL_NAME_LEN = 32
+COL_INTEGER  = 1
+COL_REAL     = 2
+
+
+# Read header, yielding column names and types, and the number of rows
+def readHeader(f):
+
+	f.seek(0)
+	header = f.read(16)
+	if len(header) < 16 or header[0:8].decode("ascii") != COL_MAGIC:
+		raise IOError("not a columnar file")
+	nCols, nRows = struct.unpack("=ii", header[8:16])
+	names = []
+	types = []
+	for i in range(nCols):
+		descriptor = f.read(COL_NAME_LEN + 4)
+		names.append(descriptor[0:COL_NAME_LEN].decode("ascii").rstrip())
+		types.append(struct.unpack("=i", descriptor[COL_NAME_LEN:])[0])
+	return (names, types, nRows)
+
+
+# Read the columns desired (all, if 'columns' is None), seeking directly
+# to each of them; result is a dictionary of lists, and the column order
+def readColumnar(fileName, columns=None):
+
+	f = open(fileName, "rb")
+	names, types, nRows = readHeader(f)
+	if columns is None:
+		columns = names
+	data = {}
+	for column in columns:
+		i = names.index(column)
+		f.seek(16 + (COL_NAME_LEN + 4)*len(names) + 4*nRows*i)
+		if types[i] == COL_INTEGER:
+			fmt = "=%di" % nRows
+		else:
+			fmt = "=%df" % nRows
+		data[column] = list(struct.unpack(fmt, f.read(4*nRows)))
+	f.close()
+	return (data, columns)
+
+
+# Write data to CSV, in the same form as text result files; time stamps
+# are converted to date-times
+def exportCsv(data, columns, out):
+
+	header = []
+	for column in columns:
+		if column == "Time.Stamp":
+			header.append("Date.Time")
+		else:
+			header.append(column)
+	out.write(",".join(header) + "\n")
+
+	if len(columns) <= 0:
+		return
+	for row in range(len(data[columns[0]])):
+		line = []
+		for column in columns:
+			value = data[column][row]
+			if column == "Time.Stamp":
+				line.append(time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(value)))
+			elif isinstance(value, float):
+				line.append("%9.3f" % value)
+			else:
+				line.append("%6d" % value)
+		out.write(",".join(line) + "\n")
+
+
+if __name__ == "__main__":
+
+	if len(sys.argv) < 2:
+		print("columnar.py - Export binary columnar result file to CSV")
+		print("")
+		print("Usage:")
+		print("")
+		print("  ./columnar.py <ColumnarFile> [<Column> ...]")
+		print("")
+		sys.exit(1)
+
+	columns = None
+	if len(sys.argv) > 2:
+		columns = sys.argv[2:]
+		if "Time.Stamp" not in columns:
+			columns.insert(0, "Time.Stamp")
+
+	try:
+		data, columns = readColumnar(sys.argv[1], columns)
+	except (IOError, ValueError) as e:
+		print("columnar.py:: error: %s" % str(e))
+		sys.exit(2)
+	exportCsv(data, columns, sys.stdout)
@@ -13,6 +13,13 @@ def clean(directory, year, month):
 	os.system(cmd)
 	print dataDir
 
+# Drop all monthly partitions of a time-indexed store older than the given month
+def dropStore(storeDir, year, month):
+	
+	cmd = "/home/standard/bin/ts_store drop %s %4.4d%2.2d > cmd.txt" % (storeDir, year, month)
+	os.system(cmd)
+	print storeDir
+
 if __name__ == "__main__":
 
 	# Get current time, extract current month and deduce which the *previous* month was
@@ -32,6 +39,7 @@ if __name__ == "__main__":
 	dl_processed  = main + "/dl_processed"
 	dl_diagnostic = main + "/dl_diagnostic"
 	dl_raw        = main + "/dl_raw"
+	moments       = main + "/moments"
 	
 	# Perform monthly cleanup
 	clean(processed, year, month)
@@ -40,4 +48,7 @@ if __name__ == "__main__":
 	clean(dl_processed, year, month)
 	clean(dl_diagnostic, year, month)
 	clean(dl_raw, year, month)
+	clean(moments, year, month)
+	dropStore(main + "/store/processed", now.tm_year, now.tm_mon)
+	dropStore(main + "/store/diagnostic", now.tm_year, now.tm_mon)
 
@@ -27,29 +27,92 @@ def enumerateFiles(dateFrom, dateTo, prefix, postfix):
 	return fileNames
 
 
-def packFile(fileNames, outFile):
+# Append the content of hourly files to outFile; the header line is
+# written only if outFile is new (or empty). Missing hours are reported;
+# when appending, packing stops at the first of them, so that the next
+# run starts from there again. Returns the number of files packed.
+def packFile(fileNames, outFile, append=False):
 
-	isFirst = True
+	isFirst = not (append and os.path.isfile(outFile) and os.path.getsize(outFile) > 0)
 
-	g = open(outFile, "w")
+	if append:
+		g = open(outFile, "a")
+	else:
+		g = open(outFile, "w")
 
+	numPacked = 0
 	for fileName in fileNames:
 
 		try:
 			f = open(fileName, "r")
-			data = f.readlines()
-			for lineNum in range(len(data)):
-				if isFirst:
-					if lineNum == 0:
-						g.write(data[lineNum])
-						isFirst = False
-				if lineNum > 0:
+		except IOError:
+			print "Missing: " + fileName
+			if append:
+				break
+			continue
+		data = f.readlines()
+		f.close()
+		for lineNum in range(len(data)):
+			if isFirst:
+				if lineNum == 0:
 					g.write(data[lineNum])
-				f.close()
-		except:
-			pass
+					isFirst = False
+			if lineNum > 0:
+				g.write(data[lineNum])
+		numPacked += 1
 	
 	g.close()
+	return numPacked
+
+
+# Locate the last hour packed so far: return its beginning, as date and
+# time, and the offset of its first line in the packed file; None if the
+# packed file does not exist or has no data. The file is read backwards,
+# by blocks, only as far as the beginning of that hour.
+def lastPackedHour(outFile):
+
+	try:
+		f = open(outFile, "r")
+	except IOError:
+		return None
+	f.seek(0, 2)
+	pos  = f.tell()
+	tail = ""
+	hour = None
+	while True:
+
+		# Get one more block, and the lines in it known to be whole
+		begin = max(0, pos - 65536)
+		f.seek(begin)
+		tail = f.read(pos - begin) + tail
+		pos  = begin
+		lines = tail.split("\n")
+		offset = pos
+		if pos > 0:
+			offset += len(lines[0]) + 1
+			lines = lines[1:]
+		offsets = []
+		for line in lines:
+			offsets.append(offset)
+			offset += len(line) + 1
+
+		# Walk back to the first line of the last hour
+		hour = None
+		for i in reversed(range(len(lines))):
+			isData = len(lines[i]) >= 19 and lines[i][0:2] in ("19", "20")
+			if hour is None:
+				if isData:
+					hour = lines[i][0:13]
+			elif not isData or lines[i][0:13] != hour:
+				f.close()
+				return (hour + ":00:00", offsets[i+1])
+		if pos <= 0:
+			break
+
+	f.close()
+	if hour is None:
+		return None
+	return (hour + ":00:00", 0)
 
 
 if __name__ == "__main__":
@@ -72,6 +135,28 @@ if __name__ == "__main__":
 	print yearStart
 	print monthStart
 	
-	# Enumerate files and compact them to unique file (test)
-	files = enumerateFiles(monthStart, currentDateTime, "/mnt/data/processed", "p")
-	packFile(files, "/mnt/ramdisk/Monthly.csv")
+	# Append to the monthly file only the hours from the last one already
+	# there, which is packed again as it may have been incomplete: so each
+	# run costs one or two hours, not the whole month to date. On month
+	# change (or if the file is missing) restart from month begin, and do
+	# the same if hours are missing before others already processed.
+	monthlyFile = "/mnt/ramdisk/Monthly.csv"
+	lastHourPacked = lastPackedHour(monthlyFile)
+	rebuild = lastHourPacked is None or lastHourPacked[0][0:7] != currentDateTime[0:7]
+	if not rebuild:
+		g = open(monthlyFile, "r+")
+		g.truncate(lastHourPacked[1])
+		g.close()
+		files = enumerateFiles(lastHourPacked[0], currentDateTime, "/mnt/data/processed", "p")
+		numPacked = packFile(files, monthlyFile, True)
+		for fileName in files[numPacked+1:]:
+			if os.path.isfile(fileName):
+				rebuild = True
+				break
+	if rebuild:
+		files = enumerateFiles(monthStart, currentDateTime, "/mnt/data/processed", "p")
+		packFile(files, monthlyFile)
+	
+	# Month-to-date and year-to-date aggregates, maintained by 'rollup'
+	os.system("/home/standard/bin/rollup show /mnt/data/rollup %s%s > /mnt/ramdisk/MonthToDate.csv" % (year, month))
+	os.system("/home/standard/bin/rollup show /mnt/data/rollup %s > /mnt/ramdisk/YearToDate.csv" % year)